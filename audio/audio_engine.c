@@ -0,0 +1,377 @@
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+#include <libavutil/channel_layout.h>
+#include <string.h>
+#include "audio_engine.h"
+#include "../video_debugging.h"
+
+//PCM 环形缓冲默认能放多少个音频回调周期
+#define AUDIO_RING_PERIODS 8
+//至少放两个周期，回调一次总能取到一整个周期
+#define AUDIO_RING_MIN_PERIODS 2
+//环形缓冲满的时候，解码线程每次等待的时间
+#define AUDIO_RING_WAIT_MS 2
+
+static void queue_init(AudioPacketQueue *q)
+{
+    memset(q, 0, sizeof(AudioPacketQueue));
+    q->mutex = SDL_CreateMutex();
+    q->cond = SDL_CreateCond();
+}
+
+static int queue_put_node(AudioPacketQueue *q, AudioPacketNode *node)
+{
+    SDL_LockMutex(q->mutex);
+    if (!q->last_pkt)
+    {
+        q->first_pkt = node;
+    }
+    else
+    {
+        q->last_pkt->next = node;
+    }
+    q->last_pkt = node;
+    q->nb_packets++;
+    q->size += node->pkt.size;
+    SDL_CondSignal(q->cond);
+    SDL_UnlockMutex(q->mutex);
+    return 0;
+}
+
+static void queue_flush(AudioPacketQueue *q)
+{
+    AudioPacketNode *node, *next;
+    SDL_LockMutex(q->mutex);
+    for (node = q->first_pkt; node; node = next)
+    {
+        next = node->next;
+        av_packet_unref(&node->pkt);
+        av_free(node);
+    }
+    q->first_pkt = NULL;
+    q->last_pkt = NULL;
+    q->nb_packets = 0;
+    q->size = 0;
+    SDL_UnlockMutex(q->mutex);
+}
+
+//阻塞等待下一个包，引擎停止时返回 NULL
+static AudioPacketNode *queue_get(AudioEngine *ae)
+{
+    AudioPacketQueue *q = &ae->queue;
+    AudioPacketNode *node = NULL;
+    SDL_LockMutex(q->mutex);
+    while (!ae->quit)
+    {
+        node = q->first_pkt;
+        if (node)
+        {
+            q->first_pkt = node->next;
+            if (!q->first_pkt)
+            {
+                q->last_pkt = NULL;
+            }
+            q->nb_packets--;
+            q->size -= node->pkt.size;
+            break;
+        }
+        SDL_CondWait(q->cond, q->mutex);
+    }
+    //取出之后才看到 quit：这个包已经不在队列里，queue_flush 释放不到，在这里释放
+    if (node && ae->quit)
+    {
+        av_packet_unref(&node->pkt);
+        av_free(node);
+        node = NULL;
+    }
+    SDL_UnlockMutex(q->mutex);
+    return node;
+}
+
+static void queue_destroy(AudioPacketQueue *q)
+{
+    if (!q->mutex)
+    {
+        return;
+    }
+    queue_flush(q);
+    SDL_DestroyCond(q->cond);
+    SDL_DestroyMutex(q->mutex);
+    q->cond = NULL;
+    q->mutex = NULL;
+}
+
+int audio_engine_init(AudioEngine *ae, AVCodecContext *codec_ctx)
+{
+    memset(ae, 0, sizeof(AudioEngine));
+    ae->codec_ctx = codec_ctx;
+    queue_init(&ae->queue);
+    ae->frame = av_frame_alloc();
+    if (!ae->frame)
+    {
+        return AVERROR(ENOMEM);
+    }
+    //没有在录 trace 时是 NULL
+    ae->trace_thread = trace_thread_reserve("audio_callback", AUDIO_TRACE_EVENTS);
+    return 0;
+}
+
+int audio_engine_configure(AudioEngine *ae, int sample_rate, enum AVSampleFormat sample_fmt, int channels,
+                           int period_samples, int buffer_samples)
+{
+    AVCodecContext *codec_ctx = ae->codec_ctx;
+    ae->out_channels = channels;
+    ae->out_sample_rate = sample_rate;
+    ae->out_sample_fmt = sample_fmt;
+    ae->out_frame_bytes = av_get_bytes_per_sample(sample_fmt) * channels;
+    ae->out_silence = sample_fmt == AV_SAMPLE_FMT_U8 ? 0x80 : 0;
+
+    //HLS 的 TS 流里 channel_layout 可能是 0，swr_init 会失败
+    int64_t in_layout = codec_ctx->channel_layout ? codec_ctx->channel_layout : av_get_default_channel_layout(codec_ctx->channels);
+    //SDL 的声道顺序和 FFmpeg 默认布局一致（5.1 是 FL FR FC LFE SL SR）
+    int64_t out_layout = av_get_default_channel_layout(channels);
+    //声道数、采样率、采样格式一次转换到设备格式，SDL 不再转换
+    ae->swr_ctx = swr_alloc_set_opts(ae->swr_ctx,
+                                     out_layout, sample_fmt, sample_rate,
+                                     in_layout, codec_ctx->sample_fmt, codec_ctx->sample_rate,
+                                     0, NULL);
+    if (!ae->swr_ctx)
+    {
+        av_log(NULL, AV_LOG_ERROR, "audio_engine swr_alloc_set_opts NULL.\n");
+        return -1;
+    }
+    int ret = swr_init(ae->swr_ctx);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "audio_engine swr_init ret = %d.\n", ret);
+        return ret;
+    }
+    av_log(NULL, AV_LOG_INFO, "audio_engine %s %dHz %dch -> %s %dHz %dch.\n",
+           av_get_sample_fmt_name(codec_ctx->sample_fmt), codec_ctx->sample_rate, codec_ctx->channels,
+           av_get_sample_fmt_name(sample_fmt), sample_rate, channels);
+
+    if (buffer_samples <= 0)
+    {
+        buffer_samples = period_samples * AUDIO_RING_PERIODS;
+    }
+    if (buffer_samples < period_samples * AUDIO_RING_MIN_PERIODS)
+    {
+        buffer_samples = period_samples * AUDIO_RING_MIN_PERIODS;
+    }
+    pcm_ring_free(&ae->ring);
+    if (pcm_ring_init(&ae->ring, buffer_samples * ae->out_frame_bytes) < 0)
+    {
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+//重采样一帧到 audio_buf，返回字节数
+static int convert_frame(AudioEngine *ae, AVFrame *frame)
+{
+    int out_samples = swr_get_out_samples(ae->swr_ctx, frame->nb_samples);
+    av_fast_malloc(&ae->audio_buf, &ae->audio_buf_size, out_samples * ae->out_frame_bytes);
+    if (!ae->audio_buf)
+    {
+        return AVERROR(ENOMEM);
+    }
+    int samples = swr_convert(ae->swr_ctx, &ae->audio_buf, out_samples, (const uint8_t **)frame->extended_data, frame->nb_samples);
+    if (samples < 0)
+    {
+        return samples;
+    }
+    return samples * ae->out_frame_bytes;
+}
+
+static void write_ring(AudioEngine *ae, const uint8_t *data, int size)
+{
+    int written = 0;
+    while (written < size && !ae->quit)
+    {
+        int n = pcm_ring_write(&ae->ring, data + written, size - written);
+        written += n;
+        if (n == 0)
+        {
+            //缓冲满了，等音频回调取走一些
+            SDL_Delay(AUDIO_RING_WAIT_MS);
+        }
+    }
+}
+
+//音频解码线程：取包、解码、重采样都在这里，结果写进环形缓冲
+static int audio_decode_thread(void *arg)
+{
+    AudioEngine *ae = (AudioEngine *)arg;
+    AudioPacketNode *node;
+    trace_thread_name("audio_decode");
+    while ((node = queue_get(ae)) != NULL)
+    {
+        if (node->flush)
+        {
+            //seek 之后清空解码器里残留的数据，已经解码还没播放的也不要了
+            avcodec_flush_buffers(ae->codec_ctx);
+            pcm_ring_discard(&ae->ring);
+            ae->stats.flushes++;
+            av_free(node);
+            continue;
+        }
+        int stream_index = node->pkt.stream_index;
+        TRACE_BEGIN(send_start);
+        int ret = avcodec_send_packet(ae->codec_ctx, &node->pkt);
+        TRACE_END(send_start, "avcodec_send_packet", stream_index, ae->stats.packets_decoded);
+        av_packet_unref(&node->pkt);
+        av_free(node);
+        if (ret < 0)
+        {
+            ae->stats.decode_errors++;
+            continue;
+        }
+        ae->stats.packets_decoded++;
+        while (!ae->quit)
+        {
+            TRACE_BEGIN(receive_start);
+            ret = avcodec_receive_frame(ae->codec_ctx, ae->frame);
+            TRACE_END(receive_start, "avcodec_receive_frame", stream_index, ae->stats.frames_decoded);
+            if (ret != 0)
+            {
+                break;
+            }
+            ae->stats.frames_decoded++;
+            int size = convert_frame(ae, ae->frame);
+            av_frame_unref(ae->frame);
+            if (size < 0)
+            {
+                ae->stats.decode_errors++;
+                continue;
+            }
+            write_ring(ae, ae->audio_buf, size);
+        }
+    }
+    av_log(NULL, AV_LOG_INFO, "audio_decode_thread exit.\n");
+    return 0;
+}
+
+int audio_engine_start(AudioEngine *ae)
+{
+    ae->thread = SDL_CreateThread(audio_decode_thread, "audio_decode", ae);
+    if (!ae->thread)
+    {
+        av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread audio_decode error = %s.\n", SDL_GetError());
+        return -1;
+    }
+    return 0;
+}
+
+int audio_engine_put_packet(AudioEngine *ae, AVPacket *pkt)
+{
+    AudioPacketNode *node = av_mallocz(sizeof(AudioPacketNode));
+    if (!node)
+    {
+        av_packet_unref(pkt);
+        return AVERROR(ENOMEM);
+    }
+    av_packet_move_ref(&node->pkt, pkt);
+    return queue_put_node(&ae->queue, node);
+}
+
+void audio_engine_flush(AudioEngine *ae)
+{
+    queue_flush(&ae->queue);
+    AudioPacketNode *node = av_mallocz(sizeof(AudioPacketNode));
+    if (!node)
+    {
+        return;
+    }
+    av_init_packet(&node->pkt);
+    node->flush = 1;
+    queue_put_node(&ae->queue, node);
+}
+
+int audio_engine_queued_packets(AudioEngine *ae)
+{
+    return ae->queue.nb_packets;
+}
+
+int audio_engine_buffered_bytes(AudioEngine *ae)
+{
+    return ae->ring.buf ? pcm_ring_available(&ae->ring) : 0;
+}
+
+int audio_engine_read(AudioEngine *ae, uint8_t *stream, int len)
+{
+    int n = pcm_ring_read(&ae->ring, stream, len);
+    if (n < len)
+    {
+        //解码跟不上，不够的部分输出静音
+        memset(stream + n, ae->out_silence, len - n);
+    }
+    return n;
+}
+
+//SDL 的实时音频线程，只从环形缓冲拷贝数据，不解码、不等锁、不打日志
+void audio_engine_callback(void *userdata, Uint8 *stream, int len)
+{
+    AudioEngine *ae = (AudioEngine *)userdata;
+    //trace 关闭时 span_start 是 0，只多一次判断；统计用的时间单独取
+    TRACE_BEGIN(span_start);
+    int64_t start = av_gettime_relative();
+    int n = audio_engine_read(ae, stream, len);
+    int64_t us = av_gettime_relative() - start;
+    int64_t period_us = (int64_t)len * 1000000 / (ae->out_sample_rate * ae->out_frame_bytes);
+
+    int64_t callbacks = atomic_fetch_add_explicit(&ae->stats.callbacks, 1, memory_order_relaxed);
+    TRACE_END_RT(ae->trace_thread, span_start, "audio_callback", -1, callbacks);
+    if (n < len || us > period_us)
+    {
+        atomic_fetch_add_explicit(&ae->stats.underruns, 1, memory_order_relaxed);
+    }
+    if (us > ae->stats.callback_max_us)
+    {
+        ae->stats.callback_max_us = us;
+    }
+}
+
+void audio_engine_stop(AudioEngine *ae)
+{
+    ae->quit = 1;
+    if (ae->queue.mutex)
+    {
+        //持锁通知，避免解码线程检查完 quit 之后才开始等待
+        SDL_LockMutex(ae->queue.mutex);
+        SDL_CondSignal(ae->queue.cond);
+        SDL_UnlockMutex(ae->queue.mutex);
+    }
+    if (ae->thread)
+    {
+        SDL_WaitThread(ae->thread, NULL);
+        ae->thread = NULL;
+    }
+}
+
+void audio_engine_log_stats(AudioEngine *ae, const char *name)
+{
+    AudioEngineStats *s = &ae->stats;
+    av_log(NULL, AV_LOG_INFO, "audio_engine %s: packets = %lld, frames = %lld, errors = %lld, flushes = %lld, "
+                              "callbacks = %lld, underruns = %lld, callback_max = %lldus.\n",
+           name ? name : "",
+           (long long)s->packets_decoded, (long long)s->frames_decoded, (long long)s->decode_errors, (long long)s->flushes,
+           (long long)s->callbacks, (long long)s->underruns, (long long)s->callback_max_us);
+}
+
+//调用前先关闭音频设备，保证回调不会再访问引擎
+void audio_engine_destroy(AudioEngine *ae)
+{
+    audio_engine_stop(ae);
+    queue_destroy(&ae->queue);
+    pcm_ring_free(&ae->ring);
+    if (ae->frame)
+    {
+        av_frame_free(&ae->frame);
+    }
+    if (ae->swr_ctx)
+    {
+        swr_free(&ae->swr_ctx);
+    }
+    av_freep(&ae->audio_buf);
+    ae->audio_buf_size = 0;
+}
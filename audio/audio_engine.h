@@ -0,0 +1,97 @@
+#ifndef AUDIO_ENGINE_H
+#define AUDIO_ENGINE_H
+
+#include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
+#include <SDL2/SDL.h>
+#include <stdatomic.h>
+#include "pcm_ring.h"
+
+//一个播放会话的音频通路：包队列 -> 解码线程 -> 重采样 -> PCM 环形缓冲 -> 音频回调
+//所有状态都在 AudioEngine 里，一个进程可以同时跑多个会话
+
+//音频回调预留的 trace 事件数，1024 个采样的周期下大约 20 分钟
+#define AUDIO_TRACE_EVENTS (64 * 1024)
+
+typedef struct AudioPacketNode
+{
+    AVPacket pkt;
+    //seek 之后放进队列的标记，解码线程收到后清空解码器和环形缓冲
+    int flush;
+    struct AudioPacketNode *next;
+} AudioPacketNode;
+
+typedef struct AudioPacketQueue
+{
+    AudioPacketNode *first_pkt, *last_pkt;
+    int nb_packets;
+    int size;
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+} AudioPacketQueue;
+
+typedef struct AudioEngineStats
+{
+    int64_t packets_decoded;
+    int64_t frames_decoded;
+    int64_t decode_errors;
+    int64_t flushes;
+    //以下只在音频回调线程上更新；callbacks 和 underruns 播放时主线程也会读，用原子变量
+    _Atomic int64_t callbacks;
+    //回调输出了静音，或者耗时超过一个周期
+    _Atomic int64_t underruns;
+    int64_t callback_max_us;
+} AudioEngineStats;
+
+typedef struct AudioEngine
+{
+    //解码器由调用者打开和释放
+    AVCodecContext *codec_ctx;
+    SwrContext *swr_ctx;
+    //输出格式，和音频设备实际打开的格式一致，只重采样一次
+    int out_channels;
+    int out_sample_rate;
+    enum AVSampleFormat out_sample_fmt;
+    int out_frame_bytes;
+    //静音的字节值，U8 是 0x80
+    uint8_t out_silence;
+
+    AudioPacketQueue queue;
+    PcmRing ring;
+    AVFrame *frame;
+    uint8_t *audio_buf;
+    unsigned int audio_buf_size;
+
+    SDL_Thread *thread;
+    volatile int quit;
+    AudioEngineStats stats;
+    //回调线程的 trace 缓冲，在 init 里预先分配，回调里不分配内存
+    struct TraceThread *trace_thread;
+} AudioEngine;
+
+//codec_ctx 要先打开，返回 0 成功
+int audio_engine_init(AudioEngine *ae, AVCodecContext *codec_ctx);
+//按设备的格式设置重采样和环形缓冲，在 audio_engine_start 之前调用
+//sample_fmt 必须是交错格式；period_samples 是设备一次回调的采样数
+//buffer_samples 是环形缓冲最多缓冲的采样数，<= 0 时取 8 个周期，最少 2 个周期
+int audio_engine_configure(AudioEngine *ae, int sample_rate, enum AVSampleFormat sample_fmt, int channels,
+                           int period_samples, int buffer_samples);
+//启动解码线程
+int audio_engine_start(AudioEngine *ae);
+//包的引用转移给引擎，pkt 会被重置
+int audio_engine_put_packet(AudioEngine *ae, AVPacket *pkt);
+//丢掉队列里的包和已经解码还没播放的数据，seek 时调用
+void audio_engine_flush(AudioEngine *ae);
+int audio_engine_queued_packets(AudioEngine *ae);
+//环形缓冲里已经解码、还没播放的字节数
+int audio_engine_buffered_bytes(AudioEngine *ae);
+//从环形缓冲取 len 字节，不够的部分填静音，返回实际取到的字节数
+int audio_engine_read(AudioEngine *ae, uint8_t *stream, int len);
+//SDL 音频回调，userdata 是 AudioEngine
+void audio_engine_callback(void *userdata, Uint8 *stream, int len);
+//停止解码线程，可以重复调用
+void audio_engine_stop(AudioEngine *ae);
+void audio_engine_log_stats(AudioEngine *ae, const char *name);
+void audio_engine_destroy(AudioEngine *ae);
+
+#endif
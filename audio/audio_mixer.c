@@ -0,0 +1,350 @@
+#include <libavutil/log.h>
+#include <libavutil/cpu.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <math.h>
+#include <string.h>
+#include "audio_mixer.h"
+#include "../video_debugging.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+//标量实现，也是 SIMD 实现的参考结果：先算浮点，再按当前舍入模式（就近取偶）转整数
+static void mix_s16_scalar(int16_t *dst, const int16_t *src, int n, float gain)
+{
+    for (int i = 0; i < n; i++)
+    {
+        float v = dst[i] + src[i] * gain;
+        v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+        dst[i] = (int16_t)lrintf(v);
+    }
+}
+
+static void mix_flt_scalar(float *dst, const float *src, int n, float gain)
+{
+    for (int i = 0; i < n; i++)
+    {
+        dst[i] = dst[i] + src[i] * gain;
+    }
+}
+
+static void clip_flt_scalar(float *dst, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        dst[i] = dst[i] > 1.0f ? 1.0f : (dst[i] < -1.0f ? -1.0f : dst[i]);
+    }
+}
+
+#if HAVE_X86_SIMD
+//乘加分开算，不用 FMA，结果和标量实现一致
+__attribute__((target("sse2"))) static void mix_s16_sse2(int16_t *dst, const int16_t *src, int n, float gain)
+{
+    __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        //16 位符号扩展到 32 位
+        __m128i d_lo = _mm_srai_epi32(_mm_unpacklo_epi16(d, d), 16);
+        __m128i d_hi = _mm_srai_epi32(_mm_unpackhi_epi16(d, d), 16);
+        __m128i s_lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i s_hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        __m128 v_lo = _mm_add_ps(_mm_cvtepi32_ps(d_lo), _mm_mul_ps(_mm_cvtepi32_ps(s_lo), g));
+        __m128 v_hi = _mm_add_ps(_mm_cvtepi32_ps(d_hi), _mm_mul_ps(_mm_cvtepi32_ps(s_hi), g));
+        //packs 饱和到 int16
+        __m128i r = _mm_packs_epi32(_mm_cvtps_epi32(v_lo), _mm_cvtps_epi32(v_hi));
+        _mm_storeu_si128((__m128i *)(dst + i), r);
+    }
+    mix_s16_scalar(dst + i, src + i, n - i, gain);
+}
+
+__attribute__((target("sse2"))) static void mix_flt_sse2(float *dst, const float *src, int n, float gain)
+{
+    __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128 d0 = _mm_loadu_ps(dst + i);
+        __m128 d1 = _mm_loadu_ps(dst + i + 4);
+        d0 = _mm_add_ps(d0, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+        d1 = _mm_add_ps(d1, _mm_mul_ps(_mm_loadu_ps(src + i + 4), g));
+        _mm_storeu_ps(dst + i, d0);
+        _mm_storeu_ps(dst + i + 4, d1);
+    }
+    mix_flt_scalar(dst + i, src + i, n - i, gain);
+}
+
+__attribute__((target("sse2"))) static void clip_flt_sse2(float *dst, int n)
+{
+    __m128 hi = _mm_set1_ps(1.0f);
+    __m128 lo = _mm_set1_ps(-1.0f);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(dst + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(dst + i), lo), hi));
+    }
+    clip_flt_scalar(dst + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void mix_s16_avx2(int16_t *dst, const int16_t *src, int n, float gain)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i d0 = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i d1 = _mm_loadu_si128((const __m128i *)(dst + i + 8));
+        __m128i s0 = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i s1 = _mm_loadu_si128((const __m128i *)(src + i + 8));
+        __m256 v0 = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(d0)),
+                                  _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s0)), g));
+        __m256 v1 = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(d1)),
+                                  _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s1)), g));
+        //packs 在每个 128 位通道内交错，再把 64 位块排回顺序
+        __m256i r = _mm256_packs_epi32(_mm256_cvtps_epi32(v0), _mm256_cvtps_epi32(v1));
+        r = _mm256_permute4x64_epi64(r, 0xD8);
+        _mm256_storeu_si256((__m256i *)(dst + i), r);
+    }
+    mix_s16_sse2(dst + i, src + i, n - i, gain);
+}
+
+__attribute__((target("avx2"))) static void mix_flt_avx2(float *dst, const float *src, int n, float gain)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256 d0 = _mm256_loadu_ps(dst + i);
+        __m256 d1 = _mm256_loadu_ps(dst + i + 8);
+        d0 = _mm256_add_ps(d0, _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+        d1 = _mm256_add_ps(d1, _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), g));
+        _mm256_storeu_ps(dst + i, d0);
+        _mm256_storeu_ps(dst + i + 8, d1);
+    }
+    mix_flt_sse2(dst + i, src + i, n - i, gain);
+}
+
+__attribute__((target("avx2"))) static void clip_flt_avx2(float *dst, int n)
+{
+    __m256 hi = _mm256_set1_ps(1.0f);
+    __m256 lo = _mm256_set1_ps(-1.0f);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(dst + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(dst + i), lo), hi));
+    }
+    clip_flt_sse2(dst + i, n - i);
+}
+#endif
+
+enum AudioMixImpl audio_mix_impl_from_name(const char *name)
+{
+    if (!strcmp(name, "scalar"))
+    {
+        return AUDIO_MIX_SCALAR;
+    }
+    if (!strcmp(name, "sse2"))
+    {
+        return AUDIO_MIX_SSE2;
+    }
+    if (!strcmp(name, "avx2"))
+    {
+        return AUDIO_MIX_AVX2;
+    }
+    return AUDIO_MIX_AUTO;
+}
+
+int audio_mix_get_kernels(enum AudioMixImpl impl, AudioMixKernels *kernels)
+{
+    int flags = av_get_cpu_flags();
+    if (impl == AUDIO_MIX_AUTO)
+    {
+        if (HAVE_X86_SIMD && (flags & AV_CPU_FLAG_AVX2))
+        {
+            impl = AUDIO_MIX_AVX2;
+        }
+        else if (HAVE_X86_SIMD && (flags & AV_CPU_FLAG_SSE2))
+        {
+            impl = AUDIO_MIX_SSE2;
+        }
+        else
+        {
+            impl = AUDIO_MIX_SCALAR;
+        }
+    }
+    switch (impl)
+    {
+    case AUDIO_MIX_SCALAR:
+        *kernels = (AudioMixKernels){"scalar", mix_s16_scalar, mix_flt_scalar, clip_flt_scalar};
+        return 0;
+#if HAVE_X86_SIMD
+    case AUDIO_MIX_SSE2:
+        if (!(flags & AV_CPU_FLAG_SSE2))
+        {
+            return -1;
+        }
+        *kernels = (AudioMixKernels){"sse2", mix_s16_sse2, mix_flt_sse2, clip_flt_sse2};
+        return 0;
+    case AUDIO_MIX_AVX2:
+        if (!(flags & AV_CPU_FLAG_AVX2))
+        {
+            return -1;
+        }
+        *kernels = (AudioMixKernels){"avx2", mix_s16_avx2, mix_flt_avx2, clip_flt_avx2};
+        return 0;
+#endif
+    default:
+        return -1;
+    }
+}
+
+int audio_mixer_init(AudioMixer *mixer, enum AudioMixImpl impl)
+{
+    memset(mixer, 0, sizeof(AudioMixer));
+    if (audio_mix_get_kernels(impl, &mixer->kernels) < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "audio_mixer impl %d not supported on this cpu.\n", impl);
+        return -1;
+    }
+    av_log(NULL, AV_LOG_INFO, "audio_mixer use %s kernels.\n", mixer->kernels.name);
+    mixer->trace_thread = trace_thread_reserve("audio_mixer_callback", AUDIO_TRACE_EVENTS);
+    return 0;
+}
+
+int audio_mixer_add_track(AudioMixer *mixer, AudioEngine *engine, float gain)
+{
+    if (mixer->nb_tracks >= AUDIO_MIXER_MAX_TRACKS)
+    {
+        return -1;
+    }
+    mixer->tracks[mixer->nb_tracks].engine = engine;
+    mixer->tracks[mixer->nb_tracks].gain = gain;
+    return mixer->nb_tracks++;
+}
+
+void audio_mixer_set_gain(AudioMixer *mixer, int track, float gain)
+{
+    if (track >= 0 && track < mixer->nb_tracks)
+    {
+        mixer->tracks[track].gain = gain;
+    }
+}
+
+int audio_mixer_prepare(AudioMixer *mixer, int max_bytes)
+{
+    for (int i = 0; i < mixer->nb_tracks; i++)
+    {
+        enum AVSampleFormat fmt = mixer->tracks[i].engine->out_sample_fmt;
+        if (fmt != AV_SAMPLE_FMT_S16 && fmt != AV_SAMPLE_FMT_FLT)
+        {
+            av_log(NULL, AV_LOG_ERROR, "audio_mixer can't mix %s.\n", av_get_sample_fmt_name(fmt));
+            return -1;
+        }
+    }
+    av_freep(&mixer->scratch);
+    mixer->scratch = av_malloc(max_bytes);
+    if (!mixer->scratch)
+    {
+        return AVERROR(ENOMEM);
+    }
+    mixer->scratch_size = max_bytes;
+    return 0;
+}
+
+int audio_mixer_read(AudioMixer *mixer, uint8_t *stream, int len)
+{
+    if (mixer->nb_tracks < 1)
+    {
+        memset(stream, 0, len);
+        return 0;
+    }
+    AudioEngine *first = mixer->tracks[0].engine;
+    int is_float = first->out_sample_fmt == AV_SAMPLE_FMT_FLT;
+    int sample_bytes = is_float ? sizeof(float) : sizeof(int16_t);
+    //按整帧分块，scratch 放不下一次回调的数据时分几次混
+    int chunk_max = mixer->scratch_size - mixer->scratch_size % first->out_frame_bytes;
+    int got_min = len;
+
+    memset(stream, 0, len);
+    for (int offset = 0; offset < len; offset += chunk_max)
+    {
+        int chunk = len - offset < chunk_max ? len - offset : chunk_max;
+        int n = chunk / sample_bytes;
+        for (int i = 0; i < mixer->nb_tracks; i++)
+        {
+            int got = audio_engine_read(mixer->tracks[i].engine, mixer->scratch, chunk);
+            if (got < chunk && offset + got < got_min)
+            {
+                got_min = offset + got;
+            }
+            if (is_float)
+            {
+                mixer->kernels.mix_flt((float *)(stream + offset), (const float *)mixer->scratch, n, mixer->tracks[i].gain);
+            }
+            else
+            {
+                mixer->kernels.mix_s16((int16_t *)(stream + offset), (const int16_t *)mixer->scratch, n, mixer->tracks[i].gain);
+            }
+        }
+        if (is_float)
+        {
+            mixer->kernels.clip_flt((float *)(stream + offset), n);
+        }
+    }
+    return got_min;
+}
+
+int audio_mixer_buffered_bytes(AudioMixer *mixer)
+{
+    int buffered = 0;
+    for (int i = 0; i < mixer->nb_tracks; i++)
+    {
+        int n = audio_engine_buffered_bytes(mixer->tracks[i].engine);
+        if (i == 0 || n < buffered)
+        {
+            buffered = n;
+        }
+    }
+    return buffered;
+}
+
+void audio_mixer_callback(void *userdata, Uint8 *stream, int len)
+{
+    AudioMixer *mixer = (AudioMixer *)userdata;
+    TRACE_BEGIN(span_start);
+    int64_t start = av_gettime_relative();
+    int got = audio_mixer_read(mixer, stream, len);
+    int64_t us = av_gettime_relative() - start;
+    int64_t callbacks = atomic_fetch_add_explicit(&mixer->stats.callbacks, 1, memory_order_relaxed);
+    TRACE_END_RT(mixer->trace_thread, span_start, "audio_mixer_callback", -1, callbacks);
+    mixer->stats.mix_us += us;
+    if (got < len)
+    {
+        atomic_fetch_add_explicit(&mixer->stats.underruns, 1, memory_order_relaxed);
+    }
+    if (us > mixer->stats.mix_max_us)
+    {
+        mixer->stats.mix_max_us = us;
+    }
+}
+
+void audio_mixer_log_stats(AudioMixer *mixer)
+{
+    AudioMixerStats *s = &mixer->stats;
+    av_log(NULL, AV_LOG_INFO, "audio_mixer %s: tracks = %d, callbacks = %lld, underruns = %lld, mix avg = %.1fus, max = %lldus.\n",
+           mixer->kernels.name, mixer->nb_tracks, (long long)s->callbacks, (long long)s->underruns,
+           s->callbacks ? (double)s->mix_us / s->callbacks : 0, (long long)s->mix_max_us);
+}
+
+void audio_mixer_free(AudioMixer *mixer)
+{
+    av_freep(&mixer->scratch);
+    mixer->scratch_size = 0;
+}
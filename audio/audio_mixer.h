@@ -0,0 +1,85 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include "audio_engine.h"
+
+//多路音频混音：每一路是一个 AudioEngine，按各自的增益叠加到一路输出
+//支持交错的 S16 和 FLT，S16 每叠加一路就饱和，FLT 全部叠加完再限幅到 [-1, 1]
+
+#define AUDIO_MIXER_MAX_TRACKS 16
+
+enum AudioMixImpl
+{
+    //按 CPU 选择最快的实现
+    AUDIO_MIX_AUTO,
+    AUDIO_MIX_SCALAR,
+    AUDIO_MIX_SSE2,
+    AUDIO_MIX_AVX2,
+};
+
+//dst = dst + src * gain，n 是采样数（声道数 * 帧数）
+typedef void (*AudioMixS16Func)(int16_t *dst, const int16_t *src, int n, float gain);
+typedef void (*AudioMixFltFunc)(float *dst, const float *src, int n, float gain);
+typedef void (*AudioClipFltFunc)(float *dst, int n);
+
+typedef struct AudioMixKernels
+{
+    const char *name;
+    AudioMixS16Func mix_s16;
+    AudioMixFltFunc mix_flt;
+    AudioClipFltFunc clip_flt;
+} AudioMixKernels;
+
+//auto|scalar|sse2|avx2，不认识的名字返回 AUDIO_MIX_AUTO
+enum AudioMixImpl audio_mix_impl_from_name(const char *name);
+//取指定实现的函数，CPU 不支持时返回 -1
+int audio_mix_get_kernels(enum AudioMixImpl impl, AudioMixKernels *kernels);
+
+typedef struct AudioMixerTrack
+{
+    AudioEngine *engine;
+    //音频回调线程读，其他线程可以随时修改
+    volatile float gain;
+} AudioMixerTrack;
+
+typedef struct AudioMixerStats
+{
+    //callbacks 和 underruns 播放时主线程也会读，用原子变量
+    _Atomic int64_t callbacks;
+    //任意一路数据不够
+    _Atomic int64_t underruns;
+    int64_t mix_us;
+    int64_t mix_max_us;
+} AudioMixerStats;
+
+typedef struct AudioMixer
+{
+    AudioMixerTrack tracks[AUDIO_MIXER_MAX_TRACKS];
+    int nb_tracks;
+    AudioMixKernels kernels;
+    //每一路先读到这里，再叠加到输出
+    uint8_t *scratch;
+    int scratch_size;
+    AudioMixerStats stats;
+    //回调线程的 trace 缓冲，在 init 里预先分配
+    struct TraceThread *trace_thread;
+} AudioMixer;
+
+int audio_mixer_init(AudioMixer *mixer, enum AudioMixImpl impl);
+//返回这一路的序号，满了返回 -1
+int audio_mixer_add_track(AudioMixer *mixer, AudioEngine *engine, float gain);
+void audio_mixer_set_gain(AudioMixer *mixer, int track, float gain);
+//所有引擎配置好输出格式之后调用，max_bytes 是一次最多读多少字节
+int audio_mixer_prepare(AudioMixer *mixer, int max_bytes);
+//和 audio_engine_read 一样，返回各路中最少取到的字节数，不够的部分是静音
+int audio_mixer_read(AudioMixer *mixer, uint8_t *stream, int len);
+//各路中最少缓冲的字节数
+int audio_mixer_buffered_bytes(AudioMixer *mixer);
+//SDL 音频回调，userdata 是 AudioMixer
+void audio_mixer_callback(void *userdata, Uint8 *stream, int len);
+void audio_mixer_log_stats(AudioMixer *mixer);
+void audio_mixer_free(AudioMixer *mixer);
+
+#endif
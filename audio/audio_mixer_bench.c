@@ -0,0 +1,182 @@
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audio_mixer.h"
+
+//混音内核的 benchmark：同样的输入分别用 scalar / sse2 / avx2 混音，比较耗时，并检查结果和 scalar 完全一致
+//./audio_mixer_bench [-tracks n] [-samples n] [-iterations n]
+
+static const enum AudioMixImpl impls[] = {AUDIO_MIX_SCALAR, AUDIO_MIX_SSE2, AUDIO_MIX_AVX2};
+#define NB_IMPLS (int)(sizeof(impls) / sizeof(impls[0]))
+
+//固定种子的伪随机数，每次运行的输入一样
+static uint32_t next_random(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state;
+}
+
+//每一路 samples 个采样，S16 用满量程，FLT 故意超出 [-1, 1] 让限幅起作用
+static void fill_tracks(int16_t **s16, float **flt, int tracks, int samples)
+{
+    uint32_t state = 1;
+    for (int t = 0; t < tracks; t++)
+    {
+        for (int i = 0; i < samples; i++)
+        {
+            uint32_t r = next_random(&state);
+            s16[t][i] = (int16_t)(r >> 16);
+            flt[t][i] = ((int)(r >> 8) - (1 << 23)) / (float)(1 << 22);
+        }
+    }
+}
+
+//混一个周期：和 audio_mixer_read 一样先清零，再逐路叠加，FLT 最后限幅
+static void mix_s16(const AudioMixKernels *k, int16_t *dst, int16_t **src, const float *gains, int tracks, int samples)
+{
+    memset(dst, 0, samples * sizeof(int16_t));
+    for (int t = 0; t < tracks; t++)
+    {
+        k->mix_s16(dst, src[t], samples, gains[t]);
+    }
+}
+
+static void mix_flt(const AudioMixKernels *k, float *dst, float **src, const float *gains, int tracks, int samples)
+{
+    memset(dst, 0, samples * sizeof(float));
+    for (int t = 0; t < tracks; t++)
+    {
+        k->mix_flt(dst, src[t], samples, gains[t]);
+    }
+    k->clip_flt(dst, samples);
+}
+
+int main(int argc, char *argv[])
+{
+    //默认 4 路立体声，一个周期 1024 帧
+    int tracks = 4;
+    int samples = 2048;
+    int iterations = 20000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-tracks") && i + 1 < argc)
+        {
+            tracks = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-samples") && i + 1 < argc)
+        {
+            samples = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-iterations") && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+    }
+    if (tracks < 1 || tracks > AUDIO_MIXER_MAX_TRACKS || samples < 1 || iterations < 1)
+    {
+        av_log(NULL, AV_LOG_ERROR, "invalid arguments.\n");
+        return -1;
+    }
+
+    int ret = 0;
+    int16_t *s16[AUDIO_MIXER_MAX_TRACKS] = {0};
+    float *flt[AUDIO_MIXER_MAX_TRACKS] = {0};
+    float gains[AUDIO_MIXER_MAX_TRACKS];
+    int16_t *s16_out = av_malloc(samples * sizeof(int16_t));
+    int16_t *s16_ref = av_malloc(samples * sizeof(int16_t));
+    float *flt_out = av_malloc(samples * sizeof(float));
+    float *flt_ref = av_malloc(samples * sizeof(float));
+    if (!s16_out || !s16_ref || !flt_out || !flt_ref)
+    {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (int t = 0; t < tracks; t++)
+    {
+        s16[t] = av_malloc(samples * sizeof(int16_t));
+        flt[t] = av_malloc(samples * sizeof(float));
+        if (!s16[t] || !flt[t])
+        {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        //增益不是 1，乘法和舍入都要走到
+        gains[t] = 0.35f + 0.2f * t;
+    }
+    fill_tracks(s16, flt, tracks, samples);
+
+    //scalar 的结果作为参考
+    AudioMixKernels scalar;
+    audio_mix_get_kernels(AUDIO_MIX_SCALAR, &scalar);
+    mix_s16(&scalar, s16_ref, s16, gains, tracks, samples);
+    mix_flt(&scalar, flt_ref, flt, gains, tracks, samples);
+
+    printf("tracks = %d, samples = %d, iterations = %d\n", tracks, samples, iterations);
+    printf("%-8s %-4s %12s %12s %8s %s\n", "impl", "fmt", "ns/period", "Msamples/s", "speedup", "match");
+    double scalar_ns[2] = {0};
+    for (int i = 0; i < NB_IMPLS; i++)
+    {
+        AudioMixKernels k;
+        if (audio_mix_get_kernels(impls[i], &k) < 0)
+        {
+            printf("%-8s not supported on this cpu\n", impls[i] == AUDIO_MIX_SSE2 ? "sse2" : "avx2");
+            continue;
+        }
+        for (int fmt = 0; fmt < 2; fmt++)
+        {
+            //先跑一次预热缓存，顺便检查结果
+            int match;
+            if (fmt == 0)
+            {
+                mix_s16(&k, s16_out, s16, gains, tracks, samples);
+                match = !memcmp(s16_out, s16_ref, samples * sizeof(int16_t));
+            }
+            else
+            {
+                mix_flt(&k, flt_out, flt, gains, tracks, samples);
+                match = !memcmp(flt_out, flt_ref, samples * sizeof(float));
+            }
+            if (!match)
+            {
+                ret = -1;
+            }
+
+            int64_t start = av_gettime_relative();
+            for (int n = 0; n < iterations; n++)
+            {
+                if (fmt == 0)
+                {
+                    mix_s16(&k, s16_out, s16, gains, tracks, samples);
+                }
+                else
+                {
+                    mix_flt(&k, flt_out, flt, gains, tracks, samples);
+                }
+            }
+            int64_t us = av_gettime_relative() - start;
+            double ns = us * 1000.0 / iterations;
+            if (impls[i] == AUDIO_MIX_SCALAR)
+            {
+                scalar_ns[fmt] = ns;
+            }
+            printf("%-8s %-4s %12.0f %12.1f %7.2fx %s\n", k.name, fmt == 0 ? "s16" : "flt", ns,
+                   ns > 0 ? (double)samples * tracks / ns * 1000.0 : 0,
+                   ns > 0 ? scalar_ns[fmt] / ns : 0, match ? "yes" : "NO");
+        }
+    }
+
+end:
+    for (int t = 0; t < tracks; t++)
+    {
+        av_freep(&s16[t]);
+        av_freep(&flt[t]);
+    }
+    av_freep(&s16_out);
+    av_freep(&s16_ref);
+    av_freep(&flt_out);
+    av_freep(&flt_ref);
+    return ret < 0 ? 1 : 0;
+}
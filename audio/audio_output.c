@@ -0,0 +1,332 @@
+#include <libavutil/log.h>
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <string.h>
+#include "audio_output.h"
+
+//默认周期 1024 个采样，和以前 SDL_OpenAudio 一样；低延迟可以设成 256（48kHz 时约 5.3ms）
+#define AUDIO_OUTPUT_PERIOD 1024
+//push 模式默认让设备队列保持 2 个周期
+#define AUDIO_OUTPUT_PUSH_PERIODS 2
+//push 模式输出线程最短的等待时间
+#define AUDIO_OUTPUT_PUSH_MIN_WAIT_MS 1
+
+void audio_output_config_default(AudioOutputConfig *config)
+{
+    memset(config, 0, sizeof(AudioOutputConfig));
+    config->mode = AUDIO_OUTPUT_PULL;
+    config->period_samples = AUDIO_OUTPUT_PERIOD;
+    config->push_periods = AUDIO_OUTPUT_PUSH_PERIODS;
+}
+
+static int64_t bytes_to_us(AudioOutput *ao, int64_t bytes)
+{
+    int64_t bytes_per_second = (int64_t)ao->engine->out_sample_rate * ao->engine->out_frame_bytes;
+    return bytes_per_second > 0 ? bytes * 1000000 / bytes_per_second : 0;
+}
+
+static int source_buffered(AudioOutput *ao)
+{
+    return ao->mixer ? audio_mixer_buffered_bytes(ao->mixer) : audio_engine_buffered_bytes(ao->engine);
+}
+
+static void source_read(AudioOutput *ao, uint8_t *data, int len)
+{
+    if (ao->mixer)
+    {
+        audio_mixer_read(ao->mixer, data, len);
+    }
+    else
+    {
+        audio_engine_read(ao->engine, data, len);
+    }
+}
+
+//延迟 = 环形缓冲 + 设备队列 + 设备正在播放的一个周期
+static int64_t measure(AudioOutput *ao, int record)
+{
+    int ring = source_buffered(ao);
+    int queued = ao->config.mode == AUDIO_OUTPUT_PUSH ? (int)SDL_GetQueuedAudioSize(ao->dev) : 0;
+    int64_t latency = bytes_to_us(ao, (int64_t)ring + queued + ao->period_bytes);
+    if (record)
+    {
+        AudioOutputStats *s = &ao->stats;
+        int fill = ao->config.mode == AUDIO_OUTPUT_PUSH ? queued : ring;
+        if (!s->latency_samples || latency < s->latency_min_us)
+        {
+            s->latency_min_us = latency;
+        }
+        if (latency > s->latency_max_us)
+        {
+            s->latency_max_us = latency;
+        }
+        s->latency_samples++;
+        s->latency_sum_us += latency;
+        s->queue_fill_sum += fill;
+        if (fill > s->queue_fill_max)
+        {
+            s->queue_fill_max = fill;
+        }
+    }
+    return latency;
+}
+
+//push 模式下一次检查之前等多久：队列里超过目标水位的部分播完之前不用醒，
+//最多等半个周期；源里没有数据时也等半个周期，不空转
+static Uint32 push_wait_ms(AudioOutput *ao, Uint32 queued, Uint32 target)
+{
+    int64_t max_ms = FFMAX(bytes_to_us(ao, ao->period_bytes) / 2000, AUDIO_OUTPUT_PUSH_MIN_WAIT_MS);
+    int64_t wait_ms = queued > target ? bytes_to_us(ao, queued - target) / 1000 : max_ms;
+    return (Uint32)av_clip64(wait_ms, AUDIO_OUTPUT_PUSH_MIN_WAIT_MS, max_ms);
+}
+
+//push 模式：设备队列低于目标水位时，从环形缓冲取数据写给设备
+static int push_thread(void *arg)
+{
+    AudioOutput *ao = (AudioOutput *)arg;
+    int frame_bytes = ao->engine->out_frame_bytes;
+    Uint32 target = (Uint32)(ao->period_bytes * ao->config.push_periods);
+    int empty = 1;
+    while (!ao->quit)
+    {
+        Uint32 queued = SDL_GetQueuedAudioSize(ao->dev);
+        if (queued == 0 && !empty && SDL_GetAudioDeviceStatus(ao->dev) == SDL_AUDIO_PLAYING)
+        {
+            //队列被设备取空，开始输出静音
+            atomic_fetch_add_explicit(&ao->stats.underruns, 1, memory_order_relaxed);
+        }
+        empty = queued == 0;
+        if (queued < target)
+        {
+            int n = source_buffered(ao);
+            if (n > ao->period_bytes)
+            {
+                n = ao->period_bytes;
+            }
+            //按整帧取，声道不会错位
+            n -= n % frame_bytes;
+            if (n > 0)
+            {
+                source_read(ao, ao->push_buf, n);
+                if (SDL_QueueAudio(ao->dev, ao->push_buf, n) < 0)
+                {
+                    av_log(NULL, AV_LOG_WARNING, "SDL_QueueAudio error = %s.\n", SDL_GetError());
+                }
+                atomic_fetch_add_explicit(&ao->stats.pushes, 1, memory_order_relaxed);
+                empty = 0;
+                continue;
+            }
+        }
+        measure(ao, 1);
+        SDL_Delay(push_wait_ms(ao, queued, target));
+    }
+    return 0;
+}
+
+SDL_AudioFormat audio_output_sdl_format(enum AVSampleFormat sample_fmt)
+{
+    switch (av_get_packed_sample_fmt(sample_fmt))
+    {
+    case AV_SAMPLE_FMT_U8:
+        return AUDIO_U8;
+    case AV_SAMPLE_FMT_S16:
+        return AUDIO_S16SYS;
+    case AV_SAMPLE_FMT_S32:
+        return AUDIO_S32SYS;
+    case AV_SAMPLE_FMT_FLT:
+        return AUDIO_F32SYS;
+    default:
+        return 0;
+    }
+}
+
+enum AVSampleFormat audio_output_av_format(SDL_AudioFormat format)
+{
+    switch (format)
+    {
+    case AUDIO_U8:
+        return AV_SAMPLE_FMT_U8;
+    case AUDIO_S16SYS:
+        return AV_SAMPLE_FMT_S16;
+    case AUDIO_S32SYS:
+        return AV_SAMPLE_FMT_S32;
+    case AUDIO_F32SYS:
+        return AV_SAMPLE_FMT_FLT;
+    default:
+        return AV_SAMPLE_FMT_NONE;
+    }
+}
+
+static SDL_AudioDeviceID open_device(AudioOutput *ao, SDL_AudioSpec *wanted, int allowed_changes)
+{
+    SDL_AudioDeviceID dev = SDL_OpenAudioDevice(ao->config.device, 0, wanted, &ao->obtained, allowed_changes);
+    if (dev == 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "SDL_OpenAudioDevice error = %s.\n", SDL_GetError());
+    }
+    return dev;
+}
+
+//混音只支持 S16 和 FLT
+static int format_supported(AudioOutput *ao, SDL_AudioFormat format)
+{
+    enum AVSampleFormat fmt = audio_output_av_format(format);
+    if (ao->mixer)
+    {
+        return fmt == AV_SAMPLE_FMT_S16 || fmt == AV_SAMPLE_FMT_FLT;
+    }
+    return fmt != AV_SAMPLE_FMT_NONE;
+}
+
+static int open_output(AudioOutput *ao, AudioEngine **engines, int nb_engines, const AudioOutputConfig *config)
+{
+    AudioEngine *engine = engines[0];
+    ao->config = *config;
+    ao->engine = engine;
+    if (ao->config.period_samples <= 0)
+    {
+        ao->config.period_samples = AUDIO_OUTPUT_PERIOD;
+    }
+    if (ao->config.push_periods <= 0)
+    {
+        ao->config.push_periods = AUDIO_OUTPUT_PUSH_PERIODS;
+    }
+
+    //按解码器的格式请求，设备不支持时由 SDL 告诉我们它实际的格式
+    AVCodecContext *codec_ctx = engine->codec_ctx;
+    SDL_AudioSpec wanted;
+    SDL_zero(wanted);
+    wanted.freq = codec_ctx->sample_rate;
+    wanted.format = audio_output_sdl_format(codec_ctx->sample_fmt);
+    if (!format_supported(ao, wanted.format))
+    {
+        wanted.format = ao->mixer && wanted.format ? AUDIO_F32SYS : AUDIO_S16SYS;
+    }
+    wanted.channels = codec_ctx->channels;
+    wanted.samples = ao->config.period_samples;
+    //push 模式不设置回调，数据通过 SDL_QueueAudio 写入
+    if (ao->config.mode == AUDIO_OUTPUT_PULL)
+    {
+        wanted.callback = ao->mixer ? audio_mixer_callback : audio_engine_callback;
+        wanted.userdata = ao->mixer ? (void *)ao->mixer : (void *)engine;
+    }
+    //周期不允许修改，保证配置的延迟
+    int allowed_changes = SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_FORMAT_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE;
+    ao->dev = open_device(ao, &wanted, allowed_changes);
+    if (ao->dev && !format_supported(ao, ao->obtained.format))
+    {
+        //设备的原生格式 swresample 不能直接输出（比如大端），让 SDL 转换成 S16
+        av_log(NULL, AV_LOG_WARNING, "audio_output device format 0x%x not supported, use S16.\n", ao->obtained.format);
+        SDL_CloseAudioDevice(ao->dev);
+        wanted.format = AUDIO_S16SYS;
+        ao->dev = open_device(ao, &wanted, allowed_changes & ~SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+    }
+    if (ao->dev == 0)
+    {
+        return -1;
+    }
+    //每一路都直接重采样到设备的格式
+    for (int i = 0; i < nb_engines; i++)
+    {
+        int ret = audio_engine_configure(engines[i], ao->obtained.freq, audio_output_av_format(ao->obtained.format), ao->obtained.channels,
+                                         ao->obtained.samples, (int)((int64_t)ao->config.buffer_ms * ao->obtained.freq / 1000));
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    ao->period_bytes = ao->obtained.samples * engine->out_frame_bytes;
+    if (ao->mixer && audio_mixer_prepare(ao->mixer, ao->period_bytes) < 0)
+    {
+        return -1;
+    }
+    av_log(NULL, AV_LOG_INFO, "audio_output open %s, %s mode, %s %dHz, %d channels, period = %d samples (%.1fms), %d tracks.\n",
+           ao->config.device ? ao->config.device : "default",
+           ao->config.mode == AUDIO_OUTPUT_PUSH ? "push" : "pull",
+           av_get_sample_fmt_name(engine->out_sample_fmt), ao->obtained.freq, ao->obtained.channels, ao->obtained.samples,
+           bytes_to_us(ao, ao->period_bytes) / 1000.0, nb_engines);
+
+    if (ao->config.mode == AUDIO_OUTPUT_PUSH)
+    {
+        ao->push_buf = av_malloc(ao->period_bytes);
+        if (!ao->push_buf)
+        {
+            return AVERROR(ENOMEM);
+        }
+        ao->thread = SDL_CreateThread(push_thread, "audio_push", ao);
+        if (!ao->thread)
+        {
+            av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread audio_push error = %s.\n", SDL_GetError());
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int audio_output_open(AudioOutput *ao, AudioEngine *engine, const AudioOutputConfig *config)
+{
+    memset(ao, 0, sizeof(AudioOutput));
+    return open_output(ao, &engine, 1, config);
+}
+
+int audio_output_open_mixer(AudioOutput *ao, AudioMixer *mixer, const AudioOutputConfig *config)
+{
+    memset(ao, 0, sizeof(AudioOutput));
+    if (mixer->nb_tracks < 1)
+    {
+        return -1;
+    }
+    AudioEngine *engines[AUDIO_MIXER_MAX_TRACKS];
+    for (int i = 0; i < mixer->nb_tracks; i++)
+    {
+        engines[i] = mixer->tracks[i].engine;
+    }
+    ao->mixer = mixer;
+    return open_output(ao, engines, mixer->nb_tracks, config);
+}
+
+void audio_output_pause(AudioOutput *ao, int pause_on)
+{
+    if (ao->dev)
+    {
+        SDL_PauseAudioDevice(ao->dev, pause_on);
+    }
+}
+
+int64_t audio_output_sample(AudioOutput *ao)
+{
+    if (!ao->dev)
+    {
+        return 0;
+    }
+    return measure(ao, ao->config.mode == AUDIO_OUTPUT_PULL);
+}
+
+void audio_output_log_stats(AudioOutput *ao)
+{
+    AudioOutputStats *s = &ao->stats;
+    int64_t samples = s->latency_samples ? s->latency_samples : 1;
+    av_log(NULL, AV_LOG_INFO, "audio_output: latency avg = %.1fms, min = %.1fms, max = %.1fms, "
+                              "queue fill avg = %lld bytes, max = %d bytes, pushes = %lld, underruns = %lld.\n",
+           s->latency_sum_us / 1000.0 / samples, s->latency_min_us / 1000.0, s->latency_max_us / 1000.0,
+           (long long)(s->queue_fill_sum / samples), s->queue_fill_max,
+           (long long)s->pushes, (long long)s->underruns);
+}
+
+//关闭之后回调不会再访问引擎
+void audio_output_close(AudioOutput *ao)
+{
+    ao->quit = 1;
+    if (ao->thread)
+    {
+        SDL_WaitThread(ao->thread, NULL);
+        ao->thread = NULL;
+    }
+    if (ao->dev)
+    {
+        SDL_CloseAudioDevice(ao->dev);
+        ao->dev = 0;
+    }
+    av_freep(&ao->push_buf);
+}
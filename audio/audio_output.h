@@ -0,0 +1,77 @@
+#ifndef AUDIO_OUTPUT_H
+#define AUDIO_OUTPUT_H
+
+#include <SDL2/SDL.h>
+#include "audio_engine.h"
+#include "audio_mixer.h"
+
+//SDL_OpenAudioDevice 打开的音频输出，数据来自一个 AudioEngine，或者 AudioMixer 混合的多个 AudioEngine
+//pull：SDL 在音频线程上调用 audio_engine_callback / audio_mixer_callback
+//push：输出线程把环形缓冲里的数据 SDL_QueueAudio 给设备，队列保持在目标水位
+
+enum AudioOutputMode
+{
+    AUDIO_OUTPUT_PULL,
+    AUDIO_OUTPUT_PUSH,
+};
+
+typedef struct AudioOutputConfig
+{
+    //NULL 使用默认设备
+    const char *device;
+    enum AudioOutputMode mode;
+    //一个周期的采样数，越小延迟越低，欠载的风险越大
+    int period_samples;
+    //push 模式下设备队列的目标水位（周期数）
+    int push_periods;
+    //解码好还没播放的数据最多多少毫秒，0 表示 8 个周期
+    int buffer_ms;
+} AudioOutputConfig;
+
+typedef struct AudioOutputStats
+{
+    //push 模式下写给设备的次数和设备队列被取空的次数，输出线程写、主线程读
+    _Atomic int64_t pushes;
+    _Atomic int64_t underruns;
+    //估算的输出延迟：环形缓冲 + 设备队列 + 设备的一个周期
+    int64_t latency_samples;
+    int64_t latency_sum_us;
+    int64_t latency_min_us;
+    int64_t latency_max_us;
+    //设备队列（push）或环形缓冲（pull）里的字节数
+    int64_t queue_fill_sum;
+    int queue_fill_max;
+} AudioOutputStats;
+
+typedef struct AudioOutput
+{
+    AudioOutputConfig config;
+    //混音时是第一路的引擎，所有引擎的输出格式相同
+    AudioEngine *engine;
+    AudioMixer *mixer;
+    SDL_AudioDeviceID dev;
+    SDL_AudioSpec obtained;
+    int period_bytes;
+    //push 模式的输出线程
+    SDL_Thread *thread;
+    volatile int quit;
+    uint8_t *push_buf;
+    AudioOutputStats stats;
+} AudioOutput;
+
+void audio_output_config_default(AudioOutputConfig *config);
+//按解码器的格式请求设备，允许设备改成自己的采样率、格式、声道数，
+//再按实际打开的格式配置引擎的重采样，返回 0 成功，打开之后是暂停状态
+int audio_output_open(AudioOutput *ao, AudioEngine *engine, const AudioOutputConfig *config);
+//混音输出：按第一路的格式请求设备，每一路都配置成设备的格式，设备只支持 S16 和 FLT
+int audio_output_open_mixer(AudioOutput *ao, AudioMixer *mixer, const AudioOutputConfig *config);
+//SDL 和 FFmpeg 采样格式互相转换，不支持的格式返回 0 / AV_SAMPLE_FMT_NONE
+SDL_AudioFormat audio_output_sdl_format(enum AVSampleFormat sample_fmt);
+enum AVSampleFormat audio_output_av_format(SDL_AudioFormat format);
+void audio_output_pause(AudioOutput *ao, int pause_on);
+//当前估算的输出延迟（微秒），同时记进统计；push 模式下由输出线程自己采样
+int64_t audio_output_sample(AudioOutput *ao);
+void audio_output_log_stats(AudioOutput *ao);
+void audio_output_close(AudioOutput *ao);
+
+#endif
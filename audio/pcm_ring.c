@@ -0,0 +1,116 @@
+#include <libavutil/log.h>
+#include <string.h>
+#include "pcm_ring.h"
+
+int pcm_ring_init(PcmRing *ring, int size)
+{
+    memset(ring, 0, sizeof(PcmRing));
+    int cap = 1;
+    while (cap < size)
+    {
+        cap <<= 1;
+    }
+    ring->buf = (uint8_t *)SDL_malloc(cap);
+    if (!ring->buf)
+    {
+        av_log(NULL, AV_LOG_ERROR, "pcm_ring_init malloc %d error.\n", cap);
+        return -1;
+    }
+    ring->size = cap;
+    ring->mask = cap - 1;
+    ring->limit = size > 0 ? size : cap;
+    SDL_AtomicSet(&ring->write_pos, 0);
+    SDL_AtomicSet(&ring->read_pos, 0);
+    SDL_AtomicSet(&ring->discard_pos, 0);
+    SDL_AtomicSet(&ring->underruns, 0);
+    return 0;
+}
+
+void pcm_ring_free(PcmRing *ring)
+{
+    if (ring->buf)
+    {
+        SDL_free(ring->buf);
+        ring->buf = NULL;
+    }
+}
+
+//位置按 unsigned 相减，溢出回绕之后差值仍然正确
+static int ring_used(unsigned int write_pos, unsigned int read_pos)
+{
+    return (int)(write_pos - read_pos);
+}
+
+int pcm_ring_write(PcmRing *ring, const uint8_t *data, int len)
+{
+    unsigned int w = (unsigned int)SDL_AtomicGet(&ring->write_pos);
+    unsigned int r = (unsigned int)SDL_AtomicGet(&ring->read_pos);
+    int space = ring->limit - ring_used(w, r);
+    if (len > space)
+    {
+        len = space;
+    }
+    if (len <= 0)
+    {
+        return 0;
+    }
+    int offset = w & ring->mask;
+    int first = ring->size - offset;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(ring->buf + offset, data, first);
+    memcpy(ring->buf, data + first, len - first);
+    //数据写完之后才发布新的写位置，SDL_AtomicSet 带内存屏障
+    SDL_AtomicSet(&ring->write_pos, (int)(w + len));
+    return len;
+}
+
+void pcm_ring_discard(PcmRing *ring)
+{
+    SDL_AtomicSet(&ring->discard_pos, SDL_AtomicGet(&ring->write_pos));
+}
+
+int pcm_ring_read(PcmRing *ring, uint8_t *data, int len)
+{
+    unsigned int r = (unsigned int)SDL_AtomicGet(&ring->read_pos);
+    unsigned int w = (unsigned int)SDL_AtomicGet(&ring->write_pos);
+    unsigned int d = (unsigned int)SDL_AtomicGet(&ring->discard_pos);
+    //seek 之前的数据直接跳过
+    if (ring_used(d, r) > 0)
+    {
+        r = d;
+    }
+    int avail = ring_used(w, r);
+    int n = len < avail ? len : avail;
+    if (n < len)
+    {
+        SDL_AtomicIncRef(&ring->underruns);
+    }
+    if (n > 0)
+    {
+        int offset = r & ring->mask;
+        int first = ring->size - offset;
+        if (first > n)
+        {
+            first = n;
+        }
+        memcpy(data, ring->buf + offset, first);
+        memcpy(data + first, ring->buf, n - first);
+    }
+    SDL_AtomicSet(&ring->read_pos, (int)(r + n));
+    return n;
+}
+
+int pcm_ring_available(PcmRing *ring)
+{
+    unsigned int r = (unsigned int)SDL_AtomicGet(&ring->read_pos);
+    unsigned int w = (unsigned int)SDL_AtomicGet(&ring->write_pos);
+    return ring_used(w, r);
+}
+
+int pcm_ring_space(PcmRing *ring)
+{
+    return ring->limit - pcm_ring_available(ring);
+}
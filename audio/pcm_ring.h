@@ -0,0 +1,38 @@
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+//单生产者单消费者的 PCM 环形缓冲，不加锁
+//生产者是音频解码线程，消费者是 SDL 音频回调
+typedef struct PcmRing
+{
+    uint8_t *buf;
+    //分配的大小，2 的幂
+    int size;
+    int mask;
+    //最多缓冲多少字节，不超过 size，决定了环形缓冲带来的延迟
+    int limit;
+    //读写位置一直递增，取余后才是下标；write_pos 只由生产者修改，read_pos 只由消费者修改
+    SDL_atomic_t write_pos;
+    SDL_atomic_t read_pos;
+    //生产者要求丢弃这个位置之前的数据（seek），消费者读的时候跳过
+    SDL_atomic_t discard_pos;
+    SDL_atomic_t underruns;
+} PcmRing;
+
+//最多缓冲 size 字节，分配时向上取整到 2 的幂，返回 0 成功
+int pcm_ring_init(PcmRing *ring, int size);
+void pcm_ring_free(PcmRing *ring);
+//生产者调用，返回实际写入的字节数，空间不够时只写一部分
+int pcm_ring_write(PcmRing *ring, const uint8_t *data, int len);
+//生产者调用，已经写入的数据都不再播放
+void pcm_ring_discard(PcmRing *ring);
+//消费者调用，返回实际读出的字节数，不够的部分由调用者填静音
+int pcm_ring_read(PcmRing *ring, uint8_t *data, int len);
+//可读字节数、可写字节数，在任一线程调用都只是一个快照
+int pcm_ring_available(PcmRing *ring);
+int pcm_ring_space(PcmRing *ring);
+
+#endif
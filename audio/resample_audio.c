@@ -1,4 +1,562 @@
-int main(int argc,char *argv[]){
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mem.h>
+#include <libavutil/avstring.h>
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "resampler.h"
+#include "../thread_pool.h"
 
-    
-}
\ No newline at end of file
+//不经过完整转码，只解码 + 重采样，输出 wav 或裸 PCM
+//./resample_audio [-ar rate] [-ac channels] [-sample_fmt s16|s32|flt|dbl|u8] [-quality fast|medium|high|best]
+//                 [-chunk samples] [-o output] input
+//./resample_audio -batch [-j threads] [-o outdir] [-raw] ... input1 input2 ...
+//./resample_audio -bench [-ar rate] [-seconds n] [-chunk samples]
+
+//一次最多送给重采样多少个输入采样，决定了输出缓冲的大小
+#define RESAMPLE_DEFAULT_CHUNK 4096
+#define BENCH_DEFAULT_SECONDS 60
+#define BENCH_IN_RATE 48000
+
+typedef struct ResampleOptions
+{
+    //0 表示和输入一样
+    int out_rate;
+    int out_channels;
+    enum AVSampleFormat out_fmt;
+    enum ResamplerQuality quality;
+    int chunk;
+    //输出裸 PCM，不写 wav 头
+    int raw;
+} ResampleOptions;
+
+typedef struct ResampleJob
+{
+    const ResampleOptions *options;
+    const char *input;
+    char *output;
+    int ret;
+    int64_t samples_in;
+    int64_t samples_out;
+    //输入时长（微秒）和处理耗时
+    int64_t duration_us;
+    int64_t elapsed_us;
+} ResampleJob;
+
+static void put_le16(uint8_t *p, int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    put_le16(p, v & 0xffff);
+    put_le16(p + 2, v >> 16);
+}
+
+//RIFF 头，数据大小先写 0，结束时回填；多于 2 声道用 WAVE_FORMAT_EXTENSIBLE 带上声道掩码
+static int write_wav_header(FILE *fp, enum AVSampleFormat fmt, int channels, int64_t layout, int rate, uint32_t data_size)
+{
+    uint8_t h[68];
+    int bits = av_get_bytes_per_sample(fmt) * 8;
+    int is_float = fmt == AV_SAMPLE_FMT_FLT || fmt == AV_SAMPLE_FMT_DBL;
+    int extensible = channels > 2;
+    int fmt_size = extensible ? 40 : 16;
+    int header_size = 20 + fmt_size + 8;
+    memcpy(h, "RIFF", 4);
+    put_le32(h + 4, header_size - 8 + data_size);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le32(h + 16, fmt_size);
+    put_le16(h + 20, extensible ? 0xFFFE : (is_float ? 3 : 1));
+    put_le16(h + 22, channels);
+    put_le32(h + 24, rate);
+    put_le32(h + 28, rate * channels * bits / 8);
+    put_le16(h + 32, channels * bits / 8);
+    put_le16(h + 34, bits);
+    if (extensible)
+    {
+        static const uint8_t guid_tail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        put_le16(h + 36, 22);
+        put_le16(h + 38, bits);
+        put_le32(h + 40, (uint32_t)layout);
+        put_le16(h + 44, is_float ? 3 : 1);
+        memcpy(h + 46, guid_tail, sizeof(guid_tail));
+    }
+    memcpy(h + 20 + fmt_size, "data", 4);
+    put_le32(h + 24 + fmt_size, data_size);
+    return fwrite(h, 1, header_size, fp) == (size_t)header_size ? 0 : -1;
+}
+
+//按块送进重采样，输出立刻写文件，内存占用和输入帧大小无关
+static int convert_and_write(Resampler *rs, const uint8_t **data, int samples, int chunk, FILE *fp, int64_t *data_size)
+{
+    int in_channels = av_get_channel_layout_nb_channels(rs->config.in_layout);
+    int planar = av_sample_fmt_is_planar(rs->config.in_fmt);
+    int bytes = av_get_bytes_per_sample(rs->config.in_fmt);
+    const uint8_t *planes[AV_NUM_DATA_POINTERS * 8];
+    int nb_planes = planar ? in_channels : 1;
+    if (nb_planes > (int)(sizeof(planes) / sizeof(planes[0])))
+    {
+        return AVERROR(EINVAL);
+    }
+    int offset = 0;
+    do
+    {
+        int n = samples - offset < chunk ? samples - offset : chunk;
+        const uint8_t **in = NULL;
+        if (data)
+        {
+            //每个平面向后移 offset 个采样
+            for (int i = 0; i < nb_planes; i++)
+            {
+                planes[i] = data[i] + (size_t)offset * bytes * (planar ? 1 : in_channels);
+            }
+            in = planes;
+        }
+        int out = resampler_convert(rs, in, n);
+        if (out < 0)
+        {
+            return out;
+        }
+        //冲刷时一直转换到没有输出为止
+        if (!data && out == 0)
+        {
+            break;
+        }
+        //交错格式只有一个平面；平面格式按 wav 的要求不支持，调用者保证是交错格式
+        int size = resampler_out_bytes(rs, out);
+        if (size > 0 && fwrite(rs->out_data[0], 1, size, fp) != (size_t)size)
+        {
+            return AVERROR(EIO);
+        }
+        *data_size += size > 0 ? size : 0;
+        offset += n;
+    } while (data ? offset < samples : 1);
+    return 0;
+}
+
+static int resample_file(ResampleJob *job)
+{
+    const ResampleOptions *opt = job->options;
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *codec_ctx = NULL;
+    AVPacket *packet = NULL;
+    AVFrame *frame = NULL;
+    Resampler rs;
+    FILE *fp = NULL;
+    int64_t data_size = 0;
+    int64_t start = av_gettime_relative();
+    memset(&rs, 0, sizeof(rs));
+
+    int ret = avformat_open_input(&fmt_ctx, job->input, NULL, NULL);
+    if (ret != 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: avformat_open_input error,ret = %d.\n", job->input, ret);
+        goto end;
+    }
+    ret = avformat_find_stream_info(fmt_ctx, NULL);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: avformat_find_stream_info error,ret = %d.\n", job->input, ret);
+        goto end;
+    }
+    AVCodec *codec = NULL;
+    int stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+    if (stream_index < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: no audio stream.\n", job->input);
+        ret = stream_index;
+        goto end;
+    }
+    codec_ctx = avcodec_alloc_context3(codec);
+    if (!codec_ctx)
+    {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    avcodec_parameters_to_context(codec_ctx, fmt_ctx->streams[stream_index]->codecpar);
+    ret = avcodec_open2(codec_ctx, codec, NULL);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: avcodec_open2 ret = %d.\n", job->input, ret);
+        goto end;
+    }
+
+    ResamplerConfig config;
+    //HLS 的 TS 流里 channel_layout 可能是 0
+    config.in_layout = codec_ctx->channel_layout ? codec_ctx->channel_layout : av_get_default_channel_layout(codec_ctx->channels);
+    config.in_fmt = codec_ctx->sample_fmt;
+    config.in_rate = codec_ctx->sample_rate;
+    config.out_layout = opt->out_channels > 0 ? av_get_default_channel_layout(opt->out_channels) : config.in_layout;
+    config.out_fmt = opt->out_fmt;
+    config.out_rate = opt->out_rate > 0 ? opt->out_rate : codec_ctx->sample_rate;
+    config.quality = opt->quality;
+    ret = resampler_init(&rs, &config);
+    if (ret < 0)
+    {
+        goto end;
+    }
+
+    fp = fopen(job->output, "wb");
+    if (!fp)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: can't open %s.\n", job->input, job->output);
+        ret = AVERROR(EIO);
+        goto end;
+    }
+    if (!opt->raw && write_wav_header(fp, config.out_fmt, rs.out_channels, config.out_layout, config.out_rate, 0) < 0)
+    {
+        ret = AVERROR(EIO);
+        goto end;
+    }
+
+    packet = av_packet_alloc();
+    frame = av_frame_alloc();
+    if (!packet || !frame)
+    {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    while (av_read_frame(fmt_ctx, packet) >= 0)
+    {
+        if (packet->stream_index != stream_index)
+        {
+            av_packet_unref(packet);
+            continue;
+        }
+        ret = avcodec_send_packet(codec_ctx, packet);
+        av_packet_unref(packet);
+        if (ret < 0)
+        {
+            //坏包跳过，继续转换后面的数据
+            continue;
+        }
+        while ((ret = avcodec_receive_frame(codec_ctx, frame)) == 0)
+        {
+            ret = convert_and_write(&rs, (const uint8_t **)frame->extended_data, frame->nb_samples, opt->chunk, fp, &data_size);
+            av_frame_unref(frame);
+            if (ret < 0)
+            {
+                goto end;
+            }
+        }
+    }
+    //解码器和重采样里剩下的数据
+    avcodec_send_packet(codec_ctx, NULL);
+    while (avcodec_receive_frame(codec_ctx, frame) == 0)
+    {
+        ret = convert_and_write(&rs, (const uint8_t **)frame->extended_data, frame->nb_samples, opt->chunk, fp, &data_size);
+        av_frame_unref(frame);
+        if (ret < 0)
+        {
+            goto end;
+        }
+    }
+    ret = convert_and_write(&rs, NULL, 0, opt->chunk, fp, &data_size);
+    if (ret < 0)
+    {
+        goto end;
+    }
+    //回填 wav 头里的大小，超过 4GB 的数据 wav 放不下，只保证数据完整
+    if (!opt->raw && fseek(fp, 0, SEEK_SET) == 0)
+    {
+        write_wav_header(fp, config.out_fmt, rs.out_channels, config.out_layout, config.out_rate,
+                         data_size > UINT32_MAX - 80 ? UINT32_MAX - 80 : (uint32_t)data_size);
+    }
+    ret = 0;
+
+end:
+    job->samples_in = rs.samples_in;
+    job->samples_out = rs.samples_out;
+    job->duration_us = codec_ctx && codec_ctx->sample_rate > 0 ? rs.samples_in * 1000000 / codec_ctx->sample_rate : 0;
+    job->elapsed_us = av_gettime_relative() - start;
+    if (fp)
+    {
+        fclose(fp);
+    }
+    resampler_free(&rs);
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    avcodec_free_context(&codec_ctx);
+    if (fmt_ctx)
+    {
+        avformat_close_input(&fmt_ctx);
+    }
+    return ret;
+}
+
+static void resample_job(void *arg)
+{
+    ResampleJob *job = (ResampleJob *)arg;
+    job->ret = resample_file(job);
+    if (job->ret == 0)
+    {
+        av_log(NULL, AV_LOG_INFO, "%s -> %s: %lld -> %lld samples, %.1fs in %.2fs (%.0fx realtime).\n",
+               job->input, job->output, (long long)job->samples_in, (long long)job->samples_out,
+               job->duration_us / 1000000.0, job->elapsed_us / 1000000.0,
+               job->elapsed_us > 0 ? (double)job->duration_us / job->elapsed_us : 0);
+    }
+}
+
+//outdir/名字去掉扩展名.wav，suffix > 0 时是 outdir/名字-suffix.wav
+static char *batch_output_path(const char *input, const char *outdir, int raw, int suffix)
+{
+    const char *name = strrchr(input, '/');
+    name = name ? name + 1 : input;
+    const char *dot = strrchr(name, '.');
+    int len = dot && dot != name ? (int)(dot - name) : (int)strlen(name);
+    if (suffix > 0)
+    {
+        return av_asprintf("%s/%.*s-%d.%s", outdir, len, name, suffix, raw ? "pcm" : "wav");
+    }
+    return av_asprintf("%s/%.*s.%s", outdir, len, name, raw ? "pcm" : "wav");
+}
+
+//不同目录下的同名文件（a/audio.mp4、b/audio.mp4）会映射到同一个输出，
+//两个线程同时写一个文件都会报告成功，内容却是坏的：和前面的输出重名时加数字后缀
+static char *batch_unique_output_path(const ResampleJob *jobs, int nb_jobs, const char *input, const char *outdir, int raw)
+{
+    for (int suffix = 0;; suffix++)
+    {
+        char *path = batch_output_path(input, outdir, raw, suffix);
+        int taken = 0;
+        for (int i = 0; path && !taken && i < nb_jobs; i++)
+        {
+            taken = jobs[i].output && !strcmp(jobs[i].output, path);
+        }
+        if (!taken)
+        {
+            if (path && suffix > 0)
+            {
+                av_log(NULL, AV_LOG_WARNING, "%s: output name taken, write to %s.\n", input, path);
+            }
+            return path;
+        }
+        av_free(path);
+    }
+}
+
+//合成一段 48kHz 立体声 FLTP 正弦扫频，按每种质量各转换一遍，统计每秒处理的输入采样数
+static int run_bench(const ResampleOptions *opt, int seconds)
+{
+    int in_samples = BENCH_IN_RATE * seconds;
+    int chunk = opt->chunk;
+    float *planes[2] = {av_malloc(chunk * sizeof(float)), av_malloc(chunk * sizeof(float))};
+    int ret = 0;
+    if (!planes[0] || !planes[1])
+    {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (int q = 0; q < RESAMPLER_NB_QUALITIES; q++)
+    {
+        Resampler rs;
+        ResamplerConfig config;
+        config.in_layout = AV_CH_LAYOUT_STEREO;
+        config.in_fmt = AV_SAMPLE_FMT_FLTP;
+        config.in_rate = BENCH_IN_RATE;
+        config.out_layout = opt->out_channels > 0 ? av_get_default_channel_layout(opt->out_channels) : AV_CH_LAYOUT_STEREO;
+        config.out_fmt = opt->out_fmt;
+        config.out_rate = opt->out_rate > 0 ? opt->out_rate : 44100;
+        config.quality = q;
+        ret = resampler_init(&rs, &config);
+        if (ret < 0)
+        {
+            resampler_free(&rs);
+            goto end;
+        }
+        int64_t elapsed = 0;
+        for (int offset = 0; offset < in_samples; offset += chunk)
+        {
+            int n = in_samples - offset < chunk ? in_samples - offset : chunk;
+            //生成信号不计入耗时
+            for (int i = 0; i < n; i++)
+            {
+                double t = (double)(offset + i) / BENCH_IN_RATE;
+                planes[0][i] = (float)(0.5 * sin(2 * M_PI * (100 + 200 * t) * t));
+                planes[1][i] = (float)(0.5 * sin(2 * M_PI * 1000 * t));
+            }
+            int64_t start = av_gettime_relative();
+            ret = resampler_convert(&rs, (const uint8_t **)planes, n);
+            elapsed += av_gettime_relative() - start;
+            if (ret < 0)
+            {
+                resampler_free(&rs);
+                goto end;
+            }
+        }
+        int64_t start = av_gettime_relative();
+        while ((ret = resampler_convert(&rs, NULL, 0)) > 0)
+        {
+        }
+        elapsed += av_gettime_relative() - start;
+        //和 player 的 benchmark 一样，一行一个结果，方便脚本解析
+        printf("bench resample_%s in_rate=%d out_rate=%d out_fmt=%s channels=%d samples=%lld elapsed_us=%lld samples_per_sec=%.0f realtime=%.1f\n",
+               resampler_quality_name(q), BENCH_IN_RATE, config.out_rate, av_get_sample_fmt_name(config.out_fmt), rs.out_channels,
+               (long long)rs.samples_in, (long long)elapsed,
+               elapsed > 0 ? rs.samples_in * 1000000.0 / elapsed : 0,
+               elapsed > 0 ? seconds * 1000000.0 / elapsed : 0);
+        resampler_free(&rs);
+        ret = 0;
+    }
+
+end:
+    av_freep(&planes[0]);
+    av_freep(&planes[1]);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    ResampleOptions options;
+    memset(&options, 0, sizeof(options));
+    options.out_fmt = AV_SAMPLE_FMT_S16;
+    options.quality = RESAMPLER_MEDIUM;
+    options.chunk = RESAMPLE_DEFAULT_CHUNK;
+    const char *output = NULL;
+    const char **inputs = av_mallocz_array(argc, sizeof(char *));
+    int nb_inputs = 0;
+    int batch = 0;
+    int bench = 0;
+    int threads = 0;
+    int seconds = BENCH_DEFAULT_SECONDS;
+    if (!inputs)
+    {
+        return -1;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-ar") && i + 1 < argc)
+        {
+            options.out_rate = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-ac") && i + 1 < argc)
+        {
+            options.out_channels = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-sample_fmt") && i + 1 < argc)
+        {
+            //wav 只能放交错格式
+            options.out_fmt = av_get_packed_sample_fmt(av_get_sample_fmt(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-quality") && i + 1 < argc)
+        {
+            options.quality = resampler_quality_from_name(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-chunk") && i + 1 < argc)
+        {
+            options.chunk = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-raw"))
+        {
+            options.raw = 1;
+        }
+        else if (!strcmp(argv[i], "-batch"))
+        {
+            batch = 1;
+        }
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-bench"))
+        {
+            bench = 1;
+        }
+        else if (!strcmp(argv[i], "-seconds") && i + 1 < argc)
+        {
+            seconds = atoi(argv[++i]);
+        }
+        else
+        {
+            inputs[nb_inputs++] = argv[i];
+        }
+    }
+    int ret = -1;
+    if (options.out_fmt == AV_SAMPLE_FMT_NONE || options.quality < 0 || options.chunk <= 0 || seconds <= 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "invalid -sample_fmt / -quality / -chunk / -seconds.\n");
+        goto end;
+    }
+    if (bench)
+    {
+        ret = run_bench(&options, seconds);
+        goto end;
+    }
+    if (nb_inputs == 0 || (!batch && nb_inputs > 1))
+    {
+        av_log(NULL, AV_LOG_ERROR, "without input url, use -batch for more than one input.\n");
+        goto end;
+    }
+
+    ResampleJob *jobs = av_mallocz_array(nb_inputs, sizeof(ResampleJob));
+    if (!jobs)
+    {
+        goto end;
+    }
+    for (int i = 0; i < nb_inputs; i++)
+    {
+        jobs[i].options = &options;
+        jobs[i].input = inputs[i];
+        jobs[i].output = batch ? batch_unique_output_path(jobs, i, inputs[i], output ? output : ".", options.raw)
+                               : av_strdup(output ? output : (options.raw ? "out.pcm" : "out.wav"));
+    }
+    if (batch)
+    {
+        //一个文件一个任务，线程数默认等于 CPU 核数
+        ThreadPool pool;
+        int submitted = 0;
+        //初始化失败时 thread_pool_init 已经清理过，不能再 wait / destroy
+        ret = thread_pool_init(&pool, threads);
+        if (ret >= 0)
+        {
+            for (; submitted < nb_inputs; submitted++)
+            {
+                ret = thread_pool_submit(&pool, resample_job, &jobs[submitted]);
+                if (ret < 0)
+                {
+                    break;
+                }
+            }
+            thread_pool_wait(&pool);
+            thread_pool_destroy(&pool);
+        }
+        //没有提交的任务算失败
+        for (int i = submitted; i < nb_inputs; i++)
+        {
+            jobs[i].ret = ret;
+        }
+    }
+    else
+    {
+        resample_job(&jobs[0]);
+    }
+
+    int failed = 0;
+    int64_t duration_us = 0;
+    for (int i = 0; i < nb_inputs; i++)
+    {
+        failed += jobs[i].ret < 0;
+        duration_us += jobs[i].duration_us;
+        av_freep(&jobs[i].output);
+    }
+    if (batch)
+    {
+        av_log(NULL, AV_LOG_INFO, "batch: %d files, %d failed, %.1fs of audio.\n", nb_inputs, failed, duration_us / 1000000.0);
+    }
+    av_freep(&jobs);
+    ret = ret < 0 ? ret : (failed ? -1 : 0);
+
+end:
+    av_freep(&inputs);
+    return ret < 0 ? 1 : 0;
+}
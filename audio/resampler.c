@@ -0,0 +1,146 @@
+#include <libavutil/log.h>
+#include <libavutil/opt.h>
+#include <libavutil/mem.h>
+#include <libavutil/channel_layout.h>
+#include <string.h>
+#include "resampler.h"
+
+typedef struct QualityTier
+{
+    const char *name;
+    int filter_size;
+    int phase_shift;
+    double cutoff;
+    //输出 S16 时是否加三角形 dither
+    int dither;
+} QualityTier;
+
+//filter_size 和 phase_shift 越大，阻带衰减越大、速度越慢；medium 和 swresample 的默认值一样
+static const QualityTier tiers[RESAMPLER_NB_QUALITIES] = {
+    {"fast", 8, 6, 0.80, 0},
+    {"medium", 32, 10, 0.97, 0},
+    {"high", 64, 12, 0.98, 1},
+    {"best", 128, 16, 0.99, 1},
+};
+
+const char *resampler_quality_name(enum ResamplerQuality quality)
+{
+    return quality >= 0 && quality < RESAMPLER_NB_QUALITIES ? tiers[quality].name : "unknown";
+}
+
+int resampler_quality_from_name(const char *name)
+{
+    for (int i = 0; i < RESAMPLER_NB_QUALITIES; i++)
+    {
+        if (!strcmp(tiers[i].name, name))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int resampler_init(Resampler *rs, const ResamplerConfig *config)
+{
+    memset(rs, 0, sizeof(Resampler));
+    rs->config = *config;
+    if (config->quality < 0 || config->quality >= RESAMPLER_NB_QUALITIES)
+    {
+        return AVERROR(EINVAL);
+    }
+    const QualityTier *tier = &tiers[config->quality];
+    rs->out_channels = av_get_channel_layout_nb_channels(config->out_layout);
+    rs->swr = swr_alloc_set_opts(NULL,
+                                 config->out_layout, config->out_fmt, config->out_rate,
+                                 config->in_layout, config->in_fmt, config->in_rate,
+                                 0, NULL);
+    if (!rs->swr)
+    {
+        av_log(NULL, AV_LOG_ERROR, "resampler swr_alloc_set_opts NULL.\n");
+        return AVERROR(ENOMEM);
+    }
+    av_opt_set_int(rs->swr, "filter_size", tier->filter_size, 0);
+    av_opt_set_int(rs->swr, "phase_shift", tier->phase_shift, 0);
+    av_opt_set_int(rs->swr, "linear_interp", 1, 0);
+    av_opt_set_double(rs->swr, "cutoff", tier->cutoff, 0);
+    if (tier->dither && av_get_packed_sample_fmt(config->out_fmt) == AV_SAMPLE_FMT_S16)
+    {
+        av_opt_set(rs->swr, "dither_method", "triangular", 0);
+    }
+    int ret = swr_init(rs->swr);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "resampler swr_init ret = %d.\n", ret);
+        return ret;
+    }
+    return 0;
+}
+
+//按需要的采样数扩大输出缓冲
+static int ensure_capacity(Resampler *rs, int samples)
+{
+    if (samples <= rs->out_capacity)
+    {
+        return 0;
+    }
+    if (rs->out_data)
+    {
+        av_freep(&rs->out_data[0]);
+        av_freep(&rs->out_data);
+    }
+    rs->out_capacity = 0;
+    int linesize;
+    int ret = av_samples_alloc_array_and_samples(&rs->out_data, &linesize, rs->out_channels, samples, rs->config.out_fmt, 0);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    rs->out_capacity = samples;
+    return 0;
+}
+
+int resampler_convert(Resampler *rs, const uint8_t **in, int in_samples)
+{
+    if (!in)
+    {
+        in_samples = 0;
+    }
+    //swresample 内部缓存的数据也会在这次输出
+    int need = swr_get_out_samples(rs->swr, in_samples);
+    if (need <= 0)
+    {
+        return 0;
+    }
+    int ret = ensure_capacity(rs, need);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    int samples = swr_convert(rs->swr, rs->out_data, rs->out_capacity, in, in_samples);
+    if (samples < 0)
+    {
+        return samples;
+    }
+    rs->samples_in += in_samples;
+    rs->samples_out += samples;
+    return samples;
+}
+
+int resampler_out_bytes(Resampler *rs, int samples)
+{
+    return av_samples_get_buffer_size(NULL, rs->out_channels, samples, rs->config.out_fmt, 1);
+}
+
+void resampler_free(Resampler *rs)
+{
+    if (rs->out_data)
+    {
+        av_freep(&rs->out_data[0]);
+        av_freep(&rs->out_data);
+    }
+    rs->out_capacity = 0;
+    if (rs->swr)
+    {
+        swr_free(&rs->swr);
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stdint.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+
+//流式重采样：采样率、采样格式、声道布局一次转换，输入按块送进来，输出缓冲只和块大小有关
+
+enum ResamplerQuality
+{
+    //滤波器短，适合预览
+    RESAMPLER_FAST,
+    //swresample 的默认参数
+    RESAMPLER_MEDIUM,
+    RESAMPLER_HIGH,
+    //滤波器最长，输出 S16 时加 dither
+    RESAMPLER_BEST,
+    RESAMPLER_NB_QUALITIES,
+};
+
+typedef struct ResamplerConfig
+{
+    int64_t in_layout;
+    enum AVSampleFormat in_fmt;
+    int in_rate;
+    int64_t out_layout;
+    enum AVSampleFormat out_fmt;
+    int out_rate;
+    enum ResamplerQuality quality;
+} ResamplerConfig;
+
+typedef struct Resampler
+{
+    ResamplerConfig config;
+    SwrContext *swr;
+    int out_channels;
+    //一次转换的输出，按 out_fmt 排列（交错格式只有 out_data[0]）
+    uint8_t **out_data;
+    //out_data 能放多少个采样，只在输入块变大时增长
+    int out_capacity;
+    int64_t samples_in;
+    int64_t samples_out;
+} Resampler;
+
+const char *resampler_quality_name(enum ResamplerQuality quality);
+//不认识的名字返回 -1
+int resampler_quality_from_name(const char *name);
+//layout 必须填好（可以用 av_get_default_channel_layout），返回 0 成功
+int resampler_init(Resampler *rs, const ResamplerConfig *config);
+//转换 in_samples 个输入采样，结果在 rs->out_data，返回输出的采样数
+//in 为 NULL 时冲刷滤波器里剩下的数据，返回 0 表示冲刷完了
+int resampler_convert(Resampler *rs, const uint8_t **in, int in_samples);
+//输出 samples 个采样占多少字节（所有平面加起来）
+int resampler_out_bytes(Resampler *rs, int samples);
+void resampler_free(Resampler *rs);
+
+#endif
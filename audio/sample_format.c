@@ -1,20 +1,786 @@
 #include <libavutil/samplefmt.h>
 #include <libavutil/log.h>
+#include <libavutil/common.h>
+#include <libavutil/cpu.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+#include <libswresample/swresample.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+//采样格式转换的 benchmark：所有 AVSampleFormat 两两组合（交错/平面，u8/s16/s32/flt/dbl），
+//不同声道数、不同缓冲大小，比较 swresample 和手写的 C / SSE2 / AVX2 内核，输出 CSV
+//./sample_format [-channels 1,2,6] [-samples 256,1024,4096] [-budget samples] [-o result.csv]
+
+#define MAX_CHANNELS 16
+#define MAX_LIST 16
+//每次测量大约转换多少个采样（所有声道加起来），决定了重复次数
+#define DEFAULT_BUDGET 4000000
+
+enum Engine
+{
+    ENGINE_SWR,
+    ENGINE_C,
+    ENGINE_SSE2,
+    ENGINE_AVX2,
+    NB_ENGINES,
+};
+
+static const char *engine_names[NB_ENGINES] = {"swr", "c", "sse2", "avx2"};
+
+//n 个采样从一种交错格式转换到另一种，格式的下标是 AV_SAMPLE_FMT_U8 ~ AV_SAMPLE_FMT_DBL
+typedef void (*ConvertFunc)(uint8_t *dst, const uint8_t *src, int n);
+#define NB_PACKED (AV_SAMPLE_FMT_DBL + 1)
+
+//标量实现，公式和 swresample 的 audioconvert.c 一致，结果逐位相同
+#define CONV_FUNC(ofmt, otype, ifmt, itype, expr)                                   \
+    static void conv_##ifmt##_to_##ofmt(uint8_t *dst, const uint8_t *src, int n) \
+    {                                                                              \
+        const itype *in = (const itype *)src;                                      \
+        otype *out = (otype *)dst;                                                 \
+        for (int i = 0; i < n; i++)                                                \
+        {                                                                          \
+            itype x = in[i];                                                       \
+            out[i] = expr;                                                         \
+        }                                                                          \
+    }
+
+CONV_FUNC(u8, uint8_t, u8, uint8_t, x)
+CONV_FUNC(s16, int16_t, u8, uint8_t, (x - 0x80) * (1 << 8))
+CONV_FUNC(s32, int32_t, u8, uint8_t, (x - 0x80) * (1 << 24))
+CONV_FUNC(flt, float, u8, uint8_t, (x - 0x80) * (1.0f / (1 << 7)))
+CONV_FUNC(dbl, double, u8, uint8_t, (x - 0x80) * (1.0 / (1 << 7)))
+CONV_FUNC(u8, uint8_t, s16, int16_t, (x >> 8) + 0x80)
+CONV_FUNC(s16, int16_t, s16, int16_t, x)
+CONV_FUNC(s32, int32_t, s16, int16_t, x * (1 << 16))
+CONV_FUNC(flt, float, s16, int16_t, x * (1.0f / (1 << 15)))
+CONV_FUNC(dbl, double, s16, int16_t, x * (1.0 / (1 << 15)))
+CONV_FUNC(u8, uint8_t, s32, int32_t, (x >> 24) + 0x80)
+CONV_FUNC(s16, int16_t, s32, int32_t, x >> 16)
+CONV_FUNC(s32, int32_t, s32, int32_t, x)
+CONV_FUNC(flt, float, s32, int32_t, x * (1.0f / (1U << 31)))
+CONV_FUNC(dbl, double, s32, int32_t, x * (1.0 / (1U << 31)))
+CONV_FUNC(u8, uint8_t, flt, float, av_clip_uint8(lrintf(x * (1 << 7)) + 0x80))
+CONV_FUNC(s16, int16_t, flt, float, av_clip_int16(lrintf(x * (1 << 15))))
+CONV_FUNC(s32, int32_t, flt, float, av_clipl_int32(llrintf(x * (1U << 31))))
+CONV_FUNC(flt, float, flt, float, x)
+CONV_FUNC(dbl, double, flt, float, x)
+CONV_FUNC(u8, uint8_t, dbl, double, av_clip_uint8(lrint(x * (1 << 7)) + 0x80))
+CONV_FUNC(s16, int16_t, dbl, double, av_clip_int16(lrint(x * (1 << 15))))
+CONV_FUNC(s32, int32_t, dbl, double, av_clipl_int32(llrint(x * (1U << 31))))
+CONV_FUNC(flt, float, dbl, double, x)
+CONV_FUNC(dbl, double, dbl, double, x)
+
+#define CONV_ROW(ifmt) \
+    {conv_##ifmt##_to_u8, conv_##ifmt##_to_s16, conv_##ifmt##_to_s32, conv_##ifmt##_to_flt, conv_##ifmt##_to_dbl}
+
+//[输入][输出]
+static const ConvertFunc c_kernels[NB_PACKED][NB_PACKED] = {
+    CONV_ROW(u8),
+    CONV_ROW(s16),
+    CONV_ROW(s32),
+    CONV_ROW(flt),
+    CONV_ROW(dbl),
+};
+
+//两个声道、4 字节采样的交错/解交错，SIMD 引擎用得上
+typedef void (*Interleave2Func)(uint8_t *dst, const uint8_t *l, const uint8_t *r, int n);
+typedef void (*Deinterleave2Func)(uint8_t *l, uint8_t *r, const uint8_t *src, int n);
+
+static void interleave2_c(uint8_t *dst, const uint8_t *l, const uint8_t *r, int n)
+{
+    const uint32_t *a = (const uint32_t *)l;
+    const uint32_t *b = (const uint32_t *)r;
+    uint32_t *out = (uint32_t *)dst;
+    for (int i = 0; i < n; i++)
+    {
+        out[2 * i] = a[i];
+        out[2 * i + 1] = b[i];
+    }
+}
+
+static void deinterleave2_c(uint8_t *l, uint8_t *r, const uint8_t *src, int n)
+{
+    const uint32_t *in = (const uint32_t *)src;
+    uint32_t *a = (uint32_t *)l;
+    uint32_t *b = (uint32_t *)r;
+    for (int i = 0; i < n; i++)
+    {
+        a[i] = in[2 * i];
+        b[i] = in[2 * i + 1];
+    }
+}
+
+#if HAVE_X86_SIMD
+//SSE2 / AVX2 内核：主循环之后剩下的不够一个向量的采样交给标量实现
+//flt -> 整数先限幅再转换，避免 cvtps 溢出时返回 0x80000000，结果和 av_clip(lrintf()) 一致
+
+__attribute__((target("sse2"))) static void s16_to_flt_sse2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const int16_t *in = (const int16_t *)src;
+    float *out = (float *)dst;
+    __m128 scale = _mm_set1_ps(1.0f / (1 << 15));
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    conv_s16_to_flt(dst + i * 4, src + i * 2, n - i);
+}
+
+__attribute__((target("sse2"))) static void flt_to_s16_sse2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const float *in = (const float *)src;
+    int16_t *out = (int16_t *)dst;
+    __m128 scale = _mm_set1_ps(1 << 15);
+    __m128 hi = _mm_set1_ps(32767.0f);
+    __m128 lo = _mm_set1_ps(-32768.0f);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), lo), hi);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), lo), hi);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+    conv_flt_to_s16(dst + i * 2, src + i * 4, n - i);
+}
+
+__attribute__((target("sse2"))) static void s32_to_flt_sse2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const int32_t *in = (const int32_t *)src;
+    float *out = (float *)dst;
+    __m128 scale = _mm_set1_ps(1.0f / (1U << 31));
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(in + i))), scale));
+    }
+    conv_s32_to_flt(dst + i * 4, src + i * 4, n - i);
+}
+
+__attribute__((target("sse2"))) static void flt_to_s32_sse2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const float *in = (const float *)src;
+    int32_t *out = (int32_t *)dst;
+    __m128 scale = _mm_set1_ps(1U << 31);
+    __m128 limit = _mm_set1_ps(2147483648.0f);
+    __m128i max = _mm_set1_epi32(INT32_MAX);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+        //负方向溢出时 cvtps 返回 INT32_MIN，正好是限幅的结果；正方向溢出改成 INT32_MAX
+        __m128i over = _mm_castps_si128(_mm_cmpge_ps(v, limit));
+        __m128i r = _mm_cvtps_epi32(v);
+        r = _mm_or_si128(_mm_andnot_si128(over, r), _mm_and_si128(over, max));
+        _mm_storeu_si128((__m128i *)(out + i), r);
+    }
+    conv_flt_to_s32(dst + i * 4, src + i * 4, n - i);
+}
+
+__attribute__((target("sse2"))) static void flt_to_dbl_sse2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const float *in = (const float *)src;
+    double *out = (double *)dst;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(in + i);
+        _mm_storeu_pd(out + i, _mm_cvtps_pd(v));
+        _mm_storeu_pd(out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    conv_flt_to_dbl(dst + i * 8, src + i * 4, n - i);
+}
+
+__attribute__((target("sse2"))) static void dbl_to_flt_sse2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const double *in = (const double *)src;
+    float *out = (float *)dst;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 a = _mm_cvtpd_ps(_mm_loadu_pd(in + i));
+        __m128 b = _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2));
+        _mm_storeu_ps(out + i, _mm_movelh_ps(a, b));
+    }
+    conv_dbl_to_flt(dst + i * 4, src + i * 8, n - i);
+}
+
+__attribute__((target("sse2"))) static void interleave2_sse2(uint8_t *dst, const uint8_t *l, const uint8_t *r, int n)
+{
+    const float *a = (const float *)l;
+    const float *b = (const float *)r;
+    float *out = (float *)dst;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 va = _mm_loadu_ps(a + i);
+        __m128 vb = _mm_loadu_ps(b + i);
+        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(va, vb));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(va, vb));
+    }
+    interleave2_c(dst + i * 8, l + i * 4, r + i * 4, n - i);
+}
+
+__attribute__((target("sse2"))) static void deinterleave2_sse2(uint8_t *l, uint8_t *r, const uint8_t *src, int n)
+{
+    const float *in = (const float *)src;
+    float *a = (float *)l;
+    float *b = (float *)r;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v0 = _mm_loadu_ps(in + 2 * i);
+        __m128 v1 = _mm_loadu_ps(in + 2 * i + 4);
+        _mm_storeu_ps(a + i, _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(b + i, _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    deinterleave2_c(l + i * 4, r + i * 4, src + i * 8, n - i);
+}
+
+__attribute__((target("avx2"))) static void s16_to_flt_avx2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const int16_t *in = (const int16_t *)src;
+    float *out = (float *)dst;
+    __m256 scale = _mm256_set1_ps(1.0f / (1 << 15));
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i a = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+        __m256i b = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i + 8)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(b), scale));
+    }
+    s16_to_flt_sse2(dst + i * 4, src + i * 2, n - i);
+}
+
+__attribute__((target("avx2"))) static void flt_to_s16_avx2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const float *in = (const float *)src;
+    int16_t *out = (int16_t *)dst;
+    __m256 scale = _mm256_set1_ps(1 << 15);
+    __m256 hi = _mm256_set1_ps(32767.0f);
+    __m256 lo = _mm256_set1_ps(-32768.0f);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), lo), hi);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale), lo), hi);
+        //packs 在每个 128 位通道内交错，再把 64 位块排回顺序
+        __m256i r = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(r, 0xD8));
+    }
+    flt_to_s16_sse2(dst + i * 2, src + i * 4, n - i);
+}
+
+__attribute__((target("avx2"))) static void s32_to_flt_avx2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const int32_t *in = (const int32_t *)src;
+    float *out = (float *)dst;
+    __m256 scale = _mm256_set1_ps(1.0f / (1U << 31));
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(in + i))), scale));
+    }
+    s32_to_flt_sse2(dst + i * 4, src + i * 4, n - i);
+}
+
+__attribute__((target("avx2"))) static void flt_to_s32_avx2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const float *in = (const float *)src;
+    int32_t *out = (int32_t *)dst;
+    __m256 scale = _mm256_set1_ps(1U << 31);
+    __m256 limit = _mm256_set1_ps(2147483648.0f);
+    __m256i max = _mm256_set1_epi32(INT32_MAX);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+        __m256i over = _mm256_castps_si256(_mm256_cmp_ps(v, limit, _CMP_GE_OQ));
+        __m256i r = _mm256_blendv_epi8(_mm256_cvtps_epi32(v), max, over);
+        _mm256_storeu_si256((__m256i *)(out + i), r);
+    }
+    flt_to_s32_sse2(dst + i * 4, src + i * 4, n - i);
+}
+
+__attribute__((target("avx2"))) static void flt_to_dbl_avx2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const float *in = (const float *)src;
+    double *out = (double *)dst;
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_pd(out + i, _mm256_cvtps_pd(_mm_loadu_ps(in + i)));
+        _mm256_storeu_pd(out + i + 4, _mm256_cvtps_pd(_mm_loadu_ps(in + i + 4)));
+    }
+    flt_to_dbl_sse2(dst + i * 8, src + i * 4, n - i);
+}
+
+__attribute__((target("avx2"))) static void dbl_to_flt_avx2(uint8_t *dst, const uint8_t *src, int n)
+{
+    const double *in = (const double *)src;
+    float *out = (float *)dst;
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128 a = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i));
+        __m128 b = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i + 4));
+        _mm256_storeu_ps(out + i, _mm256_insertf128_ps(_mm256_castps128_ps256(a), b, 1));
+    }
+    dbl_to_flt_sse2(dst + i * 4, src + i * 8, n - i);
+}
+
+__attribute__((target("avx2"))) static void interleave2_avx2(uint8_t *dst, const uint8_t *l, const uint8_t *r, int n)
+{
+    const float *a = (const float *)l;
+    const float *b = (const float *)r;
+    float *out = (float *)dst;
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 va = _mm256_loadu_ps(a + i);
+        __m256 vb = _mm256_loadu_ps(b + i);
+        //unpack 在 128 位通道内进行：lo = a0 b0 a1 b1 | a4 b4 a5 b5，hi = a2 b2 a3 b3 | a6 b6 a7 b7
+        __m256 lo = _mm256_unpacklo_ps(va, vb);
+        __m256 hi = _mm256_unpackhi_ps(va, vb);
+        _mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    interleave2_sse2(dst + i * 8, l + i * 4, r + i * 4, n - i);
+}
+
+__attribute__((target("avx2"))) static void deinterleave2_avx2(uint8_t *l, uint8_t *r, const uint8_t *src, int n)
+{
+    const float *in = (const float *)src;
+    float *a = (float *)l;
+    float *b = (float *)r;
+    __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v0 = _mm256_loadu_ps(in + 2 * i);
+        __m256 v1 = _mm256_loadu_ps(in + 2 * i + 8);
+        //shuffle 之后是 a0 a1 a4 a5 a2 a3 a6 a7，再按 64 位重排
+        __m256 va = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 vb = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm256_storeu_ps(a + i, _mm256_permutevar8x32_ps(va, order));
+        _mm256_storeu_ps(b + i, _mm256_permutevar8x32_ps(vb, order));
+    }
+    deinterleave2_sse2(l + i * 4, r + i * 4, src + i * 8, n - i);
+}
+#endif
+
+typedef struct Kernels
+{
+    ConvertFunc convert[NB_PACKED][NB_PACKED];
+    Interleave2Func interleave2;
+    Deinterleave2Func deinterleave2;
+} Kernels;
+
+//SIMD 引擎没有写的组合为 NULL，这些组合在 CSV 里只有 swr 和 c
+static int get_kernels(enum Engine engine, Kernels *k)
+{
+    memset(k, 0, sizeof(Kernels));
+    if (engine == ENGINE_C)
+    {
+        memcpy(k->convert, c_kernels, sizeof(c_kernels));
+        k->interleave2 = interleave2_c;
+        k->deinterleave2 = deinterleave2_c;
+        return 0;
+    }
+#if HAVE_X86_SIMD
+    int flags = av_get_cpu_flags();
+    if (engine == ENGINE_SSE2 && (flags & AV_CPU_FLAG_SSE2))
+    {
+        k->convert[AV_SAMPLE_FMT_S16][AV_SAMPLE_FMT_FLT] = s16_to_flt_sse2;
+        k->convert[AV_SAMPLE_FMT_FLT][AV_SAMPLE_FMT_S16] = flt_to_s16_sse2;
+        k->convert[AV_SAMPLE_FMT_S32][AV_SAMPLE_FMT_FLT] = s32_to_flt_sse2;
+        k->convert[AV_SAMPLE_FMT_FLT][AV_SAMPLE_FMT_S32] = flt_to_s32_sse2;
+        k->convert[AV_SAMPLE_FMT_FLT][AV_SAMPLE_FMT_DBL] = flt_to_dbl_sse2;
+        k->convert[AV_SAMPLE_FMT_DBL][AV_SAMPLE_FMT_FLT] = dbl_to_flt_sse2;
+        k->interleave2 = interleave2_sse2;
+        k->deinterleave2 = deinterleave2_sse2;
+        return 0;
+    }
+    if (engine == ENGINE_AVX2 && (flags & AV_CPU_FLAG_AVX2))
+    {
+        k->convert[AV_SAMPLE_FMT_S16][AV_SAMPLE_FMT_FLT] = s16_to_flt_avx2;
+        k->convert[AV_SAMPLE_FMT_FLT][AV_SAMPLE_FMT_S16] = flt_to_s16_avx2;
+        k->convert[AV_SAMPLE_FMT_S32][AV_SAMPLE_FMT_FLT] = s32_to_flt_avx2;
+        k->convert[AV_SAMPLE_FMT_FLT][AV_SAMPLE_FMT_S32] = flt_to_s32_avx2;
+        k->convert[AV_SAMPLE_FMT_FLT][AV_SAMPLE_FMT_DBL] = flt_to_dbl_avx2;
+        k->convert[AV_SAMPLE_FMT_DBL][AV_SAMPLE_FMT_FLT] = dbl_to_flt_avx2;
+        k->interleave2 = interleave2_avx2;
+        k->deinterleave2 = deinterleave2_avx2;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+//按字节大小做跨步拷贝：交错 <-> 平面的一个声道
+static void gather(uint8_t *dst, const uint8_t *src, int stride, int bytes, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        memcpy(dst + i * bytes, src + (size_t)i * stride, bytes);
+    }
+}
+
+static void scatter(uint8_t *dst, const uint8_t *src, int stride, int bytes, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        memcpy(dst + (size_t)i * stride, src + i * bytes, bytes);
+    }
+}
+
+//用手写内核完成一次转换，tmp 至少能放一个声道的采样（按 8 字节算）
+//返回 -1 表示这个引擎没有这个组合的内核
+static int convert_with_kernels(const Kernels *k, uint8_t **dst, enum AVSampleFormat dst_fmt,
+                                uint8_t **src, enum AVSampleFormat src_fmt, int channels, int samples, uint8_t *tmp)
+{
+    enum AVSampleFormat di = av_get_packed_sample_fmt(dst_fmt);
+    enum AVSampleFormat si = av_get_packed_sample_fmt(src_fmt);
+    int src_planar = av_sample_fmt_is_planar(src_fmt);
+    int dst_planar = av_sample_fmt_is_planar(dst_fmt);
+    int dst_bytes = av_get_bytes_per_sample(dst_fmt);
+    int src_bytes = av_get_bytes_per_sample(src_fmt);
+    ConvertFunc f = k->convert[si][di];
+
+    //同一种采样类型只改排列：双声道 4 字节有 SIMD 交错/解交错
+    if (si == di && src_planar != dst_planar && channels == 2 && src_bytes == 4 && k->interleave2)
+    {
+        if (dst_planar)
+        {
+            k->deinterleave2(dst[0], dst[1], src[0], samples);
+        }
+        else
+        {
+            k->interleave2(dst[0], src[0], src[1], samples);
+        }
+        return 0;
+    }
+    if (!f)
+    {
+        return -1;
+    }
+    if (src_planar == dst_planar)
+    {
+        //排列相同，每个平面直接转换（交错格式只有一个平面）
+        int planes = src_planar ? channels : 1;
+        int n = src_planar ? samples : samples * channels;
+        for (int c = 0; c < planes; c++)
+        {
+            f(dst[c], src[c], n);
+        }
+    }
+    else if (src_planar)
+    {
+        //平面 -> 交错：每个声道先转换到 tmp，再按跨步写进输出
+        for (int c = 0; c < channels; c++)
+        {
+            f(tmp, src[c], samples);
+            scatter(dst[0] + c * dst_bytes, tmp, dst_bytes * channels, dst_bytes, samples);
+        }
+    }
+    else
+    {
+        //交错 -> 平面：每个声道先按跨步取到 tmp，再转换
+        for (int c = 0; c < channels; c++)
+        {
+            gather(tmp, src[0] + c * src_bytes, src_bytes * channels, src_bytes, samples);
+            f(dst[c], tmp, samples);
+        }
+    }
+    return 0;
+}
+
+//随机输入，浮点故意超出 [-1, 1] 一点，让限幅也被测到
+static void fill_input(uint8_t **data, enum AVSampleFormat fmt, int channels, int samples)
+{
+    uint32_t state = 12345;
+    int planes = av_sample_fmt_is_planar(fmt) ? channels : 1;
+    int n = av_sample_fmt_is_planar(fmt) ? samples : samples * channels;
+    for (int c = 0; c < planes; c++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            state = state * 1664525 + 1013904223;
+            double v = ((int32_t)state) / 2147483648.0 * 1.05;
+            switch (av_get_packed_sample_fmt(fmt))
+            {
+            case AV_SAMPLE_FMT_U8:
+                data[c][i] = (uint8_t)(state >> 24);
+                break;
+            case AV_SAMPLE_FMT_S16:
+                ((int16_t *)data[c])[i] = (int16_t)(state >> 16);
+                break;
+            case AV_SAMPLE_FMT_S32:
+                ((int32_t *)data[c])[i] = (int32_t)state;
+                break;
+            case AV_SAMPLE_FMT_FLT:
+                ((float *)data[c])[i] = (float)v;
+                break;
+            default:
+                ((double *)data[c])[i] = v;
+                break;
+            }
+        }
+    }
+}
+
+static int parse_list(const char *arg, int *list, int max)
+{
+    int n = 0;
+    const char *p = arg;
+    while (n < max && *p)
+    {
+        char *end;
+        list[n] = (int)strtol(p, &end, 10);
+        if (end == p)
+        {
+            break;
+        }
+        n++;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+static int buffers_equal(uint8_t **a, uint8_t **b, enum AVSampleFormat fmt, int channels, int samples)
+{
+    int planes = av_sample_fmt_is_planar(fmt) ? channels : 1;
+    int size = av_samples_get_buffer_size(NULL, channels, samples, fmt, 1) / planes;
+    for (int c = 0; c < planes; c++)
+    {
+        if (memcmp(a[c], b[c], size))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
 
 int main(int argc, char *argv[])
 {
 
     av_log_set_level(AV_LOG_INFO);
 
-    enum AVSampleFormat format = AV_SAMPLE_FMT_S16;
+    int channel_list[MAX_LIST] = {1, 2, 6};
+    int nb_channels = 3;
+    int sample_list[MAX_LIST] = {256, 1024, 4096};
+    int nb_samples = 3;
+    int64_t budget = DEFAULT_BUDGET;
+    const char *output = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-channels") && i + 1 < argc)
+        {
+            nb_channels = parse_list(argv[++i], channel_list, MAX_LIST);
+        }
+        else if (!strcmp(argv[i], "-samples") && i + 1 < argc)
+        {
+            nb_samples = parse_list(argv[++i], sample_list, MAX_LIST);
+        }
+        else if (!strcmp(argv[i], "-budget") && i + 1 < argc)
+        {
+            budget = atoll(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+    }
+    for (int i = 0; i < nb_channels; i++)
+    {
+        if (channel_list[i] < 1 || channel_list[i] > MAX_CHANNELS)
+        {
+            av_log(NULL, AV_LOG_ERROR, "channels must be 1 ~ %d.\n", MAX_CHANNELS);
+            return -1;
+        }
+    }
+    int max_samples = 0;
+    for (int i = 0; i < nb_samples; i++)
+    {
+        if (sample_list[i] < 1)
+        {
+            av_log(NULL, AV_LOG_ERROR, "invalid -samples.\n");
+            return -1;
+        }
+        max_samples = FFMAX(max_samples, sample_list[i]);
+    }
 
-    char *name = av_get_sample_fmt_name(format);
-    av_log(NULL, AV_LOG_INFO, "av_get_sample_fmt_name name = %s.\n", name);
+    //格式一览，以前的 av_get_sample_fmt_name / av_get_bytes_per_sample 示例
+    for (int f = 0; f < AV_SAMPLE_FMT_NB; f++)
+    {
+        if (f == AV_SAMPLE_FMT_S64 || f == AV_SAMPLE_FMT_S64P)
+        {
+            continue;
+        }
+        av_log(NULL, AV_LOG_INFO, "%-5s bytes = %d, planar = %d.\n", av_get_sample_fmt_name(f), av_get_bytes_per_sample(f),
+               av_sample_fmt_is_planar(f));
+    }
 
-    int byte_count = av_get_bytes_per_sample(format);
-    av_log(NULL, AV_LOG_INFO, "av_get_bytes_per_sample byte_count = %d.\n", byte_count);
+    Kernels kernels[NB_ENGINES];
+    int have_engine[NB_ENGINES] = {1};
+    for (int e = ENGINE_C; e < NB_ENGINES; e++)
+    {
+        have_engine[e] = get_kernels(e, &kernels[e]) == 0;
+        if (!have_engine[e])
+        {
+            av_log(NULL, AV_LOG_WARNING, "%s not supported on this cpu.\n", engine_names[e]);
+        }
+    }
 
-    // av_samples_get_buffer_size();
+    FILE *fp = output ? fopen(output, "w") : stdout;
+    if (!fp)
+    {
+        av_log(NULL, AV_LOG_ERROR, "can't open %s.\n", output);
+        return -1;
+    }
+    fprintf(fp, "engine,src_fmt,dst_fmt,channels,samples,iterations,ns_per_call,msamples_per_sec,speedup_vs_swr,match_swr\n");
 
-    return 0;
-}
\ No newline at end of file
+    int ret = 0;
+    uint8_t **src = NULL;
+    uint8_t **dst = NULL;
+    uint8_t **ref = NULL;
+    uint8_t *tmp = av_malloc((size_t)max_samples * 8);
+    //10 种格式：5 种交错 + 5 种平面，S64 不测
+    enum AVSampleFormat fmts[] = {AV_SAMPLE_FMT_U8, AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_DBL,
+                                  AV_SAMPLE_FMT_U8P, AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S32P, AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_DBLP};
+    int nb_fmts = sizeof(fmts) / sizeof(fmts[0]);
+    if (!tmp)
+    {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (int ci = 0; ci < nb_channels; ci++)
+    {
+        int channels = channel_list[ci];
+        int64_t layout = av_get_default_channel_layout(channels);
+        for (int si = 0; si < nb_samples; si++)
+        {
+            int samples = sample_list[si];
+            int iterations = (int)FFMAX(1, budget / ((int64_t)samples * channels));
+            for (int a = 0; a < nb_fmts; a++)
+            {
+                for (int b = 0; b < nb_fmts; b++)
+                {
+                    enum AVSampleFormat src_fmt = fmts[a];
+                    enum AVSampleFormat dst_fmt = fmts[b];
+                    if (av_samples_alloc_array_and_samples(&src, NULL, channels, samples, src_fmt, 0) < 0 ||
+                        av_samples_alloc_array_and_samples(&dst, NULL, channels, samples, dst_fmt, 0) < 0 ||
+                        av_samples_alloc_array_and_samples(&ref, NULL, channels, samples, dst_fmt, 0) < 0)
+                    {
+                        ret = AVERROR(ENOMEM);
+                        goto end;
+                    }
+                    fill_input(src, src_fmt, channels, samples);
+
+                    //采样率和布局不变，swresample 只做格式转换
+                    SwrContext *swr = swr_alloc_set_opts(NULL, layout, dst_fmt, 48000, layout, src_fmt, 48000, 0, NULL);
+                    //9 ~ 15 声道没有默认布局（layout 是 0），直接给声道数
+                    if (swr)
+                    {
+                        av_opt_set_int(swr, "ich", channels, 0);
+                        av_opt_set_int(swr, "och", channels, 0);
+                    }
+                    if (!swr || swr_init(swr) < 0)
+                    {
+                        av_log(NULL, AV_LOG_ERROR, "swr_init %s -> %s failed.\n", av_get_sample_fmt_name(src_fmt), av_get_sample_fmt_name(dst_fmt));
+                        swr_free(&swr);
+                        ret = -1;
+                        goto end;
+                    }
+                    //先转换一次当参考结果，顺便预热
+                    swr_convert(swr, ref, samples, (const uint8_t **)src, samples);
+                    double swr_ns = 0;
+                    for (int e = 0; e < NB_ENGINES; e++)
+                    {
+                        if (!have_engine[e])
+                        {
+                            continue;
+                        }
+                        int match = 1;
+                        if (e != ENGINE_SWR)
+                        {
+                            if (convert_with_kernels(&kernels[e], dst, dst_fmt, src, src_fmt, channels, samples, tmp) < 0)
+                            {
+                                continue;
+                            }
+                            match = buffers_equal(dst, ref, dst_fmt, channels, samples);
+                        }
+                        int64_t start = av_gettime_relative();
+                        for (int n = 0; n < iterations; n++)
+                        {
+                            if (e == ENGINE_SWR)
+                            {
+                                swr_convert(swr, dst, samples, (const uint8_t **)src, samples);
+                            }
+                            else
+                            {
+                                convert_with_kernels(&kernels[e], dst, dst_fmt, src, src_fmt, channels, samples, tmp);
+                            }
+                        }
+                        double ns = (av_gettime_relative() - start) * 1000.0 / iterations;
+                        if (e == ENGINE_SWR)
+                        {
+                            swr_ns = ns;
+                        }
+                        fprintf(fp, "%s,%s,%s,%d,%d,%d,%.1f,%.1f,%.2f,%d\n", engine_names[e],
+                                av_get_sample_fmt_name(src_fmt), av_get_sample_fmt_name(dst_fmt), channels, samples, iterations, ns,
+                                ns > 0 ? (double)samples * channels / ns * 1000.0 : 0, ns > 0 ? swr_ns / ns : 0, match);
+                    }
+                    swr_free(&swr);
+                    av_freep(&src[0]);
+                    av_freep(&src);
+                    av_freep(&dst[0]);
+                    av_freep(&dst);
+                    av_freep(&ref[0]);
+                    av_freep(&ref);
+                }
+            }
+            av_log(NULL, AV_LOG_INFO, "channels = %d, samples = %d done.\n", channels, samples);
+        }
+    }
+
+end:
+    if (src)
+    {
+        av_freep(&src[0]);
+        av_freep(&src);
+    }
+    if (dst)
+    {
+        av_freep(&dst[0]);
+        av_freep(&dst);
+    }
+    if (ref)
+    {
+        av_freep(&ref[0]);
+        av_freep(&ref);
+    }
+    av_freep(&tmp);
+    if (fp && fp != stdout)
+    {
+        fclose(fp);
+    }
+
+    return ret < 0 ? 1 : 0;
+}
@@ -1,11 +1,10 @@
 #include <libavutil/log.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
-#include <libswresample/swresample.h>
 #include <SDL2/SDL.h>
-
-#define SDL_AUDIO_BUFFER_SIZE 1024
-#define MAX_AUDIO_FRAME_SIZE 192000
+#include <string.h>
+#include "audio_engine.h"
+#include "audio_output.h"
 
 typedef struct Decoder
 {
@@ -13,184 +12,6 @@ typedef struct Decoder
   AVCodecContext *decode_ctx;
 } Decoder;
 
-typedef struct PacketQueue
-{
-  AVPacketList *first_pkt, *last_pkt;
-  int nb_packets;
-  int size;
-  SDL_mutex *mutex;
-  SDL_cond *cond;
-} PacketQueue;
-
-PacketQueue audioq;
-
-SwrContext *swr_ctx;
-
-int quit = 0;
-
-//for event
-SDL_Event event;
-
-void packet_queue_init(PacketQueue *q)
-{
-  memset(q, 0, sizeof(PacketQueue));
-  q->mutex = SDL_CreateMutex();
-  q->cond = SDL_CreateCond();
-}
-
-int packet_queue_put(PacketQueue *q, AVPacket *pkt)
-{
-
-  AVPacketList *pkt1;
-  if (av_dup_packet(pkt) < 0)
-  {
-    return -1;
-  }
-  pkt1 = av_malloc(sizeof(AVPacketList));
-  if (!pkt1)
-    return -1;
-  pkt1->pkt = *pkt;
-  pkt1->next = NULL;
-
-  SDL_LockMutex(q->mutex);
-
-  if (!q->last_pkt)
-  {
-    q->first_pkt = pkt1;
-  }
-  else
-  {
-    q->last_pkt->next = pkt1;
-  }
-
-  q->last_pkt = pkt1;
-  q->nb_packets++;
-  q->size += pkt1->pkt.size;
-  SDL_CondSignal(q->cond);
-
-  SDL_UnlockMutex(q->mutex);
-  return 0;
-}
-
-int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
-{
-  AVPacketList *pkt1;
-  int ret;
-
-  SDL_LockMutex(q->mutex);
-
-  for (;;)
-  {
-
-    if (quit)
-    {
-      ret = -1;
-      break;
-    }
-
-    pkt1 = q->first_pkt;
-    if (pkt1)
-    {
-      q->first_pkt = pkt1->next;
-      if (!q->first_pkt)
-        q->last_pkt = NULL;
-      q->nb_packets--;
-      q->size -= pkt1->pkt.size;
-      *pkt = pkt1->pkt;
-      av_free(pkt1);
-      ret = 1;
-      break;
-    }
-    else if (!block)
-    {
-      ret = 0;
-      break;
-    }
-    else
-    {
-      SDL_CondWait(q->cond, q->mutex);
-    }
-  }
-  SDL_UnlockMutex(q->mutex);
-  return ret;
-}
-
-static Uint8 *audio_chunk;
-static Uint32 audio_len;
-static Uint8 *audio_pos;
-int pcm_buffer_size = 4096;
-
-int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_size)
-{
-
-  static AVPacket pkt;
-  static uint8_t *audio_pkt_data = NULL;
-  static int audio_pkt_size = 0;
-  static AVFrame frame;
-
-  int len1, data_size = 0;
-
-  for (;;)
-  {
-    while (audio_pkt_size > 0)
-    {
-      int got_frame = 0;
-      len1 = avcodec_decode_audio4(aCodecCtx, &frame, &got_frame, &pkt);
-      if (len1 < 0)
-      {
-        /* if error, skip frame */
-        audio_pkt_size = 0;
-        break;
-      }
-      audio_pkt_data += len1;
-      audio_pkt_size -= len1;
-      data_size = 0;
-      if (got_frame)
-      {
-        //fprintf(stderr, "channels:%d, nb_samples:%d, sample_fmt:%d \n", aCodecCtx->channels, frame.nb_samples, aCodecCtx->sample_fmt);
-        /*
-	data_size = av_samples_get_buffer_size(NULL, 
-					       aCodecCtx->channels,
-					       frame.nb_samples,
-					       aCodecCtx->sample_fmt,
-					       1);
-        */
-        data_size = 2 * 2 * frame.nb_samples;
-
-        // assert(data_size <= buf_size);
-        swr_convert(swr_ctx,
-                    &audio_buf,
-                    MAX_AUDIO_FRAME_SIZE * 3 / 2,
-                    (const uint8_t **)frame.data,
-                    frame.nb_samples);
-
-        //memcpy(audio_buf, frame.data[0], data_size);
-      }
-      if (data_size <= 0)
-      {
-        /* No data yet, get more frames */
-        continue;
-      }
-      /* We have data, return it and come back for more later */
-      return data_size;
-    }
-    if (pkt.data)
-      av_free_packet(&pkt);
-
-    if (quit)
-    {
-      return -1;
-    }
-
-    if (packet_queue_get(&audioq, &pkt, 1) < 0)
-    {
-      return -1;
-    }
-    audio_pkt_data = pkt.data;
-    audio_pkt_size = pkt.size;
-  }
-}
-
 //回调函数，音频设备需要更多数据的时候会调用该回调函数
 // static void audio_callback(void *udata, Uint8 *stream, int len)
 // {
@@ -204,53 +25,6 @@ int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_si
 //     audio_len -= len;
 // }
 
-void audio_callback(void *userdata, Uint8 *stream, int len)
-{
-
-  av_log(NULL, AV_LOG_INFO, "audio_callback.\n");
-
-  AVCodecContext *aCodecCtx = (AVCodecContext *)userdata;
-  int len1, audio_size;
-
-  static uint8_t audio_buf[(MAX_AUDIO_FRAME_SIZE * 3) / 2];
-  static unsigned int audio_buf_size = 0;
-  static unsigned int audio_buf_index = 0;
-
-  while (len > 0)
-  {
-    if (audio_buf_index >= audio_buf_size)
-    {
-      /* We have already sent all our data; get more */
-      audio_size = audio_decode_frame(aCodecCtx, audio_buf, sizeof(audio_buf));
-      av_log(NULL, AV_LOG_INFO, "audio_decode_frame audio_size = %d.\n", audio_size);
-      if (audio_size < 0)
-      {
-        /* If error, output silence */
-        audio_buf_size = 1024; // arbitrary?
-        memset(audio_buf, 0, audio_buf_size);
-      }
-      else
-      {
-        audio_buf_size = audio_size;
-      }
-      audio_buf_index = 0;
-    }
-    len1 = audio_buf_size - audio_buf_index;
-    if (len1 > len)
-      len1 = len;
-    // fprintf(stderr, "index=%d, len1=%d, len=%d\n",
-    //         audio_buf_index,
-    //         len,
-    //         len1);
-    memcpy(stream, (uint8_t *)audio_buf + audio_buf_index, len1);
-    // SDL_MixAudio(stream,(uint8_t *)audio_buf + audio_buf_index,len1,SDL_MIX_MAXVOLUME);
-    // SDL_MixAudio(stream,(uint8_t *)audio_buf,len1,SDL_MIX_MAXVOLUME);
-    len -= len1;
-    stream += len1;
-    audio_buf_index += len1;
-  }
-}
-
 static int init_audio_decoder(Decoder *decoder, AVCodecParameters *parameters)
 {
   AVCodec *decodec = avcodec_find_decoder(parameters->codec_id);
@@ -272,16 +46,74 @@ static int init_audio_decoder(Decoder *decoder, AVCodecParameters *parameters)
   return 0;
 }
 
-static int init_swr_ctx(SwrContext *swr_ctx)
+//-gain 0.5,1,0.8：按顺序设置每一路的增益，没有给的是 1
+static void parse_gains(const char *arg, float *gains, int max)
 {
-
-  return 0;
+  const char *p = arg;
+  for (int i = 0; i < max && *p; i++)
+  {
+    char *end;
+    gains[i] = strtof(p, &end);
+    if (end == p || *end != ',')
+    {
+      break;
+    }
+    p = end + 1;
+  }
 }
 
 int main(int argc, char *argv[])
 {
-
-  if (argc != 2)
+  //./sdl_play_audio [-audio_period samples] [-audio_buffer ms] [-audio_push] [-audio_device name]
+  //                 [-mix] [-gain g1,g2,...] [-mix_impl auto|scalar|sse2|avx2] url
+  char *input_url = NULL;
+  //音频设备的周期和解码缓冲决定了音频延迟
+  AudioOutputConfig audio_config;
+  audio_output_config_default(&audio_config);
+  //-mix 把所有音频流混成一路播放，否则只播放最后一路
+  int mix = 0;
+  enum AudioMixImpl mix_impl = AUDIO_MIX_AUTO;
+  float gains[AUDIO_MIXER_MAX_TRACKS];
+  for (int i = 0; i < AUDIO_MIXER_MAX_TRACKS; i++)
+  {
+    gains[i] = 1.0f;
+  }
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-audio_period") && i + 1 < argc)
+    {
+      audio_config.period_samples = atoi(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "-audio_buffer") && i + 1 < argc)
+    {
+      audio_config.buffer_ms = atoi(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "-audio_push"))
+    {
+      audio_config.mode = AUDIO_OUTPUT_PUSH;
+    }
+    else if (!strcmp(argv[i], "-audio_device") && i + 1 < argc)
+    {
+      audio_config.device = argv[++i];
+    }
+    else if (!strcmp(argv[i], "-mix"))
+    {
+      mix = 1;
+    }
+    else if (!strcmp(argv[i], "-gain") && i + 1 < argc)
+    {
+      parse_gains(argv[++i], gains, AUDIO_MIXER_MAX_TRACKS);
+    }
+    else if (!strcmp(argv[i], "-mix_impl") && i + 1 < argc)
+    {
+      mix_impl = audio_mix_impl_from_name(argv[++i]);
+    }
+    else
+    {
+      input_url = argv[i];
+    }
+  }
+  if (!input_url)
   {
     av_log(NULL, AV_LOG_ERROR, "without input url.\n");
     return -1;
@@ -289,10 +121,21 @@ int main(int argc, char *argv[])
 
   av_register_all();
 
-  char *input_url = argv[1];
   av_log(NULL, AV_LOG_INFO, "input_url = %s.\n", input_url);
 
   AVFormatContext *input_format_ctx = NULL;
+  //每一路音频一个解码器和一个引擎，包队列、解码线程、重采样、PCM 缓冲都在引擎里
+  Decoder decoders[AUDIO_MIXER_MAX_TRACKS];
+  AudioEngine engines[AUDIO_MIXER_MAX_TRACKS];
+  int stream_indexes[AUDIO_MIXER_MAX_TRACKS];
+  int nb_tracks = 0;
+  AudioMixer mixer = {0};
+  AudioOutput audio_output = {0};
+  AVPacket *packet = NULL;
+  //for event
+  SDL_Event event = {0};
+  memset(decoders, 0, sizeof(decoders));
+  memset(engines, 0, sizeof(engines));
 
   int ret;
   ret = avformat_open_input(&input_format_ctx, input_url, NULL, NULL);
@@ -316,8 +159,6 @@ int main(int argc, char *argv[])
     goto end;
   }
 
-  Decoder *audio_decoder = (Decoder *)malloc(sizeof(Decoder));
-  int audio_stream_index = 0;
   for (int i = 0; i < stream_num; i++)
   {
     AVStream *stream = input_format_ctx->streams[i];
@@ -329,9 +170,20 @@ int main(int argc, char *argv[])
     {
       continue;
     }
+    if (nb_tracks == AUDIO_MIXER_MAX_TRACKS)
+    {
+      av_log(NULL, AV_LOG_WARNING, "too many audio streams, skip stream %d.\n", index);
+      continue;
+    }
+    //不混音时只保留最后一路
+    if (!mix && nb_tracks > 0)
+    {
+      avcodec_free_context(&decoders[0].decode_ctx);
+      nb_tracks = 0;
+    }
 
-    audio_stream_index = index;
-    av_log(NULL, AV_LOG_INFO, "audio_stream_index = %d,format = %d\n", audio_stream_index, parameters->format);
+    Decoder *audio_decoder = &decoders[nb_tracks];
+    av_log(NULL, AV_LOG_INFO, "audio_stream_index = %d,format = %d\n", index, parameters->format);
 
     ret = init_audio_decoder(audio_decoder, parameters);
     av_log(NULL, AV_LOG_INFO, "init_audio_decoder ret = %d\n", ret);
@@ -339,101 +191,106 @@ int main(int argc, char *argv[])
     {
       goto end;
     }
+    stream_indexes[nb_tracks++] = index;
 
     ret = avcodec_open2(audio_decoder->decode_ctx, audio_decoder->decodec, NULL);
     av_log(NULL, AV_LOG_INFO, "avcodec_open2 ret = %d.\n", ret);
+    if (ret < 0)
+    {
+      goto end;
+    }
   }
-
-  /* create resampler context */
-  // SwrContext *swr_ctx = swr_alloc();
-  swr_ctx = swr_alloc();
-  if (!swr_ctx)
+  if (nb_tracks == 0)
   {
-    fprintf(stderr, "Could not allocate resampler context\n");
-    ret = AVERROR(ENOMEM);
+    av_log(NULL, AV_LOG_ERROR, "no audio stream.\n");
     goto end;
   }
 
-  int src_ch_layout = audio_decoder->decode_ctx->channel_layout;
-  int dst_ch_layout = src_ch_layout;
-  int src_rate = audio_decoder->decode_ctx->sample_rate;
-  int dst_rate = src_rate;
-  enum AVSampleFormat src_sample_fmt = AV_SAMPLE_FMT_FLTP;
-  enum AVSampleFormat dst_sample_fmt = AV_SAMPLE_FMT_S16;
-
-  /* set options */
-  swr_alloc_set_opts(swr_ctx,
-                     dst_ch_layout,
-                     dst_sample_fmt,
-                     dst_rate,
-                     src_ch_layout,
-                     src_sample_fmt,
-                     src_rate,
-                     0,
-                     NULL);
-
-  /* initialize the resampling context */
-  if ((ret = swr_init(swr_ctx)) < 0)
+  //重采样在打开音频设备、知道设备格式之后再配置，SDL 不再转换
+  for (int i = 0; i < nb_tracks; i++)
   {
-    av_log(NULL, AV_LOG_INFO, "swr_init ret = %d.\n", ret);
-    goto end;
+    ret = audio_engine_init(&engines[i], decoders[i].decode_ctx);
+    if (ret < 0)
+    {
+      av_log(NULL, AV_LOG_ERROR, "audio_engine_init ret = %d.\n", ret);
+      goto end;
+    }
+  }
+  //只有一路时不经过混音器
+  if (nb_tracks > 1)
+  {
+    if (audio_mixer_init(&mixer, mix_impl) < 0)
+    {
+      goto end;
+    }
+    for (int i = 0; i < nb_tracks; i++)
+    {
+      audio_mixer_add_track(&mixer, &engines[i], gains[i]);
+      av_log(NULL, AV_LOG_INFO, "mix track %d: stream %d, gain = %.2f.\n", i, stream_indexes[i], gains[i]);
+    }
   }
 
   if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_TIMER))
   {
-    av_log(AV_LOG_ERROR, "Could not initialize SDL - %s\n", SDL_GetError());
-    return -1;
+    av_log(NULL, AV_LOG_ERROR, "Could not initialize SDL - %s\n", SDL_GetError());
+    goto end;
   }
 
-  //test.pcm 对应的信息如下
-  SDL_AudioSpec spec;
-  spec.freq = audio_decoder->decode_ctx->sample_rate;
-  //AV_SAMPLE_FMT_FLTP
-  spec.format = AUDIO_S16SYS;
-  spec.channels = audio_decoder->decode_ctx->channels;
-  spec.silence = 0;
-  spec.samples = 1024;
-  spec.callback = audio_callback;
-  // spec.userdata = NULL;
-  spec.userdata = audio_decoder->decode_ctx;
-
-  if (SDL_OpenAudio(&spec, NULL) < 0)
+  //pull 模式由 SDL 调用 audio_engine_callback / audio_mixer_callback，push 模式由输出线程 SDL_QueueAudio
+  ret = nb_tracks > 1 ? audio_output_open_mixer(&audio_output, &mixer, &audio_config)
+                      : audio_output_open(&audio_output, &engines[0], &audio_config);
+  if (ret < 0)
   {
     av_log(NULL, AV_LOG_ERROR, "can't open audio.\n");
-    return -1;
+    goto end;
   }
 
-  packet_queue_init(&audioq);
+  //音频解码线程先把环形缓冲填上，再开始播放
+  for (int i = 0; i < nb_tracks; i++)
+  {
+    if (audio_engine_start(&engines[i]) < 0)
+    {
+      goto end;
+    }
+  }
 
-  AVPacket *packet = av_packet_alloc();
-  AVFrame *frame = av_frame_alloc();
+  packet = av_packet_alloc();
 
   //播放
-  SDL_PauseAudio(0);
+  audio_output_pause(&audio_output, 0);
 
   while (av_read_frame(input_format_ctx, packet) >= 0)
   {
     // av_log(NULL, AV_LOG_INFO, "av_read_frame packet->stream_index = %d\n", packet->stream_index);
-    if (packet->stream_index != audio_stream_index)
+    int track = -1;
+    for (int i = 0; i < nb_tracks; i++)
     {
+      if (packet->stream_index == stream_indexes[i])
+      {
+        track = i;
+        break;
+      }
+    }
+    if (track < 0)
+    {
+      av_packet_unref(packet);
       continue;
     }
 
-    packet_queue_put(&audioq, packet);
+    audio_engine_put_packet(&engines[track], packet);
     // av_packet_unref(packet);
 
-    //延迟一下，以免太快结束
-    SDL_Delay(10);
+    //延迟一下，以免太快结束，多路时按路数分摊
+    SDL_Delay(10 / nb_tracks);
+    audio_output_sample(&audio_output);
 
-    SDL_PollEvent(&event);
-    switch (event.type)
+    //没有事件时 event 不会被写入，只处理真正取到的事件
+    while (SDL_PollEvent(&event))
     {
-    case SDL_QUIT:
-      quit = 1;
-      goto __QUIT;
-      break;
-    default:
-      break;
+      if (event.type == SDL_QUIT)
+      {
+        goto __QUIT;
+      }
     }
   }
 
@@ -444,29 +301,33 @@ __QUIT:
   ret = 0;
 end:
   av_log(NULL, AV_LOG_INFO, "goto end.\n");
+  //先停止解码线程和音频设备，再释放引擎和解码器
+  for (int i = 0; i < nb_tracks; i++)
+  {
+    audio_engine_stop(&engines[i]);
+  }
+  audio_output_log_stats(&audio_output);
+  audio_output_close(&audio_output);
+  if (nb_tracks > 1)
+  {
+    audio_mixer_log_stats(&mixer);
+  }
+  audio_mixer_free(&mixer);
+  for (int i = 0; i < nb_tracks; i++)
+  {
+    audio_engine_log_stats(&engines[i], "sdl_play_audio");
+    audio_engine_destroy(&engines[i]);
+    avcodec_free_context(&decoders[i].decode_ctx);
+  }
   if (input_format_ctx)
   {
     avformat_close_input(&input_format_ctx);
     avformat_free_context(input_format_ctx);
     input_format_ctx = NULL;
   }
-  if (audio_decoder)
-  {
-    if (audio_decoder->decode_ctx)
-    {
-      avcodec_free_context(&audio_decoder->decode_ctx);
-      audio_decoder->decode_ctx = NULL;
-      free(audio_decoder);
-    }
-    audio_decoder = NULL;
-  }
   if (packet)
   {
-    av_free_packet(packet);
-  }
-  if (frame)
-  {
-    av_frame_free(&frame);
+    av_packet_free(&packet);
   }
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,137 @@
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/avstring.h>
+#include <libavutil/error.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "batch_files.h"
+
+int batch_submit_file(BatchFiles *batch, const char *path)
+{
+    BatchJob *job = (BatchJob *)av_mallocz(sizeof(BatchJob));
+    if (!job)
+    {
+        return AVERROR(ENOMEM);
+    }
+    job->opaque = batch->opaque;
+    job->path = av_strdup(path);
+    if (!job->path)
+    {
+        av_free(job);
+        return AVERROR(ENOMEM);
+    }
+    int ret = thread_pool_submit(batch->pool, batch->func, job);
+    if (ret < 0)
+    {
+        batch_job_free(job);
+    }
+    return ret;
+}
+
+//边遍历边提交，线程池排满时等空位，不用先把所有路径都收集起来。
+//命令行给的路径跟随符号链接；遍历中遇到指向目录的符号链接跳过（dir/loop -> .. 会无限递归，
+//每一层都把所有文件再提交一遍），指向文件的照常处理
+static void submit_path(BatchFiles *batch, const char *path, int top)
+{
+    struct stat st;
+    if ((top ? stat(path, &st) : lstat(path, &st)) < 0)
+    {
+        batch_submit_file(batch, path);
+        return;
+    }
+    if (S_ISLNK(st.st_mode) && (stat(path, &st) < 0 || S_ISDIR(st.st_mode)))
+    {
+        return;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        if (S_ISREG(st.st_mode))
+        {
+            batch_submit_file(batch, path);
+        }
+        return;
+    }
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        av_log(NULL, AV_LOG_ERROR, "opendir %s fail.\n", path);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        //跳过 . .. 和隐藏文件
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        char *child = av_asprintf("%s/%s", path, entry->d_name);
+        if (child)
+        {
+            submit_path(batch, child, 0);
+            av_free(child);
+        }
+    }
+    closedir(dir);
+}
+
+void batch_submit_path(BatchFiles *batch, const char *path)
+{
+    submit_path(batch, path, 1);
+}
+
+void batch_submit_list(BatchFiles *batch, const char *list)
+{
+    FILE *fp = strcmp(list, "-") ? fopen(list, "r") : stdin;
+    if (!fp)
+    {
+        av_log(NULL, AV_LOG_ERROR, "can't open list %s.\n", list);
+        return;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), fp))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0])
+        {
+            batch_submit_path(batch, line);
+        }
+    }
+    if (fp != stdin)
+    {
+        fclose(fp);
+    }
+}
+
+void batch_job_free(BatchJob *job)
+{
+    if (job)
+    {
+        av_free(job->path);
+        av_free(job);
+    }
+}
+
+void json_string(AVBPrint *bp, const char *s)
+{
+    av_bprint_chars(bp, '"', 1);
+    for (; s && *s; s++)
+    {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+        {
+            av_bprintf(bp, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            av_bprintf(bp, "\\u%04x", c);
+        }
+        else
+        {
+            av_bprint_chars(bp, c, 1);
+        }
+    }
+    av_bprint_chars(bp, '"', 1);
+}
@@ -0,0 +1,36 @@
+#ifndef BATCH_FILES_H
+#define BATCH_FILES_H
+
+#include <libavutil/bprint.h>
+#include "thread_pool.h"
+
+//批量处理文件的工具共用：把命令行里的文件、目录（递归）和 -list 列表展开成线程池任务，
+//每个文件一个 BatchJob，任务函数处理完调用 batch_job_free
+
+typedef struct BatchJob
+{
+    //BatchFiles.opaque，一般是整次运行的状态
+    void *opaque;
+    char *path;
+} BatchJob;
+
+typedef struct BatchFiles
+{
+    ThreadPool *pool;
+    //参数是 BatchJob *
+    ThreadPoolFunc func;
+    void *opaque;
+} BatchFiles;
+
+//提交一个文件（或 url），返回 0 成功
+int batch_submit_file(BatchFiles *batch, const char *path);
+//目录递归展开，跳过隐藏文件和目录里指向目录的符号链接；stat 失败的当作 url 交给 libavformat
+void batch_submit_path(BatchFiles *batch, const char *path);
+//list 文件里一行一个路径，"-" 从标准输入读
+void batch_submit_list(BatchFiles *batch, const char *list);
+void batch_job_free(BatchJob *job);
+
+//JSON 字符串转义，控制字符用 \u00XX
+void json_string(AVBPrint *bp, const char *s);
+
+#endif
@@ -0,0 +1,656 @@
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "probe_cache.h"
+
+//./bitstream_info [-stream n] [-frames] [-gops] [-probe_cache file|default|off] input...
+//H.264/HEVC 的码流分析，不解码：解复用之后交给 AVCodecParser 拿帧类型和关键帧标记，
+//再自己扫一遍 NAL 头统计 slice 个数、是否参考帧、SEI 类型，HEVC 还有 NAL 类型和 temporal id。
+//用来看 GOP 结构（长度、开放/封闭、B 帧个数、B 帧是否做参考），选切片边界和编码参数
+
+//每帧统计 SEI 类型的位图，更大的类型只计入汇总
+#define SEI_MASK_TYPES 64
+#define SEI_MAX_TYPES 256
+
+//H.264 NAL 类型
+#define H264_NAL_SLICE 1
+#define H264_NAL_IDR 5
+#define H264_NAL_SEI 6
+//HEVC NAL 类型
+#define HEVC_NAL_RADL_N 6
+#define HEVC_NAL_RASL_R 9
+#define HEVC_NAL_IDR_W_RADL 19
+#define HEVC_NAL_IDR_N_LP 20
+#define HEVC_NAL_IRAP_END 23
+#define HEVC_NAL_SEI_PREFIX 39
+#define HEVC_NAL_SEI_SUFFIX 40
+
+typedef struct FrameInfo
+{
+    int64_t pts;
+    int64_t dts;
+    int64_t pos;
+    int size;
+    //I、P、B，parser 没给出类型时是 ?
+    char type;
+    uint8_t key;
+    uint8_t idr;
+    //被其他帧参考：H.264 的 nal_ref_idc 不为 0，HEVC 不是 *_N 类型
+    uint8_t ref;
+    //HEVC 的 RASL/RADL
+    uint8_t leading;
+    uint8_t temporal_id;
+    //第一个 slice 的 NAL 类型
+    uint8_t nal_type;
+    uint16_t slices;
+    uint64_t sei;
+} FrameInfo;
+
+typedef struct BitstreamInfo
+{
+    enum AVCodecID codec_id;
+    //avcC/hvcC 里的长度字段字节数，0 表示 Annex B 起始码
+    int nal_length_size;
+    FrameInfo *frames;
+    int nb_frames;
+    int frames_size;
+    int64_t sei_counts[SEI_MAX_TYPES];
+    //SEI 去掉防竞争字节之后的缓冲
+    uint8_t *rbsp;
+    unsigned rbsp_size;
+} BitstreamInfo;
+
+static const char *sei_name(int type)
+{
+    switch (type)
+    {
+    case 0:
+        return "buffering_period";
+    case 1:
+        return "pic_timing";
+    case 4:
+        return "user_data_registered";
+    case 5:
+        return "user_data_unregistered";
+    case 6:
+        return "recovery_point";
+    case 137:
+        return "mastering_display_colour_volume";
+    case 144:
+        return "content_light_level";
+    case 147:
+        return "alternative_transfer";
+    default:
+        return "other";
+    }
+}
+
+//avcC 第一个字节是 1，长度字段字节数在第 5 个字节；hvcC 在第 22 个字节。其余按 Annex B 处理
+static int nal_length_size(const AVCodecParameters *par)
+{
+    const uint8_t *extradata = par->extradata;
+    if (par->codec_id == AV_CODEC_ID_H264 && par->extradata_size >= 7 && extradata[0] == 1)
+    {
+        return (extradata[4] & 3) + 1;
+    }
+    if (par->codec_id == AV_CODEC_ID_HEVC && par->extradata_size >= 23 &&
+        (extradata[0] || extradata[1] || extradata[2] > 1))
+    {
+        return (extradata[21] & 3) + 1;
+    }
+    return 0;
+}
+
+//返回 00 00 01 之后的位置，没有时返回 end
+static const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end)
+{
+    for (; p + 3 <= end; p++)
+    {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+        {
+            return p + 3;
+        }
+    }
+    return end;
+}
+
+//取下一个 NAL，*p 前进到它之后；没有了返回 NULL
+static const uint8_t *next_nal(const uint8_t **p, const uint8_t *end, int length_size, int *size)
+{
+    if (length_size)
+    {
+        if (end - *p < length_size)
+        {
+            return NULL;
+        }
+        uint32_t len = 0;
+        for (int i = 0; i < length_size; i++)
+        {
+            len = (len << 8) | (*p)[i];
+        }
+        const uint8_t *nal = *p + length_size;
+        if (len > (uint32_t)(end - nal))
+        {
+            return NULL;
+        }
+        *p = nal + len;
+        *size = len;
+        return len ? nal : next_nal(p, end, length_size, size);
+    }
+
+    const uint8_t *nal = find_start_code(*p, end);
+    if (nal >= end)
+    {
+        return NULL;
+    }
+    const uint8_t *next = find_start_code(nal, end);
+    const uint8_t *nal_end = next < end ? next - 3 : end;
+    //4 字节起始码的前导 0 和 trailing_zero_8bits 不属于这个 NAL
+    while (nal_end > nal && nal_end[-1] == 0)
+    {
+        nal_end--;
+    }
+    *p = next < end ? next - 3 : end;
+    *size = nal_end - nal;
+    return nal;
+}
+
+//SEI 里可以有多条消息，只读 payloadType 和 payloadSize，跳过内容
+static void parse_sei(BitstreamInfo *info, FrameInfo *frame, const uint8_t *nal, int size)
+{
+    av_fast_malloc(&info->rbsp, &info->rbsp_size, size);
+    if (!info->rbsp)
+    {
+        return;
+    }
+    int len = 0;
+    for (int i = 0; i < size; i++)
+    {
+        if (i >= 2 && nal[i] == 3 && nal[i - 1] == 0 && nal[i - 2] == 0)
+        {
+            continue;
+        }
+        info->rbsp[len++] = nal[i];
+    }
+    const uint8_t *p = info->rbsp;
+    const uint8_t *end = info->rbsp + len;
+    //最后一个字节是 rbsp_trailing_bits
+    while (end - p > 1)
+    {
+        int type = 0;
+        int payload_size = 0;
+        while (p < end && *p == 0xFF)
+        {
+            type += *p++;
+        }
+        if (p >= end)
+        {
+            break;
+        }
+        type += *p++;
+        while (p < end && *p == 0xFF)
+        {
+            payload_size += *p++;
+        }
+        if (p >= end)
+        {
+            break;
+        }
+        payload_size += *p++;
+        info->sei_counts[FFMIN(type, SEI_MAX_TYPES - 1)]++;
+        if (type < SEI_MASK_TYPES)
+        {
+            frame->sei |= UINT64_C(1) << type;
+        }
+        if (payload_size > end - p)
+        {
+            break;
+        }
+        p += payload_size;
+    }
+}
+
+static void scan_nal_units(BitstreamInfo *info, FrameInfo *frame, const uint8_t *data, int data_size)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = data + data_size;
+    const uint8_t *nal;
+    int size;
+    int hevc = info->codec_id == AV_CODEC_ID_HEVC;
+    while ((nal = next_nal(&p, end, info->nal_length_size, &size)) != NULL)
+    {
+        if (size < 1 + hevc)
+        {
+            continue;
+        }
+        if (hevc)
+        {
+            int type = (nal[0] >> 1) & 0x3f;
+            if (type == HEVC_NAL_SEI_PREFIX || type == HEVC_NAL_SEI_SUFFIX)
+            {
+                parse_sei(info, frame, nal + 2, size - 2);
+            }
+            if (type > HEVC_NAL_IRAP_END)
+            {
+                continue;
+            }
+            if (!frame->slices++)
+            {
+                frame->nal_type = type;
+                frame->temporal_id = (nal[1] & 7) - 1;
+                frame->idr = type == HEVC_NAL_IDR_W_RADL || type == HEVC_NAL_IDR_N_LP;
+                frame->leading = type >= HEVC_NAL_RADL_N && type <= HEVC_NAL_RASL_R;
+            }
+            //0～14 的偶数是子层非参考帧（TRAIL_N、TSA_N、RASL_N 等）
+            frame->ref |= type > 14 || type % 2;
+        }
+        else
+        {
+            int type = nal[0] & 0x1f;
+            if (type == H264_NAL_SEI)
+            {
+                parse_sei(info, frame, nal + 1, size - 1);
+            }
+            if (type < H264_NAL_SLICE || type > H264_NAL_IDR)
+            {
+                continue;
+            }
+            if (!frame->slices++)
+            {
+                frame->nal_type = type;
+                frame->idr = type == H264_NAL_IDR;
+            }
+            frame->ref |= (nal[0] >> 5) != 0;
+        }
+    }
+}
+
+static FrameInfo *add_frame(BitstreamInfo *info)
+{
+    if (info->nb_frames >= info->frames_size)
+    {
+        int frames_size = FFMAX(1024, info->frames_size * 2);
+        FrameInfo *frames = (FrameInfo *)av_realloc_array(info->frames, frames_size, sizeof(FrameInfo));
+        if (!frames)
+        {
+            return NULL;
+        }
+        info->frames = frames;
+        info->frames_size = frames_size;
+    }
+    FrameInfo *frame = &info->frames[info->nb_frames++];
+    memset(frame, 0, sizeof(*frame));
+    return frame;
+}
+
+static void print_sei_mask(uint64_t sei)
+{
+    const char *sep = "";
+    for (int i = 0; i < SEI_MASK_TYPES; i++)
+    {
+        if (sei & (UINT64_C(1) << i))
+        {
+            printf("%s%d", sep, i);
+            sep = ",";
+        }
+    }
+    if (!*sep)
+    {
+        printf("-");
+    }
+}
+
+static int compare_pts(const void *a, const void *b)
+{
+    const FrameInfo *fa = *(const FrameInfo *const *)a;
+    const FrameInfo *fb = *(const FrameInfo *const *)b;
+    return (fa->pts > fb->pts) - (fa->pts < fb->pts);
+}
+
+//一个 GOP 按显示顺序排列的帧类型，例如 IBBPBBP；没有 pts 时按解码顺序
+static void gop_pattern(const FrameInfo *frames, int nb_frames, const FrameInfo **sorted, char *pattern,
+                        int *max_b_run)
+{
+    int has_pts = 1;
+    for (int i = 0; i < nb_frames; i++)
+    {
+        sorted[i] = &frames[i];
+        has_pts &= frames[i].pts != AV_NOPTS_VALUE;
+    }
+    if (has_pts)
+    {
+        qsort(sorted, nb_frames, sizeof(*sorted), compare_pts);
+    }
+    int b_run = 0;
+    for (int i = 0; i < nb_frames; i++)
+    {
+        pattern[i] = sorted[i]->type;
+        b_run = sorted[i]->type == 'B' ? b_run + 1 : 0;
+        *max_b_run = FFMAX(*max_b_run, b_run);
+    }
+    pattern[nb_frames] = 0;
+}
+
+static void print_report(const BitstreamInfo *info, const AVStream *st, int print_frames, int print_gops)
+{
+    const FrameInfo *frames = info->frames;
+    double time_base = av_q2d(st->time_base);
+    int hevc = info->codec_id == AV_CODEC_ID_HEVC;
+
+    if (print_frames)
+    {
+        for (int i = 0; i < info->nb_frames; i++)
+        {
+            const FrameInfo *f = &frames[i];
+            printf("frame=%d type=%c key=%d idr=%d ref=%d nal=%d slices=%d", i, f->type, f->key, f->idr, f->ref,
+                   f->nal_type, f->slices);
+            if (hevc)
+            {
+                printf(" tid=%d leading=%d", f->temporal_id, f->leading);
+            }
+            printf(" size=%d pos=%" PRId64 " dts=%" PRId64 " pts=%" PRId64, f->size, f->pos, f->dts, f->pts);
+            if (f->pts != AV_NOPTS_VALUE)
+            {
+                printf(" time=%.3f", f->pts * time_base);
+            }
+            printf(" sei=");
+            print_sei_mask(f->sei);
+            printf("\n");
+        }
+    }
+
+    //按帧类型汇总
+    const char types[] = "IPB?";
+    int64_t count[4] = {0};
+    int64_t ref_count[4] = {0};
+    int64_t bytes[4] = {0};
+    int max_size[4] = {0};
+    int64_t slices = 0;
+    int max_slices = 0;
+    for (int i = 0; i < info->nb_frames; i++)
+    {
+        const FrameInfo *f = &frames[i];
+        int t = (int)(strchr(types, f->type) - types);
+        count[t]++;
+        ref_count[t] += f->ref;
+        bytes[t] += f->size;
+        max_size[t] = FFMAX(max_size[t], f->size);
+        slices += f->slices;
+        max_slices = FFMAX(max_slices, f->slices);
+    }
+    for (int t = 0; t < 4; t++)
+    {
+        if (count[t])
+        {
+            printf("type=%c count=%" PRId64 " ref=%" PRId64 " avg_size=%" PRId64 " max_size=%d\n", types[t],
+                   count[t], ref_count[t], bytes[t] / count[t], max_size[t]);
+        }
+    }
+    printf("slices avg=%.2f max=%d\n", info->nb_frames ? (double)slices / info->nb_frames : 0, max_slices);
+
+    //GOP 从每个关键帧开始，IDR 是封闭 GOP，其余关键帧（CRA/BLA、带 recovery point 的 I 帧）后面的帧可能参考前一个 GOP
+    const FrameInfo **sorted = (const FrameInfo **)av_malloc_array(FFMAX(info->nb_frames, 1), sizeof(*sorted));
+    char *pattern = (char *)av_malloc(info->nb_frames + 1);
+    if (!sorted || !pattern)
+    {
+        av_free(sorted);
+        av_free(pattern);
+        return;
+    }
+    int gops = 0;
+    int closed = 0;
+    int min_gop = 0;
+    int max_gop = 0;
+    int max_b_run = 0;
+    int start = 0;
+    while (start < info->nb_frames && !frames[start].key)
+    {
+        start++;
+    }
+    int leading = start;
+    if (leading)
+    {
+        printf("leading_frames=%d before the first keyframe\n", leading);
+    }
+    while (start < info->nb_frames)
+    {
+        int end = start + 1;
+        while (end < info->nb_frames && !frames[end].key)
+        {
+            end++;
+        }
+        int length = end - start;
+        gop_pattern(frames + start, length, sorted, pattern, &max_b_run);
+        if (print_gops)
+        {
+            const FrameInfo *f = &frames[start];
+            printf("gop=%d frame=%d frames=%d closed=%d pos=%" PRId64 " pts=%" PRId64, gops, start, length, f->idr,
+                   f->pos, f->pts);
+            if (f->pts != AV_NOPTS_VALUE)
+            {
+                printf(" time=%.3f", f->pts * time_base);
+            }
+            printf(" pattern=%s\n", pattern);
+        }
+        min_gop = gops ? FFMIN(min_gop, length) : length;
+        max_gop = FFMAX(max_gop, length);
+        closed += frames[start].idr;
+        gops++;
+        start = end;
+    }
+    printf("gops=%d closed=%d open=%d min=%d max=%d avg=%.1f max_consecutive_b=%d b_reference=%s\n", gops,
+           closed, gops - closed, min_gop, max_gop, gops ? (double)(info->nb_frames - leading) / gops : 0, max_b_run, ref_count[2] ? "yes" : "no");
+
+    for (int i = 0; i < SEI_MAX_TYPES; i++)
+    {
+        if (info->sei_counts[i])
+        {
+            printf("sei type=%d%s name=%s count=%" PRId64 "\n", i, i == SEI_MAX_TYPES - 1 ? "+" : "", sei_name(i),
+                   info->sei_counts[i]);
+        }
+    }
+    av_free(sorted);
+    av_free(pattern);
+}
+
+//封装头里每一路都有类型和编码时不用再分析，TS 这类要读包才知道的才调用 avformat_find_stream_info
+static int need_stream_info(const AVFormatContext *fmt_ctx)
+{
+    for (unsigned i = 0; i < fmt_ctx->nb_streams; i++)
+    {
+        const AVCodecParameters *par = fmt_ctx->streams[i]->codecpar;
+        if (par->codec_type == AVMEDIA_TYPE_UNKNOWN || par->codec_id == AV_CODEC_ID_NONE)
+        {
+            return 1;
+        }
+    }
+    return fmt_ctx->nb_streams == 0;
+}
+
+static int analyze(ProbeCache *cache, const char *input, int stream_index, int print_frames, int print_gops)
+{
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *codec_ctx = NULL;
+    AVCodecParserContext *parser = NULL;
+    BitstreamInfo info;
+    memset(&info, 0, sizeof(info));
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    int64_t start = av_gettime_relative();
+
+    int ret = avformat_open_input(&fmt_ctx, input, NULL, NULL);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: %s\n", input, av_err2str(ret));
+        goto end;
+    }
+    if (need_stream_info(fmt_ctx) && (ret = probe_cache_find_stream_info(cache, input, fmt_ctx)) < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: Cannot find stream information\n", input);
+        goto end;
+    }
+    if (stream_index < 0)
+    {
+        stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    }
+    if (stream_index < 0 || stream_index >= (int)fmt_ctx->nb_streams)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: no video stream\n", input);
+        ret = AVERROR_STREAM_NOT_FOUND;
+        goto end;
+    }
+    AVStream *st = fmt_ctx->streams[stream_index];
+    info.codec_id = st->codecpar->codec_id;
+    if (info.codec_id != AV_CODEC_ID_H264 && info.codec_id != AV_CODEC_ID_HEVC)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: stream %d is %s, only h264 and hevc are supported\n", input, stream_index,
+               avcodec_get_name(info.codec_id));
+        ret = AVERROR_PATCHWELCOME;
+        goto end;
+    }
+    //其他流不读，mp4 之类可以跳过它们的数据
+    for (unsigned i = 0; i < fmt_ctx->nb_streams; i++)
+    {
+        fmt_ctx->streams[i]->discard = (int)i == stream_index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+    info.nal_length_size = nal_length_size(st->codecpar);
+
+    //parser 从 extradata 读 SPS/PPS，avcC/hvcC 的长度前缀它自己处理
+    codec_ctx = avcodec_alloc_context3(NULL);
+    parser = av_parser_init(info.codec_id);
+    if (!codec_ctx || !parser)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: can't create %s parser\n", input, avcodec_get_name(info.codec_id));
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = avcodec_parameters_to_context(codec_ctx, st->codecpar)) < 0)
+    {
+        goto end;
+    }
+    //av_read_frame 给的已经是完整的帧，parser 不用再拼帧
+    parser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
+
+    while ((ret = av_read_frame(fmt_ctx, &pkt)) >= 0)
+    {
+        if (pkt.stream_index != stream_index || pkt.size <= 0)
+        {
+            av_packet_unref(&pkt);
+            continue;
+        }
+        uint8_t *out = NULL;
+        int out_size = 0;
+        av_parser_parse2(parser, codec_ctx, &out, &out_size, pkt.data, pkt.size, pkt.pts, pkt.dts, pkt.pos);
+        FrameInfo *frame = add_frame(&info);
+        if (!frame)
+        {
+            av_packet_unref(&pkt);
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        frame->pts = pkt.pts;
+        frame->dts = pkt.dts;
+        frame->pos = pkt.pos;
+        frame->size = pkt.size;
+        switch (parser->pict_type)
+        {
+        case AV_PICTURE_TYPE_I:
+        case AV_PICTURE_TYPE_SI:
+            frame->type = 'I';
+            break;
+        case AV_PICTURE_TYPE_P:
+        case AV_PICTURE_TYPE_SP:
+            frame->type = 'P';
+            break;
+        case AV_PICTURE_TYPE_B:
+            frame->type = 'B';
+            break;
+        default:
+            frame->type = '?';
+            break;
+        }
+        frame->key = (pkt.flags & AV_PKT_FLAG_KEY) || parser->key_frame == 1;
+        scan_nal_units(&info, frame, pkt.data, pkt.size);
+        av_packet_unref(&pkt);
+    }
+    if (ret != AVERROR_EOF)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: read error %s\n", input, av_err2str(ret));
+        goto end;
+    }
+    double seconds = (av_gettime_relative() - start) / 1000000.0;
+    printf("input=%s stream=%d codec=%s format=%s frames=%d time=%.2fs fps=%.0f\n", input, stream_index,
+           avcodec_get_name(info.codec_id), info.nal_length_size ? "length_prefixed" : "annexb", info.nb_frames,
+           seconds, seconds > 0 ? info.nb_frames / seconds : 0);
+    print_report(&info, st, print_frames, print_gops);
+    ret = 0;
+
+end:
+    av_parser_close(parser);
+    avcodec_free_context(&codec_ctx);
+    avformat_close_input(&fmt_ctx);
+    av_free(info.frames);
+    av_free(info.rbsp);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *probe_cache_path = NULL;
+    int stream_index = -1;
+    int print_frames = 0;
+    int print_gops = 0;
+    int nb_inputs = 0;
+    char **inputs = (char **)av_mallocz_array(argc, sizeof(char *));
+    if (!inputs)
+    {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-stream") && i + 1 < argc)
+        {
+            stream_index = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-frames"))
+        {
+            print_frames = 1;
+        }
+        else if (!strcmp(argv[i], "-gops"))
+        {
+            print_gops = 1;
+        }
+        else if (!strcmp(argv[i], "-probe_cache") && i + 1 < argc)
+        {
+            probe_cache_path = argv[++i];
+        }
+        else
+        {
+            inputs[nb_inputs++] = argv[i];
+        }
+    }
+    if (!nb_inputs)
+    {
+        av_log(NULL, AV_LOG_ERROR, "usage: %s [-stream n] [-frames] [-gops] [-probe_cache file|default|off] input...\n", argv[0]);
+        av_free(inputs);
+        return 1;
+    }
+
+    ProbeCache probe_cache;
+    probe_cache_open(&probe_cache, probe_cache_path);
+    int failed = 0;
+    for (int i = 0; i < nb_inputs; i++)
+    {
+        failed += analyze(&probe_cache, inputs[i], stream_index, print_frames, print_gops) < 0;
+    }
+    probe_cache_close(&probe_cache);
+    av_free(inputs);
+    return failed ? 1 : 0;
+}
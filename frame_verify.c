@@ -0,0 +1,822 @@
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avstring.h>
+#include <libavutil/bprint.h>
+#include <libavutil/cpu.h>
+#include <libavutil/hash.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "thread_pool.h"
+#include "probe_cache.h"
+
+//./frame_verify [-j threads] [-segments n] [-preroll s] [-hash md5|adler32|crc32|sha256] [-o manifest] input...
+//./frame_verify -check manifest [-j threads] ... [input...]
+//解码 transcoding 的输出，每个视频帧、音频帧算一个哈希（和 ffmpeg -f framemd5 / framecrc 类似），
+//比较解码结果而不是文件字节，封装层的差异（时间戳写法、box 顺序、编码器版本字符串）不会误报。
+//每个文件按时长切成几段，每段是线程池里的一个任务：各自打开文件、seek 到段起点之前、解码，
+//只保留时间戳落在本段的帧。-o 写清单，-check 和清单逐行比较，有差异返回 1
+
+//每段至少这么长（秒），太短的话 seek 和预滚的开销比解码还多
+#define VERIFY_MIN_SEGMENT 2.0
+//-check 时每个文件最多打印几行差异
+#define VERIFY_MAX_DIFFS 5
+
+typedef struct FrameHash
+{
+    int stream;
+    int64_t pts;
+    int64_t duration;
+    int size;
+    char hash[AV_HASH_MAX_SIZE * 2 + 1];
+} FrameHash;
+
+struct VerifyFile;
+
+typedef struct Segment
+{
+    struct VerifyFile *file;
+    //AV_TIME_BASE，第一段从 INT64_MIN 开始，最后一段到 INT64_MAX
+    int64_t start;
+    int64_t end;
+    FrameHash *frames;
+    int nb_frames;
+    int frames_size;
+    int ret;
+} Segment;
+
+typedef struct VerifyFile
+{
+    struct VerifyRun *run;
+    const char *path;
+    //参与比较的流：有解码器的视频、音频流，封面除外
+    int *streams;
+    int nb_streams;
+    AVBPrint header;
+    Segment *segments;
+    int nb_segments;
+    int ret;
+} VerifyFile;
+
+typedef struct VerifyRun
+{
+    ThreadPool pool;
+    ProbeCache cache;
+    const char *hash_name;
+    int segments;
+    double preroll;
+} VerifyRun;
+
+static int open_input(VerifyRun *run, const char *path, AVFormatContext **fmt_ctx)
+{
+    int ret = avformat_open_input(fmt_ctx, path, NULL, NULL);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return probe_cache_find_stream_info(&run->cache, path, *fmt_ctx);
+}
+
+static int is_verified_stream(const AVStream *st)
+{
+    enum AVMediaType type = st->codecpar->codec_type;
+    if (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO)
+    {
+        return 0;
+    }
+    return !(st->disposition & AV_DISPOSITION_ATTACHED_PIC) && avcodec_find_decoder(st->codecpar->codec_id);
+}
+
+static FrameHash *add_frame(Segment *seg)
+{
+    if (seg->nb_frames >= seg->frames_size)
+    {
+        int frames_size = FFMAX(256, seg->frames_size * 2);
+        FrameHash *frames = (FrameHash *)av_realloc_array(seg->frames, frames_size, sizeof(FrameHash));
+        if (!frames)
+        {
+            return NULL;
+        }
+        seg->frames = frames;
+        seg->frames_size = frames_size;
+    }
+    return &seg->frames[seg->nb_frames++];
+}
+
+//视频按 av_image_copy_to_buffer 紧密排列后计算，和 framemd5 的 rawvideo 一致；
+//音频按平面依次计算，交错格式和 framemd5 一致
+static int hash_frame(struct AVHashContext *hash, const AVFrame *frame, enum AVMediaType type, uint8_t **buf,
+                      unsigned *buf_size, FrameHash *out)
+{
+    av_hash_init(hash);
+    if (type == AVMEDIA_TYPE_VIDEO)
+    {
+        int size = av_image_get_buffer_size((enum AVPixelFormat)frame->format, frame->width, frame->height, 1);
+        if (size < 0)
+        {
+            return size;
+        }
+        av_fast_malloc(buf, buf_size, size);
+        if (!*buf)
+        {
+            return AVERROR(ENOMEM);
+        }
+        av_image_copy_to_buffer(*buf, size, (const uint8_t *const *)frame->data, frame->linesize,
+                                (enum AVPixelFormat)frame->format, frame->width, frame->height, 1);
+        av_hash_update(hash, *buf, size);
+        out->size = size;
+    }
+    else
+    {
+        int planar = av_sample_fmt_is_planar((enum AVSampleFormat)frame->format);
+        int plane_size = frame->nb_samples * av_get_bytes_per_sample((enum AVSampleFormat)frame->format) *
+                         (planar ? 1 : frame->channels);
+        int planes = planar ? frame->channels : 1;
+        for (int i = 0; i < planes; i++)
+        {
+            av_hash_update(hash, frame->extended_data[i], plane_size);
+        }
+        out->size = plane_size * planes;
+    }
+    av_hash_final_hex(hash, (uint8_t *)out->hash, sizeof(out->hash));
+    return 0;
+}
+
+typedef struct SegmentDecoder
+{
+    int stream;
+    AVCodecContext *codec_ctx;
+    //已经输出了本段终点之后的帧，这一路不用再解
+    int done;
+} SegmentDecoder;
+
+static int receive_frames(Segment *seg, AVFormatContext *fmt_ctx, SegmentDecoder *dec, AVFrame *frame,
+                          struct AVHashContext *hash, uint8_t **buf, unsigned *buf_size)
+{
+    AVStream *st = fmt_ctx->streams[dec->stream];
+    int whole_file = seg->start == INT64_MIN && seg->end == INT64_MAX;
+    for (;;)
+    {
+        int ret = avcodec_receive_frame(dec->codec_ctx, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+        {
+            return 0;
+        }
+        if (ret < 0)
+        {
+            return ret;
+        }
+        int64_t pts = frame->best_effort_timestamp;
+        if (pts == AV_NOPTS_VALUE && !whole_file)
+        {
+            //没有时间戳就没法判断帧属于哪一段
+            av_log(NULL, AV_LOG_ERROR, "%s: stream %d has frames without timestamps, use -segments 1\n",
+                   seg->file->path, dec->stream);
+            av_frame_unref(frame);
+            return AVERROR_INVALIDDATA;
+        }
+        int64_t ts = pts == AV_NOPTS_VALUE ? 0 : av_rescale_q(pts, st->time_base, AV_TIME_BASE_Q);
+        if (!whole_file && ts >= seg->end)
+        {
+            dec->done = 1;
+        }
+        else if (whole_file || ts >= seg->start)
+        {
+            FrameHash *out = add_frame(seg);
+            if (!out)
+            {
+                av_frame_unref(frame);
+                return AVERROR(ENOMEM);
+            }
+            out->stream = dec->stream;
+            out->pts = pts;
+            out->duration = frame->pkt_duration;
+            ret = hash_frame(hash, frame, st->codecpar->codec_type, buf, buf_size, out);
+            if (ret < 0)
+            {
+                av_frame_unref(frame);
+                return ret;
+            }
+        }
+        av_frame_unref(frame);
+    }
+}
+
+//解码一段：seek 到 start - preroll 之前的关键帧，丢掉 start 之前的帧，所有流都过了 end 就停。
+//预滚让音频解码器（AAC 的重叠窗口等）在段起点的输出和从头解码时一样
+static void segment_job(void *arg)
+{
+    Segment *seg = (Segment *)arg;
+    VerifyFile *file = seg->file;
+    VerifyRun *run = file->run;
+    AVFormatContext *fmt_ctx = NULL;
+    SegmentDecoder *decoders = NULL;
+    SegmentDecoder **by_index = NULL;
+    AVFrame *frame = av_frame_alloc();
+    struct AVHashContext *hash = NULL;
+    uint8_t *buf = NULL;
+    unsigned buf_size = 0;
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+
+    int ret = frame ? av_hash_alloc(&hash, run->hash_name) : AVERROR(ENOMEM);
+    if (ret < 0)
+    {
+        goto end;
+    }
+    if ((ret = open_input(run, file->path, &fmt_ctx)) < 0)
+    {
+        goto end;
+    }
+    decoders = (SegmentDecoder *)av_mallocz_array(file->nb_streams, sizeof(SegmentDecoder));
+    by_index = (SegmentDecoder **)av_mallocz_array(fmt_ctx->nb_streams, sizeof(SegmentDecoder *));
+    if (!decoders || !by_index)
+    {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (int i = 0; i < file->nb_streams; i++)
+    {
+        int index = file->streams[i];
+        if (index >= (int)fmt_ctx->nb_streams)
+        {
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+        AVStream *st = fmt_ctx->streams[index];
+        SegmentDecoder *dec = &decoders[i];
+        dec->stream = index;
+        dec->codec_ctx = avcodec_alloc_context3(avcodec_find_decoder(st->codecpar->codec_id));
+        if (!dec->codec_ctx)
+        {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if ((ret = avcodec_parameters_to_context(dec->codec_ctx, st->codecpar)) < 0)
+        {
+            goto end;
+        }
+        dec->codec_ctx->pkt_timebase = st->time_base;
+        //段之间已经并行了，解码器单线程，结果也不依赖线程数
+        dec->codec_ctx->thread_count = 1;
+        if ((ret = avcodec_open2(dec->codec_ctx, NULL, NULL)) < 0)
+        {
+            goto end;
+        }
+        by_index[index] = dec;
+    }
+    for (unsigned i = 0; i < fmt_ctx->nb_streams; i++)
+    {
+        if (!by_index[i])
+        {
+            fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    if (seg->start != INT64_MIN)
+    {
+        int64_t target = seg->start - (int64_t)(run->preroll * AV_TIME_BASE);
+        //seek 失败就从头解，只是慢一些
+        if (av_seek_frame(fmt_ctx, -1, target, AVSEEK_FLAG_BACKWARD) < 0)
+        {
+            av_log(NULL, AV_LOG_WARNING, "%s: seek to %.3f failed, decoding from the start\n", file->path,
+                   target / (double)AV_TIME_BASE);
+        }
+    }
+
+    for (;;)
+    {
+        int done = 1;
+        for (int i = 0; i < file->nb_streams; i++)
+        {
+            done &= decoders[i].done;
+        }
+        if (done)
+        {
+            break;
+        }
+        int read_ret = av_read_frame(fmt_ctx, &pkt);
+        if (read_ret == AVERROR_EOF)
+        {
+            //冲出解码器里缓存的帧
+            for (int i = 0; i < file->nb_streams && ret >= 0; i++)
+            {
+                if (!decoders[i].done)
+                {
+                    avcodec_send_packet(decoders[i].codec_ctx, NULL);
+                    ret = receive_frames(seg, fmt_ctx, &decoders[i], frame, hash, &buf, &buf_size);
+                }
+            }
+            break;
+        }
+        if (read_ret < 0)
+        {
+            ret = read_ret;
+            break;
+        }
+        SegmentDecoder *dec = pkt.stream_index < (int)fmt_ctx->nb_streams ? by_index[pkt.stream_index] : NULL;
+        if (dec && !dec->done)
+        {
+            ret = avcodec_send_packet(dec->codec_ctx, &pkt);
+            //坏包跳过，和 ffmpeg 一样继续解；结果不同会在比较时发现
+            if (ret < 0 && ret != AVERROR(EAGAIN))
+            {
+                av_log(NULL, AV_LOG_WARNING, "%s: stream %d decode error %s\n", file->path, dec->stream,
+                       av_err2str(ret));
+            }
+            ret = receive_frames(seg, fmt_ctx, dec, frame, hash, &buf, &buf_size);
+        }
+        av_packet_unref(&pkt);
+        if (ret < 0)
+        {
+            break;
+        }
+    }
+
+end:
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: segment %.3f-%.3f %s\n", file->path,
+               seg->start == INT64_MIN ? 0 : seg->start / (double)AV_TIME_BASE,
+               seg->end == INT64_MAX ? -1 : seg->end / (double)AV_TIME_BASE, av_err2str(ret));
+    }
+    seg->ret = ret;
+    av_packet_unref(&pkt);
+    for (int i = 0; decoders && i < file->nb_streams; i++)
+    {
+        avcodec_free_context(&decoders[i].codec_ctx);
+    }
+    av_free(decoders);
+    av_free(by_index);
+    avformat_close_input(&fmt_ctx);
+    av_frame_free(&frame);
+    av_hash_freep(&hash);
+    av_free(buf);
+}
+
+//打开文件、写清单的头、按时长切段，再把每段提交到线程池
+static void plan_job(void *arg)
+{
+    VerifyFile *file = (VerifyFile *)arg;
+    VerifyRun *run = file->run;
+    AVFormatContext *fmt_ctx = NULL;
+    int ret = open_input(run, file->path, &fmt_ctx);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: %s\n", file->path, av_err2str(ret));
+        goto end;
+    }
+    file->streams = (int *)av_mallocz_array(fmt_ctx->nb_streams + 1, sizeof(int));
+    if (!file->streams)
+    {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    AVBPrint *bp = &file->header;
+    av_bprintf(bp, "#hash: %s\n", run->hash_name);
+    for (unsigned i = 0; i < fmt_ctx->nb_streams; i++)
+    {
+        const AVStream *st = fmt_ctx->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        if (!is_verified_stream(st))
+        {
+            continue;
+        }
+        file->streams[file->nb_streams++] = i;
+        av_bprintf(bp, "#tb %u: %d/%d\n", i, st->time_base.num, st->time_base.den);
+        av_bprintf(bp, "#media_type %u: %s\n", i, av_get_media_type_string(par->codec_type));
+        av_bprintf(bp, "#codec_id %u: %s\n", i, avcodec_get_name(par->codec_id));
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            const char *pix_fmt = av_get_pix_fmt_name((enum AVPixelFormat)par->format);
+            av_bprintf(bp, "#dimensions %u: %dx%d\n", i, par->width, par->height);
+            av_bprintf(bp, "#pix_fmt %u: %s\n", i, pix_fmt ? pix_fmt : "unknown");
+        }
+        else
+        {
+            av_bprintf(bp, "#sample_rate %u: %d\n", i, par->sample_rate);
+            av_bprintf(bp, "#channels %u: %d\n", i, par->channels);
+        }
+    }
+    if (!file->nb_streams)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: no decodable audio or video stream\n", file->path);
+        ret = AVERROR_STREAM_NOT_FOUND;
+        goto end;
+    }
+
+    //时长未知或者不能 seek 的输入只解一段
+    int nb_segments = 1;
+    int64_t duration = fmt_ctx->duration;
+    int64_t start_time = fmt_ctx->start_time != AV_NOPTS_VALUE ? fmt_ctx->start_time : 0;
+    if (duration > 0 && fmt_ctx->pb && (fmt_ctx->pb->seekable & AVIO_SEEKABLE_NORMAL))
+    {
+        nb_segments = (int)FFMIN(run->segments, duration / (VERIFY_MIN_SEGMENT * AV_TIME_BASE));
+        nb_segments = FFMAX(nb_segments, 1);
+    }
+    file->segments = (Segment *)av_mallocz_array(nb_segments, sizeof(Segment));
+    if (!file->segments)
+    {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    file->nb_segments = nb_segments;
+    for (int i = 0; i < nb_segments; i++)
+    {
+        Segment *seg = &file->segments[i];
+        seg->file = file;
+        seg->start = i ? start_time + av_rescale(duration, i, nb_segments) : INT64_MIN;
+        seg->end = i < nb_segments - 1 ? start_time + av_rescale(duration, i + 1, nb_segments) : INT64_MAX;
+    }
+    for (int i = 0; i < nb_segments; i++)
+    {
+        if ((ret = thread_pool_submit(&run->pool, segment_job, &file->segments[i])) < 0)
+        {
+            //已经提交的段照常执行，这个文件算失败
+            for (; i < nb_segments; i++)
+            {
+                file->segments[i].ret = ret;
+            }
+            break;
+        }
+    }
+
+end:
+    file->ret = ret < 0 ? ret : 0;
+    avformat_close_input(&fmt_ctx);
+}
+
+//清单里一个文件的内容：#file 行、头，然后按流的顺序列出每一帧，同一路的帧按段的顺序拼起来。
+//不按解码时的交错顺序，切多少段都得到同样的结果
+static int build_manifest(const VerifyFile *file, AVBPrint *bp)
+{
+    av_bprintf(bp, "#file: %s\n", file->path);
+    if (file->ret < 0)
+    {
+        return file->ret;
+    }
+    for (int i = 0; i < file->nb_segments; i++)
+    {
+        if (file->segments[i].ret < 0)
+        {
+            return file->segments[i].ret;
+        }
+    }
+    av_bprintf(bp, "%s", file->header.str);
+    for (int s = 0; s < file->nb_streams; s++)
+    {
+        for (int i = 0; i < file->nb_segments; i++)
+        {
+            const Segment *seg = &file->segments[i];
+            for (int j = 0; j < seg->nb_frames; j++)
+            {
+                const FrameHash *f = &seg->frames[j];
+                if (f->stream == file->streams[s])
+                {
+                    av_bprintf(bp, "%d, %10" PRId64 ", %10" PRId64 ", %8d, %s\n", f->stream, f->pts, f->duration,
+                               f->size, f->hash);
+                }
+            }
+        }
+    }
+    return av_bprint_is_complete(bp) ? 0 : AVERROR(ENOMEM);
+}
+
+//清单里某个文件那一节（#file 行之后到下一个 #file 之前），没有返回 NULL
+static const char *find_section(const char *manifest, const char *path, size_t *len)
+{
+    size_t path_len = strlen(path);
+    const char *p = manifest;
+    while (p && *p)
+    {
+        if (!strncmp(p, "#file: ", 7) && !strncmp(p + 7, path, path_len) && p[7 + path_len] == '\n')
+        {
+            const char *section = p;
+            const char *next = strstr(p + 1, "\n#file: ");
+            *len = next ? (size_t)(next + 1 - section) : strlen(section);
+            return section;
+        }
+        p = strchr(p, '\n');
+        p = p ? p + 1 : NULL;
+    }
+    return NULL;
+}
+
+static const char *next_line(const char *p, const char *end, int *len)
+{
+    const char *nl = memchr(p, '\n', end - p);
+    *len = (int)((nl ? nl : end) - p);
+    return nl ? nl + 1 : end;
+}
+
+//逐行比较，打印前几处差异
+static int compare_manifest(const char *path, const char *expected, size_t expected_len, const char *actual,
+                            size_t actual_len)
+{
+    const char *e = expected;
+    const char *e_end = expected + expected_len;
+    const char *a = actual;
+    const char *a_end = actual + actual_len;
+    int line = 0;
+    int diffs = 0;
+    int expected_lines = 0;
+    int actual_lines = 0;
+    while (e < e_end || a < a_end)
+    {
+        const char *e_line = e;
+        const char *a_line = a;
+        int e_len = 0;
+        int a_len = 0;
+        line++;
+        if (e < e_end)
+        {
+            e = next_line(e, e_end, &e_len);
+            expected_lines++;
+        }
+        if (a < a_end)
+        {
+            a = next_line(a, a_end, &a_len);
+            actual_lines++;
+        }
+        if (e_len == a_len && !memcmp(e_line, a_line, e_len) && (e_line < e_end) == (a_line < a_end))
+        {
+            continue;
+        }
+        if (diffs++ < VERIFY_MAX_DIFFS)
+        {
+            printf("%s: line %d\n  expected: %.*s\n  actual:   %.*s\n", path, line, e_len, e_line, a_len, a_line);
+        }
+    }
+    if (diffs)
+    {
+        printf("%s: FAIL, %d differing lines, expected %d lines, got %d\n", path, diffs, expected_lines, actual_lines);
+        return 1;
+    }
+    printf("%s: ok, %d lines\n", path, actual_lines);
+    return 0;
+}
+
+//清单里所有 #file 行的路径
+static const char **manifest_files(const char *manifest, int *nb_files)
+{
+    const char **files = NULL;
+    int files_size = 0;
+    *nb_files = 0;
+    for (const char *p = manifest; p && *p;)
+    {
+        const char *nl = strchr(p, '\n');
+        size_t len = nl ? (size_t)(nl - p) : strlen(p);
+        if (len > 7 && !strncmp(p, "#file: ", 7))
+        {
+            if (*nb_files >= files_size)
+            {
+                files_size = FFMAX(16, files_size * 2);
+                const char **more = (const char **)av_realloc_array(files, files_size, sizeof(char *));
+                if (!more)
+                {
+                    break;
+                }
+                files = more;
+            }
+            char *path = av_strndup(p + 7, len - 7);
+            if (path)
+            {
+                files[(*nb_files)++] = path;
+            }
+        }
+        p = nl ? nl + 1 : NULL;
+    }
+    return files;
+}
+
+static char *read_file(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        return NULL;
+    }
+    AVBPrint bp;
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    {
+        av_bprint_append_data(&bp, chunk, n);
+    }
+    fclose(fp);
+    char *data = NULL;
+    if (!av_bprint_is_complete(&bp) || av_bprint_finalize(&bp, &data) < 0)
+    {
+        av_bprint_finalize(&bp, NULL);
+        return NULL;
+    }
+    return data;
+}
+
+int main(int argc, char *argv[])
+{
+    VerifyRun run;
+    memset(&run, 0, sizeof(run));
+    run.hash_name = "MD5";
+    run.preroll = 1.0;
+    int threads = 0;
+    const char *output = NULL;
+    const char *check = NULL;
+    const char *cache_path = NULL;
+    int nb_inputs = 0;
+    int inputs_owned = 0;
+    const char **inputs = (const char **)av_mallocz_array(argc, sizeof(char *));
+    if (!inputs)
+    {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-segments") && i + 1 < argc)
+        {
+            run.segments = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-preroll") && i + 1 < argc)
+        {
+            run.preroll = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-hash") && i + 1 < argc)
+        {
+            run.hash_name = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-check") && i + 1 < argc)
+        {
+            check = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-cache") && i + 1 < argc)
+        {
+            cache_path = argv[++i];
+        }
+        else
+        {
+            inputs[nb_inputs++] = argv[i];
+        }
+    }
+
+    //av_hash_alloc 区分大小写，换成 av_hash_names 里的写法，也写进清单头
+    const char *hash_name = NULL;
+    for (int i = 0; av_hash_names(i); i++)
+    {
+        if (!av_strcasecmp(run.hash_name, av_hash_names(i)))
+        {
+            hash_name = av_hash_names(i);
+        }
+    }
+    if (!hash_name)
+    {
+        av_log(NULL, AV_LOG_ERROR, "unknown hash %s.\n", run.hash_name);
+        av_free(inputs);
+        return 1;
+    }
+    run.hash_name = hash_name;
+
+    char *manifest = NULL;
+    if (check)
+    {
+        manifest = read_file(check);
+        if (!manifest)
+        {
+            av_log(NULL, AV_LOG_ERROR, "can't read %s.\n", check);
+            av_free(inputs);
+            return 1;
+        }
+        //没有给输入时检查清单里的所有文件
+        if (!nb_inputs)
+        {
+            av_free(inputs);
+            inputs = manifest_files(manifest, &nb_inputs);
+            inputs_owned = 1;
+        }
+    }
+    if (!nb_inputs)
+    {
+        av_log(NULL, AV_LOG_ERROR, "usage: %s [-j threads] [-segments n] [-preroll s] [-hash md5|adler32|crc32|sha256] [-cache file|default|off] [-o manifest] input...\n"
+                                   "       %s -check manifest [options] [input...]\n", argv[0], argv[0]);
+        av_free(manifest);
+        av_free(inputs);
+        return 1;
+    }
+    if (run.segments <= 0)
+    {
+        run.segments = threads > 0 ? threads : av_cpu_count();
+    }
+    //解码器的警告太多，只留错误
+    av_log_set_level(AV_LOG_ERROR);
+
+    VerifyFile *files = (VerifyFile *)av_mallocz_array(nb_inputs, sizeof(VerifyFile));
+    FILE *out = output ? fopen(output, "w") : stdout;
+    int failed = 0;
+    int ret = files && out ? 0 : AVERROR(ENOMEM);
+    if (!out)
+    {
+        av_log(NULL, AV_LOG_ERROR, "can't open %s.\n", output);
+    }
+    probe_cache_open(&run.cache, cache_path);
+    if (ret < 0 || (ret = thread_pool_init(&run.pool, threads)) < 0)
+    {
+        failed = 1;
+        goto end;
+    }
+
+    int64_t start = av_gettime_relative();
+    for (int i = 0; i < nb_inputs; i++)
+    {
+        files[i].run = &run;
+        files[i].path = inputs[i];
+        av_bprint_init(&files[i].header, 0, AV_BPRINT_SIZE_UNLIMITED);
+        if (thread_pool_submit(&run.pool, plan_job, &files[i]) < 0)
+        {
+            files[i].ret = AVERROR(ENOMEM);
+        }
+    }
+    //plan_job 里提交的段也算在内
+    thread_pool_wait(&run.pool);
+    thread_pool_destroy(&run.pool);
+    double seconds = (av_gettime_relative() - start) / 1000000.0;
+
+    int64_t frames = 0;
+    int segments = 0;
+    for (int i = 0; i < nb_inputs; i++)
+    {
+        VerifyFile *file = &files[i];
+        AVBPrint bp;
+        av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+        if (build_manifest(file, &bp) < 0)
+        {
+            printf("%s: FAIL, can't decode\n", file->path);
+            failed++;
+        }
+        else if (manifest)
+        {
+            size_t len = 0;
+            const char *section = find_section(manifest, file->path, &len);
+            if (!section)
+            {
+                printf("%s: FAIL, not in %s\n", file->path, check);
+                failed++;
+            }
+            else
+            {
+                failed += compare_manifest(file->path, section, len, bp.str, bp.len);
+            }
+        }
+        else
+        {
+            fwrite(bp.str, 1, bp.len, out);
+        }
+        av_bprint_finalize(&bp, NULL);
+        for (int j = 0; j < file->nb_segments; j++)
+        {
+            frames += file->segments[j].nb_frames;
+        }
+        segments += file->nb_segments;
+    }
+    fprintf(stderr, "frame_verify: %d files, %d failed, %d segments, %" PRId64 " frames, %.1fs, %.0f frames/s, %d threads.\n",
+            nb_inputs, failed, segments, frames, seconds, seconds > 0 ? frames / seconds : 0,
+            threads > 0 ? threads : av_cpu_count());
+
+end:
+    for (int i = 0; files && i < nb_inputs; i++)
+    {
+        for (int j = 0; j < files[i].nb_segments; j++)
+        {
+            av_free(files[i].segments[j].frames);
+        }
+        av_free(files[i].segments);
+        av_free(files[i].streams);
+        av_bprint_finalize(&files[i].header, NULL);
+    }
+    for (int i = 0; inputs_owned && i < nb_inputs; i++)
+    {
+        av_free((char *)inputs[i]);
+    }
+    probe_cache_close(&run.cache);
+    if (out && out != stdout)
+    {
+        fclose(out);
+    }
+    av_free(files);
+    av_free(manifest);
+    av_free(inputs);
+    return failed ? 1 : 0;
+}
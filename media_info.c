@@ -1,5 +1,285 @@
 #include<libavformat/avformat.h>
 #include<libavutil/log.h>
+#include<libavutil/bprint.h>
+#include<libavutil/time.h>
+#include<libavutil/cpu.h>
+#include<libavutil/pixdesc.h>
+#include<libavutil/channel_layout.h>
+#include<pthread.h>
+#include<stdio.h>
+#include<string.h>
+#include "batch_files.h"
+#include "probe_cache.h"
+
+//./media_info url                        打印一个文件的信息（av_dump_format）
+//./media_info -json [-j threads] [-o out.jsonl] [-probesize bytes] [-analyzeduration us]
+//             [-max_probesize bytes] [-list paths.txt] [-cache file|default|off] path|dir ...
+//-json 模式：文件和目录（递归）放进线程池并行探测，每个文件输出一行 JSON
+//设置了 PROBE_CACHE 或者 -cache 时，两种模式都先查 probe_cache.c 的探测缓存，文件没变就不再分析
+
+//快速探测的初始预算，远小于 FFmpeg 默认的 5MB / 5s
+#define FAST_PROBESIZE (256 * 1024)
+#define FAST_ANALYZEDURATION 500000
+//参数还不完整时预算每次扩大的倍数和上限
+#define PROBE_ESCALATE 8
+#define MAX_PROBESIZE (64 * 1024 * 1024)
+#define MAX_ANALYZEDURATION (30 * AV_TIME_BASE)
+
+typedef struct ProbeOptions{
+    int64_t probesize;
+    int64_t analyzeduration;
+    int64_t max_probesize;
+    int64_t max_analyzeduration;
+}ProbeOptions;
+
+typedef struct ProbeRun{
+    const ProbeOptions *options;
+    ThreadPool pool;
+    //所有线程共用一个缓存
+    ProbeCache cache;
+    //结果按完成的顺序写，一行一个文件
+    FILE *out;
+    pthread_mutex_t out_mutex;
+    //统计
+    int files;
+    int failed;
+    int escalated;
+    int cached;
+}ProbeRun;
+
+//决定是否需要更大的预算：每一路的关键参数都拿到了才算完整
+static int params_complete(AVFormatContext *fmt_ctx){
+    for(int i = 0;i < (int)fmt_ctx->nb_streams;i++){
+        AVCodecParameters *par = fmt_ctx->streams[i]->codecpar;
+        if(par->codec_id == AV_CODEC_ID_NONE){
+            return 0;
+        }
+        if(par->codec_type == AVMEDIA_TYPE_VIDEO && (par->width <= 0 || par->height <= 0 || par->format < 0)){
+            return 0;
+        }
+        if(par->codec_type == AVMEDIA_TYPE_AUDIO && (par->sample_rate <= 0 || par->channels <= 0 || par->format < 0)){
+            return 0;
+        }
+    }
+    return fmt_ctx->nb_streams > 0;
+}
+
+//按预算打开并分析，参数不完整时扩大预算重来，返回最后一次的结果。缓存命中时不分析，*cached 置 1
+static int probe_file(const char *path,const ProbeOptions *opt,ProbeCache *cache,AVFormatContext **out_ctx,
+                      int *attempts,int64_t *probesize,int *cached){
+    int64_t size = opt->probesize;
+    int64_t duration = opt->analyzeduration;
+    int ret = 0;
+    *attempts = 0;
+    *cached = 0;
+    while(1){
+        AVFormatContext *fmt_ctx = NULL;
+        AVDictionary *dict = NULL;
+        av_dict_set_int(&dict,"probesize",size,0);
+        av_dict_set_int(&dict,"analyzeduration",duration,0);
+        (*attempts)++;
+        *probesize = size;
+        ret = avformat_open_input(&fmt_ctx,path,NULL,&dict);
+        av_dict_free(&dict);
+        if(ret < 0){
+            return ret;
+        }
+        if(*attempts == 1 && probe_cache_lookup(cache,path,fmt_ctx) > 0){
+            *cached = 1;
+            *out_ctx = fmt_ctx;
+            return 0;
+        }
+        ret = avformat_find_stream_info(fmt_ctx,NULL);
+        //预算不能再扩大时（都到了上限，或者初始值是 0 乘了也不变）这是最后一次
+        int64_t next_size = FFMIN(size * PROBE_ESCALATE,opt->max_probesize);
+        int64_t next_duration = FFMIN(duration * PROBE_ESCALATE,opt->max_analyzeduration);
+        int last = next_size <= size && next_duration <= duration;
+        if(last || (ret >= 0 && params_complete(fmt_ctx))){
+            //参数不完整的结果不缓存，下次还按预算重新分析
+            if(ret >= 0 && params_complete(fmt_ctx)){
+                probe_cache_store(cache,path,fmt_ctx);
+            }
+            *out_ctx = fmt_ctx;
+            return ret;
+        }
+        avformat_close_input(&fmt_ctx);
+        size = FFMAX(size,next_size);
+        duration = FFMAX(duration,next_duration);
+    }
+}
+
+static void json_stream(AVBPrint *bp,AVStream *st){
+    AVCodecParameters *par = st->codecpar;
+    av_bprintf(bp,"{\"index\":%d,\"type\":",st->index);
+    json_string(bp,av_get_media_type_string(par->codec_type) ? av_get_media_type_string(par->codec_type) : "unknown");
+    av_bprintf(bp,",\"codec\":");
+    json_string(bp,avcodec_get_name(par->codec_id));
+    if(par->profile != FF_PROFILE_UNKNOWN && avcodec_profile_name(par->codec_id,par->profile)){
+        av_bprintf(bp,",\"profile\":");
+        json_string(bp,avcodec_profile_name(par->codec_id,par->profile));
+    }
+    if(par->bit_rate > 0){
+        av_bprintf(bp,",\"bit_rate\":%"PRId64,par->bit_rate);
+    }
+    av_bprintf(bp,",\"time_base\":\"%d/%d\"",st->time_base.num,st->time_base.den);
+    if(st->duration != AV_NOPTS_VALUE){
+        av_bprintf(bp,",\"duration\":%.6f",st->duration * av_q2d(st->time_base));
+    }
+    if(par->codec_type == AVMEDIA_TYPE_VIDEO){
+        av_bprintf(bp,",\"width\":%d,\"height\":%d",par->width,par->height);
+        if(par->format >= 0){
+            av_bprintf(bp,",\"pix_fmt\":");
+            json_string(bp,av_get_pix_fmt_name(par->format));
+        }
+        if(st->avg_frame_rate.den && st->avg_frame_rate.num){
+            av_bprintf(bp,",\"fps\":\"%d/%d\"",st->avg_frame_rate.num,st->avg_frame_rate.den);
+        }
+    }else if(par->codec_type == AVMEDIA_TYPE_AUDIO){
+        char layout[128];
+        av_get_channel_layout_string(layout,sizeof(layout),par->channels,par->channel_layout);
+        av_bprintf(bp,",\"sample_rate\":%d,\"channels\":%d,\"channel_layout\":",par->sample_rate,par->channels);
+        json_string(bp,layout);
+        if(par->format >= 0){
+            av_bprintf(bp,",\"sample_fmt\":");
+            json_string(bp,av_get_sample_fmt_name(par->format));
+        }
+    }
+    av_bprintf(bp,"}");
+}
+
+static void probe_job(void *arg){
+    BatchJob *job = (BatchJob *)arg;
+    ProbeRun *run = (ProbeRun *)job->opaque;
+    AVFormatContext *fmt_ctx = NULL;
+    int attempts = 0;
+    int64_t probesize = 0;
+    int cached = 0;
+    int64_t start = av_gettime_relative();
+    int ret = probe_file(job->path,run->options,&run->cache,&fmt_ctx,&attempts,&probesize,&cached);
+    int64_t elapsed = av_gettime_relative() - start;
+
+    AVBPrint bp;
+    av_bprint_init(&bp,0,AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp,"{\"path\":");
+    json_string(&bp,job->path);
+    av_bprintf(&bp,",\"ok\":%s",ret >= 0 ? "true" : "false");
+    av_bprintf(&bp,",\"probe\":{\"attempts\":%d,\"probesize\":%"PRId64",\"cached\":%s,\"ms\":%.1f}",
+               attempts,probesize,cached ? "true" : "false",elapsed / 1000.0);
+    if(ret < 0){
+        char err[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret,err,sizeof(err));
+        av_bprintf(&bp,",\"error\":");
+        json_string(&bp,err);
+    }
+    if(fmt_ctx){
+        av_bprintf(&bp,",\"format\":");
+        json_string(&bp,fmt_ctx->iformat->name);
+        if(fmt_ctx->pb && avio_size(fmt_ctx->pb) >= 0){
+            av_bprintf(&bp,",\"size\":%"PRId64,avio_size(fmt_ctx->pb));
+        }
+        if(fmt_ctx->duration != AV_NOPTS_VALUE){
+            av_bprintf(&bp,",\"duration\":%.6f",fmt_ctx->duration / (double)AV_TIME_BASE);
+        }
+        if(fmt_ctx->bit_rate > 0){
+            av_bprintf(&bp,",\"bit_rate\":%"PRId64,fmt_ctx->bit_rate);
+        }
+        av_bprintf(&bp,",\"complete\":%s,\"streams\":[",params_complete(fmt_ctx) ? "true" : "false");
+        for(int i = 0;i < (int)fmt_ctx->nb_streams;i++){
+            if(i > 0){
+                av_bprint_chars(&bp,',',1);
+            }
+            json_stream(&bp,fmt_ctx->streams[i]);
+        }
+        av_bprintf(&bp,"]");
+        avformat_close_input(&fmt_ctx);
+    }
+    av_bprintf(&bp,"}\n");
+
+    pthread_mutex_lock(&run->out_mutex);
+    if(av_bprint_is_complete(&bp)){
+        fwrite(bp.str,1,bp.len,run->out);
+    }
+    run->files++;
+    run->failed += ret < 0;
+    run->escalated += attempts > 1;
+    run->cached += cached;
+    pthread_mutex_unlock(&run->out_mutex);
+
+    av_bprint_finalize(&bp,NULL);
+    batch_job_free(job);
+}
+
+static int run_json(int argc,char *argv[]){
+    ProbeOptions options = {FAST_PROBESIZE,FAST_ANALYZEDURATION,MAX_PROBESIZE,MAX_ANALYZEDURATION};
+    int threads = 0;
+    const char *output = NULL;
+    const char *cache_path = NULL;
+    for(int i = 1;i < argc;i++){
+        if(!strcmp(argv[i],"-j") && i + 1 < argc){
+            threads = atoi(argv[++i]);
+        }else if(!strcmp(argv[i],"-o") && i + 1 < argc){
+            output = argv[++i];
+        }else if(!strcmp(argv[i],"-probesize") && i + 1 < argc){
+            options.probesize = atoll(argv[++i]);
+        }else if(!strcmp(argv[i],"-analyzeduration") && i + 1 < argc){
+            options.analyzeduration = atoll(argv[++i]);
+        }else if(!strcmp(argv[i],"-max_probesize") && i + 1 < argc){
+            options.max_probesize = atoll(argv[++i]);
+        }else if(!strcmp(argv[i],"-cache") && i + 1 < argc){
+            cache_path = argv[++i];
+        }else if(!strcmp(argv[i],"-list") && i + 1 < argc){
+            i++;
+        }
+    }
+    //FFmpeg 的最小探测大小是 32 字节，上限不能比初始值小
+    options.probesize = FFMAX(options.probesize,32);
+    options.max_probesize = FFMAX(options.max_probesize,options.probesize);
+    options.max_analyzeduration = FFMAX(options.max_analyzeduration,options.analyzeduration);
+
+    ProbeRun run;
+    memset(&run,0,sizeof(run));
+    run.options = &options;
+    run.out = output ? fopen(output,"w") : stdout;
+    if(!run.out){
+        av_log(NULL,AV_LOG_ERROR,"can't open %s.\n",output);
+        return -1;
+    }
+    pthread_mutex_init(&run.out_mutex,NULL);
+    //打不开缓存也照常探测
+    probe_cache_open(&run.cache,cache_path);
+    int ret = thread_pool_init(&run.pool,threads);
+    if(ret < 0){
+        goto end;
+    }
+    //目录边遍历边提交，线程池排满时等空位
+    BatchFiles batch = {&run.pool,probe_job,&run};
+    int64_t start = av_gettime_relative();
+    for(int i = 1;i < argc;i++){
+        if(!strcmp(argv[i],"-j") || !strcmp(argv[i],"-o") || !strcmp(argv[i],"-probesize") ||
+           !strcmp(argv[i],"-analyzeduration") || !strcmp(argv[i],"-max_probesize") || !strcmp(argv[i],"-cache")){
+            i++;
+        }else if(!strcmp(argv[i],"-list") && i + 1 < argc){
+            batch_submit_list(&batch,argv[++i]);
+        }else if(strcmp(argv[i],"-json")){
+            batch_submit_path(&batch,argv[i]);
+        }
+    }
+    thread_pool_wait(&run.pool);
+    thread_pool_destroy(&run.pool);
+    double seconds = (av_gettime_relative() - start) / 1000000.0;
+    fprintf(stderr,"media_info: %d files, %d failed, %d escalated, %d cached, %.1fs, %.0f files/s, %d threads.\n",
+            run.files,run.failed,run.escalated,run.cached,seconds,seconds > 0 ? run.files / seconds : 0,
+            threads > 0 ? threads : av_cpu_count());
+    ret = run.failed ? 1 : 0;
+
+    end:
+    if(run.out && run.out != stdout){
+        fclose(run.out);
+    }
+    pthread_mutex_destroy(&run.out_mutex);
+    probe_cache_close(&run.cache);
+    return ret;
+}
 
 int main(int argc,char *argv[]) {
 
@@ -10,12 +290,24 @@ int main(int argc,char *argv[]) {
         return -1;
     }
 
+    for(int i = 1;i < argc;i++){
+        if(!strcmp(argv[i],"-json")){
+            //错误都写进 JSON 里，解复用器的日志只留错误
+            av_log_set_level(AV_LOG_ERROR);
+            return run_json(argc,argv);
+        }
+    }
+
     char *input_url = argv[1];
 
     int ret;
+    //文件没变的话直接用上次的探测结果
+    ProbeCache cache;
+    probe_cache_open(&cache,NULL);
     AVFormatContext *input_format_ctx = avformat_alloc_context();
     if(input_format_ctx == NULL){
         av_log(NULL,AV_LOG_ERROR,"avformat_alloc_context fail.\n");
+        probe_cache_close(&cache);
         return -1;
     }
     ret = avformat_open_input(&input_format_ctx,input_url,NULL,NULL);
@@ -24,7 +316,7 @@ int main(int argc,char *argv[]) {
         goto end;
     }
 
-    ret = avformat_find_stream_info(input_format_ctx,NULL);
+    ret = probe_cache_find_stream_info(&cache,input_url,input_format_ctx);
     if(ret < 0){
         av_log(NULL,AV_LOG_ERROR,"avformat_find_stream_info error,ret = %d.\n",ret);
         goto end;
@@ -52,6 +344,7 @@ int main(int argc,char *argv[]) {
         avformat_free_context(input_format_ctx);
         input_format_ctx = NULL;
     } 
+    probe_cache_close(&cache);
     return 0;
 
-}
\ No newline at end of file
+}
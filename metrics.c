@@ -0,0 +1,607 @@
+#include <libavutil/bprint.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "metrics.h"
+#include "video_debugging.h"
+
+//span 名字的地址到延迟直方图的缓存，同一个名字在不同文件里的地址可能不同
+#define METRICS_MAX_STAGES 32
+//两次导出间隔太短时速率不重新计算
+#define METRICS_RATE_MIN_US 100000
+//导出线程检查退出的周期
+#define METRICS_POLL_MS 200
+
+typedef enum MetricsMode
+{
+    METRICS_MODE_FILE,
+    METRICS_MODE_HTTP,
+    METRICS_MODE_UNIX,
+} MetricsMode;
+
+typedef struct MetricsStage
+{
+    _Atomic(const char *) name;
+    _Atomic(Metric *) histogram;
+} MetricsStage;
+
+//所有 trace span 的名字，metrics_init 时每个名字注册一个直方图；新增 span 要加到这里，不在表里的不统计
+static const char *const stage_names[] = {
+    "av_read_frame",
+    "avcodec_send_packet",
+    "avcodec_receive_frame",
+    "avcodec_send_frame",
+    "avcodec_receive_packet",
+    "av_interleaved_write_frame",
+    "sws_scale",
+    "texture_upload",
+    "present",
+    "audio_callback",
+    "audio_mixer_callback",
+};
+#define NB_STAGE_NAMES (int)(sizeof(stage_names) / sizeof(stage_names[0]))
+
+typedef struct MetricsRegistry
+{
+    int running;
+    MetricsMode mode;
+    char *path;
+    int interval_ms;
+    int listen_fd;
+    pthread_t thread;
+    _Atomic int quit;
+    //注册加锁，更新和导出不加锁：先填好指标，再发布 count
+    pthread_mutex_t mutex;
+    _Atomic int count;
+    Metric metrics[METRICS_MAX];
+    //和 stage_names 一一对应
+    Metric *stage_histograms[NB_STAGE_NAMES];
+    MetricsStage stages[METRICS_MAX_STAGES];
+} MetricsRegistry;
+
+static const int64_t bucket_us[METRICS_BUCKETS] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000,
+};
+
+static MetricsRegistry registry = {.mutex = PTHREAD_MUTEX_INITIALIZER, .listen_fd = -1};
+
+static Metric *add_metric_locked(MetricType type, const char *name, const char *labels, const char *help)
+{
+    int n = atomic_load_explicit(&registry.count, memory_order_relaxed);
+    if (!registry.running || n >= METRICS_MAX)
+    {
+        return NULL;
+    }
+    Metric *m = &registry.metrics[n];
+    memset(m, 0, sizeof(Metric));
+    m->type = type;
+    snprintf(m->name, sizeof(m->name), "%s", name);
+    snprintf(m->labels, sizeof(m->labels), "%s", labels ? labels : "");
+    m->help = help;
+    atomic_store_explicit(&registry.count, n + 1, memory_order_release);
+    return m;
+}
+
+static Metric *add_metric(MetricType type, const char *name, const char *labels, const char *help)
+{
+    pthread_mutex_lock(&registry.mutex);
+    Metric *m = add_metric_locked(type, name, labels, help);
+    pthread_mutex_unlock(&registry.mutex);
+    return m;
+}
+
+Metric *metrics_counter(const char *name, const char *labels, const char *help)
+{
+    return add_metric(METRIC_COUNTER, name, labels, help);
+}
+
+Metric *metrics_gauge(const char *name, const char *labels, const char *help)
+{
+    return add_metric(METRIC_GAUGE, name, labels, help);
+}
+
+Metric *metrics_histogram(const char *name, const char *labels, const char *help)
+{
+    return add_metric(METRIC_HISTOGRAM, name, labels, help);
+}
+
+Metric *metrics_rate(const char *name, const char *labels, const char *help, const Metric *source, double scale)
+{
+    if (!source)
+    {
+        return NULL;
+    }
+    Metric *m = add_metric(METRIC_RATE, name, labels, help);
+    if (m)
+    {
+        m->source = source;
+        m->scale = scale;
+    }
+    return m;
+}
+
+void metrics_observe_us(Metric *m, int64_t us)
+{
+    if (!m)
+    {
+        return;
+    }
+    int i = 0;
+    while (i < METRICS_BUCKETS && us > bucket_us[i])
+    {
+        i++;
+    }
+    //桶里只记自己这一段，导出时再累加；超过最大桶的只算进 count
+    if (i < METRICS_BUCKETS)
+    {
+        atomic_fetch_add_explicit(&m->buckets[i], 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&m->value, us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->count, 1, memory_order_relaxed);
+}
+
+//trace span 结束时调用，可能在音频回调线程里，不加锁也不分配内存：
+//先按名字的地址找，第一次遇到的地址按内容找到 metrics_init 注册的直方图，再用 CAS 占一个槽位记下来
+static void stage_sink(const char *name, int stream, int64_t dur_us)
+{
+    (void)stream;
+    for (int i = 0; i < METRICS_MAX_STAGES; i++)
+    {
+        const char *n = atomic_load_explicit(&registry.stages[i].name, memory_order_acquire);
+        if (!n)
+        {
+            break;
+        }
+        if (n == name)
+        {
+            Metric *histogram = atomic_load_explicit(&registry.stages[i].histogram, memory_order_acquire);
+            if (histogram)
+            {
+                metrics_observe_us(histogram, dur_us);
+                return;
+            }
+            //另一个线程刚占了槽位，还没有写直方图
+            break;
+        }
+    }
+    Metric *histogram = NULL;
+    for (int i = 0; i < NB_STAGE_NAMES; i++)
+    {
+        if (!strcmp(stage_names[i], name))
+        {
+            histogram = registry.stage_histograms[i];
+            break;
+        }
+    }
+    if (!histogram)
+    {
+        return;
+    }
+    for (int i = 0; i < METRICS_MAX_STAGES; i++)
+    {
+        const char *expected = NULL;
+        if (atomic_compare_exchange_strong(&registry.stages[i].name, &expected, name))
+        {
+            atomic_store_explicit(&registry.stages[i].histogram, histogram, memory_order_release);
+            break;
+        }
+        if (expected == name)
+        {
+            break;
+        }
+    }
+    metrics_observe_us(histogram, dur_us);
+}
+
+static const char *type_name(MetricType type)
+{
+    switch (type)
+    {
+    case METRIC_COUNTER:
+        return "counter";
+    case METRIC_HISTOGRAM:
+        return "histogram";
+    default:
+        return "gauge";
+    }
+}
+
+static void print_sample(AVBPrint *bp, const Metric *m, const char *suffix, const char *le, const char *value)
+{
+    av_bprintf(bp, "%s%s", m->name, suffix);
+    if (m->labels[0] || le)
+    {
+        av_bprintf(bp, "{%s%s", m->labels, m->labels[0] && le ? "," : "");
+        if (le)
+        {
+            av_bprintf(bp, "le=\"%s\"", le);
+        }
+        av_bprintf(bp, "}");
+    }
+    av_bprintf(bp, " %s\n", value);
+}
+
+static void render_metric(AVBPrint *bp, Metric *m, int64_t now)
+{
+    char value[64];
+    switch (m->type)
+    {
+    case METRIC_COUNTER:
+    case METRIC_GAUGE:
+        snprintf(value, sizeof(value), "%" PRId64, atomic_load_explicit(&m->value, memory_order_relaxed));
+        print_sample(bp, m, "", NULL, value);
+        break;
+    case METRIC_RATE:
+    {
+        int64_t cur = atomic_load_explicit(&m->source->value, memory_order_relaxed);
+        if (!m->last_time)
+        {
+            m->last_time = now;
+            m->last_value = cur;
+        }
+        else if (now - m->last_time >= METRICS_RATE_MIN_US)
+        {
+            m->rate = (double)(cur - m->last_value) * m->scale * 1000000.0 / (now - m->last_time);
+            m->last_time = now;
+            m->last_value = cur;
+        }
+        snprintf(value, sizeof(value), "%.3f", m->rate);
+        print_sample(bp, m, "", NULL, value);
+        break;
+    }
+    case METRIC_HISTOGRAM:
+    {
+        char le[32];
+        int64_t cumulative = 0;
+        for (int i = 0; i < METRICS_BUCKETS; i++)
+        {
+            cumulative += atomic_load_explicit(&m->buckets[i], memory_order_relaxed);
+            snprintf(le, sizeof(le), "%g", bucket_us[i] / 1000000.0);
+            snprintf(value, sizeof(value), "%" PRId64, cumulative);
+            print_sample(bp, m, "_bucket", le, value);
+        }
+        //count 最后读，+Inf 不会比前面的桶小
+        int64_t count = atomic_load_explicit(&m->count, memory_order_relaxed);
+        if (count < cumulative)
+        {
+            count = cumulative;
+        }
+        snprintf(value, sizeof(value), "%" PRId64, count);
+        print_sample(bp, m, "_bucket", "+Inf", value);
+        snprintf(value, sizeof(value), "%.6f", atomic_load_explicit(&m->value, memory_order_relaxed) / 1000000.0);
+        print_sample(bp, m, "_sum", NULL, value);
+        snprintf(value, sizeof(value), "%" PRId64, count);
+        print_sample(bp, m, "_count", NULL, value);
+        break;
+    }
+    }
+}
+
+//同名的指标（标签不同）必须连在一起输出，HELP 和 TYPE 只写一次
+static void render(AVBPrint *bp)
+{
+    int n = atomic_load_explicit(&registry.count, memory_order_acquire);
+    int64_t now = av_gettime_relative();
+    for (int i = 0; i < n; i++)
+    {
+        Metric *m = &registry.metrics[i];
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++)
+        {
+            seen = !strcmp(registry.metrics[j].name, m->name);
+        }
+        if (seen)
+        {
+            continue;
+        }
+        av_bprintf(bp, "# HELP %s %s\n# TYPE %s %s\n", m->name, m->help ? m->help : "", m->name, type_name(m->type));
+        for (int j = i; j < n; j++)
+        {
+            if (!strcmp(registry.metrics[j].name, m->name))
+            {
+                render_metric(bp, &registry.metrics[j], now);
+            }
+        }
+    }
+}
+
+static void write_file(void)
+{
+    AVBPrint bp;
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    render(&bp);
+    char *tmp_path = av_asprintf("%s.tmp", registry.path);
+    FILE *fp = tmp_path ? fopen(tmp_path, "w") : NULL;
+    if (fp)
+    {
+        int ok = av_bprint_is_complete(&bp) && fwrite(bp.str, 1, bp.len, fp) == bp.len;
+        if (fclose(fp) != 0 || !ok || rename(tmp_path, registry.path) < 0)
+        {
+            unlink(tmp_path);
+        }
+    }
+    av_free(tmp_path);
+    av_bprint_finalize(&bp, NULL);
+}
+
+static int write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+//每个连接只回一次指标就关闭，请求内容不解析
+static void serve_client(void)
+{
+    int fd = accept(registry.listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    char request[2048];
+    ssize_t n = recv(fd, request, sizeof(request), 0);
+    if (n > 0)
+    {
+        AVBPrint bp;
+        av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+        render(&bp);
+        if (av_bprint_is_complete(&bp))
+        {
+            char header[160];
+            int len = snprintf(header, sizeof(header),
+                               "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+                               bp.len);
+            if (write_all(fd, header, (size_t)len) == 0)
+            {
+                write_all(fd, bp.str, bp.len);
+            }
+        }
+        av_bprint_finalize(&bp, NULL);
+    }
+    close(fd);
+}
+
+static void *export_thread(void *arg)
+{
+    (void)arg;
+    while (!atomic_load(&registry.quit))
+    {
+        if (registry.mode == METRICS_MODE_FILE)
+        {
+            write_file();
+            for (int waited = 0; waited < registry.interval_ms && !atomic_load(&registry.quit); waited += METRICS_POLL_MS)
+            {
+                av_usleep(METRICS_POLL_MS * 1000);
+            }
+            continue;
+        }
+        struct pollfd pfd = {registry.listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, METRICS_POLL_MS) > 0)
+        {
+            serve_client();
+        }
+    }
+    return NULL;
+}
+
+static int open_listen_socket(void)
+{
+    int fd;
+    if (registry.mode == METRICS_MODE_HTTP)
+    {
+        int port = atoi(registry.path);
+        if (port <= 0 || port > 65535)
+        {
+            return AVERROR(EINVAL);
+        }
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return AVERROR(errno);
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        //只监听本机
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            int ret = AVERROR(errno);
+            close(fd);
+            return ret;
+        }
+    }
+    else
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(registry.path) >= sizeof(addr.sun_path))
+        {
+            return AVERROR(ENAMETOOLONG);
+        }
+        strcpy(addr.sun_path, registry.path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return AVERROR(errno);
+        }
+        //上次异常退出留下的 socket 文件
+        unlink(registry.path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            int ret = AVERROR(errno);
+            close(fd);
+            return ret;
+        }
+    }
+    if (listen(fd, 8) < 0)
+    {
+        int ret = AVERROR(errno);
+        close(fd);
+        return ret;
+    }
+    registry.listen_fd = fd;
+    return 0;
+}
+
+//file:路径[:间隔毫秒]、http:端口、unix:路径
+static int parse_spec(const char *spec)
+{
+    registry.interval_ms = METRICS_FILE_INTERVAL_MS;
+    if (!strncmp(spec, "file:", 5))
+    {
+        registry.mode = METRICS_MODE_FILE;
+        registry.path = av_strdup(spec + 5);
+        char *colon = registry.path ? strrchr(registry.path, ':') : NULL;
+        if (colon && colon[1] && strspn(colon + 1, "0123456789") == strlen(colon + 1))
+        {
+            registry.interval_ms = atoi(colon + 1);
+            *colon = 0;
+        }
+    }
+    else if (!strncmp(spec, "http:", 5))
+    {
+        registry.mode = METRICS_MODE_HTTP;
+        registry.path = av_strdup(spec + 5);
+    }
+    else if (!strncmp(spec, "unix:", 5))
+    {
+        registry.mode = METRICS_MODE_UNIX;
+        registry.path = av_strdup(spec + 5);
+    }
+    else
+    {
+        return AVERROR(EINVAL);
+    }
+    if (!registry.path || !registry.path[0])
+    {
+        av_freep(&registry.path);
+        return AVERROR(EINVAL);
+    }
+    if (registry.interval_ms < METRICS_POLL_MS)
+    {
+        registry.interval_ms = METRICS_POLL_MS;
+    }
+    return 0;
+}
+
+int metrics_init(const char *spec)
+{
+    static int registered;
+    if (registry.running)
+    {
+        return 0;
+    }
+    if (!spec)
+    {
+        spec = getenv(METRICS_ENV);
+    }
+    if (!spec || !spec[0])
+    {
+        return 0;
+    }
+    int ret = parse_spec(spec);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "metrics: bad spec %s, expected file:path[:ms], http:port or unix:path.\n", spec);
+        return ret;
+    }
+    if (registry.mode != METRICS_MODE_FILE && (ret = open_listen_socket()) < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "metrics: cannot listen on %s: %s.\n", spec, av_err2str(ret));
+        av_freep(&registry.path);
+        return ret;
+    }
+    atomic_store(&registry.quit, 0);
+    registry.running = 1;
+    if (pthread_create(&registry.thread, NULL, export_thread, NULL))
+    {
+        registry.running = 0;
+        if (registry.listen_fd >= 0)
+        {
+            close(registry.listen_fd);
+            registry.listen_fd = -1;
+        }
+        av_freep(&registry.path);
+        return AVERROR(EAGAIN);
+    }
+    //所有 trace span 的耗时都进延迟直方图，直方图在这里一次注册好，stage_sink 里不用加锁；
+    //重新 init 时沿用上次的
+    for (int i = 0; i < NB_STAGE_NAMES; i++)
+    {
+        if (!registry.stage_histograms[i])
+        {
+            char labels[64];
+            snprintf(labels, sizeof(labels), "stage=\"%s\"", stage_names[i]);
+            registry.stage_histograms[i] = metrics_histogram("media_stage_latency_seconds", labels,
+                                                             "Time spent in one pipeline stage call.");
+        }
+    }
+    trace_set_sink(stage_sink);
+    if (!registered)
+    {
+        atexit(metrics_shutdown);
+        registered = 1;
+    }
+    av_log(NULL, AV_LOG_INFO, "metrics: exporting to %s.\n", spec);
+    return 0;
+}
+
+void metrics_shutdown(void)
+{
+    if (!registry.running)
+    {
+        return;
+    }
+    trace_set_sink(NULL);
+    atomic_store(&registry.quit, 1);
+    pthread_join(registry.thread, NULL);
+    if (registry.mode == METRICS_MODE_FILE)
+    {
+        //最终值
+        write_file();
+    }
+    if (registry.listen_fd >= 0)
+    {
+        close(registry.listen_fd);
+        registry.listen_fd = -1;
+    }
+    if (registry.mode == METRICS_MODE_UNIX)
+    {
+        unlink(registry.path);
+    }
+    av_freep(&registry.path);
+    //指标本身不释放，热路径上可能还有线程在更新
+    registry.running = 0;
+}
@@ -0,0 +1,76 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+//运行时指标，按 Prometheus 文本格式导出，给机群的监控面板用：
+//  file:路径[:间隔毫秒]  定时写文件（先写临时文件再 rename），配合 node_exporter 的 textfile 收集器
+//  http:端口             在 127.0.0.1 上提供 HTTP，任意路径都返回指标
+//  unix:路径             UNIX socket 上的 HTTP，curl --unix-socket 路径 http://x/metrics
+//热路径上只有原子加法，不加锁；导出线程读取原子值并格式化
+#define METRICS_ENV "METRICS"
+#define METRICS_MAX 128
+#define METRICS_FILE_INTERVAL_MS 1000
+//延迟直方图的桶（微秒），导出时换算成秒
+#define METRICS_BUCKETS 14
+
+typedef enum MetricType
+{
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+    //导出时由另一个计数器的增量算出的每秒速率，比如编码 fps、码率
+    METRIC_RATE,
+} MetricType;
+
+typedef struct Metric
+{
+    MetricType type;
+    char name[64];
+    //Prometheus 标签，例如 type="video"，可以为空
+    char labels[64];
+    const char *help;
+    //计数器、仪表的值；直方图是观测值之和（微秒）
+    _Atomic int64_t value;
+    //直方图
+    _Atomic int64_t count;
+    _Atomic int64_t buckets[METRICS_BUCKETS];
+    //速率，只有导出线程访问
+    const struct Metric *source;
+    double scale;
+    int64_t last_value;
+    int64_t last_time;
+    double rate;
+} Metric;
+
+//spec 为 NULL 时用环境变量 METRICS；没有配置时返回 0，之后创建的指标都是 NULL
+int metrics_init(const char *spec);
+//停止导出线程，file 模式最后再写一次；也注册在 atexit 里
+void metrics_shutdown(void);
+
+//创建指标，没有启用或者超过 METRICS_MAX 时返回 NULL，下面的更新函数对 NULL 什么也不做
+Metric *metrics_counter(const char *name, const char *labels, const char *help);
+Metric *metrics_gauge(const char *name, const char *labels, const char *help);
+Metric *metrics_histogram(const char *name, const char *labels, const char *help);
+Metric *metrics_rate(const char *name, const char *labels, const char *help, const Metric *source, double scale);
+
+static inline void metrics_add(Metric *m, int64_t v)
+{
+    if (m)
+    {
+        atomic_fetch_add_explicit(&m->value, v, memory_order_relaxed);
+    }
+}
+
+static inline void metrics_set(Metric *m, int64_t v)
+{
+    if (m)
+    {
+        atomic_store_explicit(&m->value, v, memory_order_relaxed);
+    }
+}
+
+void metrics_observe_us(Metric *m, int64_t us);
+
+#endif
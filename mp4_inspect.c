@@ -0,0 +1,1072 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//不依赖 libavformat 的 MP4/ISOBMFF box 解析：整个文件 mmap 进来，直接在映射的内存上读 box 头和表，
+//不拷贝也不分配和文件大小相关的内存，mdat 的内容完全不会读到
+//./mp4_inspect [-entries n] file          打印 box 树、采样表、分片结构和 moov 的位置
+//./mp4_inspect -faststart file            moov 是否在 mdat 之前，是返回 0，不是返回 1
+//./mp4_inspect -keyframes [-track id] file 列出关键帧（默认所有视频轨）
+
+#define TAG(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+#define MAX_DEPTH 32
+#define MAX_TRACKS 64
+//trun 的 sample_flags 里 sample_is_non_sync_sample 位
+#define SAMPLE_FLAG_NON_SYNC 0x00010000
+
+typedef struct Mp4File
+{
+    const uint8_t *data;
+    uint64_t size;
+} Mp4File;
+
+typedef struct Box
+{
+    uint32_t type;
+    //box 在文件中的位置和总大小
+    uint64_t offset;
+    uint64_t size;
+    //负载（box 头之后）
+    const uint8_t *data;
+    uint64_t data_size;
+} Box;
+
+//采样表：指向映射内存里的第一个 entry
+typedef struct Table
+{
+    const uint8_t *entries;
+    uint32_t count;
+} Table;
+
+typedef struct Track
+{
+    uint32_t id;
+    uint32_t handler;
+    uint32_t timescale;
+    uint32_t codec;
+    Table stts;
+    Table ctts;
+    Table stss;
+    Table stsc;
+    Table stco;
+    //co64 时 chunk 偏移是 8 字节
+    int co64;
+    //stsz：sample_size 非 0 时所有 sample 一样大，没有表
+    uint32_t sample_size;
+    Table stsz;
+    //mvex/trex 的默认值，分片文件使用
+    uint32_t trex_duration;
+    uint32_t trex_size;
+    uint32_t trex_flags;
+    //分片里没有 tfdt 时接着上一个分片的时间
+    uint64_t frag_dts;
+} Track;
+
+typedef struct Inspector
+{
+    Mp4File mp4;
+    //打印表的前多少项，0 只打印个数
+    uint32_t entries;
+    //树形打印时当前轨道的 handler，stsd 按它解释采样描述
+    uint32_t handler;
+    Track tracks[MAX_TRACKS];
+    int nb_tracks;
+} Inspector;
+
+static uint16_t rb16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t rb24(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+}
+
+static uint32_t rb32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint64_t rb64(const uint8_t *p)
+{
+    return (uint64_t)rb32(p) << 32 | rb32(p + 4);
+}
+
+static const char *fourcc(uint32_t tag, char buf[5])
+{
+    for (int i = 0; i < 4; i++)
+    {
+        char c = (char)(tag >> (24 - 8 * i));
+        buf[i] = (c >= 0x20 && c < 0x7f) ? c : '.';
+    }
+    buf[4] = 0;
+    return buf;
+}
+
+//在 [pos, end) 里读一个 box，越界或大小不合法返回 -1
+static int read_box(const Mp4File *mp4, uint64_t pos, uint64_t end, Box *box)
+{
+    if (pos > end || end - pos < 8)
+    {
+        return -1;
+    }
+    const uint8_t *p = mp4->data + pos;
+    uint64_t size = rb32(p);
+    uint64_t header = 8;
+    box->type = rb32(p + 4);
+    if (size == 1)
+    {
+        if (end - pos < 16)
+        {
+            return -1;
+        }
+        size = rb64(p + 8);
+        header = 16;
+    }
+    else if (size == 0)
+    {
+        //一直到文件（或上层 box）结束
+        size = end - pos;
+    }
+    if (box->type == TAG('u', 'u', 'i', 'd'))
+    {
+        header += 16;
+    }
+    if (size < header || size > end - pos)
+    {
+        return -1;
+    }
+    box->offset = pos;
+    box->size = size;
+    box->data = p + header;
+    box->data_size = size - header;
+    return 0;
+}
+
+//full box 的表：version/flags 之后 skip 字节是表头，然后是 count 和 count 个 entry_size 字节的项
+static int read_table(const Box *box, uint64_t skip, uint32_t entry_size, Table *table)
+{
+    if (box->data_size < 8 + skip)
+    {
+        return -1;
+    }
+    uint32_t count = rb32(box->data + 4 + skip);
+    if ((uint64_t)count * entry_size > box->data_size - 8 - skip)
+    {
+        return -1;
+    }
+    table->count = count;
+    table->entries = box->data + 8 + skip;
+    return 0;
+}
+
+static int is_container(uint32_t type)
+{
+    switch (type)
+    {
+    case TAG('m', 'o', 'o', 'v'):
+    case TAG('t', 'r', 'a', 'k'):
+    case TAG('e', 'd', 't', 's'):
+    case TAG('m', 'd', 'i', 'a'):
+    case TAG('m', 'i', 'n', 'f'):
+    case TAG('d', 'i', 'n', 'f'):
+    case TAG('s', 't', 'b', 'l'):
+    case TAG('m', 'v', 'e', 'x'):
+    case TAG('m', 'o', 'o', 'f'):
+    case TAG('t', 'r', 'a', 'f'):
+    case TAG('m', 'f', 'r', 'a'):
+    case TAG('u', 'd', 't', 'a'):
+    case TAG('t', 'r', 'e', 'f'):
+    case TAG('i', 'l', 's', 't'):
+    case TAG('s', 'i', 'n', 'f'):
+    case TAG('s', 'c', 'h', 'i'):
+        return 1;
+    }
+    return 0;
+}
+
+//meta 在 ISO 里是 full box，QuickTime 里不是：前 4 个字节为 0 时当作 version/flags
+static uint64_t children_start(const Box *box)
+{
+    if (box->type == TAG('m', 'e', 't', 'a') && box->data_size >= 4 && rb32(box->data) == 0)
+    {
+        return 4;
+    }
+    return 0;
+}
+
+static Track *find_track(Inspector *ins, uint32_t id)
+{
+    for (int i = 0; i < ins->nb_tracks; i++)
+    {
+        if (ins->tracks[i].id == id)
+        {
+            return &ins->tracks[i];
+        }
+    }
+    return NULL;
+}
+
+static void print_indent(int depth)
+{
+    for (int i = 0; i < depth; i++)
+    {
+        printf("  ");
+    }
+}
+
+//表的前 n 项，每项 fields 个 32 位字段
+static void print_entries(const Inspector *ins, const Table *table, int fields, int depth)
+{
+    uint32_t n = table->count < ins->entries ? table->count : ins->entries;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        print_indent(depth + 1);
+        printf("[%" PRIu32 "]", i);
+        for (int f = 0; f < fields; f++)
+        {
+            printf(" %" PRIu32, rb32(table->entries + ((uint64_t)i * fields + f) * 4));
+        }
+        printf("\n");
+    }
+    if (table->count > n && n > 0)
+    {
+        print_indent(depth + 1);
+        printf("... %" PRIu32 " more\n", table->count - n);
+    }
+}
+
+static void walk_children(Inspector *ins, const Box *parent, uint64_t start, int depth);
+
+//采样描述：视频的宽高、音频的声道和采样率，然后是 avcC、esds 等子 box
+static void print_sample_entries(Inspector *ins, const Box *box, int depth)
+{
+    if (box->data_size < 8)
+    {
+        return;
+    }
+    uint64_t base = (uint64_t)(box->data - ins->mp4.data);
+    uint64_t pos = base + 8;
+    uint64_t end = base + box->data_size;
+    uint32_t count = rb32(box->data + 4);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Box entry;
+        char tag[5];
+        if (read_box(&ins->mp4, pos, end, &entry) < 0)
+        {
+            break;
+        }
+        print_indent(depth + 1);
+        printf("%s offset=%" PRIu64 " size=%" PRIu64, fourcc(entry.type, tag), entry.offset, entry.size);
+        uint64_t fixed = 0;
+        if (ins->handler == TAG('v', 'i', 'd', 'e') && entry.data_size >= 78)
+        {
+            printf(" width=%u height=%u", rb16(entry.data + 24), rb16(entry.data + 26));
+            fixed = 78;
+        }
+        else if (ins->handler == TAG('s', 'o', 'u', 'n') && entry.data_size >= 28)
+        {
+            //QuickTime 的 version 1/2 声音描述更长
+            uint16_t version = rb16(entry.data + 8);
+            printf(" channels=%u bits=%u rate=%u", rb16(entry.data + 16), rb16(entry.data + 18), rb16(entry.data + 24));
+            fixed = version == 1 ? 28 + 16 : version == 2 ? 28 + 36 : 28;
+        }
+        printf("\n");
+        if (fixed && fixed <= entry.data_size)
+        {
+            walk_children(ins, &entry, fixed, depth + 2);
+        }
+        pos += entry.size;
+    }
+}
+
+//box 自己的字段，打印在同一行，表的内容在下面几行
+static void print_details(Inspector *ins, const Box *box, int depth)
+{
+    const uint8_t *d = box->data;
+    uint64_t n = box->data_size;
+    uint8_t version = n > 0 ? d[0] : 0;
+    char tag[5];
+    Table table;
+    switch (box->type)
+    {
+    case TAG('f', 't', 'y', 'p'):
+    case TAG('s', 't', 'y', 'p'):
+        if (n >= 8)
+        {
+            printf(" major=%s minor=%" PRIu32 " compatible=", fourcc(rb32(d), tag), rb32(d + 4));
+            for (uint64_t i = 8; i + 4 <= n; i += 4)
+            {
+                printf("%s%s", i > 8 ? "," : "", fourcc(rb32(d + i), tag));
+            }
+        }
+        break;
+    case TAG('m', 'v', 'h', 'd'):
+    case TAG('m', 'd', 'h', 'd'):
+        if (version == 1 && n >= 32)
+        {
+            printf(" timescale=%" PRIu32 " duration=%" PRIu64, rb32(d + 20), rb64(d + 24));
+        }
+        else if (version == 0 && n >= 20)
+        {
+            printf(" timescale=%" PRIu32 " duration=%" PRIu32, rb32(d + 12), rb32(d + 16));
+        }
+        break;
+    case TAG('t', 'k', 'h', 'd'):
+        if (version == 1 && n >= 96)
+        {
+            printf(" track_id=%" PRIu32 " width=%" PRIu32 " height=%" PRIu32, rb32(d + 20), rb32(d + 88) >> 16, rb32(d + 92) >> 16);
+        }
+        else if (version == 0 && n >= 84)
+        {
+            printf(" track_id=%" PRIu32 " width=%" PRIu32 " height=%" PRIu32, rb32(d + 12), rb32(d + 76) >> 16, rb32(d + 80) >> 16);
+        }
+        break;
+    case TAG('h', 'd', 'l', 'r'):
+        if (n >= 12)
+        {
+            ins->handler = rb32(d + 8);
+            printf(" handler=%s", fourcc(ins->handler, tag));
+        }
+        break;
+    case TAG('s', 't', 's', 'd'):
+        if (n >= 8)
+        {
+            printf(" entries=%" PRIu32 "\n", rb32(d + 4));
+            print_sample_entries(ins, box, depth);
+            return;
+        }
+        break;
+    case TAG('s', 't', 't', 's'):
+    case TAG('c', 't', 't', 's'):
+    case TAG('s', 't', 's', 'c'):
+    case TAG('s', 't', 's', 's'):
+    case TAG('s', 't', 'c', 'o'):
+    case TAG('c', 'o', '6', '4'):
+    {
+        int fields = box->type == TAG('s', 't', 's', 'c') ? 3 : box->type == TAG('s', 't', 't', 's') || box->type == TAG('c', 't', 't', 's') || box->type == TAG('c', 'o', '6', '4') ? 2 : 1;
+        if (read_table(box, 0, fields * 4, &table) == 0)
+        {
+            printf(" entries=%" PRIu32 "\n", table.count);
+            print_entries(ins, &table, fields, depth);
+            return;
+        }
+        break;
+    }
+    case TAG('s', 't', 's', 'z'):
+        if (n >= 12)
+        {
+            uint32_t sample_size = rb32(d + 4);
+            printf(" sample_size=%" PRIu32 " samples=%" PRIu32, sample_size, rb32(d + 8));
+            if (!sample_size && read_table(box, 4, 4, &table) == 0)
+            {
+                printf("\n");
+                print_entries(ins, &table, 1, depth);
+                return;
+            }
+        }
+        break;
+    case TAG('a', 'v', 'c', 'C'):
+        if (n >= 4)
+        {
+            printf(" profile=%u level=%u", d[1], d[3]);
+        }
+        break;
+    case TAG('m', 'f', 'h', 'd'):
+        if (n >= 8)
+        {
+            printf(" sequence=%" PRIu32, rb32(d + 4));
+        }
+        break;
+    case TAG('t', 'f', 'h', 'd'):
+        if (n >= 8)
+        {
+            printf(" track_id=%" PRIu32 " flags=0x%06" PRIx32, rb32(d + 4), rb24(d + 1));
+        }
+        break;
+    case TAG('t', 'f', 'd', 't'):
+        if (version == 1 && n >= 12)
+        {
+            printf(" base_media_decode_time=%" PRIu64, rb64(d + 4));
+        }
+        else if (n >= 8)
+        {
+            printf(" base_media_decode_time=%" PRIu32, rb32(d + 4));
+        }
+        break;
+    case TAG('t', 'r', 'u', 'n'):
+        if (n >= 8)
+        {
+            printf(" samples=%" PRIu32 " flags=0x%06" PRIx32, rb32(d + 4), rb24(d + 1));
+        }
+        break;
+    case TAG('t', 'r', 'e', 'x'):
+        if (n >= 24)
+        {
+            printf(" track_id=%" PRIu32 " default_duration=%" PRIu32 " default_size=%" PRIu32 " default_flags=0x%08" PRIx32,
+                   rb32(d + 4), rb32(d + 12), rb32(d + 16), rb32(d + 20));
+        }
+        break;
+    case TAG('s', 'i', 'd', 'x'):
+        if (n >= (version == 1 ? 32 : 24))
+        {
+            printf(" reference_id=%" PRIu32 " timescale=%" PRIu32 " references=%u", rb32(d + 4), rb32(d + 8), rb16(d + (version == 1 ? 30 : 22)));
+        }
+        break;
+    case TAG('d', 'a', 't', 'a'):
+        //ilst 里的值，类型 1 是 UTF-8 文本
+        if (n >= 8 && rb24(d + 1) == 1)
+        {
+            int len = (int)(n - 8 > 60 ? 60 : n - 8);
+            printf(" text=\"%.*s\"%s", len, (const char *)d + 8, n - 8 > 60 ? "..." : "");
+        }
+        break;
+    }
+    printf("\n");
+}
+
+static void walk_children(Inspector *ins, const Box *parent, uint64_t start, int depth)
+{
+    uint64_t base = (uint64_t)(parent->data - ins->mp4.data);
+    uint64_t pos = base + start;
+    uint64_t end = base + parent->data_size;
+    while (pos < end)
+    {
+        Box box;
+        char tag[5];
+        if (read_box(&ins->mp4, pos, end, &box) < 0)
+        {
+            print_indent(depth);
+            printf("<invalid box at %" PRIu64 ">\n", pos);
+            return;
+        }
+        print_indent(depth);
+        printf("%s offset=%" PRIu64 " size=%" PRIu64, fourcc(box.type, tag), box.offset, box.size);
+        print_details(ins, &box, depth);
+        //ilst 的每一项也是容器，里面是 data
+        int container = is_container(box.type) || box.type == TAG('m', 'e', 't', 'a') || parent->type == TAG('i', 'l', 's', 't');
+        if (container && depth < MAX_DEPTH)
+        {
+            walk_children(ins, &box, children_start(&box), depth + 1);
+        }
+        pos += box.size;
+    }
+}
+
+//stbl 里的表挂到轨道上
+static void collect_stbl(Track *t, const Box *stbl, const Mp4File *mp4)
+{
+    uint64_t base = (uint64_t)(stbl->data - mp4->data);
+    uint64_t pos = base;
+    uint64_t end = base + stbl->data_size;
+    Box box;
+    while (read_box(mp4, pos, end, &box) == 0)
+    {
+        switch (box.type)
+        {
+        case TAG('s', 't', 's', 'd'):
+            if (box.data_size >= 16)
+            {
+                t->codec = rb32(box.data + 12);
+            }
+            break;
+        case TAG('s', 't', 't', 's'):
+            read_table(&box, 0, 8, &t->stts);
+            break;
+        case TAG('c', 't', 't', 's'):
+            read_table(&box, 0, 8, &t->ctts);
+            break;
+        case TAG('s', 't', 's', 's'):
+            read_table(&box, 0, 4, &t->stss);
+            break;
+        case TAG('s', 't', 's', 'c'):
+            read_table(&box, 0, 12, &t->stsc);
+            break;
+        case TAG('s', 't', 'c', 'o'):
+            read_table(&box, 0, 4, &t->stco);
+            t->co64 = 0;
+            break;
+        case TAG('c', 'o', '6', '4'):
+            read_table(&box, 0, 8, &t->stco);
+            t->co64 = 1;
+            break;
+        case TAG('s', 't', 's', 'z'):
+            if (box.data_size >= 12)
+            {
+                t->sample_size = rb32(box.data + 4);
+                if (!t->sample_size)
+                {
+                    read_table(&box, 4, 4, &t->stsz);
+                }
+                else
+                {
+                    t->stsz.count = rb32(box.data + 8);
+                }
+            }
+            break;
+        }
+        pos += box.size;
+    }
+}
+
+//递归找 trak 里需要的 box，moov/mvex 里的 trex 也在这里处理
+static void collect(Inspector *ins, const Box *parent, Track *t, int depth)
+{
+    uint64_t base = (uint64_t)(parent->data - ins->mp4.data);
+    uint64_t pos = base;
+    uint64_t end = base + parent->data_size;
+    Box box;
+    while (depth < MAX_DEPTH && read_box(&ins->mp4, pos, end, &box) == 0)
+    {
+        const uint8_t *d = box.data;
+        switch (box.type)
+        {
+        case TAG('t', 'r', 'a', 'k'):
+            if (ins->nb_tracks < MAX_TRACKS)
+            {
+                Track *track = &ins->tracks[ins->nb_tracks++];
+                memset(track, 0, sizeof(Track));
+                collect(ins, &box, track, depth + 1);
+            }
+            break;
+        case TAG('m', 'd', 'i', 'a'):
+        case TAG('m', 'i', 'n', 'f'):
+        case TAG('m', 'v', 'e', 'x'):
+            collect(ins, &box, t, depth + 1);
+            break;
+        case TAG('s', 't', 'b', 'l'):
+            if (t)
+            {
+                collect_stbl(t, &box, &ins->mp4);
+            }
+            break;
+        case TAG('t', 'k', 'h', 'd'):
+            if (t && box.data_size >= 24)
+            {
+                t->id = rb32(d + (d[0] == 1 ? 20 : 12));
+            }
+            break;
+        case TAG('m', 'd', 'h', 'd'):
+            if (t && box.data_size >= 24)
+            {
+                t->timescale = rb32(d + (d[0] == 1 ? 20 : 12));
+            }
+            break;
+        case TAG('h', 'd', 'l', 'r'):
+            if (t && box.data_size >= 12)
+            {
+                t->handler = rb32(d + 8);
+            }
+            break;
+        case TAG('t', 'r', 'e', 'x'):
+            //mvex 在所有 trak 之后，这时轨道都已经收集好了
+            if (box.data_size >= 24)
+            {
+                Track *track = find_track(ins, rb32(d + 4));
+                if (track)
+                {
+                    track->trex_duration = rb32(d + 12);
+                    track->trex_size = rb32(d + 16);
+                    track->trex_flags = rb32(d + 20);
+                }
+            }
+            break;
+        }
+        pos += box.size;
+    }
+}
+
+//顺序遍历一个轨道的 sample：同时推进 stts、ctts、stsc、stco、stsz，内存占用是常数
+typedef struct SampleIter
+{
+    const Track *t;
+    uint32_t sample;
+    uint32_t nb_samples;
+    uint64_t dts;
+    uint32_t stts_index;
+    uint32_t stts_left;
+    uint32_t ctts_index;
+    uint32_t ctts_left;
+    uint32_t stsc_index;
+    uint32_t chunk;
+    uint32_t chunk_samples;
+    uint32_t in_chunk;
+    uint64_t offset;
+} SampleIter;
+
+static uint64_t chunk_offset(const Track *t, uint32_t chunk)
+{
+    if (chunk >= t->stco.count)
+    {
+        return 0;
+    }
+    return t->co64 ? rb64(t->stco.entries + (uint64_t)chunk * 8) : rb32(t->stco.entries + (uint64_t)chunk * 4);
+}
+
+static uint32_t sample_size(const SampleIter *it)
+{
+    if (it->t->sample_size)
+    {
+        return it->t->sample_size;
+    }
+    return it->sample < it->t->stsz.count ? rb32(it->t->stsz.entries + (uint64_t)it->sample * 4) : 0;
+}
+
+static int32_t sample_cts(const SampleIter *it)
+{
+    if (it->ctts_index >= it->t->ctts.count)
+    {
+        return 0;
+    }
+    return (int32_t)rb32(it->t->ctts.entries + (uint64_t)it->ctts_index * 8 + 4);
+}
+
+//跳过 count 为 0 的项
+static void skip_empty(const Table *table, uint32_t *index, uint32_t *left)
+{
+    while (*left == 0 && *index + 1 < table->count)
+    {
+        (*index)++;
+        *left = rb32(table->entries + (uint64_t)*index * 8);
+    }
+}
+
+static void iter_init(SampleIter *it, const Track *t)
+{
+    memset(it, 0, sizeof(SampleIter));
+    it->t = t;
+    it->nb_samples = t->stsz.count;
+    it->stts_left = t->stts.count ? rb32(t->stts.entries) : 0;
+    skip_empty(&t->stts, &it->stts_index, &it->stts_left);
+    it->ctts_left = t->ctts.count ? rb32(t->ctts.entries) : 0;
+    skip_empty(&t->ctts, &it->ctts_index, &it->ctts_left);
+    it->chunk_samples = t->stsc.count ? rb32(t->stsc.entries + 4) : 0;
+    it->offset = chunk_offset(t, 0);
+}
+
+static void iter_next(SampleIter *it)
+{
+    const Track *t = it->t;
+    if (it->stts_index < t->stts.count)
+    {
+        it->dts += rb32(t->stts.entries + (uint64_t)it->stts_index * 8 + 4);
+        if (it->stts_left > 0)
+        {
+            it->stts_left--;
+        }
+        skip_empty(&t->stts, &it->stts_index, &it->stts_left);
+    }
+    if (it->ctts_left > 0)
+    {
+        it->ctts_left--;
+        skip_empty(&t->ctts, &it->ctts_index, &it->ctts_left);
+    }
+    it->offset += sample_size(it);
+    it->sample++;
+    if (++it->in_chunk >= it->chunk_samples)
+    {
+        //下一个 chunk，stsc 的 first_chunk 从 1 开始
+        it->chunk++;
+        it->in_chunk = 0;
+        while (it->stsc_index + 1 < t->stsc.count && it->chunk + 1 >= rb32(t->stsc.entries + (uint64_t)(it->stsc_index + 1) * 12))
+        {
+            it->stsc_index++;
+        }
+        it->chunk_samples = t->stsc.count ? rb32(t->stsc.entries + (uint64_t)it->stsc_index * 12 + 4) : 0;
+        it->offset = chunk_offset(t, it->chunk);
+    }
+}
+
+static void print_keyframe(const Track *t, uint32_t sample, uint64_t dts, int64_t pts, uint64_t offset, uint32_t size)
+{
+    double time = t->timescale ? (double)pts / t->timescale : 0;
+    printf("track=%" PRIu32 " sample=%" PRIu32 " dts=%" PRIu64 " pts=%" PRId64 " time=%.3f offset=%" PRIu64 " size=%" PRIu32 "\n",
+           t->id, sample, dts, pts, time, offset, size);
+}
+
+//moov 里的采样表：没有 stss 时每个 sample 都是关键帧。数据超出文件末尾（录制中断或者表损坏）就停止
+static int keyframes_progressive(const Track *t, uint64_t file_size)
+{
+    SampleIter it;
+    int count = 0;
+    iter_init(&it, t);
+    if (!t->stss.entries)
+    {
+        for (; it.sample < it.nb_samples && it.offset + sample_size(&it) <= file_size; iter_next(&it), count++)
+        {
+            print_keyframe(t, it.sample, it.dts, (int64_t)it.dts + sample_cts(&it), it.offset, sample_size(&it));
+        }
+        return count;
+    }
+    for (uint32_t i = 0; i < t->stss.count; i++)
+    {
+        uint32_t target = rb32(t->stss.entries + (uint64_t)i * 4);
+        if (target == 0 || target > it.nb_samples)
+        {
+            break;
+        }
+        while (it.sample + 1 < target && it.offset <= file_size)
+        {
+            iter_next(&it);
+        }
+        if (it.offset + sample_size(&it) > file_size)
+        {
+            break;
+        }
+        print_keyframe(t, it.sample, it.dts, (int64_t)it.dts + sample_cts(&it), it.offset, sample_size(&it));
+        count++;
+    }
+    return count;
+}
+
+//一个 traf 里的关键帧：tfhd 的默认值 + trex 的默认值 + trun 里每个 sample 的字段
+static int keyframes_traf(Inspector *ins, const Box *moof, const Box *traf, uint32_t want, uint64_t *data_end)
+{
+    uint64_t base = (uint64_t)(traf->data - ins->mp4.data);
+    uint64_t pos = base;
+    uint64_t end = base + traf->data_size;
+    Track *t = NULL;
+    uint64_t base_offset = moof->offset;
+    uint32_t def_duration = 0, def_size = 0, def_flags = 0;
+    int count = 0;
+    Box box;
+    while (read_box(&ins->mp4, pos, end, &box) == 0)
+    {
+        const uint8_t *d = box.data;
+        uint64_t n = box.data_size;
+        if (box.type == TAG('t', 'f', 'h', 'd') && n >= 8)
+        {
+            uint32_t flags = rb24(d + 1);
+            uint64_t p = 8;
+            t = find_track(ins, rb32(d + 4));
+            if (!t)
+            {
+                return count;
+            }
+            def_duration = t->trex_duration;
+            def_size = t->trex_size;
+            def_flags = t->trex_flags;
+            //没有 base-data-offset 也没有 default-base-is-moof 时，接着前一个 traf 的数据
+            base_offset = (flags & 0x020000) ? moof->offset : *data_end;
+            if ((flags & 0x000001) && n >= p + 8)
+            {
+                base_offset = rb64(d + p);
+                p += 8;
+            }
+            if (flags & 0x000002)
+            {
+                p += 4;
+            }
+            if ((flags & 0x000008) && n >= p + 4)
+            {
+                def_duration = rb32(d + p);
+                p += 4;
+            }
+            if ((flags & 0x000010) && n >= p + 4)
+            {
+                def_size = rb32(d + p);
+                p += 4;
+            }
+            if ((flags & 0x000020) && n >= p + 4)
+            {
+                def_flags = rb32(d + p);
+            }
+            *data_end = base_offset;
+        }
+        else if (box.type == TAG('t', 'f', 'd', 't') && t && n >= 8)
+        {
+            t->frag_dts = d[0] == 1 && n >= 12 ? rb64(d + 4) : rb32(d + 4);
+        }
+        else if (box.type == TAG('t', 'r', 'u', 'n') && t && n >= 8)
+        {
+            uint32_t flags = rb24(d + 1);
+            uint32_t samples = rb32(d + 4);
+            uint64_t p = 8;
+            uint64_t offset = *data_end;
+            uint32_t first_flags = def_flags;
+            int has_first_flags = 0;
+            if ((flags & 0x000001) && n >= p + 4)
+            {
+                offset = base_offset + (int64_t)(int32_t)rb32(d + p);
+                p += 4;
+            }
+            if ((flags & 0x000004) && n >= p + 4)
+            {
+                first_flags = rb32(d + p);
+                has_first_flags = 1;
+                p += 4;
+            }
+            int per_sample = !!(flags & 0x100) + !!(flags & 0x200) + !!(flags & 0x400) + !!(flags & 0x800);
+            if ((uint64_t)samples * per_sample * 4 > n - p)
+            {
+                return count;
+            }
+            for (uint32_t i = 0; i < samples; i++)
+            {
+                uint32_t duration = def_duration, size = def_size, sample_flags = def_flags;
+                int32_t cts = 0;
+                if (flags & 0x100)
+                {
+                    duration = rb32(d + p);
+                    p += 4;
+                }
+                if (flags & 0x200)
+                {
+                    size = rb32(d + p);
+                    p += 4;
+                }
+                if (flags & 0x400)
+                {
+                    sample_flags = rb32(d + p);
+                    p += 4;
+                }
+                else if (i == 0 && has_first_flags)
+                {
+                    sample_flags = first_flags;
+                }
+                if (flags & 0x800)
+                {
+                    cts = (int32_t)rb32(d + p);
+                    p += 4;
+                }
+                if (offset + size > ins->mp4.size)
+                {
+                    return count;
+                }
+                if ((!want || t->id == want) && (want || t->handler == TAG('v', 'i', 'd', 'e')) && !(sample_flags & SAMPLE_FLAG_NON_SYNC))
+                {
+                    printf("moof=%" PRIu64 " ", moof->offset);
+                    print_keyframe(t, i, t->frag_dts, (int64_t)t->frag_dts + cts, offset, size);
+                    count++;
+                }
+                t->frag_dts += duration;
+                offset += size;
+            }
+            *data_end = offset;
+        }
+        pos += box.size;
+    }
+    return count;
+}
+
+static int run_keyframes(Inspector *ins, uint32_t want)
+{
+    const Mp4File *mp4 = &ins->mp4;
+    uint64_t pos = 0;
+    int count = 0;
+    int have_moov = 0;
+    Box box;
+    while (read_box(mp4, pos, mp4->size, &box) == 0)
+    {
+        if (box.type == TAG('m', 'o', 'o', 'v') && !have_moov)
+        {
+            have_moov = 1;
+            collect(ins, &box, NULL, 0);
+            for (int i = 0; i < ins->nb_tracks; i++)
+            {
+                const Track *t = &ins->tracks[i];
+                if ((want && t->id == want) || (!want && t->handler == TAG('v', 'i', 'd', 'e')))
+                {
+                    count += keyframes_progressive(t, mp4->size);
+                }
+            }
+        }
+        else if (box.type == TAG('m', 'o', 'o', 'f') && have_moov)
+        {
+            uint64_t traf_pos = (uint64_t)(box.data - mp4->data);
+            uint64_t traf_end = traf_pos + box.data_size;
+            uint64_t data_end = box.offset;
+            Box traf;
+            while (read_box(mp4, traf_pos, traf_end, &traf) == 0)
+            {
+                if (traf.type == TAG('t', 'r', 'a', 'f'))
+                {
+                    count += keyframes_traf(ins, &box, &traf, want, &data_end);
+                }
+                traf_pos += traf.size;
+            }
+        }
+        pos += box.size;
+    }
+    if (!have_moov)
+    {
+        fprintf(stderr, "no moov box.\n");
+        return -1;
+    }
+    fprintf(stderr, "keyframes = %d.\n", count);
+    return 0;
+}
+
+//只看顶层 box：moov 和第一个 mdat 的位置，以及分片的数量
+static void scan_top_level(const Mp4File *mp4, int64_t *moov, uint64_t *moov_size, int64_t *mdat, int *moofs, int64_t *first_moof, int *truncated)
+{
+    uint64_t pos = 0;
+    Box box;
+    *moov = *mdat = *first_moof = -1;
+    *moov_size = 0;
+    *moofs = 0;
+    while (pos < mp4->size && read_box(mp4, pos, mp4->size, &box) == 0)
+    {
+        if (box.type == TAG('m', 'o', 'o', 'v') && *moov < 0)
+        {
+            *moov = (int64_t)box.offset;
+            *moov_size = box.size;
+        }
+        else if (box.type == TAG('m', 'd', 'a', 't') && *mdat < 0)
+        {
+            *mdat = (int64_t)box.offset;
+        }
+        else if (box.type == TAG('m', 'o', 'o', 'f'))
+        {
+            if (*first_moof < 0)
+            {
+                *first_moof = (int64_t)box.offset;
+            }
+            (*moofs)++;
+        }
+        pos += box.size;
+    }
+    //最后一个 box 写了一半（录制中断）
+    *truncated = pos < mp4->size;
+}
+
+//moov 在第一个 mdat 之前（或者没有 mdat）就可以边下边播
+static int run_faststart(const Mp4File *mp4)
+{
+    int64_t moov, mdat, first_moof;
+    uint64_t moov_size;
+    int moofs, truncated;
+    scan_top_level(mp4, &moov, &moov_size, &mdat, &moofs, &first_moof, &truncated);
+    if (moov < 0)
+    {
+        printf("faststart=no moov=none\n");
+        return 2;
+    }
+    int faststart = mdat < 0 || moov < mdat;
+    printf("faststart=%s moov_offset=%" PRId64 " moov_size=%" PRIu64 " mdat_offset=%" PRId64 " fragments=%d\n",
+           faststart ? "yes" : "no", moov, moov_size, mdat, moofs);
+    return faststart ? 0 : 1;
+}
+
+static int run_tree(Inspector *ins)
+{
+    const Mp4File *mp4 = &ins->mp4;
+    //整个文件当作一个没有头的容器
+    Box root = {0};
+    root.data = mp4->data;
+    root.data_size = mp4->size;
+    walk_children(ins, &root, 0, 0);
+
+    int64_t moov, mdat, first_moof;
+    uint64_t moov_size;
+    int moofs, truncated;
+    scan_top_level(mp4, &moov, &moov_size, &mdat, &moofs, &first_moof, &truncated);
+    printf("summary: size=%" PRIu64 " moov_offset=%" PRId64 " moov_size=%" PRIu64 " mdat_offset=%" PRId64 " faststart=%s",
+           mp4->size, moov, moov_size, mdat, moov >= 0 && (mdat < 0 || moov < mdat) ? "yes" : "no");
+    if (moofs > 0)
+    {
+        printf(" fragments=%d first_moof=%" PRId64, moofs, first_moof);
+    }
+    printf("%s\n", truncated ? " truncated=yes" : "");
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    Inspector *ins = calloc(1, sizeof(Inspector));
+    const char *path = NULL;
+    const char *mode = "tree";
+    uint32_t track = 0;
+    int ret = 0;
+    if (!ins)
+    {
+        return -1;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-entries") && i + 1 < argc)
+        {
+            ins->entries = (uint32_t)atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-faststart"))
+        {
+            mode = "faststart";
+        }
+        else if (!strcmp(argv[i], "-keyframes"))
+        {
+            mode = "keyframes";
+        }
+        else if (!strcmp(argv[i], "-track") && i + 1 < argc)
+        {
+            track = (uint32_t)atoi(argv[++i]);
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+    if (!path)
+    {
+        fprintf(stderr, "usage: %s [-entries n | -faststart | -keyframes [-track id]] file\n", argv[0]);
+        free(ins);
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "open %s error = %s.\n", path, strerror(errno));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        free(ins);
+        return -1;
+    }
+    ins->mp4.size = (uint64_t)st.st_size;
+    if (ins->mp4.size == 0)
+    {
+        fprintf(stderr, "%s is empty.\n", path);
+        close(fd);
+        free(ins);
+        return -1;
+    }
+    //只读映射，box 之间是随机跳读，内核不需要预读 mdat
+    void *map = mmap(NULL, ins->mp4.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "mmap %s error = %s.\n", path, strerror(errno));
+        free(ins);
+        return -1;
+    }
+    madvise(map, ins->mp4.size, MADV_RANDOM);
+    ins->mp4.data = (const uint8_t *)map;
+
+    if (!strcmp(mode, "faststart"))
+    {
+        ret = run_faststart(&ins->mp4);
+    }
+    else if (!strcmp(mode, "keyframes"))
+    {
+        ret = run_keyframes(ins, track) < 0 ? 1 : 0;
+    }
+    else
+    {
+        ret = run_tree(ins);
+    }
+
+    munmap(map, ins->mp4.size);
+    free(ins);
+    return ret;
+}
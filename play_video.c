@@ -1,8 +1,18 @@
 #include <libavutil/log.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
-#include <libswscale/swscale.h>
+#include <libavutil/time.h>
 #include <SDL2/SDL.h>
+#include <string.h>
+#include "player/frame_drop.h"
+#include "player/video_render.h"
+#include "player/prefetch.h"
+#include "player/player_stats.h"
+#include "video_debugging.h"
+
+//方向键 seek 的步长（秒）
+#define SEEK_STEP_SHORT 10
+#define SEEK_STEP_LONG 60
 
 typedef struct Decoder
 {
@@ -14,8 +24,8 @@ typedef struct SdlContext
 {
     SDL_Window *window;
     SDL_Renderer *renderer;
-    SDL_Texture *texture;
-
+    //纹理由 VideoRender 按帧大小创建
+    VideoRender render;
 } SdlContext;
 
 static int init_video_decoder(Decoder *decoder, AVCodecParameters *parameters)
@@ -44,23 +54,45 @@ static int destory_video_decoder()
     return 0;
 }
 
-static int init_sdl2(SdlContext *sdl_ctx)
+//video_out：sdl 正常窗口，dummy 使用 SDL 的 dummy 驱动，null 不创建窗口
+static int init_sdl2(SdlContext *sdl_ctx, AVCodecParameters *parameters, const char *video_out)
 {
-
-    //窗口大小
-    // int screen_w = 640;
-    // int screen_h = 480;
-    int screen_w = 852;
-    int screen_h = 480;
-
-    int ret = SDL_Init(SDL_INIT_VIDEO);
+    int null_video = !strcmp(video_out, "null");
+    int dummy_video = !strcmp(video_out, "dummy");
+    if (dummy_video)
+    {
+        //没有显示器的机器上也能创建窗口和渲染器
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+    int ret = SDL_Init(null_video ? SDL_INIT_EVENTS : SDL_INIT_VIDEO);
     av_log(NULL, AV_LOG_INFO, "SDL_Init ret = %d.\n", ret);
     if (ret)
     {
         return -1;
     }
+    if (null_video)
+    {
+        //没有渲染器，VideoRender 只统计不上传
+        video_render_init(&sdl_ctx->render, NULL);
+        return 0;
+    }
+
+    //窗口大小跟随视频，超过屏幕时按比例缩小
+    int screen_w = 0;
+    int screen_h = 0;
+    if (parameters)
+    {
+        video_render_fit_window(parameters->width, parameters->height, parameters->sample_aspect_ratio, &screen_w, &screen_h);
+    }
+    else
+    {
+        video_render_fit_window(0, 0, (AVRational){0, 1}, &screen_w, &screen_h);
+    }
+    av_log(NULL, AV_LOG_INFO, "window size = %dx%d.\n", screen_w, screen_h);
 
-    SDL_Window *window = SDL_CreateWindow("player", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screen_w, screen_h, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+    //dummy 驱动没有 OpenGL
+    Uint32 window_flags = SDL_WINDOW_RESIZABLE | (dummy_video ? 0 : SDL_WINDOW_OPENGL);
+    SDL_Window *window = SDL_CreateWindow("player", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screen_w, screen_h, window_flags);
     if (!window)
     {
         av_log(NULL, AV_LOG_ERROR, "SDL_CreateWindow NULL.\n");
@@ -74,17 +106,9 @@ static int init_sdl2(SdlContext *sdl_ctx)
         return -3;
     }
 
-    int pixformat = SDL_PIXELFORMAT_IYUV;
-    SDL_Texture *texture = SDL_CreateTexture(renderer, pixformat, SDL_TEXTUREACCESS_STREAMING, screen_w, screen_h);
-    if (!texture)
-    {
-        av_log(NULL, AV_LOG_ERROR, "SDL_CreateTexture NULL.\n");
-        return -4;
-    }
-
     sdl_ctx->window = window;
     sdl_ctx->renderer = renderer;
-    sdl_ctx->texture = texture;
+    video_render_init(&sdl_ctx->render, renderer);
 
     return 0;
 }
@@ -96,43 +120,116 @@ static int destory_sdl2(SdlContext *renderer)
 
 int main(int argc, char *argv[])
 {
-
-    if (argc != 2)
+    //./play_video [-buffer bytes] [-timeout ms] [-accurate_seek] [-vo sdl|dummy|null] [-bench realtime|fast] [-headless] url
+    char *input_url = NULL;
+    int accurate_seek = 0;
+    const char *video_out = "sdl";
+    //benchmark：NULL 正常播放，realtime 按时间戳播放，fast 尽快解码
+    const char *bench = NULL;
+    PrefetchConfig prefetch_config;
+    prefetch_config_default(&prefetch_config);
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-buffer") && i + 1 < argc)
+        {
+            prefetch_config.max_bytes = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-timeout") && i + 1 < argc)
+        {
+            prefetch_config.io_timeout_ms = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-accurate_seek"))
+        {
+            accurate_seek = 1;
+        }
+        else if (!strcmp(argv[i], "-vo") && i + 1 < argc)
+        {
+            video_out = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-bench") && i + 1 < argc)
+        {
+            bench = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-headless"))
+        {
+            video_out = "null";
+            if (!bench)
+            {
+                bench = "fast";
+            }
+        }
+        else
+        {
+            input_url = argv[i];
+        }
+    }
+    if (!input_url)
     {
         av_log(NULL, AV_LOG_ERROR, "without input url.\n");
         return -1;
     }
+    int bench_fast = bench && !strcmp(bench, "fast");
+    if (bench)
+    {
+        //benchmark 时逐帧的日志会拖慢速度
+        av_log_set_level(AV_LOG_WARNING);
+    }
 
     av_register_all();
+    avformat_network_init();
 
-    char *input_url = argv[1];
     av_log(NULL, AV_LOG_INFO, "input_url = %s.\n", input_url);
 
-    AVFormatContext *input_format_ctx = NULL;
+    //后台线程读包，网络慢的时候主线程不会卡住
+    Prefetcher prefetcher = {0};
+    //视频关键帧索引，读包时建立，或者从 url.idx 加载
+    SeekIndex video_index = {0};
+    //精确 seek 时，pts 小于该值的帧解码后丢掉
+    int64_t seek_target_pts = AV_NOPTS_VALUE;
+    int64_t seek_pending_pts = AV_NOPTS_VALUE;
+    int64_t seek_request_time = 0;
+    int64_t current_pts_us = 0;
+    //解码跟不上时丢帧、降低解码质量
+    FrameDropPolicy drop_policy = {0};
+    SdlContext *sdl_ctx = NULL;
+    //后面才创建的资源先置空，任何一步 goto end 时都能安全释放
+    Decoder *video_decoder = NULL;
+    AVPacket *packet = NULL;
+    AVFrame *frame = NULL;
+    PlayerStats stats;
+    player_stats_init(&stats);
 
     int ret;
-    ret = avformat_open_input(&input_format_ctx, input_url, NULL, NULL);
+    ret = prefetch_open(&prefetcher, input_url, &prefetch_config);
     if (ret != 0)
     {
-        av_log(NULL, AV_LOG_ERROR, "avformat_open_input error,ret = %d.\n", ret);
+        av_log(NULL, AV_LOG_ERROR, "prefetch_open error,ret = %d.\n", ret);
         goto end;
     }
+    AVFormatContext *input_format_ctx = prefetcher.fmt_ctx;
 
-    ret = avformat_find_stream_info(input_format_ctx, NULL);
-    if (ret < 0)
+    int stream_num = input_format_ctx->nb_streams;
+    av_log(NULL, AV_LOG_INFO, "stream_num = %d.\n", stream_num);
+    if (stream_num < 1)
     {
-        av_log(NULL, AV_LOG_ERROR, "avformat_find_stream_info error,ret = %d.\n", ret);
         goto end;
     }
 
-    int stream_num = input_format_ctx->nb_streams;
-    av_log(NULL, AV_LOG_INFO, "stream_num = %d.\n", stream_num);
-    if (stream_num < 1)
+    //解码器要用到纹理，先初始化 SDL
+    sdl_ctx = (SdlContext *)calloc(1, sizeof(SdlContext));
+    int best_video_index = av_find_best_stream(input_format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    ret = init_sdl2(sdl_ctx, best_video_index >= 0 ? input_format_ctx->streams[best_video_index]->codecpar : NULL, video_out);
+    av_log(NULL, AV_LOG_INFO, "init_sdl2 ret = %d.\n", ret);
+    if (ret != 0)
     {
         goto end;
     }
 
-    Decoder *video_decoder = (Decoder *)malloc(sizeof(Decoder));
+    video_decoder = (Decoder *)calloc(1, sizeof(Decoder));
+    if (!video_decoder)
+    {
+        goto end;
+    }
     int video_stream_index = 0;
     for (int i = 0; i < stream_num; i++)
     {
@@ -157,82 +254,131 @@ int main(int argc, char *argv[])
             goto end;
         }
 
+        video_render_enable_direct_decode(&sdl_ctx->render, video_decoder->decode_ctx);
         ret = avcodec_open2(video_decoder->decode_ctx, video_decoder->decodec, NULL);
         av_log(NULL, AV_LOG_INFO, "avcodec_open2 ret = %d.\n", ret);
     }
 
-    SdlContext *sdl_ctx = (SdlContext *)malloc(sizeof(SdlContext));
-    ret = init_sdl2(sdl_ctx);
-    av_log(NULL, AV_LOG_INFO, "init_sdl2 ret = %d.\n", ret);
-
-    int srcW = video_decoder->decode_ctx->width;
-    int srcH = video_decoder->decode_ctx->height;
-    enum AVPixelFormat srcFormat = video_decoder->decode_ctx->pix_fmt;
-    // int dstW = 640;
-    // int dstH = 480;
-    int dstW = 852;
-    int dstH = 480;
-    enum AVPixelFormat dstFormat = AV_PIX_FMT_YUV420P;
-    int sws_flags = SWS_FAST_BILINEAR;
-
-    struct SwsContext *sws_ctx = sws_getContext(srcW, srcH, srcFormat, dstW, dstH, dstFormat, sws_flags, NULL, NULL, NULL);
-    if (!sws_ctx)
-    {
-        av_log(NULL, AV_LOG_ERROR, "sws_ctx == NULL.\n");
-    }
-    else
-    {
-        av_log(NULL, AV_LOG_INFO, "sws_ctx != NULL.\n");
-    }
-    AVPacket *packet = av_packet_alloc();
-    AVFrame *frame = av_frame_alloc();
-    AVPicture *picture = (AVPicture *)malloc(sizeof(AVPicture));
-    ret = avpicture_alloc(picture, dstFormat, dstW, dstH);
-    SDL_Rect rect;
+    packet = av_packet_alloc();
+    frame = av_frame_alloc();
     //for event
     SDL_Event event;
 
-    av_log(NULL, AV_LOG_INFO, "avpicture_alloc ret = %d.\n", ret);
+    AVRational video_time_base = input_format_ctx->streams[video_stream_index]->time_base;
+    frame_drop_init(&drop_policy, video_decoder->decode_ctx, video_time_base);
+    seek_index_init(&video_index, video_stream_index, video_time_base);
+    seek_index_load_sidecar(&video_index, input_url);
+    prefetch_set_index(&prefetcher, &video_index);
 
-    while (av_read_frame(input_format_ctx, packet) >= 0)
+    //设置了 TRACE_FILE 时记录各个阶段的耗时，退出时写成 Chrome trace
+    trace_init(NULL);
+    trace_thread_name("main");
+    ret = packet && frame ? prefetch_start(&prefetcher) : AVERROR(ENOMEM);
+    if (ret < 0)
+    {
+        goto end;
+    }
+    stats.start_time = av_gettime_relative();
+    while ((ret = prefetch_get(&prefetcher, packet, 10)) >= 0)
     {
+        PrefetchStats prefetch_stats;
+        prefetch_get_stats(&prefetcher, &prefetch_stats);
+        player_stats_sample_queues(&stats, prefetch_stats.level_packets, 0);
         // av_log(NULL, AV_LOG_INFO, "av_read_frame packet->stream_index = %d\n", packet->stream_index);
-        if (packet->stream_index != video_stream_index)
+        if (ret == PREFETCH_FLUSH)
         {
-            continue;
+            //seek 完成：清空解码器，重新对齐时钟
+            avcodec_flush_buffers(video_decoder->decode_ctx);
+            frame_drop_reset_clock(&drop_policy);
+            seek_target_pts = seek_pending_pts;
+            seek_pending_pts = AV_NOPTS_VALUE;
+            goto poll_event;
+        }
+        //缓冲为空或者不是视频包，只处理界面事件
+        if (ret == 0 || packet->stream_index != video_stream_index)
+        {
+            av_packet_unref(packet);
+            goto poll_event;
         }
 
+        int64_t decode_start = av_gettime_relative();
+        TRACE_BEGIN(send_start);
         ret = avcodec_send_packet(video_decoder->decode_ctx, packet);
+        TRACE_END(send_start, "avcodec_send_packet", video_stream_index, video_decoder->decode_ctx->frame_number);
         // av_log(NULL, AV_LOG_INFO, "avcodec_send_packet ret = %d\n", ret);
         if (ret == 0)
         {
-            while (avcodec_receive_frame(video_decoder->decode_ctx, frame) == 0)
+            for (;;)
             {
+                TRACE_BEGIN(receive_start);
+                int receive_ret = avcodec_receive_frame(video_decoder->decode_ctx, frame);
+                TRACE_END(receive_start, "avcodec_receive_frame", video_stream_index, video_decoder->decode_ctx->frame_number);
+                if (receive_ret != 0)
+                {
+                    break;
+                }
+                player_stats_add_decode(&stats, av_gettime_relative() - decode_start, 1);
                 //todo 处理视频
                 int64_t dts = frame->pkt_dts;
                 int h = frame->height;
                 int w = frame->width;
                 av_log(NULL, AV_LOG_INFO, "avcodec_receive_frame dts = %lld,h = %d,w = %d.\n", dts, h, w);
 
-                // Convert the image into YUV format that SDL uses
-                sws_scale(sws_ctx, (uint8_t const *const *)frame->data, frame->linesize, 0, 480, picture->data, picture->linesize);
-                ret = SDL_UpdateYUVTexture(sdl_ctx->texture, &rect,
-                                           picture->data[0], picture->linesize[0],
-                                           picture->data[1], picture->linesize[1],
-                                           picture->data[2], picture->linesize[2]);
-                av_log(NULL, AV_LOG_INFO, "SDL_UpdateYUVTexture ret = %d.\n", ret);
-
-                rect.x = 0;
-                rect.y = 0;
-                rect.w = 852;
-                rect.h = 480;
-
-                SDL_RenderClear(sdl_ctx->renderer);
-                SDL_RenderCopy(sdl_ctx->renderer, sdl_ctx->texture, NULL, &rect);
-                SDL_RenderPresent(sdl_ctx->renderer);
+                int64_t frame_pts = frame->best_effort_timestamp;
+                //精确 seek：从关键帧解码到目标帧，中间的帧不显示
+                if (seek_target_pts != AV_NOPTS_VALUE && frame_pts != AV_NOPTS_VALUE && frame_pts < seek_target_pts)
+                {
+                    av_frame_unref(frame);
+                    decode_start = av_gettime_relative();
+                    continue;
+                }
+                seek_target_pts = AV_NOPTS_VALUE;
+                if (frame_pts != AV_NOPTS_VALUE)
+                {
+                    current_pts_us = av_rescale_q(frame_pts, video_time_base, AV_TIME_BASE_Q);
+                }
+
+                //迟到的帧在 sws_scale 之前丢掉；fast 模式不丢帧也不等待
+                int64_t delay_us = 0;
+                if (!bench_fast && frame_drop_check(&drop_policy, frame, &delay_us) == FRAME_DROP_DROP)
+                {
+                    av_frame_unref(frame);
+                    decode_start = av_gettime_relative();
+                    continue;
+                }
+                int64_t present_time = av_gettime_relative() + delay_us;
+
+                //YUV420P 直接上传帧的平面，其他格式才转换，缩放由渲染器完成
+                int64_t convert_start = av_gettime_relative();
+                ret = video_render_upload(&sdl_ctx->render, frame);
+                player_stats_add_convert(&stats, av_gettime_relative() - convert_start);
+                if (ret < 0)
+                {
+                    av_log(NULL, AV_LOG_ERROR, "video_render_upload ret = %d.\n", ret);
+                }
+
+                //还没到显示时间，等一下再显示
+                int64_t wait_us = present_time - av_gettime_relative();
+                if (wait_us > 0)
+                {
+                    SDL_Delay((Uint32)(wait_us / 1000));
+                }
+                TRACE_BEGIN(present_start);
+                video_render_present(&sdl_ctx->render);
+                TRACE_END(present_start, "present", video_stream_index, video_decoder->decode_ctx->frame_number);
+                player_stats_add_present(&stats, bench_fast ? 0 : av_gettime_relative() - present_time);
+                if (seek_request_time)
+                {
+                    av_log(NULL, AV_LOG_INFO, "seek to %.3fs done in %lldms.\n", current_pts_us / 1000000.0,
+                           (long long)((av_gettime_relative() - seek_request_time) / 1000));
+                    seek_request_time = 0;
+                }
 
                 av_frame_unref(frame);
+                decode_start = av_gettime_relative();
             }
+            //最后一次 receive_frame 返回 EAGAIN 的耗时也算解码时间
+            player_stats_add_decode(&stats, av_gettime_relative() - decode_start, 0);
         }
         else
         {
@@ -241,16 +387,57 @@ int main(int argc, char *argv[])
         }
         av_packet_unref(packet);
 
+    poll_event:
         // Free the packet that was allocated by av_read_frame
-        SDL_PollEvent(&event);
-        switch (event.type)
+        while (SDL_PollEvent(&event))
         {
-        case SDL_QUIT:
-            // quit = 1;
-            goto end;
-            break;
-        default:
-            break;
+            switch (event.type)
+            {
+            case SDL_QUIT:
+                // quit = 1;
+                goto end;
+                break;
+            case SDL_KEYDOWN:
+            {
+                //左右方向键 10 秒，上下方向键 60 秒
+                int64_t step = 0;
+                switch (event.key.keysym.sym)
+                {
+                case SDLK_LEFT:
+                    step = -SEEK_STEP_SHORT;
+                    break;
+                case SDLK_RIGHT:
+                    step = SEEK_STEP_SHORT;
+                    break;
+                case SDLK_DOWN:
+                    step = -SEEK_STEP_LONG;
+                    break;
+                case SDLK_UP:
+                    step = SEEK_STEP_LONG;
+                    break;
+                default:
+                    break;
+                }
+                if (step)
+                {
+                    int64_t target_us = current_pts_us + step * AV_TIME_BASE;
+                    seek_request_time = av_gettime_relative();
+                    seek_pending_pts = accurate_seek ? av_rescale_q(target_us, AV_TIME_BASE_Q, video_time_base) : AV_NOPTS_VALUE;
+                    prefetch_seek(&prefetcher, target_us);
+                }
+                break;
+            }
+            case SDL_WINDOWEVENT:
+                //窗口大小变化，重新计算显示区域
+                if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                {
+                    video_render_resize(&sdl_ctx->render);
+                    video_render_present(&sdl_ctx->render);
+                }
+                break;
+            default:
+                break;
+            }
         }
     }
 
@@ -258,29 +445,55 @@ int main(int argc, char *argv[])
 
 end:
     av_log(NULL, AV_LOG_INFO, "goto end.\n");
-    if (input_format_ctx)
+    stats.end_time = av_gettime_relative();
+    if (drop_policy.codec_ctx)
     {
-        avformat_close_input(&input_format_ctx);
-        avformat_free_context(input_format_ctx);
-        input_format_ctx = NULL;
+        frame_drop_log_stats(&drop_policy);
     }
+    if (bench)
+    {
+        player_stats_report(&stats, bench);
+    }
+    //停止读取线程并关闭输入
+    prefetch_log_stats(&prefetcher);
+    prefetch_close(&prefetcher);
+    seek_index_free(&video_index);
     if (video_decoder)
     {
         if (video_decoder->decode_ctx)
         {
             avcodec_free_context(&video_decoder->decode_ctx);
             video_decoder->decode_ctx = NULL;
-            free(video_decoder);
         }
+        free(video_decoder);
         video_decoder = NULL;
     }
+    //解码器释放之后才能销毁纹理
+    if (sdl_ctx)
+    {
+        video_render_log_stats(&sdl_ctx->render);
+        video_render_destroy(&sdl_ctx->render);
+        if (sdl_ctx->renderer)
+        {
+            SDL_DestroyRenderer(sdl_ctx->renderer);
+        }
+        if (sdl_ctx->window)
+        {
+            SDL_DestroyWindow(sdl_ctx->window);
+        }
+        free(sdl_ctx);
+        sdl_ctx = NULL;
+        SDL_Quit();
+    }
     if (packet)
     {
-        av_free_packet(packet);
+        av_packet_free(&packet);
     }
     if (frame)
     {
         av_frame_free(&frame);
     }
+    //读取线程已经退出
+    trace_shutdown();
     return 0;
 }
\ No newline at end of file
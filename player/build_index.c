@@ -0,0 +1,196 @@
+#include <libavformat/avformat.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "seek_index.h"
+#include "../probe_cache.h"
+
+//解复用一遍，把每个包的 pts、dts、字节位置、大小、关键帧标记写到 输入文件.idx，
+//player、play_video 启动时加载，剪辑、截图脚本可以用 -lookup 直接查关键帧，不用再读文件
+static int build_index(ProbeCache *cache, const char *input, const char *output, int keyframes_only)
+{
+    AVFormatContext *fmt_ctx = NULL;
+    SeekIndexWriter writer;
+    int writer_inited = 0;
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    int64_t packets = 0;
+    int64_t keyframes = 0;
+    int64_t start = av_gettime_relative();
+    char index_path[4096];
+    snprintf(index_path, sizeof(index_path), "%s%s", input, SEEK_INDEX_SUFFIX);
+    if (output)
+    {
+        snprintf(index_path, sizeof(index_path), "%s", output);
+    }
+
+    int ret = avformat_open_input(&fmt_ctx, input, NULL, NULL);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: %s\n", input, av_err2str(ret));
+        goto end;
+    }
+    //流的 time_base 和类型要和播放时一致，加载时会检查 time_base
+    if ((ret = probe_cache_find_stream_info(cache, input, fmt_ctx)) < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: Cannot find stream information\n", input);
+        goto end;
+    }
+    if ((ret = seek_index_writer_init(&writer, fmt_ctx, input, keyframes_only)) < 0)
+    {
+        goto end;
+    }
+    writer_inited = 1;
+
+    while ((ret = av_read_frame(fmt_ctx, &pkt)) >= 0)
+    {
+        packets++;
+        keyframes += (pkt.flags & AV_PKT_FLAG_KEY) != 0;
+        ret = seek_index_writer_add(&writer, &pkt);
+        av_packet_unref(&pkt);
+        if (ret < 0)
+        {
+            goto end;
+        }
+    }
+    if (ret != AVERROR_EOF)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: read error %s\n", input, av_err2str(ret));
+        goto end;
+    }
+    if ((ret = seek_index_writer_save(&writer, index_path)) < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Cannot write %s: %s\n", index_path, av_err2str(ret));
+        goto end;
+    }
+
+    int64_t entries = 0;
+    for (int i = 0; i < writer.nb_streams; i++)
+    {
+        entries += writer.streams[i].nb_entries;
+    }
+    double seconds = (av_gettime_relative() - start) / 1000000.0;
+    printf("%s: packets=%" PRId64 " keyframes=%" PRId64 " entries=%" PRId64 " bytes=%" PRId64 " time=%.2fs\n",
+           index_path, packets, keyframes, entries,
+           (int64_t)(sizeof(SeekIndexFileHeader) + writer.nb_streams * sizeof(SeekIndexFileStream) + entries * sizeof(SeekIndexEntry)),
+           seconds);
+    ret = 0;
+
+end:
+    if (writer_inited)
+    {
+        seek_index_writer_free(&writer);
+    }
+    avformat_close_input(&fmt_ctx);
+    return ret;
+}
+
+//不打开媒体文件，只 mmap 索引：每个流打印 seconds 之前最近的关键帧
+static int lookup_index(const char *input, double seconds)
+{
+    SeekIndexMap map;
+    int ret = seek_index_map_open(&map, input);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s%s: %s\n", input, SEEK_INDEX_SUFFIX, av_err2str(ret));
+        return ret;
+    }
+    for (uint32_t i = 0; i < map.nb_streams; i++)
+    {
+        const SeekIndexFileStream *stream = &map.streams[i];
+        AVRational time_base = {stream->time_base_num, stream->time_base_den};
+        if (time_base.num <= 0 || time_base.den <= 0)
+        {
+            continue;
+        }
+        const char *type = av_get_media_type_string((enum AVMediaType)stream->codec_type);
+        int64_t target = av_rescale_q((int64_t)(seconds * AV_TIME_BASE), AV_TIME_BASE_Q, time_base);
+        const SeekIndexEntry *entry = seek_index_map_find(&map, stream->stream_index, target);
+        if (!entry)
+        {
+            printf("stream=%u type=%s none\n", stream->stream_index, type ? type : "unknown");
+            continue;
+        }
+        printf("stream=%u type=%s pts=%" PRId64 " time=%.3f pos=%" PRId64 " size=%d\n",
+               stream->stream_index, type ? type : "unknown", entry->pts, entry->pts * av_q2d(time_base), entry->pos, entry->size);
+    }
+    seek_index_map_close(&map);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    //./build_index [-keyframes_only] [-o index] [-probe_cache file|default|off] input...
+    //./build_index -lookup seconds input
+    const char *output = NULL;
+    const char *probe_cache_path = NULL;
+    int keyframes_only = 0;
+    int lookup = 0;
+    double lookup_seconds = 0;
+    int nb_inputs = 0;
+    char **inputs = (char **)av_mallocz_array(argc, sizeof(char *));
+    if (!inputs)
+    {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-keyframes_only"))
+        {
+            keyframes_only = 1;
+        }
+        else if (!strcmp(argv[i], "-probe_cache") && i + 1 < argc)
+        {
+            probe_cache_path = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-lookup") && i + 1 < argc)
+        {
+            lookup = 1;
+            lookup_seconds = atof(argv[++i]);
+        }
+        else
+        {
+            inputs[nb_inputs++] = argv[i];
+        }
+    }
+    if (!nb_inputs || (output && nb_inputs > 1))
+    {
+        av_log(NULL, AV_LOG_ERROR, "usage: %s [-keyframes_only] [-o index] [-probe_cache file|default|off] input...\n"
+                                   "       %s -lookup seconds input\n"
+                                   "-o needs a single input.\n", argv[0], argv[0]);
+        av_free(inputs);
+        return 1;
+    }
+
+    int failed = 0;
+    if (lookup)
+    {
+        for (int i = 0; i < nb_inputs; i++)
+        {
+            failed += lookup_index(inputs[i], lookup_seconds) < 0;
+        }
+        av_free(inputs);
+        return failed ? 1 : 0;
+    }
+
+    //打开失败时 cache 处于关闭状态，probe_cache_find_stream_info 直接分析
+    ProbeCache probe_cache;
+    probe_cache_open(&probe_cache, probe_cache_path);
+    for (int i = 0; i < nb_inputs; i++)
+    {
+        failed += build_index(&probe_cache, inputs[i], output, keyframes_only) < 0;
+    }
+    probe_cache_log_stats(&probe_cache);
+    probe_cache_close(&probe_cache);
+    av_free(inputs);
+    return failed ? 1 : 0;
+}
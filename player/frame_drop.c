@@ -0,0 +1,147 @@
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+#include <libavutil/mathematics.h>
+#include <string.h>
+#include "frame_drop.h"
+
+static const char *level_name(enum FrameDropLevel level)
+{
+    switch (level)
+    {
+    case FRAME_DROP_LEVEL_SKIP_LOOP_FILTER:
+        return "skip_loop_filter";
+    case FRAME_DROP_LEVEL_SKIP_NONREF:
+        return "skip_nonref";
+    default:
+        return "none";
+    }
+}
+
+//把当前档位同步到解码器上
+static void apply_level(FrameDropPolicy *policy)
+{
+    AVCodecContext *codec_ctx = policy->codec_ctx;
+    if (!codec_ctx)
+    {
+        return;
+    }
+    switch (policy->level)
+    {
+    case FRAME_DROP_LEVEL_SKIP_NONREF:
+        codec_ctx->skip_loop_filter = AVDISCARD_ALL;
+        codec_ctx->skip_frame = AVDISCARD_NONREF;
+        break;
+    case FRAME_DROP_LEVEL_SKIP_LOOP_FILTER:
+        codec_ctx->skip_loop_filter = AVDISCARD_ALL;
+        codec_ctx->skip_frame = AVDISCARD_DEFAULT;
+        break;
+    default:
+        codec_ctx->skip_loop_filter = AVDISCARD_DEFAULT;
+        codec_ctx->skip_frame = AVDISCARD_DEFAULT;
+        break;
+    }
+    av_log(NULL, AV_LOG_INFO, "frame_drop level = %s.\n", level_name(policy->level));
+}
+
+void frame_drop_init(FrameDropPolicy *policy, AVCodecContext *codec_ctx, AVRational time_base)
+{
+    memset(policy, 0, sizeof(FrameDropPolicy));
+    policy->codec_ctx = codec_ctx;
+    policy->time_base = time_base;
+    policy->clock_start = AV_NOPTS_VALUE;
+    policy->level = FRAME_DROP_LEVEL_NONE;
+}
+
+void frame_drop_reset_clock(FrameDropPolicy *policy)
+{
+    policy->clock_start = AV_NOPTS_VALUE;
+    policy->late_streak = 0;
+    policy->ontime_streak = 0;
+    policy->dropped_streak = 0;
+}
+
+enum FrameDropDecision frame_drop_check(FrameDropPolicy *policy, const AVFrame *frame, int64_t *delay_us)
+{
+    int64_t pts = frame->best_effort_timestamp;
+    if (pts == AV_NOPTS_VALUE)
+    {
+        pts = frame->pts;
+    }
+    policy->stats.frames_total++;
+    *delay_us = 0;
+    if (pts == AV_NOPTS_VALUE)
+    {
+        //没有时间戳，无法判断是否迟到，直接显示
+        policy->stats.frames_rendered++;
+        return FRAME_DROP_RENDER;
+    }
+
+    int64_t pts_us = av_rescale_q(pts, policy->time_base, AV_TIME_BASE_Q);
+    int64_t now = av_gettime_relative();
+    if (policy->clock_start == AV_NOPTS_VALUE)
+    {
+        policy->clock_start = now;
+        policy->clock_pts = pts_us;
+    }
+    int64_t delay = (pts_us - policy->clock_pts) - (now - policy->clock_start);
+    if (delay > FRAME_DROP_MAX_DELAY_US)
+    {
+        policy->clock_start = now;
+        policy->clock_pts = pts_us;
+        delay = 0;
+    }
+    *delay_us = delay;
+
+    if (delay < -FRAME_DROP_LATE_THRESHOLD_US)
+    {
+        policy->stats.frames_late++;
+        if (-delay > policy->stats.max_late_us)
+        {
+            policy->stats.max_late_us = -delay;
+        }
+        policy->ontime_streak = 0;
+        policy->late_streak++;
+        //持续迟到，先关闭环路滤波，再丢弃非参考帧
+        if (policy->late_streak >= FRAME_DROP_ESCALATE_FRAMES && policy->level < FRAME_DROP_LEVEL_SKIP_NONREF)
+        {
+            policy->level++;
+            policy->late_streak = 0;
+            policy->stats.escalations++;
+            apply_level(policy);
+        }
+        if (policy->dropped_streak < FRAME_DROP_MAX_CONSECUTIVE)
+        {
+            policy->dropped_streak++;
+            policy->stats.frames_dropped++;
+            return FRAME_DROP_DROP;
+        }
+    }
+    else
+    {
+        policy->late_streak = 0;
+        policy->ontime_streak++;
+        //恢复正常之后逐级降档
+        if (policy->ontime_streak >= FRAME_DROP_RECOVER_FRAMES && policy->level > FRAME_DROP_LEVEL_NONE)
+        {
+            policy->level--;
+            policy->ontime_streak = 0;
+            policy->stats.recoveries++;
+            apply_level(policy);
+        }
+    }
+
+    policy->dropped_streak = 0;
+    policy->stats.frames_rendered++;
+    return FRAME_DROP_RENDER;
+}
+
+void frame_drop_log_stats(const FrameDropPolicy *policy)
+{
+    const FrameDropStats *stats = &policy->stats;
+    av_log(NULL, AV_LOG_INFO,
+           "frame_drop total = %lld,rendered = %lld,late = %lld,dropped = %lld,escalations = %d,recoveries = %d,max_late = %lldms,level = %s.\n",
+           (long long)stats->frames_total, (long long)stats->frames_rendered,
+           (long long)stats->frames_late, (long long)stats->frames_dropped,
+           (int)stats->escalations, (int)stats->recoveries,
+           (long long)(stats->max_late_us / 1000), level_name(policy->level));
+}
@@ -0,0 +1,62 @@
+#ifndef FRAME_DROP_H
+#define FRAME_DROP_H
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+
+//超过该值认为帧已经迟到（微秒）
+#define FRAME_DROP_LATE_THRESHOLD_US 20000
+//提前量超过该值认为时间戳跳变，重新对齐时钟（微秒）
+#define FRAME_DROP_MAX_DELAY_US 1000000
+//连续丢帧的上限，保证画面仍然会更新
+#define FRAME_DROP_MAX_CONSECUTIVE 8
+//连续迟到多少帧之后升级一档
+#define FRAME_DROP_ESCALATE_FRAMES 12
+//连续准时多少帧之后降级一档
+#define FRAME_DROP_RECOVER_FRAMES 50
+
+enum FrameDropLevel
+{
+    FRAME_DROP_LEVEL_NONE = 0,
+    FRAME_DROP_LEVEL_SKIP_LOOP_FILTER,
+    FRAME_DROP_LEVEL_SKIP_NONREF,
+};
+
+enum FrameDropDecision
+{
+    FRAME_DROP_RENDER = 0,
+    FRAME_DROP_DROP,
+};
+
+typedef struct FrameDropStats
+{
+    int64_t frames_total;
+    int64_t frames_rendered;
+    int64_t frames_late;
+    int64_t frames_dropped;
+    int64_t escalations;
+    int64_t recoveries;
+    int64_t max_late_us;
+} FrameDropStats;
+
+typedef struct FrameDropPolicy
+{
+    AVCodecContext *codec_ctx;
+    AVRational time_base;
+    int64_t clock_start;
+    int64_t clock_pts;
+    int late_streak;
+    int ontime_streak;
+    int dropped_streak;
+    enum FrameDropLevel level;
+    FrameDropStats stats;
+} FrameDropPolicy;
+
+void frame_drop_init(FrameDropPolicy *policy, AVCodecContext *codec_ctx, AVRational time_base);
+//判断帧是渲染还是丢弃，delay_us 返回距离显示时间还有多久（负数表示迟到）
+enum FrameDropDecision frame_drop_check(FrameDropPolicy *policy, const AVFrame *frame, int64_t *delay_us);
+//重置时钟，seek 或者暂停恢复之后调用
+void frame_drop_reset_clock(FrameDropPolicy *policy);
+void frame_drop_log_stats(const FrameDropPolicy *policy);
+
+#endif
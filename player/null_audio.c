@@ -0,0 +1,83 @@
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+#include <string.h>
+#include "null_audio.h"
+
+static int null_audio_thread(void *arg)
+{
+    NullAudio *na = (NullAudio *)arg;
+    Uint8 *buf = (Uint8 *)SDL_malloc(na->bytes_per_period);
+    if (!buf)
+    {
+        return -1;
+    }
+    int64_t next = av_gettime_relative();
+    while (!na->quit)
+    {
+        if (na->paused)
+        {
+            SDL_Delay(10);
+            next = av_gettime_relative();
+            continue;
+        }
+        SDL_memset(buf, na->spec.silence, na->bytes_per_period);
+        na->spec.callback(na->spec.userdata, buf, na->bytes_per_period);
+        if (na->realtime)
+        {
+            //和真实声卡一样，每个周期取一次数据
+            next += na->period_us;
+            int64_t delay = next - av_gettime_relative();
+            if (delay > 0)
+            {
+                av_usleep((unsigned)delay);
+            }
+            else if (delay < -na->period_us * 4)
+            {
+                //落后太多不追赶
+                next = av_gettime_relative();
+            }
+        }
+    }
+    SDL_free(buf);
+    return 0;
+}
+
+int null_audio_open(NullAudio *na, const SDL_AudioSpec *spec, int realtime)
+{
+    memset(na, 0, sizeof(NullAudio));
+    na->spec = *spec;
+    na->realtime = realtime;
+    na->paused = 1;
+    int frame_size = SDL_AUDIO_BITSIZE(spec->format) / 8 * spec->channels;
+    na->bytes_per_period = spec->samples * frame_size;
+    na->period_us = (int64_t)spec->samples * 1000000 / spec->freq;
+    na->spec.size = na->bytes_per_period;
+    if (na->bytes_per_period <= 0 || !spec->callback)
+    {
+        return -1;
+    }
+    na->thread = SDL_CreateThread(null_audio_thread, "null_audio", na);
+    if (!na->thread)
+    {
+        av_log(NULL, AV_LOG_ERROR, "null_audio SDL_CreateThread error = %s.\n", SDL_GetError());
+        return -1;
+    }
+    av_log(NULL, AV_LOG_INFO, "null_audio open, period = %d bytes/%lldus, realtime = %d.\n",
+           na->bytes_per_period, (long long)na->period_us, realtime);
+    return 0;
+}
+
+void null_audio_pause(NullAudio *na, int pause_on)
+{
+    na->paused = pause_on;
+}
+
+void null_audio_close(NullAudio *na)
+{
+    na->quit = 1;
+    if (na->thread)
+    {
+        SDL_WaitThread(na->thread, NULL);
+        na->thread = NULL;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef NULL_AUDIO_H
+#define NULL_AUDIO_H
+
+#include <SDL2/SDL.h>
+
+//没有声卡时代替 SDL 音频设备，按 spec 周期性调用音频回调
+typedef struct NullAudio
+{
+    SDL_AudioSpec spec;
+    //0：尽快调用回调，1：按实际播放速度调用
+    int realtime;
+    int bytes_per_period;
+    int64_t period_us;
+    SDL_Thread *thread;
+    volatile int quit;
+    int paused;
+} NullAudio;
+
+//spec 的 size 由 NullAudio 计算，返回 0 成功
+int null_audio_open(NullAudio *na, const SDL_AudioSpec *spec, int realtime);
+void null_audio_pause(NullAudio *na, int pause_on);
+void null_audio_close(NullAudio *na);
+
+#endif
@@ -1,258 +1,275 @@
 #include <libavutil/log.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
-#include <libswscale/swscale.h>
-#include <libswresample/swresample.h>
+#include <libavutil/time.h>
 #include <SDL2/SDL.h>
 #include <string.h>
-
-#define SDL_AUDIO_BUFFER_SIZE 1024
-#define MAX_AUDIO_FRAME_SIZE 192000
-
-SwrContext *swr_ctx;
-
-typedef struct PacketQueue
-{
-    AVPacketList *first_pkt, *last_pkt;
-    int nb_packets;
-    int size;
-    SDL_mutex *mutex;
-    SDL_cond *cond;
-} PacketQueue;
-
-PacketQueue audioq;
-int quit = 0;
-
-void packet_queue_init(PacketQueue *q)
+#include "frame_drop.h"
+#include "video_render.h"
+#include "prefetch.h"
+#include "player_stats.h"
+#include "null_audio.h"
+#include "../audio/audio_engine.h"
+#include "../audio/audio_output.h"
+#include "../audio/audio_mixer.h"
+#include "../video_debugging.h"
+#include "../metrics.h"
+
+//方向键 seek 的步长（秒）
+#define SEEK_STEP_SHORT 10
+#define SEEK_STEP_LONG 60
+
+//-mix 时额外的音轨用这个打开解码器
+static AVCodecContext *open_audio_decoder(AVCodecParameters *codecpar)
 {
-    memset(q, 0, sizeof(PacketQueue));
-    q->mutex = SDL_CreateMutex();
-    q->cond = SDL_CreateCond();
-}
-
-int packet_queue_put(PacketQueue *q, AVPacket *pkt)
-{
-    AVPacketList *pkt1;
-    if (av_dup_packet(pkt) < 0)
+    AVCodec *codec = avcodec_find_decoder(codecpar->codec_id);
+    if (!codec)
     {
-        return -1;
+        av_log(NULL, AV_LOG_ERROR, "audio codec %d not found.\n", codecpar->codec_id);
+        return NULL;
     }
-    pkt1 = av_malloc(sizeof(AVPacketList));
-    if (!pkt1)
-        return -1;
-    pkt1->pkt = *pkt;
-    pkt1->next = NULL;
-
-    SDL_LockMutex(q->mutex);
-
-    if (!q->last_pkt)
+    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+    if (!codec_ctx)
     {
-        q->first_pkt = pkt1;
+        return NULL;
     }
-    else
+    avcodec_parameters_to_context(codec_ctx, codecpar);
+    int ret = avcodec_open2(codec_ctx, codec, NULL);
+    if (ret)
     {
-        q->last_pkt->next = pkt1;
+        av_log(NULL, AV_LOG_ERROR, "avcodec_open2 audio ret = %d.\n", ret);
+        avcodec_free_context(&codec_ctx);
     }
-
-    q->last_pkt = pkt1;
-    q->nb_packets++;
-    q->size += pkt1->pkt.size;
-    SDL_CondSignal(q->cond);
-
-    SDL_UnlockMutex(q->mutex);
-    return 0;
+    return codec_ctx;
 }
 
-int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
+//音频线程还在累加这些计数，原子读；pull 模式只有引擎或者混音器回调在计数，push 模式是输出线程
+static int64_t audio_callbacks(AudioEngine *ae, AudioMixer *mixer, AudioOutput *ao)
 {
-    AVPacketList *pkt1;
-    int ret;
+    return atomic_load_explicit(&ae->stats.callbacks, memory_order_relaxed) +
+           atomic_load_explicit(&mixer->stats.callbacks, memory_order_relaxed) +
+           atomic_load_explicit(&ao->stats.pushes, memory_order_relaxed);
+}
 
-    SDL_LockMutex(q->mutex);
+static int64_t audio_underruns(AudioEngine *ae, AudioMixer *mixer, AudioOutput *ao)
+{
+    return atomic_load_explicit(&ae->stats.underruns, memory_order_relaxed) +
+           atomic_load_explicit(&mixer->stats.underruns, memory_order_relaxed) +
+           atomic_load_explicit(&ao->stats.underruns, memory_order_relaxed);
+}
 
-    for (;;)
+//-gain 0.5,1：按混音轨道的顺序设置增益
+static void parse_gains(const char *arg, float *gains, int max)
+{
+    const char *p = arg;
+    for (int i = 0; i < max && *p; i++)
     {
-        if (quit)
+        char *end;
+        gains[i] = strtof(p, &end);
+        if (end == p || *end != ',')
         {
-            ret = -1;
             break;
         }
+        p = end + 1;
+    }
+}
 
-        pkt1 = q->first_pkt;
-        if (pkt1)
-        {
-            q->first_pkt = pkt1->next;
-            if (!q->first_pkt)
-                q->last_pkt = NULL;
-            q->nb_packets--;
-            q->size -= pkt1->pkt.size;
-            *pkt = pkt1->pkt;
-            av_free(pkt1);
-            ret = 1;
-            break;
+int main(int argc, char *argv[])
+{
+    //./player [-buffer bytes] [-timeout ms] [-accurate_seek] [-vo sdl|dummy|null] [-ao sdl|null] [-bench realtime|fast] [-headless]
+    //         [-audio_period samples] [-audio_buffer ms] [-audio_push] [-audio_device name]
+    //         [-mix] [-gain g1,g2,...] [-mix_impl auto|scalar|sse2|avx2] [-probe_cache file|default|off]
+    //         [-metrics file:path[:ms]|http:port|unix:path] url
+    char *input_url = NULL;
+    int accurate_seek = 0;
+    //视频输出：sdl 窗口，dummy 用 SDL 的 dummy 驱动，null 不创建窗口
+    const char *video_out = "sdl";
+    //音频输出：sdl 声卡，null 用线程模拟音频回调
+    const char *audio_out = "sdl";
+    //benchmark：NULL 正常播放，realtime 按时间戳播放，fast 尽快解码
+    const char *bench = NULL;
+    //音频设备的周期和解码缓冲决定了音频延迟
+    AudioOutputConfig audio_config;
+    audio_output_config_default(&audio_config);
+    //-mix 把所有音频流混成一路，第一路是主音轨（最后一个音频流），其余按流的顺序
+    int mix = 0;
+    enum AudioMixImpl mix_impl = AUDIO_MIX_AUTO;
+    float gains[AUDIO_MIXER_MAX_TRACKS];
+    for (int i = 0; i < AUDIO_MIXER_MAX_TRACKS; i++)
+    {
+        gains[i] = 1.0f;
+    }
+    PrefetchConfig prefetch_config;
+    prefetch_config_default(&prefetch_config);
+    //探测缓存，NULL 用默认路径
+    const char *probe_cache_path = NULL;
+    //指标导出，NULL 用环境变量 METRICS
+    const char *metrics_spec = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-buffer") && i + 1 < argc)
+        {
+            prefetch_config.max_bytes = atoi(argv[++i]);
         }
-        else if (!block)
+        else if (!strcmp(argv[i], "-timeout") && i + 1 < argc)
         {
-            ret = 0;
-            break;
+            prefetch_config.io_timeout_ms = atoi(argv[++i]);
         }
-        else
+        else if (!strcmp(argv[i], "-accurate_seek"))
         {
-            SDL_CondWait(q->cond, q->mutex);
+            accurate_seek = 1;
         }
-    }
-    SDL_UnlockMutex(q->mutex);
-    return ret;
-}
-
-int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_size)
-{
-
-    static AVPacket pkt;
-    static uint8_t *audio_pkt_data = NULL;
-    static int audio_pkt_size = 0;
-    static AVFrame frame;
-
-    int len1, data_size = 0;
-
-    for (;;)
-    {
-        while (audio_pkt_size > 0)
+        else if (!strcmp(argv[i], "-probe_cache") && i + 1 < argc)
         {
-            int got_frame = 0;
-            len1 = avcodec_decode_audio4(aCodecCtx, &frame, &got_frame, &pkt);
-            if (len1 < 0)
-            {
-                /* if error, skip frame */
-                audio_pkt_size = 0;
-                break;
-            }
-            audio_pkt_data += len1;
-            audio_pkt_size -= len1;
-            data_size = 0;
-            if (got_frame)
-            {
-                //fprintf(stderr, "channels:%d, nb_samples:%d, sample_fmt:%d \n", aCodecCtx->channels, frame.nb_samples, aCodecCtx->sample_fmt);
-                /*
-	data_size = av_samples_get_buffer_size(NULL, 
-					       aCodecCtx->channels,
-					       frame.nb_samples,
-					       aCodecCtx->sample_fmt,
-					       1);
-        */
-                data_size = 2 * 2 * frame.nb_samples;
-
-                // assert(data_size <= buf_size);
-                swr_convert(swr_ctx,
-                            &audio_buf,
-                            MAX_AUDIO_FRAME_SIZE * 3 / 2,
-                            (const uint8_t **)frame.data,
-                            frame.nb_samples);
-
-                //memcpy(audio_buf, frame.data[0], data_size);
-            }
-            if (data_size <= 0)
-            {
-                /* No data yet, get more frames */
-                continue;
-            }
-            /* We have data, return it and come back for more later */
-            return data_size;
+            probe_cache_path = argv[++i];
         }
-        if (pkt.data)
-            av_free_packet(&pkt);
-
-        if (quit)
+        else if (!strcmp(argv[i], "-metrics") && i + 1 < argc)
         {
-            return -1;
+            metrics_spec = argv[++i];
         }
-
-        if (packet_queue_get(&audioq, &pkt, 1) < 0)
+        else if (!strcmp(argv[i], "-vo") && i + 1 < argc)
         {
-            return -1;
+            video_out = argv[++i];
         }
-        audio_pkt_data = pkt.data;
-        audio_pkt_size = pkt.size;
-    }
-}
-
-//stream：A pointer to the audio data buffer.
-//len：The length of that buffer in bytes
-static void audio_callback(void *userdata, Uint8 *stream, int len)
-{
-    av_log(NULL, AV_LOG_INFO, "audio_callback.\n");
-
-    AVCodecContext *aCodecCtx = (AVCodecContext *)userdata;
-    int len1, audio_size;
-
-    static uint8_t audio_buf[(MAX_AUDIO_FRAME_SIZE * 3) / 2];
-    static unsigned int audio_buf_size = 0;
-    static unsigned int audio_buf_index = 0;
-
-    while (len > 0)
-    {
-        if (audio_buf_index >= audio_buf_size)
+        else if (!strcmp(argv[i], "-ao") && i + 1 < argc)
         {
-
-            /* We have already sent all our data; get more */
-            audio_size = audio_decode_frame(aCodecCtx, audio_buf, sizeof(audio_buf));
-            if (audio_size < 0)
-            {
-                /* If error, output silence */
-                audio_buf_size = 1024; // arbitrary?
-                memset(audio_buf, 0, audio_buf_size);
-            }
-            else
+            audio_out = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-bench") && i + 1 < argc)
+        {
+            bench = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-audio_period") && i + 1 < argc)
+        {
+            audio_config.period_samples = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-audio_buffer") && i + 1 < argc)
+        {
+            audio_config.buffer_ms = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-audio_push"))
+        {
+            audio_config.mode = AUDIO_OUTPUT_PUSH;
+        }
+        else if (!strcmp(argv[i], "-audio_device") && i + 1 < argc)
+        {
+            audio_config.device = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-mix"))
+        {
+            mix = 1;
+        }
+        else if (!strcmp(argv[i], "-gain") && i + 1 < argc)
+        {
+            parse_gains(argv[++i], gains, AUDIO_MIXER_MAX_TRACKS);
+        }
+        else if (!strcmp(argv[i], "-mix_impl") && i + 1 < argc)
+        {
+            mix_impl = audio_mix_impl_from_name(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-headless"))
+        {
+            video_out = "null";
+            audio_out = "null";
+            if (!bench)
             {
-                audio_buf_size = audio_size;
+                bench = "fast";
             }
-            audio_buf_index = 0;
-        }
-        len1 = audio_buf_size - audio_buf_index;
-        if (len1 > len)
-            len1 = len;
-        // fprintf(stderr, "index=%d, len1=%d, len=%d\n",
-        //         audio_buf_index,
-        //         len,
-        //         len1);
-        memcpy(stream, (uint8_t *)audio_buf + audio_buf_index, len1);
-        // SDL_MixAudio(stream,(const Uint8 *)audio_buf + audio_buf_index,len1,SDL_MIX_MAXVOLUME);
-        len -= len1;
-        stream += len1;
-        audio_buf_index += len1;
+        }
+        else
+        {
+            input_url = argv[i];
+        }
     }
-}
-
-int main(int argc, char *argv[])
-{
-
-    if (argc != 2)
+    if (!input_url)
     {
         av_log(NULL, AV_LOG_ERROR, "without input url.\n");
         return -1;
     }
+    int null_video = !strcmp(video_out, "null");
+    int null_audio = !strcmp(audio_out, "null");
+    int bench_fast = bench && !strcmp(bench, "fast");
+    if (!strcmp(video_out, "dummy"))
+    {
+        //没有显示器的机器上也能创建窗口和渲染器，走完整的上传流程
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+    if (bench)
+    {
+        //benchmark 时逐帧、逐包的日志会拖慢速度
+        av_log_set_level(AV_LOG_WARNING);
+    }
+    //benchmark 统计
+    PlayerStats player_stats;
+    player_stats_init(&player_stats);
 
     av_register_all();
+    avformat_network_init();
 
-    char *input_url = argv[1];
     int ret = 0;
+    //解码跟不上时丢帧、降低解码质量
+    FrameDropPolicy drop_policy = {0};
+    VideoRender video_render = {0};
+    //后台线程读包，网络慢的时候主线程不会卡住
+    Prefetcher prefetcher = {0};
+    //视频关键帧索引，读包时建立，或者从 url.idx 加载
+    SeekIndex video_index = {0};
+    //精确 seek 时，pts 小于该值的帧解码后丢掉
+    int64_t seek_target_pts = AV_NOPTS_VALUE;
+    int64_t seek_pending_pts = AV_NOPTS_VALUE;
+    int64_t seek_request_time = 0;
+    int64_t current_pts_us = 0;
+    NullAudio null_audio_dev = {0};
+    //音频包队列、解码线程、重采样、PCM 缓冲都在引擎里
+    AudioEngine audio_engine = {0};
+    AudioOutput audio_output = {0};
+    //-mix：其他音频流各有一个解码器和引擎，和主音轨一起混音
+    AudioMixer mixer = {0};
+    AVCodecContext *mix_codec_ctx[AUDIO_MIXER_MAX_TRACKS] = {0};
+    AudioEngine mix_engines[AUDIO_MIXER_MAX_TRACKS];
+    int mix_stream_index[AUDIO_MIXER_MAX_TRACKS];
+    int nb_mix = 0;
+    memset(mix_engines, 0, sizeof(mix_engines));
+    //后面才创建的资源先置空，任何一步 goto end 时都能安全释放
+    AVCodecContext *video_codec_ctx = NULL;
+    AVCodecContext *audio_codec_ctx = NULL;
+    SDL_Window *window = NULL;
+    SDL_Renderer *renderer = NULL;
+    AVPacket *input_packet = NULL;
+    AVFrame *input_frame = NULL;
+    Uint32 sdl_flags = SDL_INIT_EVENTS;
+    //设置了 TRACE_FILE 时记录各个阶段的耗时，退出时写成 Chrome trace
+    trace_init(NULL);
+    trace_thread_name("main");
+    //指标：没有配置时都是 NULL，更新什么也不做；各阶段耗时由 trace span 汇总成直方图
+    metrics_init(metrics_spec);
+    Metric *m_decoded = metrics_counter("media_frames_total", "stage=\"decoded\",type=\"video\"", "Frames through each pipeline stage.");
+    Metric *m_displayed = metrics_counter("media_frames_total", "stage=\"displayed\",type=\"video\"", NULL);
+    Metric *m_dropped = metrics_counter("media_frames_dropped_total", "type=\"video\"", "Late video frames dropped before conversion.");
+    metrics_rate("media_display_fps", NULL, "Displayed frames per second.", m_displayed, 1);
+    Metric *m_prefetch_depth = metrics_gauge("media_queue_depth_packets", "queue=\"prefetch\"", "Packets waiting in each queue.");
+    Metric *m_audio_depth = metrics_gauge("media_queue_depth_packets", "queue=\"audio\"", NULL);
+    Metric *m_audio_buffered = metrics_gauge("media_audio_buffered_bytes", NULL, "Decoded PCM waiting for the audio device.");
+    Metric *m_audio_callbacks = metrics_counter("media_audio_callbacks_total", NULL, "Audio device callbacks or pushes.");
+    Metric *m_audio_underruns = metrics_counter("media_audio_underruns_total", NULL, "Audio periods that were late or padded with silence.");
 
     //step 1：打开输入文件
-    //1、打开输入文件
-    AVFormatContext *input_format_ctx = NULL;
-    ret = avformat_open_input(&input_format_ctx, input_url, NULL, NULL);
-    if (ret != 0)
+    //1、打开输入文件，2、完善流信息，都有超时
+    //文件打开过并且没有变化时，流信息直接从探测缓存里取，缓存只在打开时用
+    ProbeCache probe_cache;
+    if (probe_cache_open(&probe_cache, probe_cache_path) >= 0)
     {
-        av_log(NULL, AV_LOG_ERROR, "avformat_open_input error,ret = %d.\n", ret);
-        goto end;
+        prefetch_config.probe_cache = &probe_cache;
     }
-    //2、完善流信息
-    ret = avformat_find_stream_info(input_format_ctx, NULL);
-    if (ret < 0)
+    ret = prefetch_open(&prefetcher, input_url, &prefetch_config);
+    probe_cache_log_stats(&probe_cache);
+    probe_cache_close(&probe_cache);
+    if (ret != 0)
     {
-        av_log(NULL, AV_LOG_ERROR, "avformat_find_stream_info error,ret = %d.\n", ret);
+        av_log(NULL, AV_LOG_ERROR, "prefetch_open error,ret = %d.\n", ret);
         goto end;
     }
+    AVFormatContext *input_format_ctx = prefetcher.fmt_ctx;
 
     //step 2：初始化解码器（音、视频解码器）
     //1、找到音、视频相关信息
@@ -278,7 +295,6 @@ int main(int argc, char *argv[])
     av_log(NULL, AV_LOG_INFO, "video_stream_index = %d,audio_stream_index = %d.\n", video_stream_index, audio_stream_index);
     //2、完善视频解码器
     AVCodec *video_codec = NULL;
-    AVCodecContext *video_codec_ctx = NULL;
     video_codec = avcodec_find_decoder(video_codecpar->codec_id);
     if (!video_codec)
     {
@@ -294,7 +310,6 @@ int main(int argc, char *argv[])
     avcodec_parameters_to_context(video_codec_ctx, video_codecpar);
     //3、完善音频解码器
     AVCodec *audio_codec = NULL;
-    AVCodecContext *audio_codec_ctx = NULL;
     audio_codec = avcodec_find_decoder(audio_codecpar->codec_id);
     if (!audio_codec)
     {
@@ -308,205 +323,416 @@ int main(int argc, char *argv[])
         goto end;
     }
     avcodec_parameters_to_context(audio_codec_ctx, audio_codecpar);
-    //4、打开视频解码器
-    ret = avcodec_open2(video_codec_ctx, video_codec, NULL);
-    if (ret)
-    {
-        av_log(NULL, AV_LOG_ERROR, "avcodec_open2 video ret = %d.\n", ret);
-        goto end;
-    }
-    //5、打开音频解码器
+    //4、打开音频解码器（视频解码器在渲染器初始化之后打开）
     ret = avcodec_open2(audio_codec_ctx, audio_codec, NULL);
     if (ret)
     {
         av_log(NULL, AV_LOG_ERROR, "avcodec_open2 audio ret = %d.\n", ret);
         goto end;
     }
+    //5、-mix 时打开其他音频流的解码器，主音轨占混音器的第一路
+    for (int i = 0; mix && i < stream_num && nb_mix < AUDIO_MIXER_MAX_TRACKS - 1; i++)
+    {
+        AVStream *stream = input_format_ctx->streams[i];
+        if (stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO || stream->index == audio_stream_index)
+        {
+            continue;
+        }
+        mix_codec_ctx[nb_mix] = open_audio_decoder(stream->codecpar);
+        if (!mix_codec_ctx[nb_mix])
+        {
+            goto end;
+        }
+        mix_stream_index[nb_mix++] = stream->index;
+    }
 
     //step 3：初始化渲染器
     //1、视频
-    int screen_w = 640;
-    int screen_h = 480;
-    int pixformat = SDL_PIXELFORMAT_IYUV;
-    SDL_Window *window = NULL;
-    SDL_Renderer *renderer = NULL;
-    SDL_Texture *texture = NULL;
+    int screen_w = 0;
+    int screen_h = 0;
     SDL_Event event;
     SDL_Rect rect;
-    ret = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS);
+    //null 输出不初始化对应的 SDL 子系统
+    sdl_flags |= null_video ? 0 : SDL_INIT_VIDEO;
+    sdl_flags |= null_audio ? 0 : SDL_INIT_AUDIO;
+    ret = SDL_Init(sdl_flags);
     if (ret)
     {
         av_log(NULL, AV_LOG_INFO, "SDL_Init ret = %d.\n", ret);
         goto end;
     }
-    window = SDL_CreateWindow("player", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screen_w, screen_h, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
-    if (!window)
+    if (!null_video)
     {
-        av_log(NULL, AV_LOG_ERROR, "SDL_CreateWindow NULL.\n");
-        goto end;
+        //窗口大小跟随视频，超过屏幕时按比例缩小
+        video_render_fit_window(video_codecpar->width, video_codecpar->height, video_codecpar->sample_aspect_ratio, &screen_w, &screen_h);
+        Uint32 window_flags = SDL_WINDOW_RESIZABLE;
+        //dummy 驱动没有 OpenGL
+        window_flags |= strcmp(video_out, "dummy") ? SDL_WINDOW_OPENGL : 0;
+        window = SDL_CreateWindow("player", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screen_w, screen_h, window_flags);
+        if (!window)
+        {
+            av_log(NULL, AV_LOG_ERROR, "SDL_CreateWindow NULL.\n");
+            goto end;
+        }
+        renderer = SDL_CreateRenderer(window, -1, 0);
+        if (!renderer)
+        {
+            av_log(NULL, AV_LOG_ERROR, "SDL_CreateRenderer NULL.\n");
+            goto end;
+        }
     }
-    renderer = SDL_CreateRenderer(window, -1, 0);
-    if (!renderer)
+    //纹理按解码出来的帧大小创建，缩放交给渲染器；renderer 为 NULL 时只做统计
+    video_render_init(&video_render, renderer);
+    //打开视频解码器，条件允许时直接解码到纹理
+    video_render_enable_direct_decode(&video_render, video_codec_ctx);
+    ret = avcodec_open2(video_codec_ctx, video_codec, NULL);
+    if (ret)
     {
-        av_log(NULL, AV_LOG_ERROR, "SDL_CreateRenderer NULL.\n");
+        av_log(NULL, AV_LOG_ERROR, "avcodec_open2 video ret = %d.\n", ret);
         goto end;
     }
-    texture = SDL_CreateTexture(renderer, pixformat, SDL_TEXTUREACCESS_STREAMING, screen_w, screen_h);
-    if (!texture)
+    //2、音频
+    //重采样在打开音频设备、知道设备格式之后再配置
+    ret = audio_engine_init(&audio_engine, audio_codec_ctx);
+    if (ret < 0)
     {
-        av_log(NULL, AV_LOG_ERROR, "SDL_CreateTexture NULL.\n");
+        av_log(NULL, AV_LOG_ERROR, "audio_engine_init ret = %d.\n", ret);
         goto end;
     }
-    //2、音频
-    SDL_AudioSpec spec;
-    spec.freq = audio_codecpar->sample_rate;
-    //audio_codecpar->format;
-    spec.format = AUDIO_S16SYS;
-    spec.channels = audio_codecpar->channels;
-    spec.silence = 0;
-    spec.samples = 1024;
-    spec.callback = audio_callback;
-    spec.userdata = audio_codec_ctx;
-    ret = SDL_OpenAudio(&spec, NULL);
+    //只有一个音频流时不经过混音器
+    if (nb_mix > 0)
+    {
+        ret = audio_mixer_init(&mixer, mix_impl);
+        if (ret < 0)
+        {
+            goto end;
+        }
+        ret = audio_mixer_add_track(&mixer, &audio_engine, gains[0]);
+        for (int i = 0; ret >= 0 && i < nb_mix; i++)
+        {
+            ret = audio_engine_init(&mix_engines[i], mix_codec_ctx[i]);
+            if (ret < 0)
+            {
+                av_log(NULL, AV_LOG_ERROR, "audio_engine_init mix %d ret = %d.\n", i, ret);
+                break;
+            }
+            ret = audio_mixer_add_track(&mixer, &mix_engines[i], gains[i + 1]);
+        }
+        if (ret < 0)
+        {
+            av_log(NULL, AV_LOG_ERROR, "audio_mixer setup ret = %d.\n", ret);
+            goto end;
+        }
+        av_log(NULL, AV_LOG_INFO, "mix %d audio streams.\n", mixer.nb_tracks);
+    }
+    if (null_audio)
+    {
+        //没有设备，输出 S16，采样率和声道数跟随解码器
+        //混音时每一路都转换成主音轨的采样率和声道数
+        int buffer_samples = (int)((int64_t)audio_config.buffer_ms * audio_codec_ctx->sample_rate / 1000);
+        ret = audio_engine_configure(&audio_engine, audio_codec_ctx->sample_rate, AV_SAMPLE_FMT_S16, audio_codec_ctx->channels,
+                                     audio_config.period_samples, buffer_samples);
+        for (int i = 0; ret >= 0 && i < nb_mix; i++)
+        {
+            ret = audio_engine_configure(&mix_engines[i], audio_codec_ctx->sample_rate, AV_SAMPLE_FMT_S16, audio_codec_ctx->channels,
+                                         audio_config.period_samples, buffer_samples);
+        }
+        if (ret >= 0 && nb_mix > 0)
+        {
+            ret = audio_mixer_prepare(&mixer, audio_config.period_samples * audio_engine.out_frame_bytes);
+        }
+        SDL_AudioSpec spec;
+        SDL_zero(spec);
+        spec.freq = audio_engine.out_sample_rate;
+        spec.format = AUDIO_S16SYS;
+        spec.channels = audio_engine.out_channels;
+        spec.samples = audio_config.period_samples;
+        spec.callback = nb_mix > 0 ? audio_mixer_callback : audio_engine_callback;
+        spec.userdata = nb_mix > 0 ? (void *)&mixer : (void *)&audio_engine;
+        //null 音频在 fast 模式下不按时间调用回调，尽快消耗音频队列
+        ret = ret < 0 ? ret : null_audio_open(&null_audio_dev, &spec, !bench_fast);
+    }
+    else if (nb_mix > 0)
+    {
+        ret = audio_output_open_mixer(&audio_output, &mixer, &audio_config);
+    }
+    else
+    {
+        ret = audio_output_open(&audio_output, &audio_engine, &audio_config);
+    }
     if (ret < 0)
     {
         av_log(NULL, AV_LOG_ERROR, "can't open audio ret = %d.\n", ret);
         goto end;
     }
-    packet_queue_init(&audioq);
 
-    //step 4：初始化图像转换器
-    int srcW = video_codecpar->width;
-    int srcH = video_codecpar->height;
-    enum AVPixelFormat srcFormat = video_codecpar->format;
-    int dstW = 640;
-    int dstH = 480;
-    enum AVPixelFormat dstFormat = AV_PIX_FMT_YUV420P;
-    // srcW：源图像的宽
-    // srcH：源图像的高
-    // srcFormat：源图像的像素格式
-    // dstW：目标图像的宽
-    // dstH：目标图像的高
-    // dstFormat：目标图像的像素格式
-    // flags：设定图像拉伸使用的算法
-    struct SwsContext *sws_ctx = sws_getContext(srcW, srcH, srcFormat, dstW, dstH, dstFormat, SWS_FAST_BILINEAR, NULL, NULL, NULL);
-    if (!sws_ctx)
-    {
-        av_log(NULL, AV_LOG_ERROR, "sws_getContext NULL.\n");
-        goto end;
-    }
-    AVPicture *output_picture = (AVPicture *)malloc(sizeof(AVPicture));
-    avpicture_alloc(output_picture, dstFormat, dstW, dstH);
+    //step 4：图像转换由 VideoRender 处理，YUV420P 不需要转换
 
-    //step 5：初始化音频重采样
-    swr_ctx = swr_alloc();
-    if (!swr_ctx)
+    //step 5：音频重采样在 audio_output_open 里按设备实际的格式初始化，只转换一次
+    //音频解码线程先把环形缓冲填上，再开始播放
+    ret = audio_engine_start(&audio_engine);
+    for (int i = 0; ret >= 0 && i < nb_mix; i++)
     {
-        av_log(NULL, AV_LOG_ERROR, "swr_alloc NULL.\n");
-        goto end;
+        ret = audio_engine_start(&mix_engines[i]);
     }
-    /* set options */
-    int64_t src_ch_layout = audio_codecpar->channel_layout;
-    int64_t dst_ch_layout = src_ch_layout;
-    int src_rate = audio_codecpar->sample_rate;
-    int dst_rate = src_rate;
-    enum AVSampleFormat src_sample_fmt = audio_codecpar->format;
-    enum AVSampleFormat dst_sample_fmt = AV_SAMPLE_FMT_S16;
-    swr_alloc_set_opts(swr_ctx,
-                       dst_ch_layout,
-                       dst_sample_fmt,
-                       dst_rate,
-                       src_ch_layout,
-                       src_sample_fmt,
-                       src_rate,
-                       0,
-                       NULL);
-    if ((ret = swr_init(swr_ctx)) < 0)
-    {
-        av_log(NULL, AV_LOG_INFO, "swr_init ret = %d.\n", ret);
+    if (ret < 0)
+    {
         goto end;
     }
 
     //开始播放
-    SDL_PauseAudio(0);
+    if (null_audio)
+    {
+        null_audio_pause(&null_audio_dev, 0);
+    }
+    else
+    {
+        audio_output_pause(&audio_output, 0);
+    }
+
+    AVRational video_time_base = input_format_ctx->streams[video_stream_index]->time_base;
+    frame_drop_init(&drop_policy, video_codec_ctx, video_time_base);
+    seek_index_init(&video_index, video_stream_index, video_time_base);
+    seek_index_load_sidecar(&video_index, input_url);
+    prefetch_set_index(&prefetcher, &video_index);
 
     //step 6：解码
-    AVPacket *input_packet = av_packet_alloc();
-    AVFrame *input_frame = av_frame_alloc();
-    while (av_read_frame(input_format_ctx, input_packet) == 0)
+    input_packet = av_packet_alloc();
+    input_frame = av_frame_alloc();
+    ret = input_packet && input_frame ? prefetch_start(&prefetcher) : AVERROR(ENOMEM);
+    if (ret < 0)
     {
+        goto end;
+    }
+    player_stats.start_time = av_gettime_relative();
+    while ((ret = prefetch_get(&prefetcher, input_packet, 10)) >= 0)
+    {
+        PrefetchStats prefetch_stats;
+        prefetch_get_stats(&prefetcher, &prefetch_stats);
+        player_stats_sample_queues(&player_stats, prefetch_stats.level_packets, audio_engine_queued_packets(&audio_engine));
+        audio_output_sample(&audio_output);
+        metrics_set(m_prefetch_depth, prefetch_stats.level_packets);
+        metrics_set(m_audio_depth, audio_engine_queued_packets(&audio_engine));
+        metrics_set(m_audio_buffered, audio_engine_buffered_bytes(&audio_engine));
+        //音频线程自己累加统计，这里只是拷贝过去，和退出时的汇总一样
+        metrics_set(m_audio_callbacks, audio_callbacks(&audio_engine, &mixer, &audio_output));
+        metrics_set(m_audio_underruns, audio_underruns(&audio_engine, &mixer, &audio_output));
+        if (ret == 0)
+        {
+            //缓冲为空，只处理界面事件
+        }
+        else if (ret == PREFETCH_FLUSH)
+        {
+            //seek 完成：清空视频解码器、音频队列，重新对齐时钟
+            avcodec_flush_buffers(video_codec_ctx);
+            audio_engine_flush(&audio_engine);
+            for (int i = 0; i < nb_mix; i++)
+            {
+                audio_engine_flush(&mix_engines[i]);
+            }
+            frame_drop_reset_clock(&drop_policy);
+            seek_target_pts = seek_pending_pts;
+            seek_pending_pts = AV_NOPTS_VALUE;
+        }
         //视频
-        if (input_packet->stream_index == video_stream_index)
+        else if (input_packet->stream_index == video_stream_index)
         {
             av_log(NULL, AV_LOG_INFO, "av_read_frame video.\n");
+            int64_t decode_start = av_gettime_relative();
+            TRACE_BEGIN(send_start);
             ret = avcodec_send_packet(video_codec_ctx, input_packet);
+            TRACE_END(send_start, "avcodec_send_packet", video_stream_index, video_codec_ctx->frame_number);
             if (ret == 0)
             {
-                while (avcodec_receive_frame(video_codec_ctx, input_frame) == 0)
+                for (;;)
                 {
+                    TRACE_BEGIN(receive_start);
+                    int receive_ret = avcodec_receive_frame(video_codec_ctx, input_frame);
+                    TRACE_END(receive_start, "avcodec_receive_frame", video_stream_index, video_codec_ctx->frame_number);
+                    if (receive_ret != 0)
+                    {
+                        break;
+                    }
+                    player_stats_add_decode(&player_stats, av_gettime_relative() - decode_start, 1);
+                    metrics_add(m_decoded, 1);
+                    int64_t frame_pts = input_frame->best_effort_timestamp;
+                    //精确 seek：从关键帧解码到目标帧，中间的帧不显示
+                    if (seek_target_pts != AV_NOPTS_VALUE && frame_pts != AV_NOPTS_VALUE && frame_pts < seek_target_pts)
+                    {
+                        continue;
+                    }
+                    seek_target_pts = AV_NOPTS_VALUE;
+                    if (frame_pts != AV_NOPTS_VALUE)
+                    {
+                        current_pts_us = av_rescale_q(frame_pts, video_time_base, AV_TIME_BASE_Q);
+                    }
+                    //迟到的帧在 sws_scale 之前丢掉；fast 模式不丢帧也不等待
+                    int64_t delay_us = 0;
+                    if (!bench_fast && frame_drop_check(&drop_policy, input_frame, &delay_us) == FRAME_DROP_DROP)
+                    {
+                        metrics_add(m_dropped, 1);
+                        decode_start = av_gettime_relative();
+                        continue;
+                    }
+                    int64_t present_time = av_gettime_relative() + delay_us;
                     //渲染视频
-                    // for (int i = 0; i < 8; i++)
-                    // {
-                    //     av_log(NULL, AV_LOG_INFO, "input_frame_linesize[%d] = %d,output_picture_linesize[%d] = %d.\n", i, input_frame->linesize[i], i, output_picture->linesize[i]);
-                    // }
-                    //参数1
-                    //参数二：input_frame->data 输入数据（一帧图像数据），yuv420p是3个平面
-                    //参数三：input_frame->linesize 输入数据不同平面每个平面的每行的个数
-                    //参数四：源图像Y方向位置
-                    //参数五：图像高度（为什么需要高度，C语言用指针表示数组，并不知道数组大小）
-                    //参数六：输出图像存储数据
-                    //参数七：输出图像不同平面每行的个数
-                    sws_scale(sws_ctx, input_frame->data, input_frame->linesize, 0, input_frame->height, output_picture->data, output_picture->linesize);
-                    // for (int i = 0; i < 3; i++)
-                    // {
-                    //     av_log(NULL, AV_LOG_INFO, "after sws_scale output_picture_linesize[%d] = %d.\n", i, output_picture->linesize[i]);
-                    // }
-                    SDL_UpdateYUVTexture(texture, NULL,
-                                         output_picture->data[0], output_picture->linesize[0],
-                                         output_picture->data[1], output_picture->linesize[1],
-                                         output_picture->data[2], output_picture->linesize[2]);
-
-                    // rect.x = 0;
-                    // rect.y = 0;
-                    // rect.w = dstW;
-                    // rect.h = dstH;
-
-                    SDL_RenderClear(renderer);
-                    // SDL_RenderCopy(renderer, texture, NULL, &rect);
-                    SDL_RenderCopy(renderer, texture, NULL, NULL);
-                    SDL_RenderPresent(renderer);
+                    //YUV420P 直接上传 input_frame 的平面，其他格式才经过 sws_scale
+                    int64_t convert_start = av_gettime_relative();
+                    video_render_upload(&video_render, input_frame);
+                    player_stats_add_convert(&player_stats, av_gettime_relative() - convert_start);
+
+                    //还没到显示时间，等一下再显示
+                    int64_t wait_us = present_time - av_gettime_relative();
+                    if (wait_us > 0)
+                    {
+                        SDL_Delay((Uint32)(wait_us / 1000));
+                    }
+                    TRACE_BEGIN(present_start);
+                    video_render_present(&video_render);
+                    TRACE_END(present_start, "present", video_stream_index, video_codec_ctx->frame_number);
+                    metrics_add(m_displayed, 1);
+                    player_stats_add_present(&player_stats, bench_fast ? 0 : av_gettime_relative() - present_time);
+                    if (seek_request_time)
+                    {
+                        av_log(NULL, AV_LOG_INFO, "seek to %.3fs done in %lldms.\n", current_pts_us / 1000000.0,
+                               (long long)((av_gettime_relative() - seek_request_time) / 1000));
+                        seek_request_time = 0;
+                    }
+                    decode_start = av_gettime_relative();
 
                     // av_free_packet(&input_packet);
                 }
+                //最后一次 receive_frame 返回 EAGAIN 的耗时也算解码时间
+                player_stats_add_decode(&player_stats, av_gettime_relative() - decode_start, 0);
             }
+            av_packet_unref(input_packet);
         }
         //音频
         else if (input_packet->stream_index == audio_stream_index)
         {
             av_log(NULL, AV_LOG_INFO, "av_read_frame audio.\n");
-            packet_queue_put(&audioq, input_packet);
+            audio_engine_put_packet(&audio_engine, input_packet);
+        }
+        else
+        {
+            int track = -1;
+            for (int i = 0; i < nb_mix; i++)
+            {
+                if (input_packet->stream_index == mix_stream_index[i])
+                {
+                    track = i;
+                    break;
+                }
+            }
+            if (track >= 0)
+            {
+                audio_engine_put_packet(&mix_engines[track], input_packet);
+            }
+            else
+            {
+                av_packet_unref(input_packet);
+            }
         }
 
         // Free the packet that was allocated by av_read_frame
-        SDL_PollEvent(&event);
-        switch (event.type)
+        while (SDL_PollEvent(&event))
         {
-        case SDL_QUIT:
-            // quit = 1;
-            goto end;
-            break;
-        default:
-            break;
+            switch (event.type)
+            {
+            case SDL_QUIT:
+                // quit = 1;
+                goto end;
+                break;
+            case SDL_KEYDOWN:
+            {
+                //左右方向键 10 秒，上下方向键 60 秒
+                int64_t step = 0;
+                switch (event.key.keysym.sym)
+                {
+                case SDLK_LEFT:
+                    step = -SEEK_STEP_SHORT;
+                    break;
+                case SDLK_RIGHT:
+                    step = SEEK_STEP_SHORT;
+                    break;
+                case SDLK_DOWN:
+                    step = -SEEK_STEP_LONG;
+                    break;
+                case SDLK_UP:
+                    step = SEEK_STEP_LONG;
+                    break;
+                default:
+                    break;
+                }
+                if (step)
+                {
+                    int64_t target_us = current_pts_us + step * AV_TIME_BASE;
+                    seek_request_time = av_gettime_relative();
+                    seek_pending_pts = accurate_seek ? av_rescale_q(target_us, AV_TIME_BASE_Q, video_time_base) : AV_NOPTS_VALUE;
+                    prefetch_seek(&prefetcher, target_us);
+                }
+                break;
+            }
+            case SDL_WINDOWEVENT:
+                //窗口大小变化，重新计算显示区域
+                if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                {
+                    video_render_resize(&video_render);
+                    video_render_present(&video_render);
+                }
+                break;
+            default:
+                break;
+            }
         }
     }
 
 end:
-    if (input_format_ctx)
+    player_stats.end_time = av_gettime_relative();
+    //先停止解码线程，再关闭音频设备，最后释放引擎
+    audio_engine_stop(&audio_engine);
+    for (int i = 0; i < nb_mix; i++)
+    {
+        audio_engine_stop(&mix_engines[i]);
+    }
+    if (null_audio)
+    {
+        null_audio_close(&null_audio_dev);
+    }
+    else
+    {
+        audio_output_log_stats(&audio_output);
+        audio_output_close(&audio_output);
+    }
+    //push 模式没有回调，欠载由输出线程统计；混音时回调在混音器里
+    player_stats.audio_callbacks = audio_callbacks(&audio_engine, &mixer, &audio_output);
+    player_stats.audio_underruns = audio_underruns(&audio_engine, &mixer, &audio_output);
+    player_stats.audio_callback_max_us = FFMAX(audio_engine.stats.callback_max_us, mixer.stats.mix_max_us);
+    if (nb_mix > 0)
     {
-        avformat_close_input(&input_format_ctx);
-        avformat_free_context(input_format_ctx);
-        input_format_ctx = NULL;
+        audio_mixer_log_stats(&mixer);
     }
+    audio_mixer_free(&mixer);
+    audio_engine_log_stats(&audio_engine, "player");
+    audio_engine_destroy(&audio_engine);
+    for (int i = 0; i < nb_mix; i++)
+    {
+        audio_engine_log_stats(&mix_engines[i], "player mix");
+        audio_engine_destroy(&mix_engines[i]);
+        avcodec_free_context(&mix_codec_ctx[i]);
+    }
+    if (drop_policy.codec_ctx)
+    {
+        frame_drop_log_stats(&drop_policy);
+    }
+    if (bench)
+    {
+        player_stats_report(&player_stats, bench);
+    }
+    //停止读取线程并关闭输入
+    prefetch_log_stats(&prefetcher);
+    prefetch_close(&prefetcher);
+    seek_index_free(&video_index);
     if (video_codec_ctx)
     {
         avcodec_free_context(&video_codec_ctx);
@@ -518,11 +744,9 @@ end:
         audio_codec_ctx = NULL;
     }
 
-    //sdl释放
-    if (texture)
-    {
-        SDL_DestroyTexture(texture);
-    }
+    //sdl释放，解码器释放之后才能销毁纹理
+    video_render_log_stats(&video_render);
+    video_render_destroy(&video_render);
     if (renderer)
     {
         SDL_DestroyRenderer(renderer);
@@ -533,28 +757,18 @@ end:
     }
     SDL_Quit();
 
-    if (sws_ctx)
-    {
-        sws_freeContext(sws_ctx);
-        sws_ctx = NULL;
-    }
-
-    if (swr_ctx)
-    {
-        swr_free(swr_ctx);
-        swr_ctx = NULL;
-    }
-
     //
     if (input_packet)
     {
-        av_packet_unref(input_packet);
-        input_packet = NULL;
+        av_packet_free(&input_packet);
     }
     if (input_frame)
     {
         av_frame_free(&input_frame);
         input_frame = NULL;
     }
+    //所有线程都已经退出
+    metrics_shutdown();
+    trace_shutdown();
     return 0;
 }
\ No newline at end of file
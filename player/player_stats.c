@@ -0,0 +1,86 @@
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "player_stats.h"
+
+void player_stats_init(PlayerStats *stats)
+{
+    memset(stats, 0, sizeof(PlayerStats));
+    stats->start_time = av_gettime_relative();
+}
+
+void player_stats_add_decode(PlayerStats *stats, int64_t us, int frames)
+{
+    stats->decode_us += us;
+    stats->frames_decoded += frames;
+}
+
+void player_stats_add_convert(PlayerStats *stats, int64_t us)
+{
+    stats->convert_us += us;
+    if (us > stats->convert_max_us)
+    {
+        stats->convert_max_us = us;
+    }
+}
+
+void player_stats_add_present(PlayerStats *stats, int64_t jitter_us)
+{
+    stats->frames_presented++;
+    stats->jitter_count++;
+    stats->jitter_sum += jitter_us;
+    stats->jitter_sq_sum += (double)jitter_us * jitter_us;
+    if (llabs(jitter_us) > stats->jitter_max_us)
+    {
+        stats->jitter_max_us = llabs(jitter_us);
+    }
+}
+
+void player_stats_sample_queues(PlayerStats *stats, int packet_queue, int audio_queue)
+{
+    stats->queue_samples++;
+    stats->packet_queue_sum += packet_queue;
+    stats->audio_queue_sum += audio_queue;
+    if (packet_queue > stats->packet_queue_max)
+    {
+        stats->packet_queue_max = packet_queue;
+    }
+    if (audio_queue > stats->audio_queue_max)
+    {
+        stats->audio_queue_max = audio_queue;
+    }
+}
+
+void player_stats_report(PlayerStats *stats, const char *name)
+{
+    if (!stats->end_time)
+    {
+        stats->end_time = av_gettime_relative();
+    }
+    double wall = (stats->end_time - stats->start_time) / 1000000.0;
+    double decode = stats->decode_us / 1000000.0;
+    double jitter_avg = stats->jitter_count ? stats->jitter_sum / stats->jitter_count : 0;
+    double jitter_var = stats->jitter_count ? stats->jitter_sq_sum / stats->jitter_count - jitter_avg * jitter_avg : 0;
+    int64_t samples = stats->queue_samples ? stats->queue_samples : 1;
+
+    printf("bench %s wall_s=%.3f\n", name, wall);
+    printf("bench %s frames_decoded=%lld frames_presented=%lld\n", name,
+           (long long)stats->frames_decoded, (long long)stats->frames_presented);
+    printf("bench %s fps_wall=%.2f fps_decode=%.2f\n", name,
+           wall > 0 ? stats->frames_decoded / wall : 0,
+           decode > 0 ? stats->frames_decoded / decode : 0);
+    printf("bench %s convert_avg_ms=%.3f convert_max_ms=%.3f\n", name,
+           stats->frames_presented ? stats->convert_us / 1000.0 / stats->frames_presented : 0,
+           stats->convert_max_us / 1000.0);
+    printf("bench %s jitter_avg_ms=%.3f jitter_stddev_ms=%.3f jitter_max_ms=%.3f\n", name,
+           jitter_avg / 1000.0, jitter_var > 0 ? sqrt(jitter_var) / 1000.0 : 0, stats->jitter_max_us / 1000.0);
+    printf("bench %s packet_queue_avg=%.1f packet_queue_max=%d audio_queue_avg=%.1f audio_queue_max=%d\n", name,
+           (double)stats->packet_queue_sum / samples, stats->packet_queue_max,
+           (double)stats->audio_queue_sum / samples, stats->audio_queue_max);
+    printf("bench %s audio_callbacks=%lld audio_underruns=%lld audio_callback_max_ms=%.3f\n", name,
+           (long long)stats->audio_callbacks, (long long)stats->audio_underruns,
+           stats->audio_callback_max_us / 1000.0);
+}
@@ -0,0 +1,47 @@
+#ifndef PLAYER_STATS_H
+#define PLAYER_STATS_H
+
+#include <stdint.h>
+
+//播放性能统计，无界面的 benchmark 模式下输出
+typedef struct PlayerStats
+{
+    int64_t start_time;
+    int64_t end_time;
+
+    int64_t frames_decoded;
+    int64_t frames_presented;
+    //累计解码耗时（send_packet + receive_frame）
+    int64_t decode_us;
+    //累计格式转换 + 纹理上传耗时
+    int64_t convert_us;
+    int64_t convert_max_us;
+
+    //显示抖动：实际显示时间和计划显示时间的偏差
+    int64_t jitter_count;
+    double jitter_sum;
+    double jitter_sq_sum;
+    int64_t jitter_max_us;
+
+    //队列深度采样
+    int64_t queue_samples;
+    int64_t packet_queue_sum;
+    int packet_queue_max;
+    int64_t audio_queue_sum;
+    int audio_queue_max;
+
+    //音频回调，从 AudioEngine 的统计里复制
+    int64_t audio_callbacks;
+    int64_t audio_underruns;
+    int64_t audio_callback_max_us;
+} PlayerStats;
+
+void player_stats_init(PlayerStats *stats);
+void player_stats_add_decode(PlayerStats *stats, int64_t us, int frames);
+void player_stats_add_convert(PlayerStats *stats, int64_t us);
+void player_stats_add_present(PlayerStats *stats, int64_t jitter_us);
+void player_stats_sample_queues(PlayerStats *stats, int packet_queue, int audio_queue);
+//key=value 形式的统计打印到 stdout，不受日志级别影响，方便 CI 解析
+void player_stats_report(PlayerStats *stats, const char *name);
+
+#endif
@@ -0,0 +1,470 @@
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+#include <string.h>
+#include "prefetch.h"
+#include "../video_debugging.h"
+
+//FFmpeg 在阻塞 IO 中会反复调用，返回 1 表示中断
+static int interrupt_cb(void *opaque)
+{
+    Prefetcher *pf = (Prefetcher *)opaque;
+    if (pf->abort_request)
+    {
+        return 1;
+    }
+    int64_t deadline = pf->io_deadline;
+    if (deadline && av_gettime_relative() > deadline)
+    {
+        pf->timed_out = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static void io_begin(Prefetcher *pf)
+{
+    pf->timed_out = 0;
+    pf->io_deadline = av_gettime_relative() + (int64_t)pf->config.io_timeout_ms * 1000;
+}
+
+static void io_end(Prefetcher *pf)
+{
+    pf->io_deadline = 0;
+}
+
+void prefetch_config_default(PrefetchConfig *config)
+{
+    config->max_bytes = PREFETCH_DEFAULT_MAX_BYTES;
+    config->max_packets = PREFETCH_DEFAULT_MAX_PACKETS;
+    config->io_timeout_ms = PREFETCH_DEFAULT_IO_TIMEOUT_MS;
+    config->max_retries = PREFETCH_DEFAULT_MAX_RETRIES;
+    config->probe_cache = NULL;
+}
+
+int prefetch_open(Prefetcher *pf, const char *url, const PrefetchConfig *config)
+{
+    int ret;
+    memset(pf, 0, sizeof(Prefetcher));
+    if (config)
+    {
+        pf->config = *config;
+    }
+    else
+    {
+        prefetch_config_default(&pf->config);
+    }
+    pf->mutex = SDL_CreateMutex();
+    pf->cond_not_empty = SDL_CreateCond();
+    pf->cond_not_full = SDL_CreateCond();
+    if (!pf->mutex || !pf->cond_not_empty || !pf->cond_not_full)
+    {
+        av_log(NULL, AV_LOG_ERROR, "prefetch SDL_CreateMutex/SDL_CreateCond error = %s.\n", SDL_GetError());
+        return AVERROR(ENOMEM);
+    }
+
+    pf->fmt_ctx = avformat_alloc_context();
+    if (!pf->fmt_ctx)
+    {
+        return AVERROR(ENOMEM);
+    }
+    //HLS 的分片请求也会使用这个回调
+    pf->fmt_ctx->interrupt_callback.callback = interrupt_cb;
+    pf->fmt_ctx->interrupt_callback.opaque = pf;
+
+    io_begin(pf);
+    ret = avformat_open_input(&pf->fmt_ctx, url, NULL, NULL);
+    io_end(pf);
+    if (ret != 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "prefetch avformat_open_input error = %s%s.\n", av_err2str(ret), pf->timed_out ? " (timeout)" : "");
+        return ret;
+    }
+
+    io_begin(pf);
+    ret = probe_cache_find_stream_info(pf->config.probe_cache, url, pf->fmt_ctx);
+    io_end(pf);
+    //缓存只在打开时使用，调用方打开之后就可以关闭
+    pf->config.probe_cache = NULL;
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "prefetch avformat_find_stream_info error = %s%s.\n", av_err2str(ret), pf->timed_out ? " (timeout)" : "");
+        return ret;
+    }
+    return 0;
+}
+
+static int64_t packet_duration_us(Prefetcher *pf, const AVPacket *pkt)
+{
+    if (pkt->duration <= 0 || pkt->stream_index >= (int)pf->fmt_ctx->nb_streams)
+    {
+        return 0;
+    }
+    return av_rescale_q(pkt->duration, pf->fmt_ctx->streams[pkt->stream_index]->time_base, AV_TIME_BASE_Q);
+}
+
+static int put_packet(Prefetcher *pf, AVPacket *pkt)
+{
+    PrefetchPacket *node = (PrefetchPacket *)av_mallocz(sizeof(PrefetchPacket));
+    if (!node)
+    {
+        av_packet_unref(pkt);
+        return AVERROR(ENOMEM);
+    }
+    av_packet_move_ref(&node->pkt, pkt);
+    node->duration_us = packet_duration_us(pf, &node->pkt);
+
+    SDL_LockMutex(pf->mutex);
+    if (!pf->last_pkt)
+    {
+        pf->first_pkt = node;
+    }
+    else
+    {
+        pf->last_pkt->next = node;
+    }
+    pf->last_pkt = node;
+    pf->stats.packets_in++;
+    pf->stats.bytes_in += node->pkt.size;
+    pf->stats.level_packets++;
+    pf->stats.level_bytes += node->pkt.size;
+    pf->stats.level_duration_us += node->duration_us;
+    if (pf->stats.level_bytes > pf->stats.max_level_bytes)
+    {
+        pf->stats.max_level_bytes = pf->stats.level_bytes;
+    }
+    SDL_CondSignal(pf->cond_not_empty);
+    SDL_UnlockMutex(pf->mutex);
+    return 0;
+}
+
+static void flush_buffer(Prefetcher *pf)
+{
+    while (pf->first_pkt)
+    {
+        PrefetchPacket *node = pf->first_pkt;
+        pf->first_pkt = node->next;
+        av_packet_unref(&node->pkt);
+        av_free(node);
+    }
+    pf->last_pkt = NULL;
+    pf->stats.level_packets = 0;
+    pf->stats.level_bytes = 0;
+    pf->stats.level_duration_us = 0;
+}
+
+//优先用关键帧索引：没有自带索引的格式（TS 等）直接按字节位置 seek，其他按关键帧的 pts 精确 seek
+static int do_seek(Prefetcher *pf, int64_t target_us)
+{
+    AVFormatContext *fmt_ctx = pf->fmt_ctx;
+    int ret = -1;
+    const SeekIndexEntry *entry = NULL;
+    if (pf->index)
+    {
+        entry = seek_index_lookup(pf->index, av_rescale_q(target_us, AV_TIME_BASE_Q, pf->index->time_base));
+    }
+    if (entry)
+    {
+        AVStream *stream = fmt_ctx->streams[pf->index->stream_index];
+        if (entry->pos >= 0 && stream->nb_index_entries < 2 && !(fmt_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK))
+        {
+            ret = avformat_seek_file(fmt_ctx, pf->index->stream_index, entry->pos, entry->pos, entry->pos, AVSEEK_FLAG_BYTE);
+        }
+        if (ret < 0)
+        {
+            ret = avformat_seek_file(fmt_ctx, pf->index->stream_index, INT64_MIN, entry->pts, entry->pts, 0);
+        }
+        if (ret >= 0)
+        {
+            pf->stats.seek_index_hits++;
+        }
+    }
+    if (ret < 0)
+    {
+        ret = avformat_seek_file(fmt_ctx, -1, INT64_MIN, target_us, target_us, 0);
+    }
+    if (pf->index)
+    {
+        seek_index_discontinuity(pf->index);
+    }
+    return ret;
+}
+
+static int buffer_full(Prefetcher *pf)
+{
+    return pf->stats.level_bytes >= pf->config.max_bytes ||
+           pf->stats.level_packets >= pf->config.max_packets;
+}
+
+static int read_thread(void *arg)
+{
+    Prefetcher *pf = (Prefetcher *)arg;
+    AVPacket *pkt = av_packet_alloc();
+    int retries = 0;
+    int ret = 0;
+    trace_thread_name("prefetch");
+    if (!pkt)
+    {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    while (!pf->abort_request)
+    {
+        //缓冲满了或者读到结尾就等读取端消费，或者等 seek 请求
+        SDL_LockMutex(pf->mutex);
+        while (!pf->abort_request && !pf->seek_req && (buffer_full(pf) || pf->eof))
+        {
+            if (!pf->eof)
+            {
+                pf->stats.overflow_waits++;
+            }
+            SDL_CondWait(pf->cond_not_full, pf->mutex);
+        }
+        int seek_req = pf->seek_req;
+        int64_t seek_target_us = pf->seek_target_us;
+        pf->seek_req = 0;
+        SDL_UnlockMutex(pf->mutex);
+        if (pf->abort_request)
+        {
+            break;
+        }
+
+        if (seek_req)
+        {
+            int64_t seek_start = av_gettime_relative();
+            io_begin(pf);
+            ret = do_seek(pf, seek_target_us);
+            io_end(pf);
+            if (ret < 0)
+            {
+                av_log(NULL, AV_LOG_ERROR, "prefetch seek to %.3fs error = %s.\n", seek_target_us / 1000000.0, av_err2str(ret));
+            }
+            //seek 之后缓冲里的包都作废
+            SDL_LockMutex(pf->mutex);
+            flush_buffer(pf);
+            pf->eof = 0;
+            pf->flush_pending = 1;
+            pf->stats.seeks++;
+            pf->stats.last_seek_us = av_gettime_relative() - seek_start;
+            SDL_CondSignal(pf->cond_not_empty);
+            SDL_UnlockMutex(pf->mutex);
+            continue;
+        }
+
+        io_begin(pf);
+        TRACE_BEGIN(read_start);
+        ret = av_read_frame(pf->fmt_ctx, pkt);
+        TRACE_END(read_start, "av_read_frame", ret >= 0 ? pkt->stream_index : -1, pf->stats.packets_in);
+        io_end(pf);
+        if (ret < 0)
+        {
+            if (pf->abort_request)
+            {
+                break;
+            }
+            if (ret == AVERROR_EOF || (pf->fmt_ctx->pb && avio_feof(pf->fmt_ctx->pb) && !pf->timed_out))
+            {
+                //读完之后线程不退出，还可以 seek 回去
+                SDL_LockMutex(pf->mutex);
+                pf->eof = 1;
+                SDL_CondBroadcast(pf->cond_not_empty);
+                SDL_UnlockMutex(pf->mutex);
+                continue;
+            }
+            if (pf->timed_out)
+            {
+                //慢分片：重试几次，缓冲里的数据还可以继续播放
+                SDL_LockMutex(pf->mutex);
+                pf->stats.timeouts++;
+                pf->stats.retries++;
+                SDL_UnlockMutex(pf->mutex);
+                av_log(NULL, AV_LOG_WARNING, "prefetch av_read_frame timeout, retry %d/%d.\n", retries + 1, pf->config.max_retries);
+                if (++retries > pf->config.max_retries)
+                {
+                    break;
+                }
+                continue;
+            }
+            if (ret == AVERROR(EAGAIN))
+            {
+                av_usleep(10000);
+                continue;
+            }
+            av_log(NULL, AV_LOG_ERROR, "prefetch av_read_frame error = %s.\n", av_err2str(ret));
+            break;
+        }
+        retries = 0;
+        if (pf->index)
+        {
+            seek_index_add(pf->index, pkt);
+        }
+        if ((ret = put_packet(pf, pkt)) < 0)
+        {
+            break;
+        }
+    }
+
+end:
+    av_packet_free(&pkt);
+    SDL_LockMutex(pf->mutex);
+    if (ret < 0 && !pf->abort_request)
+    {
+        pf->error = ret;
+    }
+    else
+    {
+        pf->eof = 1;
+    }
+    SDL_CondBroadcast(pf->cond_not_empty);
+    SDL_UnlockMutex(pf->mutex);
+    return 0;
+}
+
+int prefetch_start(Prefetcher *pf)
+{
+    pf->thread = SDL_CreateThread(read_thread, "prefetch", pf);
+    if (!pf->thread)
+    {
+        av_log(NULL, AV_LOG_ERROR, "prefetch SDL_CreateThread error = %s.\n", SDL_GetError());
+        return -1;
+    }
+    return 0;
+}
+
+int prefetch_get(Prefetcher *pf, AVPacket *pkt, int timeout_ms)
+{
+    int ret;
+    SDL_LockMutex(pf->mutex);
+    for (;;)
+    {
+        if (pf->flush_pending)
+        {
+            pf->flush_pending = 0;
+            ret = PREFETCH_FLUSH;
+            break;
+        }
+        PrefetchPacket *node = pf->first_pkt;
+        if (node)
+        {
+            pf->first_pkt = node->next;
+            if (!pf->first_pkt)
+            {
+                pf->last_pkt = NULL;
+            }
+            pf->stats.packets_out++;
+            pf->stats.level_packets--;
+            pf->stats.level_bytes -= node->pkt.size;
+            pf->stats.level_duration_us -= node->duration_us;
+            av_packet_move_ref(pkt, &node->pkt);
+            av_free(node);
+            SDL_CondSignal(pf->cond_not_full);
+            ret = 1;
+            break;
+        }
+        if (pf->error)
+        {
+            ret = pf->error;
+            break;
+        }
+        //读完了，但是有 seek 请求时继续等
+        if ((pf->eof && !pf->seek_req) || pf->abort_request || !pf->thread)
+        {
+            ret = AVERROR_EOF;
+            break;
+        }
+        pf->stats.underflows++;
+        //等待超时就返回，调用方可以继续处理界面事件
+        if (SDL_CondWaitTimeout(pf->cond_not_empty, pf->mutex, timeout_ms) == SDL_MUTEX_TIMEDOUT && !pf->first_pkt && !pf->flush_pending)
+        {
+            ret = 0;
+            break;
+        }
+    }
+    SDL_UnlockMutex(pf->mutex);
+    return ret;
+}
+
+void prefetch_set_index(Prefetcher *pf, SeekIndex *index)
+{
+    pf->index = index;
+}
+
+void prefetch_seek(Prefetcher *pf, int64_t target_us)
+{
+    AVFormatContext *fmt_ctx = pf->fmt_ctx;
+    int64_t start_time = fmt_ctx->start_time != AV_NOPTS_VALUE ? fmt_ctx->start_time : 0;
+    if (target_us < start_time)
+    {
+        target_us = start_time;
+    }
+    if (fmt_ctx->duration > 0 && target_us > start_time + fmt_ctx->duration)
+    {
+        target_us = start_time + fmt_ctx->duration;
+    }
+    SDL_LockMutex(pf->mutex);
+    pf->seek_req = 1;
+    pf->seek_target_us = target_us;
+    SDL_CondSignal(pf->cond_not_full);
+    SDL_UnlockMutex(pf->mutex);
+}
+
+void prefetch_get_stats(Prefetcher *pf, PrefetchStats *stats)
+{
+    SDL_LockMutex(pf->mutex);
+    *stats = pf->stats;
+    SDL_UnlockMutex(pf->mutex);
+}
+
+void prefetch_log_stats(Prefetcher *pf)
+{
+    PrefetchStats stats;
+    if (!pf->mutex)
+    {
+        return;
+    }
+    prefetch_get_stats(pf, &stats);
+    av_log(NULL, AV_LOG_INFO,
+           "prefetch in = %lld,out = %lld,bytes = %lld,level = %d packets/%d bytes/%lldms,max_level = %d bytes,underflows = %lld,overflow_waits = %lld,timeouts = %lld,seeks = %lld,seek_index_hits = %lld.\n",
+           (long long)stats.packets_in, (long long)stats.packets_out, (long long)stats.bytes_in,
+           stats.level_packets, stats.level_bytes, (long long)(stats.level_duration_us / 1000),
+           stats.max_level_bytes, (long long)stats.underflows, (long long)stats.overflow_waits,
+           (long long)stats.timeouts, (long long)stats.seeks, (long long)stats.seek_index_hits);
+}
+
+void prefetch_close(Prefetcher *pf)
+{
+    if (pf->mutex)
+    {
+        SDL_LockMutex(pf->mutex);
+        pf->abort_request = 1;
+        SDL_CondBroadcast(pf->cond_not_full);
+        SDL_CondBroadcast(pf->cond_not_empty);
+        SDL_UnlockMutex(pf->mutex);
+    }
+    pf->abort_request = 1;
+    if (pf->thread)
+    {
+        SDL_WaitThread(pf->thread, NULL);
+        pf->thread = NULL;
+    }
+    flush_buffer(pf);
+    if (pf->fmt_ctx)
+    {
+        avformat_close_input(&pf->fmt_ctx);
+    }
+    if (pf->cond_not_full)
+    {
+        SDL_DestroyCond(pf->cond_not_full);
+        pf->cond_not_full = NULL;
+    }
+    if (pf->cond_not_empty)
+    {
+        SDL_DestroyCond(pf->cond_not_empty);
+        pf->cond_not_empty = NULL;
+    }
+    if (pf->mutex)
+    {
+        SDL_DestroyMutex(pf->mutex);
+        pf->mutex = NULL;
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <libavformat/avformat.h>
+#include <SDL2/SDL.h>
+#include "seek_index.h"
+#include "../probe_cache.h"
+
+#define PREFETCH_DEFAULT_MAX_BYTES (16 * 1024 * 1024)
+#define PREFETCH_DEFAULT_MAX_PACKETS 4096
+#define PREFETCH_DEFAULT_IO_TIMEOUT_MS 10000
+#define PREFETCH_DEFAULT_MAX_RETRIES 3
+
+//prefetch_get 的返回值：seek 完成，调用方需要清空解码器和队列
+#define PREFETCH_FLUSH 2
+
+typedef struct PrefetchConfig
+{
+    //缓冲上限，任意一个达到就暂停读取
+    int max_bytes;
+    int max_packets;
+    //单次阻塞 IO（打开、读包）的超时时间
+    int io_timeout_ms;
+    //连续超时多少次之后放弃
+    int max_retries;
+    //探测缓存，命中时跳过 avformat_find_stream_info，NULL 不使用
+    ProbeCache *probe_cache;
+} PrefetchConfig;
+
+typedef struct PrefetchStats
+{
+    int64_t packets_in;
+    int64_t packets_out;
+    int64_t bytes_in;
+    //当前缓冲水位
+    int level_packets;
+    int level_bytes;
+    int64_t level_duration_us;
+    int max_level_bytes;
+    //读取端取不到数据的次数
+    int64_t underflows;
+    //缓冲满了，读取线程等待的次数
+    int64_t overflow_waits;
+    int64_t timeouts;
+    int64_t retries;
+    int64_t seeks;
+    //通过关键帧索引直接定位的次数
+    int64_t seek_index_hits;
+    int64_t last_seek_us;
+} PrefetchStats;
+
+typedef struct PrefetchPacket
+{
+    AVPacket pkt;
+    int64_t duration_us;
+    struct PrefetchPacket *next;
+} PrefetchPacket;
+
+typedef struct Prefetcher
+{
+    AVFormatContext *fmt_ctx;
+    PrefetchConfig config;
+
+    SDL_Thread *thread;
+    SDL_mutex *mutex;
+    SDL_cond *cond_not_empty;
+    SDL_cond *cond_not_full;
+    PrefetchPacket *first_pkt;
+    PrefetchPacket *last_pkt;
+
+    volatile int abort_request;
+    volatile int timed_out;
+    //当前阻塞 IO 的截止时间，0 表示没有在做 IO
+    volatile int64_t io_deadline;
+    int eof;
+    int error;
+
+    //读取线程上执行 seek，读包时顺便建立关键帧索引
+    SeekIndex *index;
+    int seek_req;
+    int64_t seek_target_us;
+    int flush_pending;
+
+    PrefetchStats stats;
+} Prefetcher;
+
+void prefetch_config_default(PrefetchConfig *config);
+//打开输入并获取流信息，打开过程同样受超时控制
+int prefetch_open(Prefetcher *pf, const char *url, const PrefetchConfig *config);
+//启动后台读取线程
+int prefetch_start(Prefetcher *pf);
+//取一个包：1 取到，0 超时缓冲为空，PREFETCH_FLUSH seek 完成，AVERROR_EOF 读完，其他负数为错误
+int prefetch_get(Prefetcher *pf, AVPacket *pkt, int timeout_ms);
+//在 prefetch_start 之前设置
+void prefetch_set_index(Prefetcher *pf, SeekIndex *index);
+//请求 seek 到 target_us（AV_TIME_BASE），完成后 prefetch_get 返回 PREFETCH_FLUSH
+void prefetch_seek(Prefetcher *pf, int64_t target_us);
+void prefetch_get_stats(Prefetcher *pf, PrefetchStats *stats);
+void prefetch_log_stats(Prefetcher *pf);
+void prefetch_close(Prefetcher *pf);
+
+#endif
@@ -0,0 +1,464 @@
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "seek_index.h"
+
+void seek_index_init(SeekIndex *index, int stream_index, AVRational time_base)
+{
+    memset(index, 0, sizeof(SeekIndex));
+    index->stream_index = stream_index;
+    index->time_base = time_base;
+    index->last_added = -1;
+    index->covered_until = INT64_MIN;
+}
+
+//第一个 pts 大于 target 的位置
+static int upper_bound(const SeekIndex *index, int64_t target)
+{
+    int lo = 0;
+    int hi = index->nb_entries;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (index->entries[mid].pts <= target)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int insert_entry(SeekIndex *index, int pos, const SeekIndexEntry *entry)
+{
+    if (index->nb_entries == index->capacity)
+    {
+        int capacity = index->capacity ? index->capacity * 2 : 1024;
+        SeekIndexEntry *entries = (SeekIndexEntry *)av_realloc_array(index->entries, capacity, sizeof(SeekIndexEntry));
+        if (!entries)
+        {
+            return AVERROR(ENOMEM);
+        }
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+    memmove(index->entries + pos + 1, index->entries + pos, (index->nb_entries - pos) * sizeof(SeekIndexEntry));
+    index->entries[pos] = *entry;
+    index->nb_entries++;
+    return 0;
+}
+
+int seek_index_add(SeekIndex *index, const AVPacket *pkt)
+{
+    if (index->complete || pkt->stream_index != index->stream_index)
+    {
+        return 0;
+    }
+    int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (pts == AV_NOPTS_VALUE)
+    {
+        return 0;
+    }
+    if (!(pkt->flags & AV_PKT_FLAG_KEY))
+    {
+        if (index->last_added >= 0 && pts > index->covered_until)
+        {
+            index->covered_until = pts;
+        }
+        return 0;
+    }
+
+    int pos = upper_bound(index, pts);
+    if (pos > 0 && index->entries[pos - 1].pts == pts)
+    {
+        //已经记录过，只更新连续性
+        pos--;
+    }
+    else
+    {
+        SeekIndexEntry entry = {0};
+        entry.pts = pts;
+        entry.dts = pkt->dts;
+        entry.pos = pkt->pos;
+        entry.size = pkt->size;
+        entry.stream_index = (uint16_t)pkt->stream_index;
+        entry.flags = SEEK_INDEX_FLAG_KEY | SEEK_INDEX_FLAG_DISCONT;
+        int ret = insert_entry(index, pos, &entry);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    //和上一个关键帧是连续读到的，中间不会再有别的关键帧
+    if (index->last_added >= 0 && index->last_added == pos - 1)
+    {
+        index->entries[pos].flags &= ~SEEK_INDEX_FLAG_DISCONT;
+    }
+    index->last_added = pos;
+    index->covered_until = pts;
+    return 1;
+}
+
+void seek_index_discontinuity(SeekIndex *index)
+{
+    index->last_added = -1;
+    index->covered_until = INT64_MIN;
+}
+
+const SeekIndexEntry *seek_index_lookup(const SeekIndex *index, int64_t target)
+{
+    int pos = upper_bound(index, target) - 1;
+    if (pos < 0)
+    {
+        return NULL;
+    }
+    if (index->complete)
+    {
+        return &index->entries[pos];
+    }
+    if (pos + 1 < index->nb_entries)
+    {
+        //下一个关键帧和它之间没有空洞
+        return (index->entries[pos + 1].flags & SEEK_INDEX_FLAG_DISCONT) ? NULL : &index->entries[pos];
+    }
+    //最后一个关键帧，只有当前正在连续读取并且已经读过 target 才能确定
+    if (index->last_added == pos && target <= index->covered_until)
+    {
+        return &index->entries[pos];
+    }
+    return NULL;
+}
+
+//媒体文件的大小和修改时间，stat 失败（url 等）返回负数
+static int media_stat(const char *media_path, int64_t *size, int64_t *mtime_ns)
+{
+    struct stat st;
+    if (stat(media_path, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        return AVERROR(ENOENT);
+    }
+    *size = (int64_t)st.st_size;
+#ifdef __APPLE__
+    *mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    *mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return 0;
+}
+
+int seek_index_map_open(SeekIndexMap *map, const char *media_path)
+{
+    memset(map, 0, sizeof(SeekIndexMap));
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%s", media_path, SEEK_INDEX_SUFFIX);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return AVERROR(ENOENT);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(SeekIndexFileHeader))
+    {
+        close(fd);
+        return AVERROR_INVALIDDATA;
+    }
+    size_t file_size = (size_t)st.st_size;
+    const uint8_t *data = (const uint8_t *)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return AVERROR(errno);
+    }
+    map->map = data;
+    map->size = file_size;
+
+    const SeekIndexFileHeader *header = (const SeekIndexFileHeader *)data;
+    if (memcmp(header->magic, SEEK_INDEX_MAGIC, 4) || header->version != SEEK_INDEX_VERSION)
+    {
+        goto fail;
+    }
+    //生成之后媒体文件被修改或替换过，里面的位置和时间戳都不可信
+    int64_t media_size = 0;
+    int64_t media_mtime_ns = 0;
+    if (media_stat(media_path, &media_size, &media_mtime_ns) < 0 ||
+        media_size != header->media_size || media_mtime_ns != header->media_mtime_ns)
+    {
+        av_log(NULL, AV_LOG_WARNING, "seek index %s is stale, ignored.\n", path);
+        seek_index_map_close(map);
+        return AVERROR(ESTALE);
+    }
+    uint64_t streams_end = sizeof(SeekIndexFileHeader) + (uint64_t)header->nb_streams * sizeof(SeekIndexFileStream);
+    if (streams_end > file_size)
+    {
+        goto fail;
+    }
+    map->nb_streams = header->nb_streams;
+    map->streams = (const SeekIndexFileStream *)(data + sizeof(SeekIndexFileHeader));
+    map->entries = (const SeekIndexEntry *)(data + streams_end);
+    map->nb_entries = (file_size - streams_end) / sizeof(SeekIndexEntry);
+    for (uint32_t i = 0; i < map->nb_streams; i++)
+    {
+        const SeekIndexFileStream *stream = &map->streams[i];
+        if (stream->first_entry > map->nb_entries || stream->nb_entries > map->nb_entries - stream->first_entry)
+        {
+            goto fail;
+        }
+    }
+    return 0;
+
+fail:
+    seek_index_map_close(map);
+    return AVERROR_INVALIDDATA;
+}
+
+const SeekIndexFileStream *seek_index_map_stream(const SeekIndexMap *map, int stream_index)
+{
+    for (uint32_t i = 0; i < map->nb_streams; i++)
+    {
+        if ((int)map->streams[i].stream_index == stream_index)
+        {
+            return &map->streams[i];
+        }
+    }
+    return NULL;
+}
+
+const SeekIndexEntry *seek_index_map_find(const SeekIndexMap *map, int stream_index, int64_t target)
+{
+    const SeekIndexFileStream *stream = seek_index_map_stream(map, stream_index);
+    if (!stream)
+    {
+        return NULL;
+    }
+    const SeekIndexEntry *entries = map->entries + stream->first_entry;
+    //第一个 dts 大于 target 的包，它和之后的包 pts >= dts > target，都不用看
+    uint64_t lo = 0;
+    uint64_t hi = stream->nb_entries;
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].dts <= target)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    //往回找关键帧，最多一个 GOP
+    for (uint64_t i = lo; i > 0; i--)
+    {
+        const SeekIndexEntry *entry = &entries[i - 1];
+        if ((entry->flags & SEEK_INDEX_FLAG_KEY) && entry->pts != AV_NOPTS_VALUE && entry->pts <= target)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void seek_index_map_close(SeekIndexMap *map)
+{
+    if (map->map)
+    {
+        munmap((void *)map->map, map->size);
+    }
+    memset(map, 0, sizeof(SeekIndexMap));
+}
+
+int seek_index_load_sidecar(SeekIndex *index, const char *media_path)
+{
+    SeekIndexMap map;
+    int ret = seek_index_map_open(&map, media_path);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    const SeekIndexFileStream *stream = seek_index_map_stream(&map, index->stream_index);
+    if (!stream)
+    {
+        ret = AVERROR_STREAM_NOT_FOUND;
+        goto end;
+    }
+    AVRational time_base = {stream->time_base_num, stream->time_base_den};
+    if (av_cmp_q(time_base, index->time_base))
+    {
+        av_log(NULL, AV_LOG_WARNING, "seek index %s%s time_base mismatch, ignored.\n", media_path, SEEK_INDEX_SUFFIX);
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    //只保留关键帧，按 pts 排序
+    index->nb_entries = 0;
+    for (uint64_t j = 0; j < stream->nb_entries; j++)
+    {
+        SeekIndexEntry entry = map.entries[stream->first_entry + j];
+        if (!(entry.flags & SEEK_INDEX_FLAG_KEY) || entry.pts == AV_NOPTS_VALUE)
+        {
+            continue;
+        }
+        entry.flags &= ~SEEK_INDEX_FLAG_DISCONT;
+        int pos = upper_bound(index, entry.pts);
+        if (pos > 0 && index->entries[pos - 1].pts == entry.pts)
+        {
+            continue;
+        }
+        if ((ret = insert_entry(index, pos, &entry)) < 0)
+        {
+            goto end;
+        }
+    }
+    index->complete = 1;
+    ret = index->nb_entries;
+    av_log(NULL, AV_LOG_INFO, "seek index %s%s loaded, keyframes = %d.\n", media_path, SEEK_INDEX_SUFFIX, index->nb_entries);
+
+end:
+    seek_index_map_close(&map);
+    return ret;
+}
+
+int seek_index_writer_init(SeekIndexWriter *writer, const AVFormatContext *fmt_ctx, const char *media_path, int keyframes_only)
+{
+    memset(writer, 0, sizeof(SeekIndexWriter));
+    writer->keyframes_only = keyframes_only;
+    //读包期间文件被改了也能在加载时发现
+    media_stat(media_path, &writer->media_size, &writer->media_mtime_ns);
+    writer->nb_streams = fmt_ctx->nb_streams;
+    writer->streams = (SeekIndexFileStream *)av_mallocz_array(writer->nb_streams + 1, sizeof(SeekIndexFileStream));
+    writer->entries = (SeekIndexEntry **)av_mallocz_array(writer->nb_streams + 1, sizeof(SeekIndexEntry *));
+    writer->capacity = (uint64_t *)av_mallocz_array(writer->nb_streams + 1, sizeof(uint64_t));
+    if (!writer->streams || !writer->entries || !writer->capacity)
+    {
+        seek_index_writer_free(writer);
+        return AVERROR(ENOMEM);
+    }
+    for (int i = 0; i < writer->nb_streams; i++)
+    {
+        const AVStream *st = fmt_ctx->streams[i];
+        writer->streams[i].stream_index = (uint32_t)i;
+        writer->streams[i].time_base_num = st->time_base.num;
+        writer->streams[i].time_base_den = st->time_base.den;
+        writer->streams[i].codec_type = (uint32_t)st->codecpar->codec_type;
+    }
+    return 0;
+}
+
+int seek_index_writer_add(SeekIndexWriter *writer, const AVPacket *pkt)
+{
+    //读头之后才出现的流不记录
+    if (pkt->stream_index < 0 || pkt->stream_index >= writer->nb_streams)
+    {
+        return 0;
+    }
+    if (writer->keyframes_only && !(pkt->flags & AV_PKT_FLAG_KEY))
+    {
+        return 0;
+    }
+    int64_t dts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    if (dts == AV_NOPTS_VALUE)
+    {
+        return 0;
+    }
+    int i = pkt->stream_index;
+    SeekIndexFileStream *stream = &writer->streams[i];
+    uint64_t n = stream->nb_entries;
+    if (n == writer->capacity[i])
+    {
+        uint64_t capacity = writer->capacity[i] ? writer->capacity[i] * 2 : 1024;
+        SeekIndexEntry *entries = (SeekIndexEntry *)av_realloc_array(writer->entries[i], capacity, sizeof(SeekIndexEntry));
+        if (!entries)
+        {
+            return AVERROR(ENOMEM);
+        }
+        writer->entries[i] = entries;
+        writer->capacity[i] = capacity;
+    }
+    //读的时候按 dts 二分，dts 回退的坏流按前一个包的 dts 记
+    if (n > 0 && dts < writer->entries[i][n - 1].dts)
+    {
+        dts = writer->entries[i][n - 1].dts;
+    }
+    SeekIndexEntry *entry = &writer->entries[i][n];
+    memset(entry, 0, sizeof(SeekIndexEntry));
+    entry->pts = pkt->pts;
+    entry->dts = dts;
+    entry->pos = pkt->pos;
+    entry->size = pkt->size;
+    entry->stream_index = (uint16_t)i;
+    entry->flags = (pkt->flags & AV_PKT_FLAG_KEY) ? SEEK_INDEX_FLAG_KEY : 0;
+    stream->nb_entries++;
+    return 1;
+}
+
+int seek_index_writer_save(SeekIndexWriter *writer, const char *index_path)
+{
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", index_path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp)
+    {
+        return AVERROR(errno);
+    }
+    SeekIndexFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SEEK_INDEX_MAGIC, 4);
+    header.version = SEEK_INDEX_VERSION;
+    header.nb_streams = (uint32_t)writer->nb_streams;
+    header.media_size = writer->media_size;
+    header.media_mtime_ns = writer->media_mtime_ns;
+    uint64_t first_entry = 0;
+    for (int i = 0; i < writer->nb_streams; i++)
+    {
+        writer->streams[i].first_entry = first_entry;
+        first_entry += writer->streams[i].nb_entries;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    if (writer->nb_streams > 0)
+    {
+        ok = ok && fwrite(writer->streams, sizeof(SeekIndexFileStream), writer->nb_streams, fp) == (size_t)writer->nb_streams;
+    }
+    for (int i = 0; i < writer->nb_streams && ok; i++)
+    {
+        size_t n = (size_t)writer->streams[i].nb_entries;
+        ok = !n || fwrite(writer->entries[i], sizeof(SeekIndexEntry), n, fp) == n;
+    }
+    if (fclose(fp) != 0)
+    {
+        ok = 0;
+    }
+    if (!ok || rename(tmp_path, index_path) < 0)
+    {
+        int ret = AVERROR(errno ? errno : EIO);
+        unlink(tmp_path);
+        return ret;
+    }
+    return 0;
+}
+
+void seek_index_writer_free(SeekIndexWriter *writer)
+{
+    for (int i = 0; writer->entries && i < writer->nb_streams; i++)
+    {
+        av_freep(&writer->entries[i]);
+    }
+    av_freep(&writer->entries);
+    av_freep(&writer->streams);
+    av_freep(&writer->capacity);
+    writer->nb_streams = 0;
+}
+
+void seek_index_free(SeekIndex *index)
+{
+    av_freep(&index->entries);
+    index->nb_entries = 0;
+    index->capacity = 0;
+}
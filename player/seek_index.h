@@ -0,0 +1,121 @@
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+//索引文件（sidecar）格式，小端，按流分组，每组内按解码顺序排列（dts 不减）：
+//  SeekIndexFileHeader
+//  SeekIndexFileStream * nb_streams
+//  SeekIndexEntry * (所有流 nb_entries 之和)
+//头里记录生成索引时媒体文件的大小和修改时间，加载时不一致说明媒体文件被替换或修改过，索引作废
+#define SEEK_INDEX_MAGIC "MSIX"
+#define SEEK_INDEX_VERSION 2
+#define SEEK_INDEX_SUFFIX ".idx"
+
+#define SEEK_INDEX_FLAG_KEY 0x0001
+//内存索引使用：这一项和前一项之间可能还有没见过的关键帧
+#define SEEK_INDEX_FLAG_DISCONT 0x8000
+
+typedef struct SeekIndexFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t nb_streams;
+    uint32_t reserved;
+    //媒体文件的 stat，不是本地文件时为 0
+    int64_t media_size;
+    int64_t media_mtime_ns;
+} SeekIndexFileHeader;
+
+typedef struct SeekIndexFileStream
+{
+    uint32_t stream_index;
+    int32_t time_base_num;
+    int32_t time_base_den;
+    uint32_t codec_type;
+    //在 entry 数组中的起始位置和个数
+    uint64_t first_entry;
+    uint64_t nb_entries;
+} SeekIndexFileStream;
+
+typedef struct SeekIndexEntry
+{
+    int64_t pts;
+    int64_t dts;
+    int64_t pos;
+    int32_t size;
+    uint16_t stream_index;
+    uint16_t flags;
+} SeekIndexEntry;
+
+//单个视频流的关键帧索引，按 pts 排序
+typedef struct SeekIndex
+{
+    int stream_index;
+    AVRational time_base;
+    SeekIndexEntry *entries;
+    int nb_entries;
+    int capacity;
+    //从索引文件加载，覆盖整个文件
+    int complete;
+    //当前连续读取过程中最后一个关键帧的位置，seek 之后为 -1
+    int last_added;
+    //从 last_added 开始读到的最大 pts
+    int64_t covered_until;
+} SeekIndex;
+
+void seek_index_init(SeekIndex *index, int stream_index, AVRational time_base);
+//解复用时调用，只记录本流的关键帧
+int seek_index_add(SeekIndex *index, const AVPacket *pkt);
+//seek 之后调用，后面读到的包和之前的不连续
+void seek_index_discontinuity(SeekIndex *index);
+//加载 media 对应的索引文件（media + ".idx"），成功返回关键帧个数
+int seek_index_load_sidecar(SeekIndex *index, const char *media_path);
+//找到 pts 不大于 target 的最后一个关键帧，不能确定时返回 NULL
+const SeekIndexEntry *seek_index_lookup(const SeekIndex *index, int64_t target);
+void seek_index_free(SeekIndex *index);
+
+//直接 mmap 索引文件，不拷贝：按 dts 二分，再往回找关键帧，O(log n)
+typedef struct SeekIndexMap
+{
+    const uint8_t *map;
+    size_t size;
+    uint32_t nb_streams;
+    const SeekIndexFileStream *streams;
+    const SeekIndexEntry *entries;
+    uint64_t nb_entries;
+} SeekIndexMap;
+
+//映射 media + ".idx" 并检查格式和媒体文件有没有变，成功返回 0
+int seek_index_map_open(SeekIndexMap *map, const char *media_path);
+//找不到这个流返回 NULL
+const SeekIndexFileStream *seek_index_map_stream(const SeekIndexMap *map, int stream_index);
+//pts 不大于 target 的最后一个关键帧
+const SeekIndexEntry *seek_index_map_find(const SeekIndexMap *map, int stream_index, int64_t target);
+void seek_index_map_close(SeekIndexMap *map);
+
+//生成索引文件：解复用时每个包调用一次 add，最后 save
+typedef struct SeekIndexWriter
+{
+    int nb_streams;
+    SeekIndexFileStream *streams;
+    //每个流一个数组
+    SeekIndexEntry **entries;
+    uint64_t *capacity;
+    //只记录关键帧
+    int keyframes_only;
+    int64_t media_size;
+    int64_t media_mtime_ns;
+} SeekIndexWriter;
+
+//media_path 在读包之前 stat，写进索引文件头
+int seek_index_writer_init(SeekIndexWriter *writer, const AVFormatContext *fmt_ctx, const char *media_path, int keyframes_only);
+int seek_index_writer_add(SeekIndexWriter *writer, const AVPacket *pkt);
+//先写临时文件再 rename，读的一方不会看到写了一半的索引
+int seek_index_writer_save(SeekIndexWriter *writer, const char *index_path);
+void seek_index_writer_free(SeekIndexWriter *writer);
+
+#endif
@@ -0,0 +1,481 @@
+#include <libavutil/log.h>
+#include <libavutil/pixdesc.h>
+#include <math.h>
+#include <string.h>
+#include "video_render.h"
+#include "../video_debugging.h"
+
+#define DEFAULT_WINDOW_W 640
+#define DEFAULT_WINDOW_H 480
+
+//可以直接上传的像素格式，对应关系和 ffplay 一致
+static const struct
+{
+    enum AVPixelFormat format;
+    Uint32 texture_format;
+} texture_format_map[] = {
+    {AV_PIX_FMT_YUV420P, SDL_PIXELFORMAT_IYUV},
+    {AV_PIX_FMT_YUVJ420P, SDL_PIXELFORMAT_IYUV},
+    {AV_PIX_FMT_NV12, SDL_PIXELFORMAT_NV12},
+    {AV_PIX_FMT_NV21, SDL_PIXELFORMAT_NV21},
+    {AV_PIX_FMT_YUYV422, SDL_PIXELFORMAT_YUY2},
+    {AV_PIX_FMT_UYVY422, SDL_PIXELFORMAT_UYVY},
+    {AV_PIX_FMT_RGB24, SDL_PIXELFORMAT_RGB24},
+    {AV_PIX_FMT_BGR24, SDL_PIXELFORMAT_BGR24},
+    {AV_PIX_FMT_RGB32, SDL_PIXELFORMAT_ARGB8888},
+    {AV_PIX_FMT_RGB32_1, SDL_PIXELFORMAT_RGBA8888},
+    {AV_PIX_FMT_BGR32, SDL_PIXELFORMAT_ABGR8888},
+    {AV_PIX_FMT_BGR32_1, SDL_PIXELFORMAT_BGRA8888},
+    {AV_PIX_FMT_0RGB32, SDL_PIXELFORMAT_RGB888},
+    {AV_PIX_FMT_0BGR32, SDL_PIXELFORMAT_BGR888},
+    {AV_PIX_FMT_RGB565, SDL_PIXELFORMAT_RGB565},
+    {AV_PIX_FMT_BGR565, SDL_PIXELFORMAT_BGR565},
+};
+
+//get_buffer2 分配出去的纹理内存，用序号区分不同的 SDL_LockTexture
+typedef struct LockToken
+{
+    VideoRender *vr;
+    int serial;
+} LockToken;
+
+static void unlock_texture(VideoRender *vr)
+{
+    if (vr->locked)
+    {
+        SDL_UnlockTexture(vr->texture);
+        vr->locked = 0;
+        vr->lock_token = NULL;
+    }
+}
+
+//纹理和帧大小一致，缩放交给 SDL_RenderCopy
+static int ensure_texture(VideoRender *vr, Uint32 format, int w, int h)
+{
+    if (vr->texture && vr->texture_format == format &&
+        vr->texture_w >= w && vr->texture_h >= h &&
+        vr->texture_w - w < 64 && vr->texture_h - h < 64)
+    {
+        return 0;
+    }
+    unlock_texture(vr);
+    if (vr->texture)
+    {
+        SDL_DestroyTexture(vr->texture);
+        vr->texture = NULL;
+    }
+    vr->texture = SDL_CreateTexture(vr->renderer, format, SDL_TEXTUREACCESS_STREAMING, w, h);
+    if (!vr->texture)
+    {
+        av_log(NULL, AV_LOG_ERROR, "SDL_CreateTexture %dx%d error = %s.\n", w, h, SDL_GetError());
+        return -1;
+    }
+    vr->texture_format = format;
+    vr->texture_w = w;
+    vr->texture_h = h;
+    vr->stats.texture_recreated++;
+    av_log(NULL, AV_LOG_INFO, "video_render texture = %dx%d.\n", w, h);
+    return 0;
+}
+
+static void release_texture_buffer(void *opaque, uint8_t *data)
+{
+    LockToken *token = (LockToken *)opaque;
+    VideoRender *vr = token->vr;
+    //解码失败等情况下帧没有走到 video_render_upload，这里解锁
+    if (vr->locked && vr->lock_serial == token->serial)
+    {
+        unlock_texture(vr);
+    }
+    av_free(token);
+}
+
+static int texture_get_buffer2(AVCodecContext *avctx, AVFrame *frame, int flags)
+{
+    VideoRender *vr = (VideoRender *)avctx->opaque;
+    if (!vr || !vr->direct_decode || frame->format != AV_PIX_FMT_YUV420P)
+    {
+        return avcodec_default_get_buffer2(avctx, frame, flags);
+    }
+
+    int w = frame->width;
+    int h = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(avctx, &w, &h, linesize_align);
+
+    unlock_texture(vr);
+    if (ensure_texture(vr, SDL_PIXELFORMAT_IYUV, w, h) < 0)
+    {
+        return avcodec_default_get_buffer2(avctx, frame, flags);
+    }
+
+    void *pixels = NULL;
+    int pitch = 0;
+    if (SDL_LockTexture(vr->texture, NULL, &pixels, &pitch) < 0)
+    {
+        return avcodec_default_get_buffer2(avctx, frame, flags);
+    }
+
+    //IYUV 纹理锁定之后是连续的 Y、U、V 三个平面
+    uint8_t *data[3];
+    int linesize[3] = {pitch, pitch / 2, pitch / 2};
+    data[0] = (uint8_t *)pixels;
+    data[1] = data[0] + pitch * vr->texture_h;
+    data[2] = data[1] + (pitch / 2) * ((vr->texture_h + 1) / 2);
+    for (int i = 0; i < 3; i++)
+    {
+        if (linesize[i] % linesize_align[i] || (uintptr_t)data[i] % linesize_align[i])
+        {
+            //SDL 给的内存不满足解码器的对齐要求，以后都走普通路径
+            av_log(NULL, AV_LOG_WARNING, "texture pitch %d not aligned for direct decode, disabled.\n", pitch);
+            SDL_UnlockTexture(vr->texture);
+            vr->direct_decode = 0;
+            return avcodec_default_get_buffer2(avctx, frame, flags);
+        }
+    }
+
+    LockToken *token = (LockToken *)av_mallocz(sizeof(LockToken));
+    if (!token)
+    {
+        SDL_UnlockTexture(vr->texture);
+        return AVERROR(ENOMEM);
+    }
+    token->vr = vr;
+    token->serial = ++vr->lock_serial;
+    int size = (int)(data[2] - data[0]) + linesize[2] * ((vr->texture_h + 1) / 2);
+    frame->buf[0] = av_buffer_create(data[0], size, release_texture_buffer, token, 0);
+    if (!frame->buf[0])
+    {
+        av_free(token);
+        SDL_UnlockTexture(vr->texture);
+        return AVERROR(ENOMEM);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        frame->data[i] = data[i];
+        frame->linesize[i] = linesize[i];
+    }
+    vr->locked = 1;
+    vr->lock_token = token;
+    return 0;
+}
+
+//YUV 纹理 SDL 在所有渲染器上都支持，RGB 纹理要渲染器原生支持才不会在 SDL 内部再转换一次
+static Uint32 find_texture_format(const VideoRender *vr, enum AVPixelFormat format)
+{
+    for (int i = 0; i < (int)(sizeof(texture_format_map) / sizeof(texture_format_map[0])); i++)
+    {
+        if (texture_format_map[i].format != format)
+        {
+            continue;
+        }
+        Uint32 texture_format = texture_format_map[i].texture_format;
+        if (SDL_ISPIXELFORMAT_FOURCC(texture_format))
+        {
+            return texture_format;
+        }
+        for (Uint32 j = 0; j < vr->info.num_texture_formats; j++)
+        {
+            if (vr->info.texture_formats[j] == texture_format)
+            {
+                return texture_format;
+            }
+        }
+        break;
+    }
+    return SDL_PIXELFORMAT_UNKNOWN;
+}
+
+//按帧的显示宽高比在输出区域内居中
+static void update_layout(VideoRender *vr)
+{
+    int out_w = 0;
+    int out_h = 0;
+    if (!vr->renderer)
+    {
+        return;
+    }
+    if (SDL_GetRendererOutputSize(vr->renderer, &out_w, &out_h) < 0 || out_w <= 0 || out_h <= 0)
+    {
+        return;
+    }
+    vr->output_w = out_w;
+    vr->output_h = out_h;
+    if (vr->frame_w <= 0 || vr->frame_h <= 0)
+    {
+        vr->dst = (SDL_Rect){0, 0, out_w, out_h};
+        return;
+    }
+    double aspect = (double)vr->frame_w / vr->frame_h;
+    if (vr->frame_sar.num > 0 && vr->frame_sar.den > 0)
+    {
+        aspect *= av_q2d(vr->frame_sar);
+    }
+    int w = out_w;
+    int h = (int)lrint(w / aspect);
+    if (h > out_h)
+    {
+        h = out_h;
+        w = (int)lrint(h * aspect);
+    }
+    w = FFMAX(w, 1);
+    h = FFMAX(h, 1);
+    vr->dst.x = (out_w - w) / 2;
+    vr->dst.y = (out_h - h) / 2;
+    vr->dst.w = w;
+    vr->dst.h = h;
+}
+
+//帧大小或者宽高比变化时重新计算显示区域
+static void set_frame_geometry(VideoRender *vr, const AVFrame *frame)
+{
+    if (vr->frame_w != frame->width || vr->frame_h != frame->height ||
+        av_cmp_q(vr->frame_sar, frame->sample_aspect_ratio) != 0)
+    {
+        vr->frame_w = frame->width;
+        vr->frame_h = frame->height;
+        vr->frame_sar = frame->sample_aspect_ratio;
+        update_layout(vr);
+    }
+}
+
+void video_render_init(VideoRender *vr, SDL_Renderer *renderer)
+{
+    memset(vr, 0, sizeof(VideoRender));
+    vr->renderer = renderer;
+    if (!renderer)
+    {
+        //无界面模式：只做格式转换，不创建纹理
+        av_log(NULL, AV_LOG_INFO, "video_render null sink.\n");
+        return;
+    }
+    if (SDL_GetRendererInfo(renderer, &vr->info) < 0)
+    {
+        av_log(NULL, AV_LOG_WARNING, "SDL_GetRendererInfo error = %s.\n", SDL_GetError());
+    }
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+    update_layout(vr);
+}
+
+void video_render_fit_window(int frame_w, int frame_h, AVRational sar, int *win_w, int *win_h)
+{
+    if (frame_w <= 0 || frame_h <= 0)
+    {
+        *win_w = DEFAULT_WINDOW_W;
+        *win_h = DEFAULT_WINDOW_H;
+        return;
+    }
+    int w = frame_w;
+    int h = frame_h;
+    if (sar.num > 0 && sar.den > 0)
+    {
+        w = (int)av_rescale(w, sar.num, sar.den);
+    }
+    SDL_Rect bounds;
+    if (SDL_GetDisplayUsableBounds(0, &bounds) == 0 && bounds.w > 0 && bounds.h > 0)
+    {
+        //4K 之类比屏幕大的视频按比例缩小窗口，帧本身不缩放
+        if (w > bounds.w || h > bounds.h)
+        {
+            double scale = FFMIN((double)bounds.w / w, (double)bounds.h / h);
+            w = (int)(w * scale);
+            h = (int)(h * scale);
+        }
+    }
+    *win_w = FFMAX(w, 1);
+    *win_h = FFMAX(h, 1);
+}
+
+void video_render_resize(VideoRender *vr)
+{
+    update_layout(vr);
+    vr->stats.resizes++;
+}
+
+int video_render_enable_direct_decode(VideoRender *vr, AVCodecContext *codec_ctx)
+{
+    //有参考帧的解码器会在后面继续读写旧的缓冲，只有帧内编码才能解码到纹理
+    const AVCodecDescriptor *desc = avcodec_descriptor_get(codec_ctx->codec_id);
+    if (!vr->renderer || !desc || !(desc->props & AV_CODEC_PROP_INTRA_ONLY))
+    {
+        return 0;
+    }
+    if (!codec_ctx->codec || !(codec_ctx->codec->capabilities & AV_CODEC_CAP_DR1))
+    {
+        return 0;
+    }
+    if (codec_ctx->pix_fmt != AV_PIX_FMT_NONE && codec_ctx->pix_fmt != AV_PIX_FMT_YUV420P)
+    {
+        return 0;
+    }
+    //SDL 纹理只能在渲染线程上锁定，不能用帧级多线程
+    codec_ctx->thread_type = FF_THREAD_SLICE;
+    codec_ctx->opaque = vr;
+    codec_ctx->get_buffer2 = texture_get_buffer2;
+    vr->direct_decode = 1;
+    av_log(NULL, AV_LOG_INFO, "video_render direct decode into texture enabled.\n");
+    return 1;
+}
+
+static int upload_frame(VideoRender *vr, const AVFrame *frame, Uint32 texture_format)
+{
+    if (!vr->renderer)
+    {
+        return 0;
+    }
+    if (ensure_texture(vr, texture_format, frame->width, frame->height) < 0)
+    {
+        return -1;
+    }
+    SDL_Rect rect = {0, 0, frame->width, frame->height};
+    int ret;
+    switch (texture_format)
+    {
+    case SDL_PIXELFORMAT_IYUV:
+        ret = SDL_UpdateYUVTexture(vr->texture, &rect,
+                                   frame->data[0], frame->linesize[0],
+                                   frame->data[1], frame->linesize[1],
+                                   frame->data[2], frame->linesize[2]);
+        break;
+    case SDL_PIXELFORMAT_NV12:
+    case SDL_PIXELFORMAT_NV21:
+    {
+        //Y 平面和交错的 UV 平面分别拷贝到锁定的纹理里
+        void *pixels = NULL;
+        int pitch = 0;
+        ret = SDL_LockTexture(vr->texture, &rect, &pixels, &pitch);
+        if (ret < 0)
+        {
+            break;
+        }
+        uint8_t *dst = (uint8_t *)pixels;
+        for (int y = 0; y < frame->height; y++)
+        {
+            memcpy(dst + y * pitch, frame->data[0] + y * frame->linesize[0], frame->width);
+        }
+        dst += pitch * frame->height;
+        int uv_w = (frame->width + 1) & ~1;
+        for (int y = 0; y < (frame->height + 1) / 2; y++)
+        {
+            memcpy(dst + y * pitch, frame->data[1] + y * frame->linesize[1], uv_w);
+        }
+        SDL_UnlockTexture(vr->texture);
+        break;
+    }
+    default:
+        //打包格式只有一个平面
+        ret = SDL_UpdateTexture(vr->texture, &rect, frame->data[0], frame->linesize[0]);
+        break;
+    }
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "update texture error = %s.\n", SDL_GetError());
+    }
+    return ret;
+}
+
+int video_render_upload(VideoRender *vr, AVFrame *frame)
+{
+    int ret;
+    //解码器已经把数据写进纹理了，解锁即可
+    if (vr->lock_token && frame->buf[0] && av_buffer_get_opaque(frame->buf[0]) == vr->lock_token)
+    {
+        unlock_texture(vr);
+        set_frame_geometry(vr, frame);
+        vr->stats.frames_zero_copy++;
+        return 0;
+    }
+    unlock_texture(vr);
+
+    Uint32 texture_format = find_texture_format(vr, frame->format);
+    if (texture_format != SDL_PIXELFORMAT_UNKNOWN && frame->linesize[0] > 0)
+    {
+        //直接上传 AVFrame 的平面，不再经过 sws_scale
+        TRACE_BEGIN(upload_start);
+        ret = upload_frame(vr, frame, texture_format);
+        TRACE_END(upload_start, "texture_upload", -1, vr->stats.frames_direct);
+        vr->stats.frames_direct++;
+    }
+    else
+    {
+        //纹理不支持的格式按原始分辨率转换成 YUV420P，不做缩放
+        AVFrame *cf = vr->convert_frame;
+        if (!cf || cf->width != frame->width || cf->height != frame->height)
+        {
+            av_frame_free(&vr->convert_frame);
+            cf = av_frame_alloc();
+            if (!cf)
+            {
+                return AVERROR(ENOMEM);
+            }
+            cf->format = AV_PIX_FMT_YUV420P;
+            cf->width = frame->width;
+            cf->height = frame->height;
+            if ((ret = av_frame_get_buffer(cf, 32)) < 0)
+            {
+                av_frame_free(&cf);
+                return ret;
+            }
+            vr->convert_frame = cf;
+        }
+        vr->sws_ctx = sws_getCachedContext(vr->sws_ctx,
+                                           frame->width, frame->height, frame->format,
+                                           cf->width, cf->height, AV_PIX_FMT_YUV420P,
+                                           SWS_BILINEAR, NULL, NULL, NULL);
+        if (!vr->sws_ctx)
+        {
+            av_log(NULL, AV_LOG_ERROR, "sws_getCachedContext NULL, format = %s.\n", av_get_pix_fmt_name(frame->format));
+            return -1;
+        }
+        TRACE_BEGIN(scale_start);
+        sws_scale(vr->sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, frame->height, cf->data, cf->linesize);
+        TRACE_END(scale_start, "sws_scale", -1, vr->stats.frames_converted);
+        TRACE_BEGIN(upload_start);
+        ret = upload_frame(vr, cf, SDL_PIXELFORMAT_IYUV);
+        TRACE_END(upload_start, "texture_upload", -1, vr->stats.frames_converted);
+        vr->stats.frames_converted++;
+    }
+    set_frame_geometry(vr, frame);
+    return ret;
+}
+
+void video_render_present(VideoRender *vr)
+{
+    if (!vr->renderer)
+    {
+        return;
+    }
+    SDL_RenderClear(vr->renderer);
+    if (vr->texture && vr->frame_w > 0 && vr->frame_h > 0)
+    {
+        //纹理可能因为对齐比帧大，只取可见区域，按宽高比放到窗口中间
+        SDL_Rect src = {0, 0, vr->frame_w, vr->frame_h};
+        SDL_RenderCopy(vr->renderer, vr->texture, &src, &vr->dst);
+    }
+    SDL_RenderPresent(vr->renderer);
+}
+
+void video_render_log_stats(const VideoRender *vr)
+{
+    av_log(NULL, AV_LOG_INFO, "video_render direct = %lld,zero_copy = %lld,converted = %lld,texture_recreated = %lld,resizes = %lld.\n",
+           (long long)vr->stats.frames_direct, (long long)vr->stats.frames_zero_copy,
+           (long long)vr->stats.frames_converted, (long long)vr->stats.texture_recreated,
+           (long long)vr->stats.resizes);
+}
+
+//解码器持有的纹理缓冲在释放时会访问 vr，需要先释放解码器
+void video_render_destroy(VideoRender *vr)
+{
+    unlock_texture(vr);
+    if (vr->texture)
+    {
+        SDL_DestroyTexture(vr->texture);
+        vr->texture = NULL;
+    }
+    if (vr->sws_ctx)
+    {
+        sws_freeContext(vr->sws_ctx);
+        vr->sws_ctx = NULL;
+    }
+    av_frame_free(&vr->convert_frame);
+}
@@ -0,0 +1,62 @@
+#ifndef VIDEO_RENDER_H
+#define VIDEO_RENDER_H
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+#include <SDL2/SDL.h>
+
+typedef struct VideoRenderStats
+{
+    int64_t frames_direct;    //直接上传 AVFrame 的平面
+    int64_t frames_zero_copy; //解码器直接写进纹理
+    int64_t frames_converted; //需要 sws_scale 转换格式
+    int64_t texture_recreated;
+    int64_t resizes;
+} VideoRenderStats;
+
+typedef struct VideoRender
+{
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    Uint32 texture_format;
+    int texture_w;
+    int texture_h;
+    //当前帧的可见区域
+    int frame_w;
+    int frame_h;
+    AVRational frame_sar;
+    //保持宽高比的显示区域，窗口大小变化时重新计算
+    int output_w;
+    int output_h;
+    SDL_Rect dst;
+    SDL_RendererInfo info;
+
+    //源格式无法直接上传时才使用
+    struct SwsContext *sws_ctx;
+    AVFrame *convert_frame;
+
+    //get_buffer2 直接解码到 SDL_LockTexture 的内存
+    int direct_decode;
+    int locked;
+    int lock_serial;
+    void *lock_token;
+
+    VideoRenderStats stats;
+} VideoRender;
+
+//renderer 为 NULL 时是无界面模式，只统计、转换，不上传
+void video_render_init(VideoRender *vr, SDL_Renderer *renderer);
+//根据视频大小和宽高比计算初始窗口大小，不超过屏幕可用区域
+void video_render_fit_window(int frame_w, int frame_h, AVRational sar, int *win_w, int *win_h);
+//在 avcodec_open2 之前调用，条件允许时让解码器直接解码到纹理
+int video_render_enable_direct_decode(VideoRender *vr, AVCodecContext *codec_ctx);
+//把解码出来的帧放进纹理
+int video_render_upload(VideoRender *vr, AVFrame *frame);
+//窗口大小变化之后调用（SDL_WINDOWEVENT_SIZE_CHANGED）
+void video_render_resize(VideoRender *vr);
+void video_render_present(VideoRender *vr);
+void video_render_log_stats(const VideoRender *vr);
+void video_render_destroy(VideoRender *vr);
+
+#endif
@@ -0,0 +1,730 @@
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "probe_cache.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+//数据区里的记录按 8 字节对齐
+#define ALIGN8(x) (((size_t)(x) + 7) & ~(size_t)7)
+
+static uint64_t fnv1a(const void *data, size_t size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ p[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint32_t checksum32(const void *data, size_t size)
+{
+    uint64_t hash = fnv1a(data, size);
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static uint32_t slot_checksum(const ProbeCacheSlot *slot)
+{
+    return checksum32(&slot->data_checksum, sizeof(ProbeCacheSlot) - offsetof(ProbeCacheSlot, data_checksum));
+}
+
+//只有本地普通文件能缓存，key 写进 rec
+static int file_key(const char *url, ProbeCacheSlot *rec)
+{
+    av_strstart(url, "file:", &url);
+    struct stat st;
+    if (stat(url, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        return AVERROR(ENOENT);
+    }
+    //相对路径、符号链接都规范成同一个 key
+    char resolved[PATH_MAX];
+    const char *path = realpath(url, resolved) ? resolved : url;
+    uint64_t hash = fnv1a(path, strlen(path));
+    rec->path_hash = hash ? hash : 1;
+    rec->dev = (uint64_t)st.st_dev;
+    rec->ino = (uint64_t)st.st_ino;
+    rec->size = (int64_t)st.st_size;
+#ifdef __APPLE__
+    rec->mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    rec->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return 0;
+}
+
+static char *default_path(void)
+{
+    const char *dir = getenv("XDG_CACHE_HOME");
+    if (dir && dir[0])
+    {
+        return av_asprintf("%s/%s", dir, PROBE_CACHE_FILE);
+    }
+    const char *home = getenv("HOME");
+    if (!home || !home[0])
+    {
+        return NULL;
+    }
+    char *cache_dir = av_asprintf("%s/.cache", home);
+    if (!cache_dir)
+    {
+        return NULL;
+    }
+    mkdir(cache_dir, 0755);
+    char *path = av_asprintf("%s/%s", cache_dir, PROBE_CACHE_FILE);
+    av_free(cache_dir);
+    return path;
+}
+
+//文件大小变了（其他进程扩容或者重建）就重新映射
+static int remap(ProbeCache *cache)
+{
+    struct stat st;
+    if (fstat(cache->fd, &st) < 0)
+    {
+        return AVERROR(errno);
+    }
+    size_t size = (size_t)st.st_size;
+    if (cache->map && size == cache->map_size)
+    {
+        return 0;
+    }
+    if (cache->map)
+    {
+        munmap(cache->map, cache->map_size);
+        cache->map = NULL;
+        cache->map_size = 0;
+    }
+    if (size == 0)
+    {
+        return 0;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return AVERROR(errno);
+    }
+    cache->map = (uint8_t *)map;
+    cache->map_size = size;
+    return 0;
+}
+
+static int lock_cache(ProbeCache *cache, int operation)
+{
+    pthread_mutex_lock(&cache->mutex);
+    while (flock(cache->fd, operation) < 0)
+    {
+        if (errno != EINTR)
+        {
+            int ret = AVERROR(errno);
+            pthread_mutex_unlock(&cache->mutex);
+            return ret;
+        }
+    }
+    int ret = remap(cache);
+    if (ret < 0)
+    {
+        flock(cache->fd, LOCK_UN);
+        pthread_mutex_unlock(&cache->mutex);
+    }
+    return ret;
+}
+
+static void unlock_cache(ProbeCache *cache)
+{
+    flock(cache->fd, LOCK_UN);
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+static void count(ProbeCache *cache, int64_t *counter)
+{
+    pthread_mutex_lock(&cache->mutex);
+    (*counter)++;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+static size_t data_start(const ProbeCacheFileHeader *header)
+{
+    return sizeof(ProbeCacheFileHeader) + (size_t)header->nb_slots * sizeof(ProbeCacheSlot);
+}
+
+static ProbeCacheFileHeader *valid_header(ProbeCache *cache)
+{
+    if (!cache->map || cache->map_size < sizeof(ProbeCacheFileHeader))
+    {
+        return NULL;
+    }
+    ProbeCacheFileHeader *header = (ProbeCacheFileHeader *)cache->map;
+    if (memcmp(header->magic, PROBE_CACHE_MAGIC, 4) || header->version != PROBE_CACHE_VERSION ||
+        header->slot_size != sizeof(ProbeCacheSlot) || !header->nb_slots ||
+        (header->nb_slots & (header->nb_slots - 1)) || cache->map_size < data_start(header) ||
+        header->data_used > cache->map_size - data_start(header) || header->data_garbage > header->data_used)
+    {
+        return NULL;
+    }
+    return header;
+}
+
+static ProbeCacheSlot *slots(ProbeCache *cache)
+{
+    return (ProbeCacheSlot *)(cache->map + sizeof(ProbeCacheFileHeader));
+}
+
+static uint8_t *data_area(ProbeCache *cache)
+{
+    return cache->map + data_start((ProbeCacheFileHeader *)cache->map);
+}
+
+//独占锁下调用：清空文件，按 nb_slots 个槽位和 data_size 字节的数据区重建。先截成 0 再扩展，新的内容全是 0
+static int reset_file(ProbeCache *cache, uint32_t nb_slots, size_t data_size)
+{
+    size_t size = sizeof(ProbeCacheFileHeader) + (size_t)nb_slots * sizeof(ProbeCacheSlot) + data_size;
+    if (ftruncate(cache->fd, 0) < 0 || ftruncate(cache->fd, (off_t)size) < 0)
+    {
+        return AVERROR(errno);
+    }
+    int ret = remap(cache);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ProbeCacheFileHeader *header = (ProbeCacheFileHeader *)cache->map;
+    memcpy(header->magic, PROBE_CACHE_MAGIC, 4);
+    header->version = PROBE_CACHE_VERSION;
+    header->slot_size = sizeof(ProbeCacheSlot);
+    header->nb_slots = nb_slots;
+    header->nb_used = 0;
+    header->data_used = 0;
+    header->data_garbage = 0;
+    return 0;
+}
+
+//返回 path_hash 相同的槽位，没有就返回探测路径上的第一个空位，都没有返回 NULL，同时给出路径上最旧的记录
+static ProbeCacheSlot *find_slot(ProbeCache *cache, uint64_t path_hash, ProbeCacheSlot **oldest)
+{
+    ProbeCacheFileHeader *header = (ProbeCacheFileHeader *)cache->map;
+    ProbeCacheSlot *table = slots(cache);
+    uint32_t mask = header->nb_slots - 1;
+    for (uint32_t i = 0; i < PROBE_CACHE_MAX_PROBES && i <= mask; i++)
+    {
+        ProbeCacheSlot *slot = &table[(path_hash + i) & mask];
+        if (slot->path_hash == path_hash || slot->path_hash == 0)
+        {
+            return slot;
+        }
+        if (oldest && (!*oldest || slot->stored_at < (*oldest)->stored_at))
+        {
+            *oldest = slot;
+        }
+    }
+    return NULL;
+}
+
+//槽位和它在数据区里的记录都校验通过时返回记录，否则返回 NULL
+static const uint8_t *slot_data(ProbeCache *cache, const ProbeCacheSlot *slot)
+{
+    const ProbeCacheFileHeader *header = (const ProbeCacheFileHeader *)cache->map;
+    if (!slot->path_hash || slot->checksum != slot_checksum(slot) || slot->data_size < sizeof(ProbeCacheRecord) ||
+        slot->data_offset > header->data_used || slot->data_size > header->data_used - slot->data_offset)
+    {
+        return NULL;
+    }
+    const uint8_t *data = data_area(cache) + slot->data_offset;
+    return checksum32(data, slot->data_size) == slot->data_checksum ? data : NULL;
+}
+
+//独占锁下调用：有效记录先拷出来，文件按 nb_slots 个槽位重建后重新插入，数据区里的垃圾也一起去掉；
+//extra 是之后要追加的字节数，重建后的数据区至少留出这么多
+static int rebuild(ProbeCache *cache, uint32_t nb_slots, size_t extra)
+{
+    ProbeCacheFileHeader *header = (ProbeCacheFileHeader *)cache->map;
+    size_t live = header->data_used - header->data_garbage;
+    ProbeCacheSlot *saved = (ProbeCacheSlot *)av_malloc_array(header->nb_used + 1, sizeof(ProbeCacheSlot));
+    uint8_t *saved_data = (uint8_t *)av_malloc(live + 1);
+    if (!saved || !saved_data)
+    {
+        av_free(saved);
+        av_free(saved_data);
+        return AVERROR(ENOMEM);
+    }
+    uint32_t nb_saved = 0;
+    size_t saved_size = 0;
+    ProbeCacheSlot *table = slots(cache);
+    for (uint32_t i = 0; i < header->nb_slots && nb_saved <= header->nb_used; i++)
+    {
+        const uint8_t *data = slot_data(cache, &table[i]);
+        if (data && saved_size + ALIGN8(table[i].data_size) <= live)
+        {
+            saved[nb_saved] = table[i];
+            saved[nb_saved].data_offset = saved_size;
+            memcpy(saved_data + saved_size, data, table[i].data_size);
+            saved_size += ALIGN8(table[i].data_size);
+            nb_saved++;
+        }
+    }
+    int ret = reset_file(cache, nb_slots, FFMAX(PROBE_CACHE_INITIAL_DATA, (saved_size + extra) * 2));
+    if (ret >= 0)
+    {
+        header = (ProbeCacheFileHeader *)cache->map;
+        memcpy(data_area(cache), saved_data, saved_size);
+        header->data_used = saved_size;
+        for (uint32_t i = 0; i < nb_saved; i++)
+        {
+            ProbeCacheSlot *slot = find_slot(cache, saved[i].path_hash, NULL);
+            if (slot && !slot->path_hash)
+            {
+                saved[i].checksum = slot_checksum(&saved[i]);
+                *slot = saved[i];
+                header->nb_used++;
+            }
+            else
+            {
+                header->data_garbage += ALIGN8(saved[i].data_size);
+            }
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "probe_cache %s rebuilt with %u slots, %zu bytes of records.\n", cache->path, nb_slots, saved_size);
+    }
+    av_free(saved);
+    av_free(saved_data);
+    return ret;
+}
+
+//独占锁下调用：把一条记录追加到数据区末尾，返回它的偏移。空间不够时垃圾多就重建，否则把文件加长
+static int64_t append_data(ProbeCache *cache, const uint8_t *data, size_t size)
+{
+    ProbeCacheFileHeader *header = (ProbeCacheFileHeader *)cache->map;
+    size_t capacity = cache->map_size - data_start(header);
+    if (header->data_used + ALIGN8(size) > capacity)
+    {
+        int ret;
+        if (header->data_garbage * 2 > header->data_used)
+        {
+            ret = rebuild(cache, header->nb_slots, ALIGN8(size));
+        }
+        else
+        {
+            capacity = FFMAX(capacity * 2, header->data_used + ALIGN8(size));
+            ret = ftruncate(cache->fd, (off_t)(data_start(header) + capacity)) < 0 ? AVERROR(errno) : remap(cache);
+        }
+        if (ret < 0)
+        {
+            return ret;
+        }
+        header = (ProbeCacheFileHeader *)cache->map;
+    }
+    uint64_t offset = header->data_used;
+    memcpy(data_area(cache) + offset, data, size);
+    header->data_used += ALIGN8(size);
+    return (int64_t)offset;
+}
+
+int probe_cache_open(ProbeCache *cache, const char *path)
+{
+    memset(cache, 0, sizeof(ProbeCache));
+    cache->fd = -1;
+    pthread_mutex_init(&cache->mutex, NULL);
+    if (!path)
+    {
+        path = getenv(PROBE_CACHE_ENV);
+    }
+    //默认不使用缓存，不往 $HOME 里写东西；default 表示用 ~/.cache 下的默认路径
+    if (!path || !path[0] || !strcmp(path, "off"))
+    {
+        return AVERROR(ENOSYS);
+    }
+    cache->path = strcmp(path, "default") ? av_strdup(path) : default_path();
+    if (!cache->path)
+    {
+        return AVERROR(ENOMEM);
+    }
+    int fd = open(cache->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        int ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_WARNING, "probe_cache open %s error = %s.\n", cache->path, av_err2str(ret));
+        av_freep(&cache->path);
+        return ret;
+    }
+    cache->fd = fd;
+    //新文件或者版本不对，重建
+    int ret = lock_cache(cache, LOCK_EX);
+    if (ret >= 0)
+    {
+        if (!valid_header(cache))
+        {
+            ret = reset_file(cache, PROBE_CACHE_INITIAL_SLOTS, PROBE_CACHE_INITIAL_DATA);
+        }
+        unlock_cache(cache);
+    }
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_WARNING, "probe_cache init %s error = %s.\n", cache->path, av_err2str(ret));
+        probe_cache_close(cache);
+        pthread_mutex_init(&cache->mutex, NULL);
+    }
+    return ret;
+}
+
+//依次取记录里的每路流，pos 是当前位置；长度不对返回 NULL
+static const ProbeCacheStream *record_stream(const uint8_t *data, size_t size, size_t *pos, const uint8_t **extradata)
+{
+    if (*pos > size || size - *pos < sizeof(ProbeCacheStream))
+    {
+        return NULL;
+    }
+    const ProbeCacheStream *s = (const ProbeCacheStream *)(data + *pos);
+    if (s->extradata_size > size - *pos - sizeof(ProbeCacheStream))
+    {
+        return NULL;
+    }
+    *extradata = data + *pos + sizeof(ProbeCacheStream);
+    *pos += sizeof(ProbeCacheStream) + ALIGN8(s->extradata_size);
+    return s;
+}
+
+//打开后的流和缓存的一致才能用：流的个数、类型、编码、time_base 都由解复用器的头决定
+static int streams_match(const uint8_t *data, size_t size, const AVFormatContext *fmt_ctx)
+{
+    const ProbeCacheRecord *rec = (const ProbeCacheRecord *)data;
+    if (rec->nb_streams != fmt_ctx->nb_streams)
+    {
+        return 0;
+    }
+    size_t pos = sizeof(ProbeCacheRecord);
+    for (uint32_t i = 0; i < rec->nb_streams; i++)
+    {
+        const uint8_t *extradata;
+        const ProbeCacheStream *s = record_stream(data, size, &pos, &extradata);
+        const AVStream *st = fmt_ctx->streams[i];
+        if (!s || s->codec_type != (int32_t)st->codecpar->codec_type || s->codec_id != (int32_t)st->codecpar->codec_id ||
+            s->time_base[0] != st->time_base.num || s->time_base[1] != st->time_base.den)
+        {
+            return 0;
+        }
+    }
+    return pos == size;
+}
+
+static void fill_stream(ProbeCacheStream *s, const AVStream *st)
+{
+    const AVCodecParameters *par = st->codecpar;
+    s->codec_type = par->codec_type;
+    s->codec_id = par->codec_id;
+    s->codec_tag = par->codec_tag;
+    s->format = par->format;
+    s->profile = par->profile;
+    s->level = par->level;
+    s->width = par->width;
+    s->height = par->height;
+    s->sample_aspect_ratio[0] = par->sample_aspect_ratio.num;
+    s->sample_aspect_ratio[1] = par->sample_aspect_ratio.den;
+    s->field_order = par->field_order;
+    s->color_range = par->color_range;
+    s->color_primaries = par->color_primaries;
+    s->color_trc = par->color_trc;
+    s->color_space = par->color_space;
+    s->chroma_location = par->chroma_location;
+    s->bits_per_coded_sample = par->bits_per_coded_sample;
+    s->bits_per_raw_sample = par->bits_per_raw_sample;
+    s->video_delay = par->video_delay;
+    s->channels = par->channels;
+    s->sample_rate = par->sample_rate;
+    s->block_align = par->block_align;
+    s->frame_size = par->frame_size;
+    s->initial_padding = par->initial_padding;
+    s->time_base[0] = st->time_base.num;
+    s->time_base[1] = st->time_base.den;
+    s->avg_frame_rate[0] = st->avg_frame_rate.num;
+    s->avg_frame_rate[1] = st->avg_frame_rate.den;
+    s->r_frame_rate[0] = st->r_frame_rate.num;
+    s->r_frame_rate[1] = st->r_frame_rate.den;
+    s->extradata_size = par->extradata_size > 0 ? (uint32_t)par->extradata_size : 0;
+    s->channel_layout = par->channel_layout;
+    s->bit_rate = par->bit_rate;
+    s->start_time = st->start_time;
+    s->duration = st->duration;
+}
+
+//把 fmt_ctx 写成一条数据区记录；超过 PROBE_CACHE_MAX_RECORD_SIZE 时返回 0 且 *data 为 NULL
+static int build_record(const AVFormatContext *fmt_ctx, uint8_t **data, size_t *size)
+{
+    *data = NULL;
+    size_t total = sizeof(ProbeCacheRecord);
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++)
+    {
+        int extradata_size = fmt_ctx->streams[i]->codecpar->extradata_size;
+        total += sizeof(ProbeCacheStream) + ALIGN8(extradata_size > 0 ? extradata_size : 0);
+        if (total > PROBE_CACHE_MAX_RECORD_SIZE)
+        {
+            return 0;
+        }
+    }
+    uint8_t *buf = (uint8_t *)av_mallocz(total);
+    if (!buf)
+    {
+        return AVERROR(ENOMEM);
+    }
+    ProbeCacheRecord *rec = (ProbeCacheRecord *)buf;
+    rec->nb_streams = fmt_ctx->nb_streams;
+    rec->start_time = fmt_ctx->start_time;
+    rec->duration = fmt_ctx->duration;
+    rec->bit_rate = fmt_ctx->bit_rate;
+    size_t pos = sizeof(ProbeCacheRecord);
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++)
+    {
+        const AVStream *st = fmt_ctx->streams[i];
+        ProbeCacheStream *s = (ProbeCacheStream *)(buf + pos);
+        fill_stream(s, st);
+        pos += sizeof(ProbeCacheStream);
+        if (s->extradata_size)
+        {
+            memcpy(buf + pos, st->codecpar->extradata, s->extradata_size);
+        }
+        pos += ALIGN8(s->extradata_size);
+    }
+    *data = buf;
+    *size = total;
+    return 0;
+}
+
+//只在打开后没有 extradata 时用缓存的：mp4、mkv 等封装在 avformat_open_input 时已经读出来了，
+//TS、裸流的要靠缓存补上，否则解码器拿不到 SPS/PPS
+static int apply_record(const uint8_t *data, size_t size, AVFormatContext *fmt_ctx)
+{
+    const ProbeCacheRecord *rec = (const ProbeCacheRecord *)data;
+    fmt_ctx->start_time = rec->start_time;
+    fmt_ctx->duration = rec->duration;
+    fmt_ctx->bit_rate = rec->bit_rate;
+    size_t pos = sizeof(ProbeCacheRecord);
+    for (uint32_t i = 0; i < rec->nb_streams; i++)
+    {
+        const uint8_t *extradata;
+        const ProbeCacheStream *s = record_stream(data, size, &pos, &extradata);
+        AVStream *st = fmt_ctx->streams[i];
+        AVCodecParameters *par = st->codecpar;
+        if (s->extradata_size && par->extradata_size <= 0)
+        {
+            uint8_t *copy = (uint8_t *)av_mallocz(s->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (!copy)
+            {
+                return AVERROR(ENOMEM);
+            }
+            memcpy(copy, extradata, s->extradata_size);
+            av_freep(&par->extradata);
+            par->extradata = copy;
+            par->extradata_size = (int)s->extradata_size;
+        }
+        par->codec_tag = s->codec_tag;
+        par->format = s->format;
+        par->profile = s->profile;
+        par->level = s->level;
+        par->width = s->width;
+        par->height = s->height;
+        par->sample_aspect_ratio = (AVRational){s->sample_aspect_ratio[0], s->sample_aspect_ratio[1]};
+        par->field_order = (enum AVFieldOrder)s->field_order;
+        par->color_range = (enum AVColorRange)s->color_range;
+        par->color_primaries = (enum AVColorPrimaries)s->color_primaries;
+        par->color_trc = (enum AVColorTransferCharacteristic)s->color_trc;
+        par->color_space = (enum AVColorSpace)s->color_space;
+        par->chroma_location = (enum AVChromaLocation)s->chroma_location;
+        par->bits_per_coded_sample = s->bits_per_coded_sample;
+        par->bits_per_raw_sample = s->bits_per_raw_sample;
+        par->video_delay = s->video_delay;
+        par->channels = s->channels;
+        par->sample_rate = s->sample_rate;
+        par->block_align = s->block_align;
+        par->frame_size = s->frame_size;
+        par->initial_padding = s->initial_padding;
+        par->channel_layout = s->channel_layout;
+        par->bit_rate = s->bit_rate;
+        st->avg_frame_rate = (AVRational){s->avg_frame_rate[0], s->avg_frame_rate[1]};
+        st->r_frame_rate = (AVRational){s->r_frame_rate[0], s->r_frame_rate[1]};
+        st->start_time = s->start_time;
+        st->duration = s->duration;
+    }
+    return 0;
+}
+
+int probe_cache_lookup(ProbeCache *cache, const char *url, AVFormatContext *fmt_ctx)
+{
+    if (!cache || cache->fd < 0)
+    {
+        return 0;
+    }
+    ProbeCacheSlot key;
+    memset(&key, 0, sizeof(key));
+    if (file_key(url, &key) < 0)
+    {
+        return 0;
+    }
+    ProbeCacheSlot rec;
+    uint8_t *data = NULL;
+    int found = 0;
+    if (lock_cache(cache, LOCK_SH) < 0)
+    {
+        return 0;
+    }
+    if (valid_header(cache))
+    {
+        ProbeCacheSlot *slot = find_slot(cache, key.path_hash, NULL);
+        if (slot && slot->path_hash == key.path_hash)
+        {
+            //拷出来再解锁，后面的检查不占锁
+            rec = *slot;
+            const uint8_t *src = slot_data(cache, &rec);
+            if (src && (data = (uint8_t *)av_malloc(rec.data_size)))
+            {
+                memcpy(data, src, rec.data_size);
+            }
+            found = 1;
+        }
+    }
+    unlock_cache(cache);
+
+    if (!found)
+    {
+        count(cache, &cache->misses);
+        return 0;
+    }
+    int hit = data && rec.dev == key.dev && rec.ino == key.ino && rec.size == key.size && rec.mtime_ns == key.mtime_ns &&
+              streams_match(data, rec.data_size, fmt_ctx) && apply_record(data, rec.data_size, fmt_ctx) >= 0;
+    av_free(data);
+    count(cache, hit ? &cache->hits : &cache->stale);
+    return hit;
+}
+
+int probe_cache_store(ProbeCache *cache, const char *url, const AVFormatContext *fmt_ctx)
+{
+    if (!cache || cache->fd < 0 || fmt_ctx->nb_streams == 0)
+    {
+        return 0;
+    }
+    ProbeCacheSlot rec;
+    memset(&rec, 0, sizeof(rec));
+    if (file_key(url, &rec) < 0)
+    {
+        return 0;
+    }
+    uint8_t *data;
+    size_t size;
+    int ret = build_record(fmt_ctx, &data, &size);
+    if (ret < 0 || !data)
+    {
+        return ret;
+    }
+    rec.stored_at = av_gettime();
+    rec.data_size = size;
+    rec.data_checksum = checksum32(data, size);
+
+    if ((ret = lock_cache(cache, LOCK_EX)) < 0)
+    {
+        av_free(data);
+        return ret;
+    }
+    ProbeCacheFileHeader *header = valid_header(cache);
+    if (!header)
+    {
+        if ((ret = reset_file(cache, PROBE_CACHE_INITIAL_SLOTS, PROBE_CACHE_INITIAL_DATA)) < 0)
+        {
+            goto end;
+        }
+        header = (ProbeCacheFileHeader *)cache->map;
+    }
+    //装载率超过 3/4，或者探测路径上没有位置，先扩容
+    if (((uint64_t)(header->nb_used + 1) * 4 > (uint64_t)header->nb_slots * 3 || !find_slot(cache, rec.path_hash, NULL)) &&
+        header->nb_slots < PROBE_CACHE_MAX_SLOTS)
+    {
+        if ((ret = rebuild(cache, header->nb_slots * 2, ALIGN8(size))) < 0)
+        {
+            goto end;
+        }
+    }
+    //追加可能重建文件，槽位要在追加之后再找
+    int64_t offset = append_data(cache, data, size);
+    if (offset < 0)
+    {
+        ret = (int)offset;
+        goto end;
+    }
+    header = (ProbeCacheFileHeader *)cache->map;
+    ProbeCacheSlot *oldest = NULL;
+    ProbeCacheSlot *slot = find_slot(cache, rec.path_hash, &oldest);
+    if (!slot)
+    {
+        //已经到上限，替换最旧的
+        slot = oldest;
+    }
+    if (slot->path_hash)
+    {
+        header->data_garbage = FFMIN(header->data_garbage + ALIGN8(slot->data_size), header->data_used);
+    }
+    else
+    {
+        header->nb_used++;
+    }
+    rec.data_offset = (uint64_t)offset;
+    rec.checksum = slot_checksum(&rec);
+    *slot = rec;
+    cache->stores++;
+
+end:
+    unlock_cache(cache);
+    av_free(data);
+    return ret;
+}
+
+int probe_cache_find_stream_info(ProbeCache *cache, const char *url, AVFormatContext *fmt_ctx)
+{
+    if (probe_cache_lookup(cache, url, fmt_ctx) > 0)
+    {
+        av_log(NULL, AV_LOG_VERBOSE, "probe_cache hit %s.\n", url);
+        return 0;
+    }
+    int ret = avformat_find_stream_info(fmt_ctx, NULL);
+    if (ret >= 0)
+    {
+        probe_cache_store(cache, url, fmt_ctx);
+    }
+    return ret;
+}
+
+void probe_cache_log_stats(ProbeCache *cache)
+{
+    if (cache->fd < 0)
+    {
+        return;
+    }
+    av_log(NULL, AV_LOG_INFO, "probe_cache %s: hits = %" PRId64 ", misses = %" PRId64 ", stale = %" PRId64 ", stores = %" PRId64 ".\n",
+           cache->path, cache->hits, cache->misses, cache->stale, cache->stores);
+}
+
+void probe_cache_close(ProbeCache *cache)
+{
+    if (cache->map)
+    {
+        munmap(cache->map, cache->map_size);
+        cache->map = NULL;
+        cache->map_size = 0;
+    }
+    if (cache->fd >= 0)
+    {
+        close(cache->fd);
+        cache->fd = -1;
+    }
+    av_freep(&cache->path);
+    pthread_mutex_destroy(&cache->mutex);
+}
@@ -0,0 +1,138 @@
+#ifndef PROBE_CACHE_H
+#define PROBE_CACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <libavformat/avformat.h>
+
+//探测结果的磁盘缓存：文件没变（路径、大小、mtime、inode 都一样）就直接用上次 avformat_find_stream_info 的结果，
+//不再读文件分析。缓存文件用 mmap 访问，多个进程同时使用时用 flock 加锁（查询共享锁，写入独占锁）
+//
+//缓存文件格式，本机字节序：
+//  ProbeCacheFileHeader
+//  ProbeCacheSlot * nb_slots：按路径 hash 开放寻址的索引（path_hash 为 0 的是空位）
+//  数据区：变长记录依次追加，每条是 ProbeCacheRecord，后面跟着每路流的 ProbeCacheStream 和它的 extradata（补齐到 8 字节）
+//更新或者替换掉的旧记录留在数据区里算作垃圾，垃圾超过一半时和扩容一样整个重建
+#define PROBE_CACHE_MAGIC "MPRC"
+#define PROBE_CACHE_VERSION 2
+//不指定路径时看环境变量，两个都没有设置（或者是 off）时不使用缓存；值为 default 时用 ~/.cache 下的 PROBE_CACHE_FILE
+#define PROBE_CACHE_ENV "PROBE_CACHE"
+#define PROBE_CACHE_FILE "media_probe.cache"
+//比这个大的记录（extradata 特别大）不缓存
+#define PROBE_CACHE_MAX_RECORD_SIZE (1 << 20)
+#define PROBE_CACHE_INITIAL_SLOTS 256
+#define PROBE_CACHE_MAX_SLOTS (1 << 20)
+#define PROBE_CACHE_INITIAL_DATA (64 * 1024)
+//线性探测的最大步数，超过就扩容
+#define PROBE_CACHE_MAX_PROBES 32
+
+typedef struct ProbeCacheFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t slot_size;
+    //槽位数，2 的幂
+    uint32_t nb_slots;
+    uint32_t nb_used;
+    uint32_t reserved;
+    //数据区从槽位后面开始到文件结尾，data_used 之后是空闲的
+    uint64_t data_used;
+    //被替换掉的旧记录占的字节
+    uint64_t data_garbage;
+} ProbeCacheFileHeader;
+
+typedef struct ProbeCacheSlot
+{
+    //data_checksum 开始到槽位结束的 FNV-1a，data_checksum 是数据区那条记录的；
+    //写到一半进程退出的记录校验不过，当作没有
+    uint32_t checksum;
+    uint32_t data_checksum;
+    //key：规范化路径的 hash + 文件身份
+    uint64_t path_hash;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+    //写入时间（微秒），槽位不够时替换最旧的
+    int64_t stored_at;
+    //记录在数据区里的位置
+    uint64_t data_offset;
+    uint64_t data_size;
+} ProbeCacheSlot;
+
+//AVStream 和 AVCodecParameters 里 avformat_find_stream_info 会补全的字段
+typedef struct ProbeCacheStream
+{
+    int32_t codec_type;
+    int32_t codec_id;
+    uint32_t codec_tag;
+    int32_t format;
+    int32_t profile;
+    int32_t level;
+    int32_t width;
+    int32_t height;
+    int32_t sample_aspect_ratio[2];
+    int32_t field_order;
+    int32_t color_range;
+    int32_t color_primaries;
+    int32_t color_trc;
+    int32_t color_space;
+    int32_t chroma_location;
+    int32_t bits_per_coded_sample;
+    int32_t bits_per_raw_sample;
+    int32_t video_delay;
+    int32_t channels;
+    int32_t sample_rate;
+    int32_t block_align;
+    int32_t frame_size;
+    int32_t initial_padding;
+    int32_t time_base[2];
+    int32_t avg_frame_rate[2];
+    int32_t r_frame_rate[2];
+    //后面跟着的 extradata 长度，TS、裸流的 extradata 是 avformat_find_stream_info 从码流里取出来的
+    uint32_t extradata_size;
+    uint64_t channel_layout;
+    int64_t bit_rate;
+    int64_t start_time;
+    int64_t duration;
+} ProbeCacheStream;
+
+//数据区里的一条记录
+typedef struct ProbeCacheRecord
+{
+    uint32_t nb_streams;
+    uint32_t reserved;
+    int64_t start_time;
+    int64_t duration;
+    int64_t bit_rate;
+} ProbeCacheRecord;
+
+typedef struct ProbeCache
+{
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    char *path;
+    //flock 只在进程之间互斥，同一进程的多个线程用 mutex
+    pthread_mutex_t mutex;
+    //统计
+    int64_t hits;
+    int64_t misses;
+    //文件变了，或者打开后的流和缓存对不上
+    int64_t stale;
+    int64_t stores;
+} ProbeCache;
+
+//path 为 NULL 时看环境变量 PROBE_CACHE，都没有设置时不启用，返回 AVERROR(ENOSYS)；
+//返回 0 成功，失败或者没有启用时 cache 处于关闭状态，其他函数都当作没有缓存
+int probe_cache_open(ProbeCache *cache, const char *path);
+//avformat_open_input 之后调用，命中时把缓存的参数写进 fmt_ctx 并返回 1，没有命中返回 0
+int probe_cache_lookup(ProbeCache *cache, const char *url, AVFormatContext *fmt_ctx);
+//avformat_find_stream_info 成功之后调用，只缓存本地普通文件
+int probe_cache_store(ProbeCache *cache, const char *url, const AVFormatContext *fmt_ctx);
+//代替 avformat_find_stream_info：先查缓存，没有命中再分析并写入缓存，cache 可以为 NULL
+int probe_cache_find_stream_info(ProbeCache *cache, const char *url, AVFormatContext *fmt_ctx);
+void probe_cache_log_stats(ProbeCache *cache);
+void probe_cache_close(ProbeCache *cache);
+
+#endif
@@ -1,92 +1,464 @@
 #include <stdio.h>
+#include <stdlib.h>
 // #include <tchar.h>
 #include <SDL2/SDL_types.h>
 #include "SDL2/SDL.h"
 #include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "audio/pcm_ring.h"
 
-static Uint8 *audio_chunk;
-static Uint32 audio_len;
-static Uint8 *audio_pos;
-int pcm_buffer_size = 4096;
+//默认参数和 test.pcm 一致：44100Hz、S16、双声道
+#define PCM_DEFAULT_RATE 44100
+#define PCM_DEFAULT_CHANNELS 2
+#define PCM_DEFAULT_PERIOD 1024
+//环形缓冲默认能放多少个周期
+#define PCM_RING_PERIODS 8
+//读线程和主线程的条件变量等待上限，回调里的通知没有加锁，可能丢失，超时之后重新检查
+#define PCM_WAIT_MS 50
+
+typedef struct PcmFormat
+{
+    const char *name;
+    SDL_AudioFormat format;
+    int bytes;
+} PcmFormat;
+
+//和 ffmpeg -f 的名字一致
+static const PcmFormat pcm_formats[] = {
+    {"u8", AUDIO_U8, 1},
+    {"s8", AUDIO_S8, 1},
+    {"s16le", AUDIO_S16LSB, 2},
+    {"s16be", AUDIO_S16MSB, 2},
+    {"s32le", AUDIO_S32LSB, 4},
+    {"s32be", AUDIO_S32MSB, 4},
+    {"f32le", AUDIO_F32LSB, 4},
+    {"f32be", AUDIO_F32MSB, 4},
+};
+
+typedef struct PcmPlayer
+{
+    const PcmFormat *format;
+    //文件里的声道数；solo >= 0 时只播放这一个声道，设备按单声道打开
+    int channels;
+    int solo;
+    int in_frame_bytes;
+    int out_frame_bytes;
+    int period_bytes;
+
+    //fread 预读，或者 mmap 整个文件
+    FILE *fp;
+    const Uint8 *map;
+    size_t map_size;
+    size_t map_pos;
+    //solo 时一次读进来的文件数据，挑出一个声道再写进环形缓冲
+    Uint8 *read_buf;
+
+    //读线程是生产者，音频回调是消费者
+    PcmRing ring;
+    SDL_Thread *reader;
+    SDL_mutex *mutex;
+    //回调取走数据之后通知读线程
+    SDL_cond *space_cond;
+    //预读完成、播放结束时通知主线程
+    SDL_cond *state_cond;
+    SDL_atomic_t eof;
+    SDL_atomic_t finished;
+    volatile int quit;
+    Uint8 silence;
+
+    //统计
+    Sint64 bytes_read;
+    int reader_waits;
+    SDL_atomic_t callbacks;
+    SDL_atomic_t underruns;
+} PcmPlayer;
+
+static const PcmFormat *find_format(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(pcm_formats) / sizeof(pcm_formats[0])); i++)
+    {
+        if (!strcmp(pcm_formats[i].name, name))
+        {
+            return &pcm_formats[i];
+        }
+    }
+    return NULL;
+}
+
+static void signal_state(PcmPlayer *p)
+{
+    SDL_LockMutex(p->mutex);
+    SDL_CondSignal(p->state_cond);
+    SDL_UnlockMutex(p->mutex);
+}
 
 //回调函数，音频设备需要更多数据的时候会调用该回调函数
-void audio_callback(void *udata, Uint8 *stream, int len)
+//只从环形缓冲拷贝，不读文件、不等锁
+static void audio_callback(void *udata, Uint8 *stream, int len)
 {
-    SDL_memset(stream, 0, len);
-    if (audio_len == 0)
+    PcmPlayer *p = (PcmPlayer *)udata;
+    int n = pcm_ring_read(&p->ring, stream, len);
+    if (n < len)
+    {
+        SDL_memset(stream + n, p->silence, len - n);
+    }
+    SDL_AtomicIncRef(&p->callbacks);
+    if (n < len && SDL_AtomicGet(&p->eof))
+    {
+        //文件读完，缓冲也取空了
+        if (!SDL_AtomicGet(&p->finished))
+        {
+            SDL_AtomicSet(&p->finished, 1);
+            SDL_CondSignal(p->state_cond);
+        }
         return;
-    len = (len > audio_len ? audio_len : len);
+    }
+    if (n < len)
+    {
+        SDL_AtomicIncRef(&p->underruns);
+    }
+    //不持锁通知，丢失的通知由读线程的超时补上
+    SDL_CondSignal(p->space_cond);
+}
+
+//读 frames 帧，返回实际读到的帧数，数据在 *data 里
+static int read_frames(PcmPlayer *p, int frames, const Uint8 **data)
+{
+    if (p->map)
+    {
+        size_t left = (p->map_size - p->map_pos) / p->in_frame_bytes;
+        if ((size_t)frames > left)
+        {
+            frames = (int)left;
+        }
+        *data = p->map + p->map_pos;
+        p->map_pos += (size_t)frames * p->in_frame_bytes;
+        return frames;
+    }
+    *data = p->read_buf;
+    return (int)fread(p->read_buf, p->in_frame_bytes, frames, p->fp);
+}
+
+//只留一个声道：每帧拷贝 solo 位置的一个采样，原地压缩
+static int pick_channel(PcmPlayer *p, const Uint8 *src, int frames)
+{
+    int bytes = p->format->bytes;
+    Uint8 *dst = p->read_buf;
+    const Uint8 *s = src + p->solo * bytes;
+    for (int i = 0; i < frames; i++)
+    {
+        memmove(dst + i * bytes, s + (size_t)i * p->in_frame_bytes, bytes);
+    }
+    return frames * bytes;
+}
+
+//读线程：预读文件写进环形缓冲，缓冲满了等回调通知
+static int reader_thread(void *arg)
+{
+    PcmPlayer *p = (PcmPlayer *)arg;
+    int prefilled = 0;
+    while (!p->quit)
+    {
+        int space = pcm_ring_space(&p->ring);
+        if (space < p->period_bytes)
+        {
+            if (!prefilled)
+            {
+                prefilled = 1;
+                signal_state(p);
+            }
+            SDL_LockMutex(p->mutex);
+            if (!p->quit && pcm_ring_space(&p->ring) < p->period_bytes)
+            {
+                p->reader_waits++;
+                SDL_CondWaitTimeout(p->space_cond, p->mutex, PCM_WAIT_MS);
+            }
+            SDL_UnlockMutex(p->mutex);
+            continue;
+        }
+
+        //按周期整帧读，最后一帧不完整就丢掉
+        int frames = space / p->out_frame_bytes;
+        if (frames > PCM_RING_PERIODS * p->period_bytes / p->out_frame_bytes)
+        {
+            frames = PCM_RING_PERIODS * p->period_bytes / p->out_frame_bytes;
+        }
+        const Uint8 *data = NULL;
+        int got = read_frames(p, frames, &data);
+        if (got <= 0)
+        {
+            break;
+        }
+        int size = p->solo >= 0 ? pick_channel(p, data, got) : got * p->in_frame_bytes;
+        if (p->solo >= 0)
+        {
+            data = p->read_buf;
+        }
+        //空间是先查过的，只有这个线程写，一次能写完
+        pcm_ring_write(&p->ring, data, size);
+        p->bytes_read += (Sint64)got * p->in_frame_bytes;
+    }
+    SDL_AtomicSet(&p->eof, 1);
+    signal_state(p);
+    return 0;
+}
+
+static int open_input(PcmPlayer *p, const char *filepath, int use_mmap)
+{
+    if (!strcmp(filepath, "-"))
+    {
+        p->fp = stdin;
+    }
+#ifndef _WIN32
+    else if (use_mmap)
+    {
+        int fd = open(filepath, O_RDONLY);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size <= 0)
+        {
+            close(fd);
+            return -1;
+        }
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            return -1;
+        }
+        //顺序读，让内核提前读入后面的页
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        p->map = (const Uint8 *)map;
+        p->map_size = st.st_size;
+    }
+#endif
+    else
+    {
+        p->fp = fopen(filepath, "rb");
+        if (!p->fp)
+        {
+            return -1;
+        }
+    }
+    //fread 和 solo 都需要一块读缓冲，最多一次读满整个环形缓冲
+    if (p->fp || p->solo >= 0)
+    {
+        int frames = PCM_RING_PERIODS * p->period_bytes / p->out_frame_bytes;
+        p->read_buf = (Uint8 *)malloc((size_t)frames * p->in_frame_bytes);
+        if (!p->read_buf)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    //向stream中填充数据
-    SDL_MixAudio(stream, audio_pos, len, SDL_MIX_MAXVOLUME);
-    // memcpy(stream, audio_pos, len);
-    audio_pos += len;
-    audio_len -= len;
+static void close_input(PcmPlayer *p)
+{
+    if (p->fp && p->fp != stdin)
+    {
+        fclose(p->fp);
+    }
+    p->fp = NULL;
+#ifndef _WIN32
+    if (p->map)
+    {
+        munmap((void *)p->map, p->map_size);
+        p->map = NULL;
+    }
+#endif
+    free(p->read_buf);
+    p->read_buf = NULL;
 }
 
 int main(int argc, char *argv[])
 {
+    //./sdl_play_pcm [-f s16le] [-ar 44100] [-ac 2] [-solo channel] [-period samples] [-buffer ms] [-mmap] [-device name] [file|-]
+    char *filepath = "./test.pcm";
+    const char *format_name = "s16le";
+    const char *device = NULL;
+    int rate = PCM_DEFAULT_RATE;
+    int period = PCM_DEFAULT_PERIOD;
+    int buffer_ms = 0;
+    int use_mmap = 0;
+    PcmPlayer player;
+    memset(&player, 0, sizeof(player));
+    player.channels = PCM_DEFAULT_CHANNELS;
+    player.solo = -1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc)
+        {
+            format_name = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-ar") && i + 1 < argc)
+        {
+            rate = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-ac") && i + 1 < argc)
+        {
+            player.channels = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-solo") && i + 1 < argc)
+        {
+            player.solo = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-period") && i + 1 < argc)
+        {
+            period = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-buffer") && i + 1 < argc)
+        {
+            buffer_ms = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-mmap"))
+        {
+            use_mmap = 1;
+        }
+        else if (!strcmp(argv[i], "-device") && i + 1 < argc)
+        {
+            device = argv[++i];
+        }
+        else
+        {
+            filepath = argv[i];
+        }
+    }
+    player.format = find_format(format_name);
+    if (!player.format)
+    {
+        printf("unknown format %s.\n", format_name);
+        return -1;
+    }
+    if (rate <= 0 || period <= 0 || player.channels <= 0 || player.solo >= player.channels)
+    {
+        printf("invalid rate / period / channels / solo.\n");
+        return -1;
+    }
+    //SDL 最多 8 个声道，多声道的测试文件用 -solo 逐个声道听
+    int out_channels = player.solo >= 0 ? 1 : player.channels;
+    if (out_channels > 8)
+    {
+        printf("%d channels, use -solo to play one of them.\n", player.channels);
+        return -1;
+    }
+    player.in_frame_bytes = player.format->bytes * player.channels;
+    player.out_frame_bytes = player.format->bytes * out_channels;
+    player.period_bytes = period * player.out_frame_bytes;
 
+    int ret = -1;
+    SDL_AudioDeviceID dev = 0;
     if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_TIMER))
     {
         printf("Could not initialize SDL - %s\n", SDL_GetError());
         return -1;
     }
 
-    // SDL_AudioSpec spec;
-    // spec.freq = 44100; //根据你录制的PCM采样率决定
-    // spec.format = AUDIO_S16SYS;
-    // spec.channels = 1; //单声道
-    // spec.silence = 0;
-    // spec.samples = 1024;
-    // spec.callback = read_audio_data;
-    // spec.userdata = NULL;
-
-    //test.pcm 对应的信息如下
     SDL_AudioSpec spec;
-    spec.freq = 44100;
-    spec.format = AUDIO_S16SYS;
-    spec.channels = 2;
-    spec.silence = 0;
-    spec.samples = 1024;
+    SDL_AudioSpec obtained;
+    SDL_zero(spec);
+    spec.freq = rate;
+    spec.format = player.format->format;
+    spec.channels = out_channels;
+    spec.samples = period;
     spec.callback = audio_callback;
-    spec.userdata = NULL;
+    spec.userdata = &player;
+    //不允许修改格式，设备不支持时由 SDL 转换，文件里的数据原样交给 SDL
+    dev = SDL_OpenAudioDevice(device, 0, &spec, &obtained, 0);
+    if (dev == 0)
+    {
+        printf("can't open audio: %s.\n", SDL_GetError());
+        goto end;
+    }
+    player.silence = obtained.silence;
 
-    if (SDL_OpenAudio(&spec, NULL) < 0)
+    int buffer_bytes = buffer_ms > 0 ? (int)((Sint64)buffer_ms * rate / 1000) * player.out_frame_bytes
+                                     : player.period_bytes * PCM_RING_PERIODS;
+    if (buffer_bytes < player.period_bytes * 2)
     {
-        printf("can't open audio.\n");
-        return -1;
+        buffer_bytes = player.period_bytes * 2;
+    }
+    player.mutex = SDL_CreateMutex();
+    player.space_cond = SDL_CreateCond();
+    player.state_cond = SDL_CreateCond();
+    if (!player.mutex || !player.space_cond || !player.state_cond || pcm_ring_init(&player.ring, buffer_bytes) < 0)
+    {
+        goto end;
     }
+    if (open_input(&player, filepath, use_mmap) < 0)
+    {
+        printf("cannot open this file %s\n", filepath);
+        goto end;
+    }
+    printf("play %s: %s %dHz %d channels%s, period = %d samples, buffer = %d bytes, %s.\n",
+           filepath, player.format->name, rate, player.channels, player.solo >= 0 ? " (solo)" : "",
+           period, buffer_bytes, player.map ? "mmap" : "fread");
 
-    char *filepath = "./test.pcm";
+    player.reader = SDL_CreateThread(reader_thread, "pcm_reader", &player);
+    if (!player.reader)
+    {
+        printf("SDL_CreateThread error = %s.\n", SDL_GetError());
+        goto end;
+    }
 
-    FILE *fp = fopen(filepath, "rb+");
-    if (fp == NULL)
+    //等读线程把缓冲填满，或者文件比缓冲还短
+    SDL_LockMutex(player.mutex);
+    while (pcm_ring_space(&player.ring) >= player.period_bytes && !SDL_AtomicGet(&player.eof))
     {
-        printf("cannot open this file\n");
-        return -1;
+        SDL_CondWaitTimeout(player.state_cond, player.mutex, PCM_WAIT_MS);
     }
-    char *pcm_buffer = (char *)malloc(pcm_buffer_size);
+    SDL_UnlockMutex(player.mutex);
 
     //播放
-    SDL_PauseAudio(0);
+    SDL_PauseAudioDevice(dev, 0);
 
-    while (1)
+    //读完并且播放完之前，主线程一直睡在条件变量上
+    SDL_LockMutex(player.mutex);
+    while (!SDL_AtomicGet(&player.finished))
     {
-        if (fread(pcm_buffer, 1, pcm_buffer_size, fp) != pcm_buffer_size)
-        { //从文件中读取数据，剩下的就交给音频设备去完成了，它播放完一段数据后会执行回调函数，获取等多的数据
-            break;
-        }
-
-        audio_chunk = (Uint8 *)pcm_buffer;
-        audio_len = pcm_buffer_size; //长度为读出数据长度，在read_audio_data中做减法
-        audio_pos = audio_chunk;
+        SDL_CondWaitTimeout(player.state_cond, player.mutex, PCM_WAIT_MS);
+    }
+    SDL_UnlockMutex(player.mutex);
+    ret = 0;
 
-        while (audio_len > 0) //判断是否播放完毕
-            SDL_Delay(1);
+end:
+    player.quit = 1;
+    if (player.reader)
+    {
+        SDL_LockMutex(player.mutex);
+        SDL_CondSignal(player.space_cond);
+        SDL_UnlockMutex(player.mutex);
+        SDL_WaitThread(player.reader, NULL);
+    }
+    if (dev)
+    {
+        SDL_CloseAudioDevice(dev);
+    }
+    printf("sdl_play_pcm: read = %lld bytes, callbacks = %d, underruns = %d, reader waits = %d.\n",
+           (long long)player.bytes_read, SDL_AtomicGet(&player.callbacks), SDL_AtomicGet(&player.underruns), player.reader_waits);
+    close_input(&player);
+    pcm_ring_free(&player.ring);
+    if (player.state_cond)
+    {
+        SDL_DestroyCond(player.state_cond);
+    }
+    if (player.space_cond)
+    {
+        SDL_DestroyCond(player.space_cond);
+    }
+    if (player.mutex)
+    {
+        SDL_DestroyMutex(player.mutex);
     }
-    free(pcm_buffer);
     SDL_Quit();
 
-    return 0;
-}
\ No newline at end of file
+    return ret;
+}
@@ -0,0 +1,574 @@
+#include <libavformat/avformat.h>
+#include <libavutil/bprint.h>
+#include <libavutil/cpu.h>
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "batch_files.h"
+#include "probe_cache.h"
+
+//./stream_health [-j threads] [-o out.jsonl] [-interval s] [-gap s] [-skew s] [-list paths.txt] [-cache file|default|off] path|dir ...
+//只解复用不解码，按磁盘速度读完整个文件，检查时间戳和流的健康状况，每个文件输出一行 JSON：
+//每路流的码率曲线、dts 缺失/为负/不递增、pts 早于 dts、时间戳跳变、GOP 长度分布，以及音视频交织的偏差
+//文件和目录（递归）放进线程池并行处理。退出码：0 没有问题，1 有文件打不开或读取出错，2 有文件存在问题
+
+//码率曲线最多的点数，超过后相邻两个点合并、间隔加倍
+#define HEALTH_MAX_BUCKETS 512
+//每路流最多记录几次跳变的位置
+#define HEALTH_MAX_JUMPS 8
+//GOP 长度直方图，更长的记在最后一格
+#define HEALTH_MAX_GOP 1024
+
+typedef struct HealthOptions
+{
+    //码率曲线的初始间隔（秒）
+    double interval;
+    //相邻两个包的 dts 相差超过这个值（秒）算跳变
+    double gap;
+    //音视频交织偏差超过这个值（秒）算问题
+    double skew;
+} HealthOptions;
+
+typedef struct StreamHealth
+{
+    int64_t packets;
+    int64_t bytes;
+    int64_t keyframes;
+    double time_base;
+    //第一个和最后一个时间戳（秒），算时长和码率曲线的起点
+    int has_first;
+    double first_ts;
+    double last_ts;
+    int64_t prev_dts;
+    int64_t prev_duration;
+    //音视频是连续的；字幕、数据流本来就是稀疏的，只检查往回跳
+    int continuous;
+    int64_t dts_missing;
+    int64_t dts_negative;
+    double dts_min;
+    //dts 不递增（包括相等），backwards 是其中严格变小的
+    int64_t dts_non_monotonic;
+    int64_t dts_backwards;
+    int64_t pts_missing;
+    int64_t pts_before_dts;
+    int64_t jumps;
+    int nb_jump_records;
+    double jump_at[HEALTH_MAX_JUMPS];
+    double jump_gap[HEALTH_MAX_JUMPS];
+    //码率曲线
+    double interval;
+    int nb_buckets;
+    int64_t buckets[HEALTH_MAX_BUCKETS];
+    //GOP：两个关键帧之间的包数
+    int64_t gop_current;
+    int64_t gop_count;
+    int64_t gop_min;
+    int64_t gop_max;
+    int64_t gop_total;
+    int64_t *gop_lengths;
+} StreamHealth;
+
+typedef struct HealthRun
+{
+    const HealthOptions *options;
+    ThreadPool pool;
+    ProbeCache cache;
+    FILE *out;
+    pthread_mutex_t out_mutex;
+    int files;
+    int failed;
+    int unhealthy;
+    int64_t bytes;
+} HealthRun;
+
+//码率曲线：t 是相对这一路第一个时间戳的秒数
+static void add_bitrate(StreamHealth *sh, double t, int size)
+{
+    if (!(t > 0))
+    {
+        t = 0;
+    }
+    int64_t index = (int64_t)(t / sh->interval);
+    while (index >= HEALTH_MAX_BUCKETS)
+    {
+        for (int i = 0; i < HEALTH_MAX_BUCKETS / 2; i++)
+        {
+            sh->buckets[i] = sh->buckets[2 * i] + sh->buckets[2 * i + 1];
+        }
+        memset(sh->buckets + HEALTH_MAX_BUCKETS / 2, 0, sizeof(int64_t) * HEALTH_MAX_BUCKETS / 2);
+        sh->nb_buckets = (sh->nb_buckets + 1) / 2;
+        sh->interval *= 2;
+        index = (int64_t)(t / sh->interval);
+    }
+    if (index >= sh->nb_buckets)
+    {
+        sh->nb_buckets = (int)index + 1;
+    }
+    sh->buckets[index] += size;
+}
+
+static void end_gop(StreamHealth *sh)
+{
+    if (!sh->gop_current || !sh->gop_lengths)
+    {
+        return;
+    }
+    int64_t n = sh->gop_current;
+    sh->gop_lengths[FFMIN(n, HEALTH_MAX_GOP) - 1]++;
+    sh->gop_min = sh->gop_count ? FFMIN(sh->gop_min, n) : n;
+    sh->gop_max = FFMAX(sh->gop_max, n);
+    sh->gop_total += n;
+    sh->gop_count++;
+}
+
+static void add_packet(StreamHealth *sh, const AVPacket *pkt, const HealthOptions *opt)
+{
+    sh->packets++;
+    sh->bytes += pkt->size;
+    if (pkt->pts == AV_NOPTS_VALUE)
+    {
+        sh->pts_missing++;
+    }
+    if (pkt->dts == AV_NOPTS_VALUE)
+    {
+        sh->dts_missing++;
+    }
+    else
+    {
+        if (pkt->dts < 0)
+        {
+            sh->dts_negative++;
+            sh->dts_min = FFMIN(sh->dts_min, pkt->dts * sh->time_base);
+        }
+        if (sh->prev_dts != AV_NOPTS_VALUE)
+        {
+            if (pkt->dts <= sh->prev_dts)
+            {
+                sh->dts_non_monotonic++;
+                sh->dts_backwards += pkt->dts < sh->prev_dts;
+            }
+            //往后跳从上一个包播完算起，包本身很长（比如字幕）不算跳变
+            double gap = (pkt->dts - sh->prev_dts) * sh->time_base;
+            if (gap > 0)
+            {
+                gap = sh->continuous ? (pkt->dts - sh->prev_dts - sh->prev_duration) * sh->time_base : 0;
+            }
+            if (fabs(gap) > opt->gap)
+            {
+                if (sh->nb_jump_records < HEALTH_MAX_JUMPS)
+                {
+                    sh->jump_at[sh->nb_jump_records] = sh->prev_dts * sh->time_base;
+                    sh->jump_gap[sh->nb_jump_records] = gap;
+                    sh->nb_jump_records++;
+                }
+                sh->jumps++;
+            }
+        }
+        sh->prev_dts = pkt->dts;
+        sh->prev_duration = FFMAX(pkt->duration, 0);
+        if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts)
+        {
+            sh->pts_before_dts++;
+        }
+    }
+
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    if (ts != AV_NOPTS_VALUE)
+    {
+        double t = ts * sh->time_base;
+        if (!sh->has_first)
+        {
+            sh->has_first = 1;
+            sh->first_ts = t;
+            sh->last_ts = t;
+        }
+        sh->last_ts = FFMAX(sh->last_ts, t + pkt->duration * sh->time_base);
+        add_bitrate(sh, t - sh->first_ts, pkt->size);
+    }
+
+    if (pkt->flags & AV_PKT_FLAG_KEY)
+    {
+        sh->keyframes++;
+        end_gop(sh);
+        sh->gop_current = 0;
+    }
+    sh->gop_current++;
+}
+
+//有 B 帧的流开头几个包 dts 为负是正常的，比 -gap 还小才算问题
+static int negative_dts_issue(const StreamHealth *sh, const HealthOptions *opt)
+{
+    return sh->dts_min < -opt->gap;
+}
+
+static int stream_has_issues(const StreamHealth *sh, const HealthOptions *opt)
+{
+    return negative_dts_issue(sh, opt) || sh->dts_non_monotonic || sh->pts_before_dts || sh->jumps;
+}
+
+static void json_stream_health(AVBPrint *bp, const AVStream *st, const StreamHealth *sh)
+{
+    const AVCodecParameters *par = st->codecpar;
+    const char *type = av_get_media_type_string(par->codec_type);
+    double duration = sh->has_first ? sh->last_ts - sh->first_ts : 0;
+    av_bprintf(bp, "{\"index\":%d,\"type\":", st->index);
+    json_string(bp, type ? type : "unknown");
+    av_bprintf(bp, ",\"codec\":");
+    json_string(bp, avcodec_get_name(par->codec_id));
+    av_bprintf(bp, ",\"packets\":%" PRId64 ",\"bytes\":%" PRId64 ",\"keyframes\":%" PRId64 ",\"duration\":%.3f",
+               sh->packets, sh->bytes, sh->keyframes, duration);
+
+    //最后一个点通常不满一个间隔，不参与最小值
+    double min_kbps = 0;
+    double max_kbps = 0;
+    av_bprintf(bp, ",\"bitrate\":{\"avg\":%.1f,\"interval\":%g,\"kbps\":[",
+               duration > 0 ? sh->bytes * 8 / duration / 1000 : 0, sh->interval);
+    for (int i = 0; i < sh->nb_buckets; i++)
+    {
+        double kbps = sh->buckets[i] * 8 / sh->interval / 1000;
+        av_bprintf(bp, "%s%.0f", i ? "," : "", kbps);
+        if (i < sh->nb_buckets - 1 || sh->nb_buckets == 1)
+        {
+            min_kbps = i ? FFMIN(min_kbps, kbps) : kbps;
+        }
+        max_kbps = FFMAX(max_kbps, kbps);
+    }
+    av_bprintf(bp, "],\"min\":%.0f,\"max\":%.0f}", min_kbps, max_kbps);
+
+    av_bprintf(bp, ",\"dts\":{\"missing\":%" PRId64 ",\"negative\":%" PRId64 ",\"min\":%.3f,\"non_monotonic\":%" PRId64 ",\"backwards\":%" PRId64 "}",
+               sh->dts_missing, sh->dts_negative, sh->dts_min, sh->dts_non_monotonic, sh->dts_backwards);
+    av_bprintf(bp, ",\"pts\":{\"missing\":%" PRId64 ",\"before_dts\":%" PRId64 "}", sh->pts_missing, sh->pts_before_dts);
+    av_bprintf(bp, ",\"jumps\":{\"count\":%" PRId64 ",\"first\":[", sh->jumps);
+    for (int i = 0; i < sh->nb_jump_records; i++)
+    {
+        av_bprintf(bp, "%s{\"at\":%.3f,\"gap\":%.3f}", i ? "," : "", sh->jump_at[i], sh->jump_gap[i]);
+    }
+    av_bprintf(bp, "]}");
+
+    if (sh->gop_lengths && sh->gop_count)
+    {
+        av_bprintf(bp, ",\"gop\":{\"count\":%" PRId64 ",\"min\":%" PRId64 ",\"max\":%" PRId64 ",\"avg\":%.1f,\"lengths\":{",
+                   sh->gop_count, sh->gop_min, sh->gop_max, (double)sh->gop_total / sh->gop_count);
+        int first = 1;
+        for (int i = 0; i < HEALTH_MAX_GOP; i++)
+        {
+            if (sh->gop_lengths[i])
+            {
+                av_bprintf(bp, "%s\"%s%d\":%" PRId64, first ? "" : ",", i == HEALTH_MAX_GOP - 1 ? ">=" : "", i + 1, sh->gop_lengths[i]);
+                first = 0;
+            }
+        }
+        av_bprintf(bp, "}}");
+    }
+    av_bprintf(bp, "}");
+}
+
+//封装头里每一路都有类型和 time_base 时不用再分析
+static int need_stream_info(const AVFormatContext *fmt_ctx)
+{
+    for (unsigned i = 0; i < fmt_ctx->nb_streams; i++)
+    {
+        const AVStream *st = fmt_ctx->streams[i];
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_UNKNOWN || st->codecpar->codec_id == AV_CODEC_ID_NONE ||
+            st->time_base.num <= 0 || st->time_base.den <= 0)
+        {
+            return 1;
+        }
+    }
+    return fmt_ctx->nb_streams == 0;
+}
+
+static void health_job(void *arg)
+{
+    BatchJob *job = (BatchJob *)arg;
+    HealthRun *run = (HealthRun *)job->opaque;
+    const HealthOptions *opt = run->options;
+    AVFormatContext *fmt_ctx = NULL;
+    StreamHealth *health = NULL;
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    int64_t start = av_gettime_relative();
+    int64_t packets = 0;
+    int64_t bytes = 0;
+    int nb_streams = 0;
+    //音视频交织偏差：各取第一路，按读到的顺序比较最近的 dts
+    int video = -1;
+    int audio = -1;
+    double last_video = NAN;
+    double last_audio = NAN;
+    double skew_max = 0;
+    double skew_sum = 0;
+    int64_t skew_samples = 0;
+    int read_error = 0;
+    char err[AV_ERROR_MAX_STRING_SIZE] = {0};
+
+    int ret = avformat_open_input(&fmt_ctx, job->path, NULL, NULL);
+    if (ret >= 0 && need_stream_info(fmt_ctx))
+    {
+        ret = probe_cache_find_stream_info(&run->cache, job->path, fmt_ctx);
+    }
+    if (ret >= 0)
+    {
+        nb_streams = fmt_ctx->nb_streams;
+        health = (StreamHealth *)av_mallocz_array(nb_streams + 1, sizeof(StreamHealth));
+        if (!health)
+        {
+            ret = AVERROR(ENOMEM);
+        }
+    }
+    for (int i = 0; ret >= 0 && i < nb_streams; i++)
+    {
+        AVStream *st = fmt_ctx->streams[i];
+        StreamHealth *sh = &health[i];
+        sh->time_base = av_q2d(st->time_base);
+        sh->prev_dts = AV_NOPTS_VALUE;
+        sh->interval = opt->interval;
+        sh->continuous = st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO || st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO;
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && !(st->disposition & AV_DISPOSITION_ATTACHED_PIC))
+        {
+            sh->gop_lengths = (int64_t *)av_mallocz_array(HEALTH_MAX_GOP, sizeof(int64_t));
+            video = video < 0 ? i : video;
+        }
+        else if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+        {
+            audio = audio < 0 ? i : audio;
+        }
+    }
+
+    while (ret >= 0)
+    {
+        int read_ret = av_read_frame(fmt_ctx, &pkt);
+        if (read_ret < 0)
+        {
+            if (read_ret != AVERROR_EOF)
+            {
+                read_error = 1;
+                av_strerror(read_ret, err, sizeof(err));
+            }
+            break;
+        }
+        //读头之后才出现的流不统计
+        if (pkt.stream_index < nb_streams)
+        {
+            StreamHealth *sh = &health[pkt.stream_index];
+            add_packet(sh, &pkt, opt);
+            if (pkt.dts != AV_NOPTS_VALUE && (pkt.stream_index == video || pkt.stream_index == audio))
+            {
+                double t = pkt.dts * sh->time_base;
+                if (pkt.stream_index == video)
+                {
+                    last_video = t;
+                }
+                else
+                {
+                    last_audio = t;
+                }
+                if (!isnan(last_video) && !isnan(last_audio))
+                {
+                    double skew = fabs(last_video - last_audio);
+                    skew_max = FFMAX(skew_max, skew);
+                    skew_sum += skew;
+                    skew_samples++;
+                }
+            }
+        }
+        packets++;
+        bytes += pkt.size;
+        av_packet_unref(&pkt);
+    }
+    double seconds = (av_gettime_relative() - start) / 1000000.0;
+
+    AVBPrint bp;
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "{\"path\":");
+    json_string(&bp, job->path);
+    av_bprintf(&bp, ",\"ok\":%s", ret >= 0 && !read_error ? "true" : "false");
+    if (ret < 0)
+    {
+        av_strerror(ret, err, sizeof(err));
+    }
+    if (err[0])
+    {
+        av_bprintf(&bp, ",\"error\":");
+        json_string(&bp, err);
+    }
+    int issues = 0;
+    if (ret >= 0)
+    {
+        int64_t size = fmt_ctx->pb ? avio_size(fmt_ctx->pb) : -1;
+        av_bprintf(&bp, ",\"format\":");
+        json_string(&bp, fmt_ctx->iformat->name);
+        av_bprintf(&bp, ",\"size\":%" PRId64 ",\"packets\":%" PRId64 ",\"ms\":%.1f,\"mb_per_s\":%.1f",
+                   size, packets, seconds * 1000, seconds > 0 ? (size > 0 ? size : bytes) / seconds / 1048576 : 0);
+        if (skew_samples)
+        {
+            av_bprintf(&bp, ",\"av_skew\":{\"max\":%.3f,\"avg\":%.3f}", skew_max, skew_sum / skew_samples);
+        }
+        //方便 jq 直接筛选有问题的文件
+        av_bprintf(&bp, ",\"issues\":[");
+        const char *sep = "";
+        for (int i = 0; i < nb_streams; i++)
+        {
+            const StreamHealth *sh = &health[i];
+            if (!stream_has_issues(sh, opt))
+            {
+                continue;
+            }
+            av_bprintf(&bp, "%s\"stream %d:%s%s%s%s\"", sep, i,
+                       negative_dts_issue(sh, opt) ? " negative_dts" : "",
+                       sh->dts_non_monotonic ? " non_monotonic_dts" : "",
+                       sh->pts_before_dts ? " pts_before_dts" : "",
+                       sh->jumps ? " timestamp_jump" : "");
+            sep = ",";
+            issues++;
+        }
+        if (skew_max > opt->skew)
+        {
+            av_bprintf(&bp, "%s\"av_skew\"", sep);
+            sep = ",";
+            issues++;
+        }
+        if (read_error)
+        {
+            av_bprintf(&bp, "%s\"read_error\"", sep);
+            issues++;
+        }
+        av_bprintf(&bp, "],\"streams\":[");
+        for (int i = 0; i < nb_streams; i++)
+        {
+            if (i > 0)
+            {
+                av_bprint_chars(&bp, ',', 1);
+            }
+            end_gop(&health[i]);
+            json_stream_health(&bp, fmt_ctx->streams[i], &health[i]);
+        }
+        av_bprintf(&bp, "]");
+    }
+    av_bprintf(&bp, "}\n");
+
+    pthread_mutex_lock(&run->out_mutex);
+    if (av_bprint_is_complete(&bp))
+    {
+        fwrite(bp.str, 1, bp.len, run->out);
+    }
+    run->files++;
+    run->failed += ret < 0 || read_error;
+    run->unhealthy += issues > 0;
+    run->bytes += bytes;
+    pthread_mutex_unlock(&run->out_mutex);
+
+    av_bprint_finalize(&bp, NULL);
+    for (int i = 0; health && i < nb_streams; i++)
+    {
+        av_freep(&health[i].gop_lengths);
+    }
+    av_free(health);
+    avformat_close_input(&fmt_ctx);
+    batch_job_free(job);
+}
+
+int main(int argc, char *argv[])
+{
+    HealthOptions options = {1.0, 1.0, 1.0};
+    int threads = 0;
+    const char *output = NULL;
+    const char *cache_path = NULL;
+    int nb_inputs = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-interval") && i + 1 < argc)
+        {
+            options.interval = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-gap") && i + 1 < argc)
+        {
+            options.gap = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-skew") && i + 1 < argc)
+        {
+            options.skew = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-cache") && i + 1 < argc)
+        {
+            cache_path = argv[++i];
+        }
+        else
+        {
+            i += !strcmp(argv[i], "-list") && i + 1 < argc;
+            nb_inputs++;
+        }
+    }
+    if (!nb_inputs || !(options.interval > 0))
+    {
+        av_log(NULL, AV_LOG_ERROR, "usage: %s [-j threads] [-o out.jsonl] [-interval s] [-gap s] [-skew s] [-list paths.txt] [-cache file|default|off] path|dir ...\n", argv[0]);
+        return 1;
+    }
+    //每个文件一个线程，libavformat 内部的日志只留错误
+    av_log_set_level(AV_LOG_ERROR);
+
+    HealthRun run;
+    memset(&run, 0, sizeof(run));
+    run.options = &options;
+    run.out = output ? fopen(output, "w") : stdout;
+    if (!run.out)
+    {
+        av_log(NULL, AV_LOG_ERROR, "can't open %s.\n", output);
+        return 1;
+    }
+    pthread_mutex_init(&run.out_mutex, NULL);
+    //打不开缓存也照常分析
+    probe_cache_open(&run.cache, cache_path);
+    int ret = thread_pool_init(&run.pool, threads);
+    if (ret < 0)
+    {
+        goto end;
+    }
+    BatchFiles batch = { &run.pool, health_job, &run };
+    int64_t start = av_gettime_relative();
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "-o") || !strcmp(argv[i], "-interval") ||
+            !strcmp(argv[i], "-gap") || !strcmp(argv[i], "-skew") || !strcmp(argv[i], "-cache"))
+        {
+            i++;
+        }
+        else if (!strcmp(argv[i], "-list") && i + 1 < argc)
+        {
+            batch_submit_list(&batch, argv[++i]);
+        }
+        else
+        {
+            batch_submit_path(&batch, argv[i]);
+        }
+    }
+    thread_pool_wait(&run.pool);
+    thread_pool_destroy(&run.pool);
+    double seconds = (av_gettime_relative() - start) / 1000000.0;
+    fprintf(stderr, "stream_health: %d files, %d failed, %d with issues, %.1fs, %.0f MB/s, %d threads.\n",
+            run.files, run.failed, run.unhealthy, seconds, seconds > 0 ? run.bytes / seconds / 1048576 : 0,
+            threads > 0 ? threads : av_cpu_count());
+    ret = run.failed ? 1 : run.unhealthy ? 2 : 0;
+
+end:
+    probe_cache_close(&run.cache);
+    if (run.out != stdout)
+    {
+        fclose(run.out);
+    }
+    pthread_mutex_destroy(&run.out_mutex);
+    return ret;
+}
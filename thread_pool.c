@@ -0,0 +1,140 @@
+#include <libavutil/log.h>
+#include <libavutil/cpu.h>
+#include <libavutil/mem.h>
+#include <libavutil/error.h>
+#include <string.h>
+#include "thread_pool.h"
+
+//当前线程所属的池，任务里提交时不等空位
+static _Thread_local ThreadPool *worker_pool;
+
+static void *worker_thread(void *arg)
+{
+    ThreadPool *pool = (ThreadPool *)arg;
+    worker_pool = pool;
+    pthread_mutex_lock(&pool->mutex);
+    while (1)
+    {
+        while (!pool->first_job && !pool->quit)
+        {
+            pthread_cond_wait(&pool->job_cond, &pool->mutex);
+        }
+        ThreadPoolJob *job = pool->first_job;
+        if (!job)
+        {
+            //quit 并且队列空了
+            break;
+        }
+        pool->first_job = job->next;
+        if (!pool->first_job)
+        {
+            pool->last_job = NULL;
+        }
+        pool->queued--;
+        pthread_cond_signal(&pool->space_cond);
+        pthread_mutex_unlock(&pool->mutex);
+
+        job->func(job->arg);
+        av_free(job);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->pending == 0)
+        {
+            pthread_cond_broadcast(&pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+int thread_pool_init(ThreadPool *pool, int nb_threads)
+{
+    memset(pool, 0, sizeof(ThreadPool));
+    if (nb_threads <= 0)
+    {
+        nb_threads = av_cpu_count();
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->job_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pthread_cond_init(&pool->space_cond, NULL);
+    pool->max_queued = nb_threads * THREAD_POOL_QUEUE_PER_THREAD;
+    pool->threads = av_mallocz_array(nb_threads, sizeof(pthread_t));
+    if (!pool->threads)
+    {
+        return AVERROR(ENOMEM);
+    }
+    for (int i = 0; i < nb_threads; i++)
+    {
+        int ret = pthread_create(&pool->threads[i], NULL, worker_thread, pool);
+        if (ret != 0)
+        {
+            av_log(NULL, AV_LOG_ERROR, "thread_pool pthread_create error = %d.\n", ret);
+            thread_pool_destroy(pool);
+            return AVERROR(ret);
+        }
+        pool->nb_threads++;
+    }
+    return 0;
+}
+
+int thread_pool_submit(ThreadPool *pool, ThreadPoolFunc func, void *arg)
+{
+    ThreadPoolJob *job = av_mallocz(sizeof(ThreadPoolJob));
+    if (!job)
+    {
+        return AVERROR(ENOMEM);
+    }
+    job->func = func;
+    job->arg = arg;
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->queued >= pool->max_queued && worker_pool != pool)
+    {
+        pthread_cond_wait(&pool->space_cond, &pool->mutex);
+    }
+    if (pool->last_job)
+    {
+        pool->last_job->next = job;
+    }
+    else
+    {
+        pool->first_job = job;
+    }
+    pool->last_job = job;
+    pool->pending++;
+    pool->queued++;
+    pthread_cond_signal(&pool->job_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+void thread_pool_wait(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->pending > 0)
+    {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void thread_pool_destroy(ThreadPool *pool)
+{
+    if (pool->threads)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        pool->quit = 1;
+        pthread_cond_broadcast(&pool->job_cond);
+        pthread_mutex_unlock(&pool->mutex);
+        for (int i = 0; i < pool->nb_threads; i++)
+        {
+            pthread_join(pool->threads[i], NULL);
+        }
+        av_freep(&pool->threads);
+    }
+    pool->nb_threads = 0;
+    pthread_cond_destroy(&pool->space_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->job_cond);
+    pthread_mutex_destroy(&pool->mutex);
+}
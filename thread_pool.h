@@ -0,0 +1,50 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+
+//固定线程数的任务池，批量处理文件时用：每个任务是一个函数 + 参数，按提交顺序取出执行
+//排队的任务数有上限，超过时 thread_pool_submit 阻塞，边遍历目录边提交时内存不会随文件数增长；
+//任务里再提交的不阻塞（所有线程都在等空位会死锁）
+#define THREAD_POOL_QUEUE_PER_THREAD 4
+
+typedef void (*ThreadPoolFunc)(void *arg);
+
+typedef struct ThreadPoolJob
+{
+    ThreadPoolFunc func;
+    void *arg;
+    struct ThreadPoolJob *next;
+} ThreadPoolJob;
+
+typedef struct ThreadPool
+{
+    pthread_t *threads;
+    int nb_threads;
+    pthread_mutex_t mutex;
+    //有新任务、或者要退出
+    pthread_cond_t job_cond;
+    //所有任务执行完
+    pthread_cond_t done_cond;
+    //排队的任务少于上限
+    pthread_cond_t space_cond;
+    ThreadPoolJob *first_job;
+    ThreadPoolJob *last_job;
+    //排队的 + 正在执行的任务数
+    int pending;
+    //只算排队的，max_queued = nb_threads * THREAD_POOL_QUEUE_PER_THREAD
+    int queued;
+    int max_queued;
+    int quit;
+} ThreadPool;
+
+//nb_threads <= 0 时按 CPU 核数，返回 0 成功
+int thread_pool_init(ThreadPool *pool, int nb_threads);
+//队列满时阻塞到有空位，在任务里调用时不阻塞
+int thread_pool_submit(ThreadPool *pool, ThreadPoolFunc func, void *arg);
+//阻塞到已经提交的任务全部执行完
+void thread_pool_wait(ThreadPool *pool);
+//等排队的任务执行完，再退出所有线程
+void thread_pool_destroy(ThreadPool *pool);
+
+#endif
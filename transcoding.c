@@ -8,6 +8,32 @@
 #include <string.h>
 #include <inttypes.h>
 #include "./video_debugging.h"
+#include "./probe_cache.h"
+#include "./metrics.h"
+
+// Live counters, all NULL (and no-ops) unless METRICS is set.
+typedef struct TranscodeMetrics {
+  Metric *packets_read;
+  Metric *decoded[2];
+  Metric *encoded[2];
+  Metric *packets_written;
+  Metric *bytes_written;
+} TranscodeMetrics;
+
+static TranscodeMetrics metrics;
+
+static void init_metrics(void) {
+  metrics_init(NULL);
+  metrics.packets_read = metrics_counter("media_packets_read_total", NULL, "Packets demuxed from the input.");
+  metrics.decoded[0] = metrics_counter("media_frames_total", "stage=\"decoded\",type=\"video\"", "Frames through each pipeline stage.");
+  metrics.decoded[1] = metrics_counter("media_frames_total", "stage=\"decoded\",type=\"audio\"", NULL);
+  metrics.encoded[0] = metrics_counter("media_frames_total", "stage=\"encoded\",type=\"video\"", NULL);
+  metrics.encoded[1] = metrics_counter("media_frames_total", "stage=\"encoded\",type=\"audio\"", NULL);
+  metrics.packets_written = metrics_counter("media_packets_written_total", NULL, "Packets handed to the muxer.");
+  metrics.bytes_written = metrics_counter("media_bytes_written_total", NULL, "Payload bytes handed to the muxer.");
+  metrics_rate("media_encode_fps", NULL, "Video frames encoded per second.", metrics.encoded[0], 1);
+  metrics_rate("media_output_bitrate_bps", NULL, "Output payload bitrate.", metrics.bytes_written, 8);
+}
 
 typedef struct StreamingParams {
   char copy_video;
@@ -53,7 +79,12 @@ int open_media(const char *in_filename, AVFormatContext **avfc) {
 
   if (avformat_open_input(avfc, in_filename, NULL, NULL) != 0) {logging("failed to open input file %s", in_filename); return -1;}
 
-  if (avformat_find_stream_info(*avfc, NULL) < 0) {logging("failed to get stream info"); return -1;}
+  // reuse the stream info of the last run when the file has not changed, only when $PROBE_CACHE is set
+  ProbeCache cache;
+  probe_cache_open(&cache, NULL);
+  int ret = probe_cache_find_stream_info(&cache, in_filename, *avfc);
+  probe_cache_close(&cache);
+  if (ret < 0) {logging("failed to get stream info"); return -1;}
   return 0;
 }
 
@@ -146,7 +177,13 @@ int prepare_copy(AVFormatContext *avfc, AVStream **avs, AVCodecParameters *decod
 
 int remux(AVPacket **pkt, AVFormatContext **avfc, AVRational decoder_tb, AVRational encoder_tb) {
   av_packet_rescale_ts(*pkt, decoder_tb, encoder_tb);
-  if (av_interleaved_write_frame(*avfc, *pkt) < 0) { logging("error while copying stream packet"); return -1; }
+  int stream_index = (*pkt)->stream_index;
+  metrics_add(metrics.packets_written, 1);
+  metrics_add(metrics.bytes_written, (*pkt)->size);
+  TRACE_BEGIN(write_start);
+  int response = av_interleaved_write_frame(*avfc, *pkt);
+  TRACE_END(write_start, "av_interleaved_write_frame", stream_index, -1);
+  if (response < 0) { logging("error while copying stream packet"); return -1; }
   return 0;
 }
 
@@ -156,10 +193,15 @@ int encode_video(StreamingContext *decoder, StreamingContext *encoder, AVFrame *
   AVPacket *output_packet = av_packet_alloc();
   if (!output_packet) {logging("could not allocate memory for output packet"); return -1;}
 
+  int64_t frame_number = encoder->video_avcc->frame_number;
+  TRACE_BEGIN(send_start);
   int response = avcodec_send_frame(encoder->video_avcc, input_frame);
+  TRACE_END(send_start, "avcodec_send_frame", decoder->video_index, frame_number);
 
   while (response >= 0) {
+    TRACE_BEGIN(receive_start);
     response = avcodec_receive_packet(encoder->video_avcc, output_packet);
+    TRACE_END(receive_start, "avcodec_receive_packet", decoder->video_index, frame_number);
     if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
       break;
     } else if (response < 0) {
@@ -171,7 +213,12 @@ int encode_video(StreamingContext *decoder, StreamingContext *encoder, AVFrame *
     output_packet->duration = encoder->video_avs->time_base.den / encoder->video_avs->time_base.num / decoder->video_avs->avg_frame_rate.num * decoder->video_avs->avg_frame_rate.den;
 
     av_packet_rescale_ts(output_packet, decoder->video_avs->time_base, encoder->video_avs->time_base);
+    metrics_add(metrics.encoded[0], 1);
+    metrics_add(metrics.packets_written, 1);
+    metrics_add(metrics.bytes_written, output_packet->size);
+    TRACE_BEGIN(write_start);
     response = av_interleaved_write_frame(encoder->avfc, output_packet);
+    TRACE_END(write_start, "av_interleaved_write_frame", decoder->video_index, frame_number);
     if (response != 0) { logging("Error %d while receiving packet from decoder: %s", response, av_err2str(response)); return -1;}
   }
   av_packet_unref(output_packet);
@@ -183,10 +230,15 @@ int encode_audio(StreamingContext *decoder, StreamingContext *encoder, AVFrame *
   AVPacket *output_packet = av_packet_alloc();
   if (!output_packet) {logging("could not allocate memory for output packet"); return -1;}
 
+  int64_t frame_number = encoder->audio_avcc->frame_number;
+  TRACE_BEGIN(send_start);
   int response = avcodec_send_frame(encoder->audio_avcc, input_frame);
+  TRACE_END(send_start, "avcodec_send_frame", decoder->audio_index, frame_number);
 
   while (response >= 0) {
+    TRACE_BEGIN(receive_start);
     response = avcodec_receive_packet(encoder->audio_avcc, output_packet);
+    TRACE_END(receive_start, "avcodec_receive_packet", decoder->audio_index, frame_number);
     if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
       break;
     } else if (response < 0) {
@@ -197,7 +249,12 @@ int encode_audio(StreamingContext *decoder, StreamingContext *encoder, AVFrame *
     output_packet->stream_index = decoder->audio_index;
 
     av_packet_rescale_ts(output_packet, decoder->audio_avs->time_base, encoder->audio_avs->time_base);
+    metrics_add(metrics.encoded[1], 1);
+    metrics_add(metrics.packets_written, 1);
+    metrics_add(metrics.bytes_written, output_packet->size);
+    TRACE_BEGIN(write_start);
     response = av_interleaved_write_frame(encoder->avfc, output_packet);
+    TRACE_END(write_start, "av_interleaved_write_frame", decoder->audio_index, frame_number);
     if (response != 0) { logging("Error %d while receiving packet from decoder: %s", response, av_err2str(response)); return -1;}
   }
   av_packet_unref(output_packet);
@@ -206,17 +263,22 @@ int encode_audio(StreamingContext *decoder, StreamingContext *encoder, AVFrame *
 }
 
 int transcode_audio(StreamingContext *decoder, StreamingContext *encoder, AVPacket *input_packet, AVFrame *input_frame) {
+  TRACE_BEGIN(send_start);
   int response = avcodec_send_packet(decoder->audio_avcc, input_packet);
+  TRACE_END(send_start, "avcodec_send_packet", input_packet->stream_index, decoder->audio_avcc->frame_number);
   if (response < 0) {logging("Error while sending packet to decoder: %s", av_err2str(response)); return response;}
 
   while (response >= 0) {
+    TRACE_BEGIN(receive_start);
     response = avcodec_receive_frame(decoder->audio_avcc, input_frame);
+    TRACE_END(receive_start, "avcodec_receive_frame", input_packet->stream_index, decoder->audio_avcc->frame_number);
     if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
       break;
     } else if (response < 0) {
       logging("Error while receiving frame from decoder: %s", av_err2str(response));
       return response;
     }
+    metrics_add(metrics.decoded[1], 1);
 
     if (response >= 0) {
       if (encode_audio(decoder, encoder, input_frame)) return -1;
@@ -227,17 +289,22 @@ int transcode_audio(StreamingContext *decoder, StreamingContext *encoder, AVPack
 }
 
 int transcode_video(StreamingContext *decoder, StreamingContext *encoder, AVPacket *input_packet, AVFrame *input_frame) {
+  TRACE_BEGIN(send_start);
   int response = avcodec_send_packet(decoder->video_avcc, input_packet);
+  TRACE_END(send_start, "avcodec_send_packet", input_packet->stream_index, decoder->video_avcc->frame_number);
   if (response < 0) {logging("Error while sending packet to decoder: %s", av_err2str(response)); return response;}
 
   while (response >= 0) {
+    TRACE_BEGIN(receive_start);
     response = avcodec_receive_frame(decoder->video_avcc, input_frame);
+    TRACE_END(receive_start, "avcodec_receive_frame", input_packet->stream_index, decoder->video_avcc->frame_number);
     if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
       break;
     } else if (response < 0) {
       logging("Error while receiving frame from decoder: %s", av_err2str(response));
       return response;
     }
+    metrics_add(metrics.decoded[0], 1);
 
     if (response >= 0) {
       if (encode_video(decoder, encoder, input_frame)) return -1;
@@ -314,6 +381,11 @@ int main(int argc, char *argv[])
   //sp.audio_codec = "libvorbis";
   //sp.output_extension = ".webm";
 
+  // async logger, TRACE_FILE tracing and METRICS export, all flushed by atexit on the early returns below
+  logging_init(NULL);
+  trace_init(NULL);
+  init_metrics();
+
   StreamingContext *decoder = (StreamingContext*) calloc(1, sizeof(StreamingContext));
   decoder->filename = argv[1];
 //   decoder->filename = "/Users/xuhang/Downloads/deviceVideo/MyVpVideo/3bb02win_general_record_20200910145648-00-00.MP4";
@@ -368,8 +440,15 @@ int main(int argc, char *argv[])
   AVPacket *input_packet = av_packet_alloc();
   if (!input_packet) {logging("failed to allocated memory for AVPacket"); return -1;}
 
-  while (av_read_frame(decoder->avfc, input_packet) >= 0)
+  int64_t packet_number = 0;
+  for (;;)
   {
+    TRACE_BEGIN(read_start);
+    int read_ret = av_read_frame(decoder->avfc, input_packet);
+    TRACE_END(read_start, "av_read_frame", read_ret >= 0 ? input_packet->stream_index : -1, packet_number++);
+    if (read_ret < 0) break;
+    metrics_add(metrics.packets_read, 1);
+    log_packet(decoder->avfc, input_packet);
     if (decoder->avfc->streams[input_packet->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
       if (!sp.copy_video) {
         // TODO: refactor to be generic for audio and video (receiving a function pointer to the differences)
@@ -386,7 +465,7 @@ int main(int argc, char *argv[])
         if (remux(&input_packet, &encoder->avfc, decoder->audio_avs->time_base, encoder->audio_avs->time_base)) return -1;
       }
     } else {
-      logging("ignoring all non video or audio packets");
+      log_debug("ignoring all non video or audio packets");
     }
   }
   // TODO: should I also flush the audio encoder?
@@ -419,6 +498,9 @@ int main(int argc, char *argv[])
 
   free(decoder); decoder = NULL;
   free(encoder); encoder = NULL;
+  metrics_shutdown();
+  trace_shutdown();
+  logging_shutdown();
   return 0;
 }
 
@@ -7,27 +7,304 @@
 #include <libavutil/opt.h>
 #include <string.h>
 #include <inttypes.h>
+#include <libavutil/time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "video_debugging.h"
 
-void logging(const char *fmt, ...)
+// Async logging: every thread that logs gets its own single-producer ring, so
+// the hot path is a format into a slot plus one release store, no locks and no
+// syscalls. A background thread merges the rings by timestamp and writes whole
+// lines in large blocks. A full ring drops the message and counts it.
+#define LOGGING_RING_SLOTS 4096
+#define LOGGING_LINE_MAX 240
+#define LOGGING_OUT_SIZE (64 * 1024)
+#define LOGGING_IDLE_US 2000
+
+enum { LOGGING_RECORD_TEXT, LOGGING_RECORD_PACKET };
+
+typedef struct LoggingRecord {
+  int level;
+  int kind;
+  int64_t time_us;
+  union {
+    char text[LOGGING_LINE_MAX];
+    struct {
+      int64_t pts, dts, duration;
+      AVRational time_base;
+      int stream_index;
+    } packet;
+  };
+} LoggingRecord;
+
+typedef struct LoggingRing {
+  // head is written by the owning thread, tail by the writer thread
+  _Atomic uint64_t head;
+  _Atomic uint64_t tail;
+  _Atomic uint64_t dropped;
+  _Atomic uint64_t suppressed;
+  int thread_id;
+  // rate limit window, only touched by the owning thread
+  int64_t window_start;
+  int window_count;
+  struct LoggingRing *next;
+  LoggingRecord records[LOGGING_RING_SLOTS];
+} LoggingRing;
+
+typedef struct Logger {
+  _Atomic int running;
+  _Atomic unsigned generation;
+  _Atomic int rate;
+  _Atomic int next_thread_id;
+  _Atomic(LoggingRing *) rings;
+  pthread_t writer;
+  FILE *out;
+  int64_t start_us;
+  char buf[LOGGING_OUT_SIZE];
+  size_t len;
+} Logger;
+
+int logging_level = LOGGING_INFO;
+static Logger logger;
+static _Thread_local LoggingRing *thread_ring;
+// rings are freed by logging_shutdown, so a ring from an earlier run is never dereferenced
+static _Thread_local unsigned thread_ring_generation;
+
+static const char *level_name(int level)
+{
+  static const char *names[] = { "error", "warning", "info", "debug", "trace" };
+  return level >= 0 && level <= LOGGING_TRACE ? names[level] : "?";
+}
+
+static int parse_level(const char *s)
+{
+  for (int i = 0; i <= LOGGING_TRACE; i++)
+    if (!strcmp(s, level_name(i))) return i;
+  return atoi(s);
+}
+
+static void out_flush(void)
+{
+  if (logger.len) fwrite(logger.buf, 1, logger.len, logger.out);
+  logger.len = 0;
+  fflush(logger.out);
+}
+
+static void out_printf(const char *fmt, ...)
+{
+  va_list args;
+  if (logger.len > LOGGING_OUT_SIZE - 512) out_flush();
+  va_start(args, fmt);
+  int n = vsnprintf(logger.buf + logger.len, LOGGING_OUT_SIZE - logger.len, fmt, args);
+  va_end(args);
+  if (n > 0) logger.len += (size_t)n < LOGGING_OUT_SIZE - logger.len ? (size_t)n : LOGGING_OUT_SIZE - logger.len - 1;
+}
+
+static void format_record(const LoggingRecord *rec, int thread_id)
+{
+  double t = (rec->time_us - logger.start_us) / 1000000.0;
+  if (rec->kind == LOGGING_RECORD_PACKET) {
+    AVRational tb = rec->packet.time_base;
+    out_printf("LOG: [%.6f] [t%d] [%s] pts:%s pts_time:%s dts:%s dts_time:%s duration:%s duration_time:%s stream_index:%d\n",
+        t, thread_id, level_name(rec->level),
+        av_ts2str(rec->packet.pts), av_ts2timestr(rec->packet.pts, &tb),
+        av_ts2str(rec->packet.dts), av_ts2timestr(rec->packet.dts, &tb),
+        av_ts2str(rec->packet.duration), av_ts2timestr(rec->packet.duration, &tb),
+        rec->packet.stream_index);
+  } else {
+    out_printf("LOG: [%.6f] [t%d] [%s] %s\n", t, thread_id, level_name(rec->level), rec->text);
+  }
+}
+
+// Writes everything queued so far, oldest first across threads.
+static int drain(void)
+{
+  int written = 0;
+  LoggingRing *rings = atomic_load_explicit(&logger.rings, memory_order_acquire);
+  for (;;) {
+    LoggingRing *best = NULL;
+    const LoggingRecord *best_rec = NULL;
+    for (LoggingRing *r = rings; r; r = r->next) {
+      uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+      if (tail == atomic_load_explicit(&r->head, memory_order_acquire)) continue;
+      const LoggingRecord *rec = &r->records[tail & (LOGGING_RING_SLOTS - 1)];
+      if (!best || rec->time_us < best_rec->time_us) {best = r; best_rec = rec;}
+    }
+    if (!best) break;
+    format_record(best_rec, best->thread_id);
+    uint64_t tail = atomic_load_explicit(&best->tail, memory_order_relaxed);
+    atomic_store_explicit(&best->tail, tail + 1, memory_order_release);
+    written++;
+  }
+  for (LoggingRing *r = rings; r; r = r->next) {
+    uint64_t dropped = atomic_exchange_explicit(&r->dropped, 0, memory_order_relaxed);
+    uint64_t suppressed = atomic_exchange_explicit(&r->suppressed, 0, memory_order_relaxed);
+    if (dropped) out_printf("LOG: [t%d] [warning] %" PRIu64 " messages dropped, queue full\n", r->thread_id, dropped);
+    if (suppressed) out_printf("LOG: [t%d] [warning] %" PRIu64 " messages suppressed by rate limit\n", r->thread_id, suppressed);
+  }
+  if (logger.len) out_flush();
+  return written;
+}
+
+static void *writer_main(void *arg)
+{
+  (void)arg;
+  while (atomic_load_explicit(&logger.running, memory_order_acquire))
+    if (!drain()) av_usleep(LOGGING_IDLE_US);
+  drain();
+  return NULL;
+}
+
+static LoggingRing *get_thread_ring(void)
+{
+  unsigned generation = atomic_load_explicit(&logger.generation, memory_order_acquire);
+  if (thread_ring && thread_ring_generation == generation) return thread_ring;
+  LoggingRing *ring = calloc(1, sizeof(LoggingRing));
+  if (!ring) return NULL;
+  ring->thread_id = atomic_fetch_add(&logger.next_thread_id, 1);
+  ring->next = atomic_load_explicit(&logger.rings, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&logger.rings, &ring->next, ring, memory_order_release, memory_order_relaxed));
+  thread_ring = ring;
+  thread_ring_generation = generation;
+  return ring;
+}
+
+// Returns the slot to fill, or NULL when the message is dropped or rate limited.
+static LoggingRecord *reserve(LoggingRing *ring, int level, int64_t now)
+{
+  int rate = atomic_load_explicit(&logger.rate, memory_order_relaxed);
+  if (rate > 0 && level > LOGGING_WARNING) {
+    if (now - ring->window_start >= 1000000) {ring->window_start = now; ring->window_count = 0;}
+    if (ring->window_count >= rate) {
+      atomic_fetch_add_explicit(&ring->suppressed, 1, memory_order_relaxed);
+      return NULL;
+    }
+    ring->window_count++;
+  }
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= LOGGING_RING_SLOTS) {
+    atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+    return NULL;
+  }
+  LoggingRecord *rec = &ring->records[head & (LOGGING_RING_SLOTS - 1)];
+  rec->level = level;
+  rec->time_us = now;
+  return rec;
+}
+
+static void commit(LoggingRing *ring)
+{
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static void logging_write(int level, const char *fmt, va_list args)
+{
+  LoggingRing *ring = atomic_load_explicit(&logger.running, memory_order_acquire) ? get_thread_ring() : NULL;
+  if (!ring) {
+    // one fwrite per line, so lines from different threads don't interleave
+    char line[LOGGING_LINE_MAX + 32];
+    int n = snprintf(line, sizeof(line), "LOG: [%s] ", level_name(level));
+    n += vsnprintf(line + n, sizeof(line) - n - 1, fmt, args);
+    if (n > (int)sizeof(line) - 2) n = sizeof(line) - 2;
+    line[n++] = '\n';
+    fwrite(line, 1, n, stderr);
+    return;
+  }
+  LoggingRecord *rec = reserve(ring, level, av_gettime_relative());
+  if (!rec) return;
+  rec->kind = LOGGING_RECORD_TEXT;
+  vsnprintf(rec->text, sizeof(rec->text), fmt, args);
+  commit(ring);
+}
+
+void logging_at(int level, const char *fmt, ...)
 {
   va_list args;
-  fprintf( stderr, "LOG: " );
-  va_start( args, fmt );
-  vfprintf( stderr, fmt, args );
-  va_end( args );
-  fprintf( stderr, "\n" );
+  va_start(args, fmt);
+  logging_write(level, fmt, args);
+  va_end(args);
 }
 
-void log_packet(const AVFormatContext *fmt_ctx, const AVPacket *pkt)
+void logging(const char *fmt, ...)
 {
-    AVRational *time_base = &fmt_ctx->streams[pkt->stream_index]->time_base;
+  va_list args;
+  if (!logging_enabled(LOGGING_INFO)) return;
+  va_start(args, fmt);
+  logging_write(LOGGING_INFO, fmt, args);
+  va_end(args);
+}
 
-    logging("pts:%s pts_time:%s dts:%s dts_time:%s duration:%s duration_time:%s stream_index:%d",
+void logging_packet(int level, const AVFormatContext *fmt_ctx, const AVPacket *pkt)
+{
+  AVRational *time_base = &fmt_ctx->streams[pkt->stream_index]->time_base;
+  LoggingRing *ring = atomic_load_explicit(&logger.running, memory_order_acquire) ? get_thread_ring() : NULL;
+  if (!ring) {
+    logging_at(level, "pts:%s pts_time:%s dts:%s dts_time:%s duration:%s duration_time:%s stream_index:%d",
            av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, time_base),
            av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, time_base),
            av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, time_base),
            pkt->stream_index);
+    return;
+  }
+  // only the raw values are copied here, the writer formats them
+  LoggingRecord *rec = reserve(ring, level, av_gettime_relative());
+  if (!rec) return;
+  rec->kind = LOGGING_RECORD_PACKET;
+  rec->packet.pts = pkt->pts;
+  rec->packet.dts = pkt->dts;
+  rec->packet.duration = pkt->duration;
+  rec->packet.time_base = *time_base;
+  rec->packet.stream_index = pkt->stream_index;
+  commit(ring);
+}
+
+void logging_set_level(int level)
+{
+  logging_level = level;
+}
+
+void logging_set_rate(int per_second)
+{
+  atomic_store(&logger.rate, per_second);
+}
+
+int logging_init(const char *path)
+{
+  static int registered;
+  const char *env;
+  if (atomic_load(&logger.running)) return 0;
+  if ((env = getenv("LOGGING_LEVEL"))) logging_set_level(parse_level(env));
+  if ((env = getenv("LOGGING_RATE"))) logging_set_rate(atoi(env));
+  logger.out = path ? fopen(path, "w") : stderr;
+  if (!logger.out) {logger.out = stderr; return AVERROR(errno);}
+  logger.start_us = av_gettime_relative();
+  logger.len = 0;
+  atomic_fetch_add(&logger.generation, 1);
+  atomic_store(&logger.running, 1);
+  if (pthread_create(&logger.writer, NULL, writer_main, NULL)) {
+    atomic_store(&logger.running, 0);
+    if (logger.out != stderr) fclose(logger.out);
+    logger.out = stderr;
+    return AVERROR(EAGAIN);
+  }
+  if (!registered) {atexit(logging_shutdown); registered = 1;}
+  return 0;
+}
+
+void logging_shutdown(void)
+{
+  if (!atomic_exchange(&logger.running, 0)) return;
+  pthread_join(logger.writer, NULL);
+  LoggingRing *ring = atomic_exchange(&logger.rings, NULL);
+  while (ring) {
+    LoggingRing *next = ring->next;
+    free(ring);
+    ring = next;
+  }
+  if (logger.out != stderr) fclose(logger.out);
+  logger.out = stderr;
 }
 
 void print_timing(char *name, AVFormatContext *avf, AVCodecContext *avc, AVStream *avs) {
@@ -36,14 +313,14 @@ void print_timing(char *name, AVFormatContext *avf, AVCodecContext *avc, AVStrea
 
   logging("\tAVFormatContext");
   if (avf != NULL) {
-    logging("\t\tstart_time=%d duration=%d bit_rate=%d start_time_realtime=%d", avf->start_time, avf->duration, avf->bit_rate, avf->start_time_realtime);
+    logging("\t\tstart_time=%" PRId64 " duration=%" PRId64 " bit_rate=%" PRId64 " start_time_realtime=%" PRId64, avf->start_time, avf->duration, avf->bit_rate, avf->start_time_realtime);
   } else {
     logging("\t\t->NULL");
   }
 
   logging("\tAVCodecContext");
   if (avc != NULL) {
-    logging("\t\tbit_rate=%d ticks_per_frame=%d width=%d height=%d gop_size=%d keyint_min=%d sample_rate=%d profile=%d level=%d ",
+    logging("\t\tbit_rate=%" PRId64 " ticks_per_frame=%d width=%d height=%d gop_size=%d keyint_min=%d sample_rate=%d profile=%d level=%d ",
         avc->bit_rate, avc->ticks_per_frame, avc->width, avc->height, avc->gop_size, avc->keyint_min, avc->sample_rate, avc->profile, avc->level);
     logging("\t\tavc->time_base=num/den %d/%d", avc->time_base.num, avc->time_base.den);
     logging("\t\tavc->framerate=num/den %d/%d", avc->framerate.num, avc->framerate.den);
@@ -54,7 +331,7 @@ void print_timing(char *name, AVFormatContext *avf, AVCodecContext *avc, AVStrea
 
   logging("\tAVStream");
   if (avs != NULL) {
-    logging("\t\tindex=%d start_time=%d duration=%d ", avs->index, avs->start_time, avs->duration);
+    logging("\t\tindex=%d start_time=%" PRId64 " duration=%" PRId64 " ", avs->index, avs->start_time, avs->duration);
     logging("\t\tavs->time_base=num/den %d/%d", avs->time_base.num, avs->time_base.den);
     logging("\t\tavs->sample_aspect_ratio=num/den %d/%d", avs->sample_aspect_ratio.num, avs->sample_aspect_ratio.den);
     logging("\t\tavs->avg_frame_rate=num/den %d/%d", avs->avg_frame_rate.num, avs->avg_frame_rate.den);
@@ -65,3 +342,231 @@ void print_timing(char *name, AVFormatContext *avf, AVCodecContext *avc, AVStrea
 
   logging("=================================================");
 }
+
+// Tracing: spans go into per-thread chunk lists. Only the owning thread
+// appends; the count of a chunk is published with a release store so
+// trace_shutdown can read everything already recorded.
+#define TRACE_CHUNK_EVENTS 8192
+#define TRACE_MAX_EVENTS (4 * 1024 * 1024)
+
+typedef struct TraceEvent {
+  const char *name;
+  int64_t start;
+  int64_t dur;
+  int64_t frame;
+  int stream;
+} TraceEvent;
+
+typedef struct TraceChunk {
+  _Atomic int count;
+  struct TraceChunk *next;
+  TraceEvent events[TRACE_CHUNK_EVENTS];
+} TraceChunk;
+
+typedef struct TraceThread {
+  int tid;
+  char name[32];
+  // set by trace_thread_reserve: the chunks are preallocated, never malloc more
+  int reserved;
+  unsigned generation;
+  TraceChunk *first;
+  TraceChunk *last;
+  struct TraceThread *next;
+} TraceThread;
+
+typedef struct Tracer {
+  _Atomic unsigned generation;
+  _Atomic int next_tid;
+  _Atomic int64_t events;
+  _Atomic int64_t dropped;
+  _Atomic(TraceThread *) threads;
+  char *path;
+  int64_t start_us;
+} Tracer;
+
+int trace_enabled;
+// spans go to the file only while recording; the sink sees them either way
+static int trace_recording;
+static TraceSink trace_sink;
+static Tracer tracer;
+static _Thread_local TraceThread *trace_thread;
+static _Thread_local unsigned trace_thread_generation;
+// the thread adopted a reserved buffer and must not allocate one
+static _Thread_local int trace_thread_realtime;
+
+static TraceThread *get_trace_thread(void)
+{
+  unsigned generation = atomic_load_explicit(&tracer.generation, memory_order_acquire);
+  if (trace_thread && trace_thread_generation == generation) return trace_thread;
+  // the reserved buffer is from an earlier recording, don't allocate on this thread
+  if (trace_thread_realtime) return NULL;
+  TraceThread *thread = calloc(1, sizeof(TraceThread));
+  if (!thread) return NULL;
+  thread->tid = atomic_fetch_add(&tracer.next_tid, 1);
+  snprintf(thread->name, sizeof(thread->name), "thread %d", thread->tid);
+  thread->generation = generation;
+  thread->next = atomic_load_explicit(&tracer.threads, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&tracer.threads, &thread->next, thread, memory_order_release, memory_order_relaxed));
+  trace_thread = thread;
+  trace_thread_generation = generation;
+  return thread;
+}
+
+TraceThread *trace_thread_reserve(const char *name, int events)
+{
+  if (!trace_recording) return NULL;
+  TraceThread *thread = calloc(1, sizeof(TraceThread));
+  if (!thread) return NULL;
+  // chunks are linked up front, trace_span only moves last along the list
+  TraceChunk **tail = &thread->first;
+  for (int i = 0; i == 0 || i < (events + TRACE_CHUNK_EVENTS - 1) / TRACE_CHUNK_EVENTS; i++) {
+    TraceChunk *chunk = malloc(sizeof(TraceChunk));
+    if (!chunk) break;
+    atomic_init(&chunk->count, 0);
+    chunk->next = NULL;
+    *tail = chunk;
+    tail = &chunk->next;
+  }
+  if (!thread->first) {free(thread); return NULL;}
+  thread->last = thread->first;
+  thread->reserved = 1;
+  thread->tid = atomic_fetch_add(&tracer.next_tid, 1);
+  snprintf(thread->name, sizeof(thread->name), "%s", name);
+  thread->generation = atomic_load_explicit(&tracer.generation, memory_order_acquire);
+  thread->next = atomic_load_explicit(&tracer.threads, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&tracer.threads, &thread->next, thread, memory_order_release, memory_order_relaxed));
+  return thread;
+}
+
+void trace_thread_adopt(TraceThread *thread)
+{
+  // the buffer belongs to the recording it was reserved for, trace_shutdown frees it
+  if (!thread || !trace_recording || trace_thread == thread) return;
+  trace_thread = thread;
+  trace_thread_generation = thread->generation;
+  trace_thread_realtime = 1;
+}
+
+void trace_thread_name(const char *name)
+{
+  TraceThread *thread = trace_recording ? get_trace_thread() : NULL;
+  if (thread) snprintf(thread->name, sizeof(thread->name), "%s", name);
+}
+
+void trace_span(const char *name, int64_t start, int stream, int64_t frame)
+{
+  int64_t end = av_gettime_relative();
+  TraceSink sink = trace_sink;
+  if (sink) sink(name, stream, end - start);
+  TraceThread *thread = trace_recording ? get_trace_thread() : NULL;
+  if (!thread) return;
+  if (atomic_fetch_add_explicit(&tracer.events, 1, memory_order_relaxed) >= TRACE_MAX_EVENTS) {
+    atomic_fetch_add_explicit(&tracer.dropped, 1, memory_order_relaxed);
+    return;
+  }
+  TraceChunk *chunk = thread->last;
+  int count = chunk ? atomic_load_explicit(&chunk->count, memory_order_relaxed) : TRACE_CHUNK_EVENTS;
+  if (count == TRACE_CHUNK_EVENTS && thread->reserved) {
+    // reserved threads only move on to the next preallocated chunk
+    if (!chunk->next) {atomic_fetch_add_explicit(&tracer.dropped, 1, memory_order_relaxed); return;}
+    thread->last = chunk = chunk->next;
+    count = 0;
+  }
+  if (count == TRACE_CHUNK_EVENTS) {
+    TraceChunk *next = malloc(sizeof(TraceChunk));
+    if (!next) {atomic_fetch_add_explicit(&tracer.dropped, 1, memory_order_relaxed); return;}
+    atomic_init(&next->count, 0);
+    next->next = NULL;
+    if (chunk) chunk->next = next; else thread->first = next;
+    thread->last = chunk = next;
+    count = 0;
+  }
+  TraceEvent *event = &chunk->events[count];
+  event->name = name;
+  event->start = start;
+  event->dur = end - start;
+  event->frame = frame;
+  event->stream = stream;
+  atomic_store_explicit(&chunk->count, count + 1, memory_order_release);
+}
+
+int trace_init(const char *path)
+{
+  static int registered;
+  if (trace_recording) return 0;
+  if (!path) path = getenv("TRACE_FILE");
+  if (!path || !path[0]) return 0;
+  if (!(tracer.path = strdup(path))) return AVERROR(ENOMEM);
+  tracer.start_us = av_gettime_relative();
+  atomic_store(&tracer.events, 0);
+  atomic_store(&tracer.dropped, 0);
+  atomic_fetch_add(&tracer.generation, 1);
+  trace_recording = 1;
+  trace_enabled = 1;
+  if (!registered) {atexit(trace_shutdown); registered = 1;}
+  return 0;
+}
+
+void trace_set_sink(TraceSink sink)
+{
+  trace_sink = sink;
+  trace_enabled = trace_recording || sink;
+}
+
+static void write_json_string(FILE *fp, const char *s)
+{
+  fputc('"', fp);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') fprintf(fp, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20) fprintf(fp, "\\u%04x", *s);
+    else fputc(*s, fp);
+  }
+  fputc('"', fp);
+}
+
+void trace_shutdown(void)
+{
+  if (!trace_recording) return;
+  trace_recording = 0;
+  trace_enabled = trace_sink != NULL;
+  TraceThread *threads = atomic_exchange(&tracer.threads, NULL);
+  FILE *fp = fopen(tracer.path, "w");
+  if (!fp) log_error("could not open trace file %s", tracer.path);
+  int64_t written = 0;
+  int first = 1;
+  if (fp) fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (TraceThread *thread = threads; thread; thread = thread->next) {
+    // reserved for an audio thread that never ran (e.g. a track behind the mixer)
+    int unused = thread->reserved && !atomic_load_explicit(&thread->first->count, memory_order_acquire);
+    if (fp && !unused) {
+      fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", thread->tid);
+      write_json_string(fp, thread->name);
+      fprintf(fp, "}}");
+      first = 0;
+    }
+    for (TraceChunk *chunk = thread->first; chunk; ) {
+      int count = atomic_load_explicit(&chunk->count, memory_order_acquire);
+      for (int i = 0; fp && i < count; i++) {
+        const TraceEvent *e = &chunk->events[i];
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%" PRId64 ",\"dur\":%" PRId64 ",\"args\":{\"stream\":%d,\"frame\":%" PRId64 "}}",
+            e->name, thread->tid, e->start - tracer.start_us, e->dur, e->stream, e->frame);
+        written++;
+      }
+      TraceChunk *next = chunk->next;
+      free(chunk);
+      chunk = next;
+    }
+  }
+  while (threads) {
+    TraceThread *next = threads->next;
+    free(threads);
+    threads = next;
+  }
+  if (fp) {
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    log_info("trace %s: %" PRId64 " spans, %" PRId64 " dropped", tracer.path, written, atomic_load(&tracer.dropped));
+  }
+  free(tracer.path);
+  tracer.path = NULL;
+}
@@ -1,3 +1,6 @@
+#ifndef VIDEO_DEBUGGING_H
+#define VIDEO_DEBUGGING_H
+
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/timestamp.h>
@@ -5,9 +8,88 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <libavutil/opt.h>
+#include <libavutil/time.h>
 #include <string.h>
 #include <inttypes.h>
 
-void logging(const char *fmt, ...);
-void log_packet(const AVFormatContext *fmt_ctx, const AVPacket *pkt);
+// Log levels, lower is more important.
+#define LOGGING_ERROR   0
+#define LOGGING_WARNING 1
+#define LOGGING_INFO    2
+#define LOGGING_DEBUG   3
+#define LOGGING_TRACE   4
+
+// Calls above this level compile to nothing, arguments included.
+// Build with -DLOGGING_MAX_LEVEL=LOGGING_TRACE to keep everything.
+#ifndef LOGGING_MAX_LEVEL
+#ifdef NDEBUG
+#define LOGGING_MAX_LEVEL LOGGING_INFO
+#else
+#define LOGGING_MAX_LEVEL LOGGING_DEBUG
+#endif
+#endif
+
+// Runtime threshold, LOGGING_INFO unless LOGGING_LEVEL=error|warning|info|debug|trace is set.
+extern int logging_level;
+
+#define logging_enabled(level) ((level) <= LOGGING_MAX_LEVEL && (level) <= logging_level)
+
+#define log_error(...)   do { if (logging_enabled(LOGGING_ERROR)) logging_at(LOGGING_ERROR, __VA_ARGS__); } while (0)
+#define log_warning(...) do { if (logging_enabled(LOGGING_WARNING)) logging_at(LOGGING_WARNING, __VA_ARGS__); } while (0)
+#define log_info(...)    do { if (logging_enabled(LOGGING_INFO)) logging_at(LOGGING_INFO, __VA_ARGS__); } while (0)
+#define log_debug(...)   do { if (logging_enabled(LOGGING_DEBUG)) logging_at(LOGGING_DEBUG, __VA_ARGS__); } while (0)
+#define log_trace(...)   do { if (logging_enabled(LOGGING_TRACE)) logging_at(LOGGING_TRACE, __VA_ARGS__); } while (0)
+
+// Per-packet timestamps are a debug-level call; the raw values are queued and
+// formatted by the writer thread.
+#define log_packet(fmt_ctx, pkt) do { if (logging_enabled(LOGGING_DEBUG)) logging_packet(LOGGING_DEBUG, fmt_ctx, pkt); } while (0)
+
+// Starts the background writer. Until then (and after logging_shutdown) every
+// call writes its line synchronously with a single fwrite.
+// path NULL means stderr. LOGGING_LEVEL and LOGGING_RATE are read here.
+int logging_init(const char *path);
+// Drains every queue and stops the writer; also registered with atexit.
+// Call it after the threads that log have stopped.
+void logging_shutdown(void);
+void logging_set_level(int level);
+// Max info/debug/trace messages per thread per second, 0 means unlimited.
+// Errors and warnings are never limited.
+void logging_set_rate(int per_second);
+
+void logging_at(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void logging_packet(int level, const AVFormatContext *fmt_ctx, const AVPacket *pkt);
+// Info level, kept for existing callers.
+void logging(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
 void print_timing(char *name, AVFormatContext *avf, AVCodecContext *avc, AVStream *avs);
+
+// Pipeline tracing, exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Each thread appends complete spans to its own buffer without locks; the file is
+// written by trace_shutdown. Off unless trace_init gets a path or TRACE_FILE is set,
+// or a sink is installed; while off a span costs one branch.
+extern int trace_enabled;
+
+#define TRACE_BEGIN(start) int64_t start = trace_enabled ? av_gettime_relative() : 0
+// name must be a string literal, only the pointer is stored.
+// stream and frame end up in the span args, pass -1 when they don't apply.
+#define TRACE_END(start, name, stream, frame) do { if (start) trace_span(name, start, stream, frame); } while (0)
+
+// path NULL means TRACE_FILE; returns 0 when tracing is simply off.
+int trace_init(const char *path);
+// Writes the trace file; also registered with atexit.
+// Call it after the threads that trace have stopped.
+void trace_shutdown(void);
+// Label for the calling thread in the viewer.
+void trace_thread_name(const char *name);
+// Real-time threads (the SDL audio callback) must not allocate: reserve their
+// buffer from a normal thread after trace_init and adopt it in TRACE_END_RT.
+// Spans past the reserved events are dropped. NULL while not recording.
+struct TraceThread *trace_thread_reserve(const char *name, int events);
+void trace_thread_adopt(struct TraceThread *thread);
+#define TRACE_END_RT(thread, start, name, stream, frame) do { if (start) {trace_thread_adopt(thread); trace_span(name, start, stream, frame);} } while (0)
+void trace_span(const char *name, int64_t start, int stream, int64_t frame);
+// Called with every finished span, from the thread that ran it, whether or not
+// a trace file is being recorded. Install before the pipeline threads start.
+typedef void (*TraceSink)(const char *name, int stream, int64_t dur_us);
+void trace_set_sink(TraceSink sink);
+
+#endif